@@ -0,0 +1,117 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/*
+	Mixes the hash of a value into an existing hash (same approach as boost::hash_combine)
+	@param seed  The hash to mix into
+	@param value The value to hash
+*/
+template <typename T>
+inline void HashCombine(size_t& seed, const T& value) {
+	seed ^= std::hash<T>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+// The hit and miss counts for an AssetRegistry
+struct AssetRegistryStats {
+	size_t Hits = 0;    // Number of requests that were handed an existing asset
+	size_t Misses = 0;  // Number of requests that had to create the asset
+	size_t Expired = 0; // Number of misses where the asset had been loaded before, but was released
+	size_t Live = 0;    // Number of assets that are currently alive
+};
+
+/*
+	Keeps track of assets that have already been loaded, so that loading the same thing twice hands back
+	the same shared handle instead of another copy.
+
+	The registry only holds weak references, so it never keeps an asset alive by itself. Once everyone
+	that is using an asset lets go of it, it will be freed and the next request will load it again
+
+	@param TKey   The type that uniquely identifies an asset, must be hashable by THash and comparable with ==
+	@param TAsset The type of asset that we are storing
+	@param THash  The hasher to use for our keys
+*/
+template <typename TKey, typename TAsset, typename THash = std::hash<TKey>>
+class AssetRegistry
+{
+public:
+	typedef std::shared_ptr<TAsset> Sptr;
+	typedef std::function<Sptr()> Factory;
+	typedef AssetRegistryStats Stats;
+
+	/*
+		Gets the asset with the given key, invoking factory to create it if it is not loaded
+		@param key     The key that identifies the asset
+		@param factory The function to invoke to create the asset if needed, if it returns nullptr nothing is stored
+		@returns The asset for key, or nullptr if it could not be created
+	*/
+	Sptr GetOrCreate(const TKey& key, const Factory& factory) {
+		// Note that we hold the lock while creating the asset, so that two threads asking for the same
+		// asset never both end up loading it
+		std::lock_guard<std::mutex> lock(myLock);
+		auto it = myEntries.find(key);
+		if (it != myEntries.end()) {
+			Sptr result = it->second.lock();
+			if (result != nullptr) {
+				myStats.Hits++;
+				return result;
+			}
+			myStats.Expired++;
+		}
+		myStats.Misses++;
+		Sptr result = factory();
+		if (result != nullptr)
+			myEntries[key] = result;
+		else if (it != myEntries.end())
+			myEntries.erase(it);
+		return result;
+	}
+
+	/*
+		Gets the asset with the given key if it is loaded, without creating it
+		@param key The key that identifies the asset
+		@returns The asset, or nullptr if it is not loaded
+	*/
+	Sptr Find(const TKey& key) const {
+		std::lock_guard<std::mutex> lock(myLock);
+		auto it = myEntries.find(key);
+		return it != myEntries.end() ? it->second.lock() : nullptr;
+	}
+
+	/*
+		Removes the entries for any assets that have been released
+	*/
+	void Prune() {
+		std::lock_guard<std::mutex> lock(myLock);
+		for (auto it = myEntries.begin(); it != myEntries.end();) {
+			if (it->second.expired())
+				it = myEntries.erase(it);
+			else
+				it++;
+		}
+	}
+
+	/*
+		Gets the hit and miss counts for this registry, as well as how many assets are still alive
+	*/
+	Stats GetStats() const {
+		std::lock_guard<std::mutex> lock(myLock);
+		Stats result = myStats;
+		result.Live = 0;
+		for (auto& kvp : myEntries)
+			result.Live += kvp.second.expired() ? 0 : 1;
+		return result;
+	}
+
+	void ResetStats() {
+		std::lock_guard<std::mutex> lock(myLock);
+		myStats = Stats();
+	}
+
+private:
+	mutable std::mutex myLock;
+	std::unordered_map<TKey, std::weak_ptr<TAsset>, THash> myEntries;
+	Stats myStats;
+};
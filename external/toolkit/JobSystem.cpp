@@ -0,0 +1,261 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+namespace {
+	struct QueuedJob {
+		JobSystem::Job Func;
+		JobCounter*    Counter;
+	};
+	struct JobQueue {
+		std::mutex            Lock;
+		std::deque<QueuedJob> Jobs;
+	};
+
+	// Queue 0 is shared by every thread that isn't one of our workers (usually just the main thread), worker N uses queue N
+	std::vector<std::unique_ptr<JobQueue>> queues;
+	// Jobs without a counter go here instead. Nobody is waiting on them, so only the workers pick these up, that way
+	// a thread that's waiting on a counter never gets stuck running some long background job
+	JobQueue background;
+	std::vector<std::thread> workers;
+	// Guards starting up and shutting down, and is what our workers sleep on
+	std::mutex              stateLock;
+	std::condition_variable wakeSignal;
+	std::atomic<bool>       isRunning{ false };
+	// The number of jobs sitting in any of the queues, and the number of workers that are asleep
+	std::atomic<size_t>     queued{ 0 };
+	std::atomic<size_t>     sleeping{ 0 };
+
+	std::atomic<uint64_t> jobsRun{ 0 };
+	std::atomic<uint64_t> steals{ 0 };
+	std::atomic<uint64_t> sleeps{ 0 };
+
+	// The queue that belongs to the current thread
+	thread_local size_t threadIndex = 0;
+
+	// How many times an idle worker checks for new work before going to sleep
+	const int SpinCount = 64;
+
+	// Makes sure the workers get joined if nobody calls Shutdown, destroying a joinable thread aborts the program.
+	// This needs to be declared after the rest of the job system's state, so that it gets destroyed first
+	struct ShutdownGuard {
+		~ShutdownGuard() { JobSystem::Shutdown(); }
+	} shutdownGuard;
+}
+
+void JobSystem::Init(size_t numWorkers) {
+	std::lock_guard<std::mutex> lock(stateLock);
+	if (isRunning)
+		return;
+	if (numWorkers == 0) {
+		size_t hardware = std::thread::hardware_concurrency();
+		numWorkers = hardware > 1 ? hardware - 1 : 1;
+	}
+	queues.clear();
+	for (size_t ix = 0; ix <= numWorkers; ix++)
+		queues.push_back(std::make_unique<JobQueue>());
+	isRunning = true;
+	workers.reserve(numWorkers);
+	for (size_t ix = 1; ix <= numWorkers; ix++)
+		workers.emplace_back(&JobSystem::__Worker, ix);
+}
+
+void JobSystem::Shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(stateLock);
+		if (!isRunning)
+			return;
+		isRunning = false;
+	}
+	wakeSignal.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+size_t JobSystem::GetConcurrency() {
+	if (!isRunning)
+		Init();
+	return workers.size() + 1;
+}
+
+JobSystem::Stats JobSystem::GetStats() {
+	Stats result;
+	result.Jobs = jobsRun.load();
+	result.Steals = steals.load();
+	result.Sleeps = sleeps.load();
+	return result;
+}
+
+void JobSystem::__Push(const Job& job, JobCounter* counter) {
+	// Counted before it's pushed, so that a thief can never take our job before we've counted it
+	queued++;
+	JobQueue& queue = counter != nullptr ? *queues[threadIndex] : background;
+	{
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		queue.Jobs.push_back({ job, counter });
+	}
+	// Workers check queued after saying they're asleep, so if nobody is asleep here then nobody can miss this job
+	if (sleeping.load() > 0) {
+		std::lock_guard<std::mutex> lock(stateLock);
+		wakeSignal.notify_one();
+	}
+}
+
+void JobSystem::Run(const Job& job, JobCounter* counter) {
+	if (!isRunning)
+		Init();
+	if (counter != nullptr)
+		counter->myCount++;
+	__Push(job, counter);
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, const Job& job, JobCounter* counter) {
+	if (!isRunning)
+		Init();
+	if (counter != nullptr)
+		counter->myCount++;
+	{
+		std::lock_guard<std::mutex> lock(dependency.myLock);
+		if (dependency.myCount.load() > 0) {
+			dependency.myContinuations.emplace_back(job, counter);
+			return;
+		}
+	}
+	__Push(job, counter);
+}
+
+void JobSystem::__Finish(JobCounter* counter) {
+	if (counter == nullptr)
+		return;
+	std::vector<std::pair<Job, JobCounter*>> released;
+	{
+		std::lock_guard<std::mutex> lock(counter->myLock);
+		if (counter->myCount.fetch_sub(1) == 1)
+			released.swap(counter->myContinuations);
+	}
+	// The counter may be gone as soon as we unlock it, so from here on we only touch our copy
+	for (auto& continuation : released)
+		__Push(continuation.first, continuation.second);
+}
+
+bool JobSystem::__TryRunOne(size_t index, bool allowBackground) {
+	QueuedJob job;
+	bool found = false;
+
+	// Our own newest job first, it's the most likely to still be in the cache
+	{
+		JobQueue& queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		if (!queue.Jobs.empty()) {
+			job = std::move(queue.Jobs.back());
+			queue.Jobs.pop_back();
+			found = true;
+		}
+	}
+	// Otherwise we steal the oldest job from someone else, which tends to be the biggest chunk of work they have
+	for (size_t offset = 1; !found && offset < queues.size(); offset++) {
+		JobQueue& queue = *queues[(index + offset) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		if (!queue.Jobs.empty()) {
+			job = std::move(queue.Jobs.front());
+			queue.Jobs.pop_front();
+			found = true;
+			steals++;
+		}
+	}
+	// Background jobs only once there's no tracked work left anywhere
+	if (!found && allowBackground) {
+		std::lock_guard<std::mutex> lock(background.Lock);
+		if (!background.Jobs.empty()) {
+			job = std::move(background.Jobs.front());
+			background.Jobs.pop_front();
+			found = true;
+		}
+	}
+	if (!found)
+		return false;
+
+	queued--;
+	job.Func();
+	jobsRun++;
+	__Finish(job.Counter);
+	return true;
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+	while (!counter.IsDone()) {
+		if (!__TryRunOne(threadIndex, false))
+			std::this_thread::yield();
+	}
+	// The last job can still be releasing it's continuations for a moment after the count hits 0, this makes
+	// sure it's finished with the counter before we return (and the counter possibly gets destroyed)
+	std::lock_guard<std::mutex> lock(counter.myLock);
+}
+
+void JobSystem::ParallelFor(size_t count, const RangeFunc& func, size_t grain) {
+	if (count == 0)
+		return;
+
+	// Aim for a few chunks per thread so that uneven work still balances out
+	size_t concurrency = GetConcurrency();
+	grain = std::max<size_t>(grain, 1);
+	size_t chunkSize = std::max(grain, (count + concurrency * 4 - 1) / (concurrency * 4));
+	size_t numChunks = (count + chunkSize - 1) / chunkSize;
+
+	// Not worth waking anyone up for a single chunk
+	if (numChunks == 1) {
+		func(0, count);
+		return;
+	}
+
+	// Each job grabs chunks until there are none left. We wait on all of them below, so they can safely
+	// reference everything on our stack
+	std::atomic<size_t> nextChunk{ 0 };
+	auto runChunks = [&]() {
+		size_t chunk;
+		while ((chunk = nextChunk.fetch_add(1)) < numChunks) {
+			size_t begin = chunk * chunkSize;
+			func(begin, std::min(begin + chunkSize, count));
+		}
+	};
+
+	// Only the helpers get queued, we will be running the chunks on this thread as well
+	JobCounter counter;
+	size_t helpers = std::min(numChunks, concurrency) - 1;
+	for (size_t ix = 0; ix < helpers; ix++)
+		Run(runChunks, &counter);
+	runChunks();
+	Wait(counter);
+}
+
+void JobSystem::__Worker(size_t index) {
+	threadIndex = index;
+	while (true) {
+		if (__TryRunOne(index, true))
+			continue;
+
+		// Work tends to come in bursts, so we check back a few times before paying for a sleep and a wake up
+		bool found = false;
+		for (int spin = 0; spin < SpinCount && !found; spin++) {
+			std::this_thread::yield();
+			found = queued.load() > 0;
+		}
+		if (found)
+			continue;
+
+		std::unique_lock<std::mutex> lock(stateLock);
+		sleeping++;
+		if (queued.load() == 0 && isRunning) {
+			sleeps++;
+			wakeSignal.wait(lock, []() { return queued.load() > 0 || !isRunning; });
+		}
+		sleeping--;
+		// Anything still queued when we shut down gets run first
+		if (!isRunning && queued.load() == 0)
+			return;
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*
+	Counts the jobs that are still running in a group. Jobs can be handed a counter when they are started, which
+	goes up by one when the job is queued and back down when it finishes. Threads can wait on a counter, and other
+	jobs can be held back until a counter reaches 0 (see JobSystem::RunAfter).
+
+	A counter needs to outlive every job that uses it, which is easiest to do by waiting on it before it goes out of scope
+*/
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	~JobCounter() = default;
+	JobCounter(const JobCounter& other) = delete;
+	JobCounter& operator =(const JobCounter& other) = delete;
+
+	// Returns true once every job that used this counter has finished
+	bool IsDone() const { return myCount.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<size_t> myCount{ 0 };
+	// Guards our continuations, and makes sure a finishing job is done with us before a waiter can see us hit 0
+	std::mutex myLock;
+	// Jobs that are waiting on us to hit 0, along with the counters they were started with
+	std::vector<std::pair<std::function<void()>, JobCounter*>> myContinuations;
+};
+
+/*
+	A work-stealing job system, with one job queue per thread. Threads push and pop jobs from the back of their own
+	queue (so the most recent, and most likely cached, work goes first), and when they run out they steal from the
+	front of someone else's. Jobs can be started from any thread, including from inside other jobs.
+
+	Threads that wait on a counter help run jobs until it is done, rather than sleeping. That means it's safe to
+	wait from inside of a job, and that the main thread is never just sitting idle while the workers are busy.
+	Jobs that are started without a counter are kept in a separate queue that only the workers run, so waiting
+	only ever helps with work that somebody is tracking.
+
+	Parallel is built on top of this, so both of them share the same worker threads
+*/
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+	typedef std::function<void(size_t begin, size_t end)> RangeFunc;
+
+	struct Stats {
+		uint64_t Jobs = 0;   // The number of jobs that have been run
+		uint64_t Steals = 0; // The number of jobs that were taken from another thread's queue
+		uint64_t Sleeps = 0; // The number of times a worker ran out of work and went to sleep
+	};
+
+	/*
+		Starts up the worker threads, this is done automatically the first time the job system is used
+		@param numWorkers The number of worker threads to start, 0 will use one less than the number of hardware threads
+	*/
+	static void Init(size_t numWorkers = 0);
+	/*
+		Stops and joins all of the worker threads. Any jobs that have not started yet will be run first
+	*/
+	static void Shutdown();
+
+	/*
+		Gets the number of threads that can run jobs at once (the workers, plus whoever is waiting)
+	*/
+	static size_t GetConcurrency();
+
+	/*
+		Queues up a job to run on one of the worker threads
+		@param job     The job to run
+		@param counter A counter to track the job with, or nullptr to fire and forget. Untracked jobs only run on
+		               the workers, once they have no tracked jobs left
+	*/
+	static void Run(const Job& job, JobCounter* counter = nullptr);
+	/*
+		Queues up a job to run once every job tracked by a counter has finished. If the counter is already done,
+		the job gets queued right away
+		@param dependency The counter to wait on
+		@param job        The job to run
+		@param counter    A counter to track the job with, or nullptr to fire and forget. Note that the job is
+		                  counted from the moment this is called, not just once it gets queued
+	*/
+	static void RunAfter(JobCounter& dependency, const Job& job, JobCounter* counter = nullptr);
+	/*
+		Runs tracked jobs on this thread until every job tracked by a counter has finished
+		@param counter The counter to wait on
+	*/
+	static void Wait(JobCounter& counter);
+
+	/*
+		Splits the range [0, count) into chunks, and invokes func on each chunk across the worker threads. The
+		calling thread runs chunks as well, and blocks until all of them have completed
+		@param count The number of items to process
+		@param func  The function to invoke for each chunk, with the range of items it should process
+		@param grain The smallest number of items that we will hand to a single invocation of func
+	*/
+	static void ParallelFor(size_t count, const RangeFunc& func, size_t grain = 1);
+
+	// Gets the totals since we started up
+	static Stats GetStats();
+
+private:
+	static void __Worker(size_t index);
+	static void __Push(const Job& job, JobCounter* counter);
+	static bool __TryRunOne(size_t index, bool allowBackground);
+	static void __Finish(JobCounter* counter);
+};
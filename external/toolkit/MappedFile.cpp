@@ -0,0 +1,79 @@
+#include "MappedFile.h"
+
+#ifdef WINDOWS
+#include "windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	#ifdef WINDOWS
+	if (myData != nullptr)
+		UnmapViewOfFile(myData);
+	if (myMapping != nullptr)
+		CloseHandle(myMapping);
+	if (myFile != nullptr)
+		CloseHandle(myFile);
+	#else
+	if (myData != nullptr)
+		munmap((void*)myData, mySize);
+	#endif
+}
+
+MappedFile::Sptr MappedFile::Open(const std::string& fileName) {
+	Sptr result = std::make_shared<MappedFile>();
+
+	#ifdef WINDOWS
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+	result->myFile = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		return nullptr;
+	result->mySize = (size_t)size.QuadPart;
+	result->myMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (result->myMapping == nullptr)
+		return nullptr;
+	result->myData = (const uint8_t*)MapViewOfFile(result->myMapping, FILE_MAP_READ, 0, 0, 0);
+	#else
+	int file = open(fileName.c_str(), O_RDONLY);
+	if (file < 0)
+		return nullptr;
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		close(file);
+		return nullptr;
+	}
+	result->mySize = (size_t)info.st_size;
+	void* data = mmap(nullptr, result->mySize, PROT_READ, MAP_SHARED, file, 0);
+	// The mapping keeps the file alive on it's own
+	close(file);
+	result->myData = data == MAP_FAILED ? nullptr : (const uint8_t*)data;
+	#endif
+
+	return result->myData != nullptr ? result : nullptr;
+}
+
+void MappedFile::Release(size_t offset, size_t size) const {
+	if (offset >= mySize)
+		return;
+	size = size < mySize - offset ? size : mySize - offset;
+
+	// We can only release whole pages, so we shrink the range to the pages that are entirely inside of it
+	const size_t pageSize = 4096;
+	size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+	size_t end = (offset + size) / pageSize * pageSize;
+	if (end <= begin)
+		return;
+
+	#ifdef WINDOWS
+	// Unlocking pages that were never locked just takes them out of our working set
+	VirtualUnlock((void*)(myData + begin), end - begin);
+	#else
+	madvise((void*)(myData + begin), end - begin, MADV_DONTNEED);
+	#endif
+}
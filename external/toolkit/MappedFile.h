@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+	A read-only view of a file that is mapped straight into our address space. Nothing is actually read until a
+	page is touched, and the OS is free to drop pages again whenever it needs the memory (they just get read back
+	in from the file), so this lets us work with files that are much bigger than we want to keep in memory
+*/
+class MappedFile
+{
+public:
+	typedef std::shared_ptr<MappedFile> Sptr;
+
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator =(const MappedFile& other) = delete;
+
+	/*
+		Maps a file for reading
+		@param fileName The path to the file to map
+		@returns The mapped file, or nullptr if it could not be opened or is empty
+	*/
+	static Sptr Open(const std::string& fileName);
+
+	const uint8_t* GetData() const { return myData; }
+	size_t GetSize() const { return mySize; }
+
+	/*
+		Lets the OS know that we are done with a range of the file for now, so it can drop those pages out of our
+		working set instead of waiting for memory pressure. The data is still valid to read afterwards
+		@param offset The start of the range, in bytes
+		@param size   The size of the range, in bytes
+	*/
+	void Release(size_t offset, size_t size) const;
+
+private:
+	const uint8_t* myData = nullptr;
+	size_t         mySize = 0;
+	void*          myFile = nullptr;
+	void*          myMapping = nullptr;
+};
@@ -0,0 +1,22 @@
+#include "Parallel.h"
+#include "JobSystem.h"
+
+void Parallel::Init(size_t numWorkers) {
+	JobSystem::Init(numWorkers);
+}
+
+void Parallel::Shutdown() {
+	JobSystem::Shutdown();
+}
+
+size_t Parallel::GetConcurrency() {
+	return JobSystem::GetConcurrency();
+}
+
+void Parallel::For(size_t count, const RangeFunc& func, size_t minChunk) {
+	JobSystem::ParallelFor(count, func, minChunk);
+}
+
+void Parallel::Enqueue(const Task& task) {
+	JobSystem::Run(task);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+/*
+	A small persistent thread pool for splitting up CPU heavy work (culling, image processing, etc...)
+	across all of our cores. The thread that calls For will also help chew through the work, so it is
+	safe to call For from inside of another parallel task
+
+	This is a thin wrapper over JobSystem, which has the worker threads. Use JobSystem directly for job
+	dependencies and counters
+*/
+class Parallel
+{
+public:
+	typedef std::function<void(size_t begin, size_t end)> RangeFunc;
+	typedef std::function<void()> Task;
+
+	/*
+		Starts up the worker threads, this is done automatically the first time the pool is used
+		@param numWorkers The number of worker threads to start, 0 will use one less than the number of hardware threads
+	*/
+	static void Init(size_t numWorkers = 0);
+	/*
+		Stops and joins all of the worker threads. Any tasks that have not started yet will be run first
+	*/
+	static void Shutdown();
+
+	/*
+		Gets the number of threads that will take part in a call to For (including the calling thread)
+	*/
+	static size_t GetConcurrency();
+
+	/*
+		Splits the range [0, count) into chunks, and invokes func on each chunk across the worker threads,
+		blocking until all of the chunks have completed
+		@param count    The number of items to process
+		@param func     The function to invoke for each chunk, with the range of items it should process
+		@param minChunk The smallest number of items that we will hand to a single invocation of func
+	*/
+	static void For(size_t count, const RangeFunc& func, size_t minChunk = 1);
+
+	/*
+		Queues up a task to run on one of the worker threads at some point in the future, without waiting
+		for it to complete
+		@param task The task to run
+	*/
+	static void Enqueue(const Task& task);
+};
@@ -0,0 +1,141 @@
+/*
+	Micro-benchmarks for JobSystem, run with ToolkitBenchmarks [workers]
+
+	The overhead benchmarks time jobs that do (almost) nothing, so they measure what it costs us to queue, steal,
+	run and count a job. The scaling benchmark runs the same compute heavy ParallelFor with more and more workers,
+	and compares each run against doing all of the work on one thread
+*/
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Runs a benchmark a few times and keeps the fastest run, in milliseconds
+template <typename Func>
+static double Measure(Func func, int runs = 5) {
+	double best = 1e30;
+	for (int ix = 0; ix < runs; ix++) {
+		auto start = Clock::now();
+		func();
+		best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+// Stops the compiler from throwing away work that we never look at
+static std::atomic<float> sink;
+
+// A chunk of math that's heavy enough to be worth splitting up
+static float Work(size_t begin, size_t end) {
+	float sum = 0.0f;
+	for (size_t ix = begin; ix < end; ix++)
+		sum += std::sin(ix * 0.001f) * std::cos(ix * 0.002f);
+	return sum;
+}
+
+static void EmptyJobs() {
+	const size_t count = 100000;
+	double ms = Measure([&]() {
+		JobCounter counter;
+		for (size_t ix = 0; ix < count; ix++)
+			JobSystem::Run([]() {}, &counter);
+		JobSystem::Wait(counter);
+	});
+	printf("%-28s %8.1f ns per job\n", "Empty jobs", ms * 1e6 / count);
+}
+
+static void NestedJobs() {
+	// Every job spawns its children from a worker, so almost everything has to be stolen to spread out
+	const size_t fanOut = 16;
+	const size_t depth = 4;
+	size_t total = 0;
+	for (size_t level = 1, width = fanOut; level <= depth; level++, width *= fanOut)
+		total += width;
+
+	double ms = Measure([&]() {
+		JobCounter counter;
+		std::function<void(size_t)> spawn = [&](size_t level) {
+			if (level == depth)
+				return;
+			for (size_t ix = 0; ix < fanOut; ix++)
+				JobSystem::Run([&spawn, level]() { spawn(level + 1); }, &counter);
+		};
+		spawn(0);
+		JobSystem::Wait(counter);
+	});
+	printf("%-28s %8.1f ns per job\n", "Nested jobs", ms * 1e6 / total);
+}
+
+static void DependencyChain() {
+	// Each job can only start once the one before it is done, so this is the cost of releasing a continuation
+	const size_t count = 10000;
+	double ms = Measure([&]() {
+		std::vector<JobCounter> counters(count);
+		JobSystem::Run([]() {}, &counters[0]);
+		for (size_t ix = 1; ix < count; ix++)
+			JobSystem::RunAfter(counters[ix - 1], []() {}, &counters[ix]);
+		JobSystem::Wait(counters[count - 1]);
+		// Earlier counters can still be handing off their continuations
+		for (JobCounter& counter : counters)
+			JobSystem::Wait(counter);
+	});
+	printf("%-28s %8.1f ns per link\n", "Dependency chain", ms * 1e6 / count);
+}
+
+static void SmallParallelFor() {
+	// Lots of tiny loops, like culling a handful of objects every frame
+	const size_t calls = 2000;
+	double ms = Measure([&]() {
+		for (size_t ix = 0; ix < calls; ix++)
+			JobSystem::ParallelFor(1024, [](size_t begin, size_t end) { sink = Work(begin, end); }, 64);
+	});
+	printf("%-28s %8.2f us per call\n", "Small ParallelFor", ms * 1e3 / calls);
+}
+
+static void Scaling(size_t maxWorkers) {
+	const size_t count = 1 << 23;
+	double single = Measure([&]() { sink = Work(0, count); }, 3);
+	printf("%-28s %8.2f ms\n", "Single thread", single);
+
+	std::vector<size_t> workerCounts;
+	for (size_t workers = 1; workers < maxWorkers; workers *= 2)
+		workerCounts.push_back(workers);
+	workerCounts.push_back(maxWorkers);
+	for (size_t workers : workerCounts) {
+		JobSystem::Shutdown();
+		JobSystem::Init(workers);
+		double ms = Measure([&]() {
+			JobSystem::ParallelFor(count, [](size_t begin, size_t end) { sink = Work(begin, end); }, 4096);
+		}, 3);
+		char name[64];
+		snprintf(name, sizeof(name), "ParallelFor, %d threads", (int)workers + 1);
+		printf("%-28s %8.2f ms (%.2fx)\n", name, ms, single / ms);
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t hardware = std::max<unsigned>(std::thread::hardware_concurrency(), 2u);
+	size_t workers = argc > 1 ? (size_t)std::atoi(argv[1]) : hardware - 1;
+	workers = std::max<size_t>(workers, 1);
+	JobSystem::Init(workers);
+	printf("Job system benchmarks, %d workers\n\n", (int)workers);
+
+	EmptyJobs();
+	NestedJobs();
+	DependencyChain();
+	SmallParallelFor();
+	printf("\n");
+	Scaling(workers);
+
+	JobSystem::Stats stats = JobSystem::GetStats();
+	printf("\n%llu jobs run, %llu stolen, %llu sleeps\n", (unsigned long long)stats.Jobs, (unsigned long long)stats.Steals, (unsigned long long)stats.Sleeps);
+	JobSystem::Shutdown();
+	return 0;
+}
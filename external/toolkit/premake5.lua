@@ -16,6 +16,13 @@ project "Toolkit"
         "EnumToString.h",
         "Sys.h",
         "Sys.cpp",
+        "Parallel.h",
+        "Parallel.cpp",
+        "JobSystem.h",
+        "JobSystem.cpp",
+        "MappedFile.h",
+        "MappedFile.cpp",
+        "AssetRegistry.h",
         "TTK\\**.cpp",
         "TTK\\**.h"
     }
@@ -53,3 +60,36 @@ project "Toolkit"
         runtime "Release"
         optimize "on"
         
+
+-- Micro-benchmarks for the job system, builds the parts of the toolkit it needs straight in so that it doesn't pull
+-- in any of our graphics dependencies
+project "ToolkitBenchmarks"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    staticruntime "on"
+
+    targetdir ("bin/" .. outputdir .. "/%{prj.name}")
+    objdir ("obj/" .. outputdir .. "/%{prj.name}")
+
+    files
+    {
+        "JobSystem.h",
+        "JobSystem.cpp",
+        "benchmarks\\**.cpp"
+    }
+
+    includedirs {
+        "%{prj.location}"
+    }
+
+    filter "system:windows"
+        systemversion "latest"
+
+    filter "configurations:Debug"
+        runtime "Debug"
+        symbols "on"
+
+    filter "configurations:Release"
+        runtime "Release"
+        optimize "on"
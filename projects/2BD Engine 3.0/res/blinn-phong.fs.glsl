@@ -1,69 +1,151 @@
-#version 410
-
-layout (location = 0) in vec4 inColor;
-layout (location = 1) in vec3 inNormal;
-layout (location = 2) in vec3 inWorldPos;
+#version 430
+
+layout (location = 0) in vec4 inColor;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inWorldPos;
 layout (location = 3) in vec2 inUV;
-
-layout (location = 0) out vec4 outColor;
-
-uniform vec3  a_CameraPos;
-
-uniform vec3  a_AmbientColor;
-uniform float a_AmbientPower;
-
-uniform vec3  a_LightPos;
-uniform vec3  a_LightColor;
-uniform float a_LightShininess;
-uniform float a_LightAttenuation;
-
-// Color is et to albedo
+
+layout (location = 0) out vec4 outColor;
+
+// These need to match the cluster grid in ClusteredLighting.h
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+// These need to match the atlas layout in ShadowAtlas.h
+#define SHADOW_MAX_LIGHTS 4
+#define SHADOW_TILE_SIZE 512
+
+struct PointLight {
+    vec4 PositionRadius;   // xyz is the world position, w is the radius
+    vec4 ColorAttenuation; // xyz is the color, w is the attenuation
+    ivec4 Shadow;          // x is the light's row in the shadow atlas, or -1 if it has no shadows
+};
+
+// All of the lights in the scene
+layout (std430, binding = 0) readonly buffer b_Lights {
+    PointLight Lights[];
+};
+// The offset and count into LightIndices for each cluster
+layout (std430, binding = 1) readonly buffer b_Clusters {
+    uvec2 Clusters[];
+};
+// The lights that touch each cluster, packed together
+layout (std430, binding = 2) readonly buffer b_LightIndices {
+    uint LightIndices[];
+};
+// The view projection for each cube face of each shadowed light
+layout (std430, binding = 3) readonly buffer b_ShadowFaces {
+    mat4 ShadowFaces[];
+};
+
+uniform vec3  a_CameraPos;
+uniform mat4  a_View;
+// x and y are the screen size, z and w are used to calculate our depth slice
+uniform vec4  a_ClusterParams;
+
+uniform vec3  a_AmbientColor;
+uniform float a_AmbientPower;
+
+uniform float a_LightShininess;
+
+// Color is et to albedo
 uniform sampler2D s_Albedo;
-
-void main() {
-    // Re-normalize our input, so that it is always length 1
-    vec3 norm = normalize(inNormal);
-    // Determine the direction from the position to the light
-    vec3 toLight = a_LightPos - inWorldPos;
-    // Determine the distance to the light (used for attenuation later)
-    float distToLight = length(toLight);
-    // Normalize our toLight vector
-    toLight = normalize(toLight);
-
-    // Determine the direction between the camera and the pixel
-    vec3 viewDir = normalize(a_CameraPos - inWorldPos);
-
-    // Calculate the halfway vector between the direction to the light and the direction to the eye
-    vec3 halfDir = normalize(toLight + viewDir);
-
-    // Our specular power is the angle between the the normal and the half vector, raised
-    // to the power of the light's shininess
-    float specPower = pow(max(dot(norm, halfDir), 0.0), a_LightShininess);
-
-    // Finally, we can calculate the actual specular factor
-    vec3 specOut = specPower * a_LightColor;
-
-    // Calculate our diffuse factor, this is essentially the angle between
-    // the surface and the light
-    float diffuseFactor = max(dot(norm, toLight), 0);
-    // Calculate our diffuse output
-    vec3  diffuseOut = diffuseFactor * a_LightColor;
-
-    // Our ambient is simply the color times the ambient power
-    vec3 ambientOut = a_AmbientColor * a_AmbientPower;
-
-    // We will use a modified form of distance squared attenuation, which will avoid divide
-    // by zero errors and allow us to control the light's attenuation via a uniform
-    float attenuation = 1.0 / (1.0 + a_LightAttenuation * pow(distToLight, 2));
-    
+// Stores the distance to the closest caster divided by the light's radius, for each cube face of each shadowed light
+uniform sampler2DShadow s_ShadowAtlas;
+
+// Works out which cluster this fragment falls into
+uint GetClusterIndex() {
+    float depth = -(a_View * vec4(inWorldPos, 1)).z;
+    int slice = clamp(int(floor(log(depth) * a_ClusterParams.z - a_ClusterParams.w)), 0, CLUSTERS_Z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / a_ClusterParams.xy * vec2(CLUSTERS_X, CLUSTERS_Y)), ivec2(0), ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+    return uint((slice * CLUSTERS_Y + tile.y) * CLUSTERS_X + tile.x);
+}
+
+// Looks up how much of the given light reaches this fragment, 1 is fully lit and 0 is fully shadowed
+float GetShadow(PointLight light, vec3 norm) {
+    if (light.Shadow.x < 0)
+        return 1.0;
+
+    // Push the sample point out along the normal a bit to avoid acne
+    vec3 samplePos = inWorldPos + norm * 0.05;
+    vec3 fromLight = samplePos - light.PositionRadius.xyz;
+
+    // The face of the cube that we fall in is whichever axis we are furthest along, in the same order as cube maps
+    vec3 absDir = abs(fromLight);
+    int face;
+    if (absDir.x >= absDir.y && absDir.x >= absDir.z)
+        face = fromLight.x >= 0 ? 0 : 1;
+    else if (absDir.y >= absDir.z)
+        face = fromLight.y >= 0 ? 2 : 3;
+    else
+        face = fromLight.z >= 0 ? 4 : 5;
+
+    vec4 clip = ShadowFaces[light.Shadow.x * 6 + face] * vec4(samplePos, 1);
+    vec2 tileUV = clip.xy / clip.w * 0.5 + 0.5;
+    // Keep our filtering from bleeding in to the neighbouring tiles
+    tileUV = clamp(tileUV, vec2(0.5 / SHADOW_TILE_SIZE), vec2(1.0 - 0.5 / SHADOW_TILE_SIZE));
+    vec2 atlasUV = (vec2(face, light.Shadow.x) + tileUV) / vec2(6, SHADOW_MAX_LIGHTS);
+
+    float depth = length(fromLight) / light.PositionRadius.w;
+    return texture(s_ShadowAtlas, vec3(atlasUV, depth - 0.002));
+}
+
+void main() {
+    // Re-normalize our input, so that it is always length 1
+    vec3 norm = normalize(inNormal);
+
+    // Determine the direction between the camera and the pixel
+    vec3 viewDir = normalize(a_CameraPos - inWorldPos);
+
+    vec3 lighting = vec3(0);
+    uvec2 cluster = Clusters[GetClusterIndex()];
+    for (uint ix = 0; ix < cluster.y; ix++) {
+        PointLight light = Lights[LightIndices[cluster.x + ix]];
+
+        // Determine the direction from the position to the light
+        vec3 toLight = light.PositionRadius.xyz - inWorldPos;
+        // Determine the distance to the light (used for attenuation later)
+        float distToLight = length(toLight);
+        // Normalize our toLight vector
+        toLight = normalize(toLight);
+
+        // Calculate the halfway vector between the direction to the light and the direction to the eye
+        vec3 halfDir = normalize(toLight + viewDir);
+
+        // Our specular power is the angle between the the normal and the half vector, raised
+        // to the power of the light's shininess
+        float specPower = pow(max(dot(norm, halfDir), 0.0), a_LightShininess);
+
+        // Finally, we can calculate the actual specular factor
+        vec3 specOut = specPower * light.ColorAttenuation.rgb;
+
+        // Calculate our diffuse factor, this is essentially the angle between
+        // the surface and the light
+        float diffuseFactor = max(dot(norm, toLight), 0);
+        // Calculate our diffuse output
+        vec3  diffuseOut = diffuseFactor * light.ColorAttenuation.rgb;
+
+        // We will use a modified form of distance squared attenuation, which will avoid divide
+        // by zero errors and allow us to control the light's attenuation per light. We fade it out
+        // towards the light's radius, so that there is no seam at the edge of it's clusters
+        float attenuation = 1.0 / (1.0 + light.ColorAttenuation.w * pow(distToLight, 2));
+        float window = clamp(1.0 - pow(distToLight / light.PositionRadius.w, 4), 0.0, 1.0);
+        attenuation *= window * window;
+
+        lighting += attenuation * GetShadow(light, norm) * (diffuseOut + specOut);
+    }
+
+    // Our ambient is simply the color times the ambient power
+    vec3 ambientOut = a_AmbientColor * a_AmbientPower;
+
 	// Below is modified for tutorial 08
 	vec4 albedo = texture(s_Albedo, inUV);
-
-    // Our result is our lighting multiplied by our object's color
-    vec3 result = (ambientOut + attenuation * (diffuseOut + specOut)) * albedo.xyz * inColor.xyz;
-
-    // TODO: gamma correction
-
-    // Write the output
-	outColor = vec4(result, inColor.a);// * a_ColorMultiplier;
-}
\ No newline at end of file
+
+    // Our result is our lighting multiplied by our object's color
+    vec3 result = (ambientOut + lighting) * albedo.xyz * inColor.xyz;
+
+    // TODO: gamma correction
+
+    // Write the output
+	outColor = vec4(result, inColor.a);// * a_ColorMultiplier;
+}
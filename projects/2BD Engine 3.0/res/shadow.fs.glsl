@@ -0,0 +1,12 @@
+#version 410
+
+layout (location = 0) in vec3 inWorldPos;
+
+uniform vec3  a_LightPos;
+uniform float a_LightRadius;
+
+void main() {
+	// We store the distance to the light rather than the projected depth, so that every face of the cube
+	// uses the same units, and the lighting shader doesn't need to know which projection was used
+	gl_FragDepth = clamp(length(inWorldPos - a_LightPos) / a_LightRadius, 0.0, 1.0);
+}
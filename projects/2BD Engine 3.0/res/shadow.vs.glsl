@@ -0,0 +1,14 @@
+#version 410
+
+// Shadow passes use the position only stream from Mesh::DrawPositions
+layout (location = 0) in vec3 inPosition;
+
+layout (location = 0) out vec3 outWorldPos;
+
+uniform mat4 a_ModelViewProjection;
+uniform mat4 a_Model;
+
+void main() {
+	outWorldPos = (a_Model * vec4(inPosition, 1)).xyz;
+	gl_Position = a_ModelViewProjection * vec4(inPosition, 1);
+}
@@ -0,0 +1,189 @@
+#include "ClusteredLighting.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+ClusteredLighting::ClusteredLighting() :
+	myView(glm::mat4(1.0f)),
+	myProjection(glm::mat4(1.0f)),
+	myWidth(1), myHeight(1),
+	myNear(0.01f), myFar(1000.0f),
+	mySliceScale(0.0f), mySliceBias(0.0f),
+	myClusterProjection(glm::mat4(0.0f))
+{
+	myClusterMin.resize(ClusterCount);
+	myClusterMax.resize(ClusterCount);
+	myClusterLights.resize(ClusterCount);
+	myClusters.resize(ClusterCount);
+	glCreateBuffers(3, myBuffers);
+}
+
+ClusteredLighting::~ClusteredLighting() {
+	glDeleteBuffers(3, myBuffers);
+}
+
+void ClusteredLighting::BeginFrame(const glm::mat4& view, const glm::mat4& projection, int width, int height) {
+	myView = view;
+	myProjection = projection;
+	myWidth = std::max(width, 1);
+	myHeight = std::max(height, 1);
+	myLights.clear();
+	myRanges.clear();
+	myStats = Stats();
+
+	if (projection != myClusterProjection) {
+		__UpdateClusterBounds();
+		myClusterProjection = projection;
+	}
+}
+
+void ClusteredLighting::__UpdateClusterBounds() {
+	// Pull the near and far planes back out of the projection, see glm::perspective
+	myNear = myProjection[3][2] / (myProjection[2][2] - 1.0f);
+	myFar = myProjection[3][2] / (myProjection[2][2] + 1.0f);
+	float logRange = std::log(myFar / myNear);
+	mySliceScale = ClustersZ / logRange;
+	mySliceBias = ClustersZ * std::log(myNear) / logRange;
+
+	// Work out the view space box around each cluster, by un-projecting the corners of the tile at the slice's
+	// near and far depth
+	for (int z = 0; z < ClustersZ; z++) {
+		float sliceNear = myNear * std::pow(myFar / myNear, z / (float)ClustersZ);
+		float sliceFar = myNear * std::pow(myFar / myNear, (z + 1) / (float)ClustersZ);
+		for (int y = 0; y < ClustersY; y++) {
+			for (int x = 0; x < ClustersX; x++) {
+				glm::vec2 ndcMin = glm::vec2(x / (float)ClustersX, y / (float)ClustersY) * 2.0f - 1.0f;
+				glm::vec2 ndcMax = glm::vec2((x + 1) / (float)ClustersX, (y + 1) / (float)ClustersY) * 2.0f - 1.0f;
+				glm::vec2 scale = glm::vec2(myProjection[0][0], myProjection[1][1]);
+				glm::vec2 offset = glm::vec2(myProjection[2][0], myProjection[2][1]);
+				// ndc = view.xy * scale / depth - offset, solved for view.xy at the slice's near and far depth
+				glm::vec2 a = (ndcMin + offset) * sliceNear / scale;
+				glm::vec2 b = (ndcMax + offset) * sliceNear / scale;
+				glm::vec2 c = (ndcMin + offset) * sliceFar / scale;
+				glm::vec2 d = (ndcMax + offset) * sliceFar / scale;
+
+				int index = (z * ClustersY + y) * ClustersX + x;
+				myClusterMin[index] = glm::vec3(glm::min(glm::min(a, b), glm::min(c, d)), -sliceFar);
+				myClusterMax[index] = glm::vec3(glm::max(glm::max(a, b), glm::max(c, d)), -sliceNear);
+			}
+		}
+	}
+}
+
+int ClusteredLighting::__GetSlice(float depth) const {
+	if (depth <= myNear)
+		return 0;
+	return glm::clamp((int)std::floor(std::log(depth) * mySliceScale - mySliceBias), 0, ClustersZ - 1);
+}
+
+void ClusteredLighting::AddLight(const glm::vec3& position, const PointLight& light, int shadowIndex) {
+	myStats.Lights++;
+
+	glm::vec3 viewPos = glm::vec3(myView * glm::vec4(position, 1.0f));
+	float depth = -viewPos.z;
+	float radius = light.Radius;
+
+	// Entirely behind the camera or past the far plane
+	if (depth + radius < myNear || depth - radius > myFar)
+		return;
+
+	LightRange range;
+	range.ViewPos = viewPos;
+	range.Radius = radius;
+	range.Min.z = __GetSlice(depth - radius);
+	range.Max.z = __GetSlice(depth + radius);
+
+	// Find the range of tiles that the light's bounding box covers. x/depth is always at it's extremes on the
+	// corners of the box, so we only need to project those
+	float nearDepth = std::max(depth - radius, myNear);
+	float farDepth = depth + radius;
+	glm::vec2 lo = glm::vec2(FLT_MAX), hi = glm::vec2(-FLT_MAX);
+	glm::vec2 scale = glm::vec2(myProjection[0][0], myProjection[1][1]);
+	glm::vec2 offset = glm::vec2(myProjection[2][0], myProjection[2][1]);
+	for (int ix = 0; ix < 8; ix++) {
+		glm::vec2 corner = glm::vec2(viewPos) + glm::vec2((ix & 1) ? radius : -radius, (ix & 2) ? radius : -radius);
+		float cornerDepth = (ix & 4) ? farDepth : nearDepth;
+		glm::vec2 ndc = corner * scale / cornerDepth - offset;
+		lo = glm::min(lo, ndc);
+		hi = glm::max(hi, ndc);
+	}
+	glm::vec2 dims = glm::vec2(ClustersX, ClustersY);
+	glm::ivec2 tileMin = glm::ivec2(glm::floor((lo * 0.5f + 0.5f) * dims));
+	glm::ivec2 tileMax = glm::ivec2(glm::floor((hi * 0.5f + 0.5f) * dims));
+	if (tileMax.x < 0 || tileMax.y < 0 || tileMin.x >= ClustersX || tileMin.y >= ClustersY)
+		return;
+	range.Min.x = std::max(tileMin.x, 0);
+	range.Min.y = std::max(tileMin.y, 0);
+	range.Max.x = std::min(tileMax.x, ClustersX - 1);
+	range.Max.y = std::min(tileMax.y, ClustersY - 1);
+
+	GpuLight gpu;
+	gpu.PositionRadius = glm::vec4(position, radius);
+	gpu.ColorAttenuation = glm::vec4(light.Color, light.Attenuation);
+	gpu.Shadow = glm::ivec4(shadowIndex, 0, 0, 0);
+	myLights.push_back(gpu);
+	myRanges.push_back(range);
+}
+
+void ClusteredLighting::Build() {
+	auto start = std::chrono::high_resolution_clock::now();
+	myStats.VisibleLights = myLights.size();
+
+	// Each depth slice owns its own clusters, so we can bin all of the slices at the same time. Inside of the
+	// slice we do a proper sphere vs box test, since the tile ranges are pretty loose for big lights
+	Parallel::For(ClustersZ, [&](size_t begin, size_t end) {
+		for (int z = (int)begin; z < (int)end; z++) {
+			for (int ix = z * ClustersX * ClustersY; ix < (z + 1) * ClustersX * ClustersY; ix++)
+				myClusterLights[ix].clear();
+
+			for (uint32_t light = 0; light < (uint32_t)myRanges.size(); light++) {
+				const LightRange& range = myRanges[light];
+				if (z < range.Min.z || z > range.Max.z)
+					continue;
+				for (int y = range.Min.y; y <= range.Max.y; y++) {
+					for (int x = range.Min.x; x <= range.Max.x; x++) {
+						int index = (z * ClustersY + y) * ClustersX + x;
+						glm::vec3 closest = glm::clamp(range.ViewPos, myClusterMin[index], myClusterMax[index]);
+						glm::vec3 delta = closest - range.ViewPos;
+						if (glm::dot(delta, delta) <= range.Radius * range.Radius)
+							myClusterLights[index].push_back(light);
+					}
+				}
+			}
+		}
+	});
+
+	// Flatten all of our lists out into a single index buffer
+	myIndices.clear();
+	for (int ix = 0; ix < ClusterCount; ix++) {
+		const std::vector<uint32_t>& lights = myClusterLights[ix];
+		myClusters[ix] = glm::uvec2((uint32_t)myIndices.size(), (uint32_t)lights.size());
+		myIndices.insert(myIndices.end(), lights.begin(), lights.end());
+		myStats.MaxPerCluster = std::max(myStats.MaxPerCluster, lights.size());
+	}
+	myStats.Indices = myIndices.size();
+
+	// Re-specifying the whole buffer lets the driver hand us fresh memory instead of waiting on last frame.
+	// We never upload an empty buffer, since binding a buffer with no storage is an error
+	GpuLight emptyLight = {};
+	uint32_t emptyIndex = 0;
+	glNamedBufferData(myBuffers[0], std::max<size_t>(myLights.size(), 1) * sizeof(GpuLight),
+		myLights.empty() ? &emptyLight : myLights.data(), GL_STREAM_DRAW);
+	glNamedBufferData(myBuffers[1], myClusters.size() * sizeof(glm::uvec2), myClusters.data(), GL_STREAM_DRAW);
+	glNamedBufferData(myBuffers[2], std::max<size_t>(myIndices.size(), 1) * sizeof(uint32_t),
+		myIndices.empty() ? &emptyIndex : myIndices.data(), GL_STREAM_DRAW);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	myStats.BuildMs = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void ClusteredLighting::Apply(const Shader::Sptr& shader) const {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LightBinding, myBuffers[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ClusterBinding, myBuffers[1]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IndexBinding, myBuffers[2]);
+
+	shader->SetUniform("a_View", myView);
+	shader->SetUniform("a_ClusterParams", glm::vec4((float)myWidth, (float)myHeight, mySliceScale, mySliceBias));
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLM/glm.hpp>
+#include <memory>
+#include <vector>
+#include <cereal/cereal.hpp>
+#include "Shader.h"
+
+/*
+	A point light in the scene, it's position comes from the entity's transform
+*/
+struct PointLight {
+	glm::vec3 Color = glm::vec3(1.0f);
+	// Same as the old a_LightAttenuation uniform, light falls off with 1 / (1 + attenuation * distance^2)
+	float Attenuation = 1.0f;
+	// The distance at which the light is faded out completely, lights only get binned into clusters they can reach.
+	// With an attenuation of 1, the light drops below 1/256 at around 16 units
+	float Radius = 16.0f;
+	// Whether this light gets a slot in the shadow atlas, we only have room for a handful of these
+	bool CastShadows = false;
+
+	template <typename Archive>
+	void serialize(Archive& archive) {
+		archive(CEREAL_NVP(Color), CEREAL_NVP(Attenuation), CEREAL_NVP(Radius), CEREAL_NVP(CastShadows));
+	}
+};
+
+/*
+	Splits the camera's view frustum into a grid of clusters (tiles on screen, with exponentially sized slices
+	in depth), and works out which lights touch each cluster on the CPU. The results get uploaded in to SSBOs
+	so that the lighting shaders only need to loop over the few lights that actually reach each pixel.
+
+	The shader side of this lives in blinn-phong.fs.glsl, and the grid size needs to match the defines there
+*/
+class ClusteredLighting {
+public:
+	typedef std::shared_ptr<ClusteredLighting> Sptr;
+
+	static const int ClustersX = 16;
+	static const int ClustersY = 9;
+	static const int ClustersZ = 24;
+	static const int ClusterCount = ClustersX * ClustersY * ClustersZ;
+
+	// The SSBO binding points that the lighting shaders expect our buffers at
+	static const GLuint LightBinding = 0;
+	static const GLuint ClusterBinding = 1;
+	static const GLuint IndexBinding = 2;
+
+	struct Stats {
+		size_t Lights = 0; // How many lights were added this frame
+		size_t VisibleLights = 0; // How many of those landed in at least one cluster
+		size_t Indices = 0; // The total number of light references across all clusters
+		size_t MaxPerCluster = 0; // The most lights any one cluster has to deal with
+		float  BuildMs = 0.0f; // How long binning the lights took on the CPU
+	};
+
+	ClusteredLighting();
+	~ClusteredLighting();
+
+	/*
+		Starts a new frame of lights
+		@param view       The camera's view matrix
+		@param projection The camera's projection matrix, this must be a perspective projection
+		@param width      The width of the window, in pixels
+		@param height     The height of the window, in pixels
+	*/
+	void BeginFrame(const glm::mat4& view, const glm::mat4& projection, int width, int height);
+	/*
+		Adds a light to be binned this frame
+		@param position    The world position of the light
+		@param light       The light's settings
+		@param shadowIndex The light's row in the shadow atlas, or -1 if it does not cast shadows
+	*/
+	void AddLight(const glm::vec3& position, const PointLight& light, int shadowIndex = -1);
+	/*
+		Bins all of the lights that were added into our clusters, and uploads the results to the GPU
+	*/
+	void Build();
+
+	/*
+		Binds our SSBOs to their binding points, and sets up the per-frame uniforms on the given shader
+		@param shader The lighting shader that we are about to draw with
+	*/
+	void Apply(const Shader::Sptr& shader) const;
+
+	const Stats& GetStats() const { return myStats; }
+
+private:
+	// The layout of a light in our SSBO, matches the std430 struct in the shader
+	struct GpuLight {
+		glm::vec4 PositionRadius;
+		glm::vec4 ColorAttenuation;
+		glm::ivec4 Shadow; // x is the row in the shadow atlas, or -1 for no shadows
+	};
+
+	// The cluster ranges that a light touches, inclusive
+	struct LightRange {
+		glm::ivec3 Min, Max;
+		glm::vec3  ViewPos;
+		float      Radius;
+	};
+
+	void __UpdateClusterBounds();
+	int  __GetSlice(float depth) const;
+
+	glm::mat4 myView, myProjection;
+	int myWidth, myHeight;
+	float myNear, myFar;
+	// Used to go from a view space depth to our slice index, slice = log(depth) * scale - bias
+	float mySliceScale, mySliceBias;
+
+	// View space bounds of each cluster, only rebuilt when our projection changes
+	glm::mat4 myClusterProjection;
+	std::vector<glm::vec3> myClusterMin, myClusterMax;
+
+	std::vector<GpuLight> myLights;
+	std::vector<LightRange> myRanges;
+	std::vector<std::vector<uint32_t>> myClusterLights;
+
+	// The flattened (offset, count) pairs for each cluster, and the light indices that they point into
+	std::vector<glm::uvec2> myClusters;
+	std::vector<uint32_t> myIndices;
+
+	// 0 is the lights, 1 is the clusters, and 2 is the light indices
+	GLuint myBuffers[3];
+
+	Stats myStats;
+};
@@ -19,6 +19,11 @@
 #include "Transform.h"
 //New Object Loader
 #include "ObjectLoader.h"
+#include "Parallel.h"
+#include "SystemScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
 
 struct TempTransform {
 
@@ -32,10 +37,73 @@ struct TempTransform {
 			glm::mat4_cast(glm::quat(glm::radians(SetRotation))) *
 			glm::scale(glm::mat4(1.0f), SetScale);
 	}
+
+	template <typename Archive>
+	void serialize(Archive& archive) {
+		archive(CEREAL_NVP(SetPosition), CEREAL_NVP(SetRotation), CEREAL_NVP(SetScale));
+	}
+};
+
+// Where an entity was as of the simulation step before last, so that we can draw it part way between steps
+struct PreviousTransform {
+	TempTransform Value;
+};
+
+// Blends between two transforms, rotations are blended as quaternions so they take the short way around
+glm::mat4 InterpolateTransform(const TempTransform& from, const TempTransform& to, float t) {
+	glm::quat rotation = glm::slerp(glm::quat(glm::radians(from.SetRotation)), glm::quat(glm::radians(to.SetRotation)), t);
+	return
+		glm::translate(glm::mat4(1.0f), glm::mix(from.SetPosition, to.SetPosition, t)) *
+		glm::mat4_cast(rotation) *
+		glm::scale(glm::mat4(1.0f), glm::mix(from.SetScale, to.SetScale, t));
+}
+
+// Same as above, but for a world matrix. Blending the matrices directly would shrink anything that is turning
+glm::mat4 InterpolateTransform(const glm::mat4& from, const glm::mat4& to, float t) {
+	glm::vec3 fromScale = glm::vec3(glm::length(glm::vec3(from[0])), glm::length(glm::vec3(from[1])), glm::length(glm::vec3(from[2])));
+	glm::vec3 toScale = glm::vec3(glm::length(glm::vec3(to[0])), glm::length(glm::vec3(to[1])), glm::length(glm::vec3(to[2])));
+	// Can't pull a rotation out of something that's been scaled down to nothing
+	if (glm::any(glm::equal(fromScale, glm::vec3(0.0f))) || glm::any(glm::equal(toScale, glm::vec3(0.0f))))
+		return to;
+	glm::quat fromRotation = glm::quat_cast(glm::mat3(glm::vec3(from[0]) / fromScale.x, glm::vec3(from[1]) / fromScale.y, glm::vec3(from[2]) / fromScale.z));
+	glm::quat toRotation = glm::quat_cast(glm::mat3(glm::vec3(to[0]) / toScale.x, glm::vec3(to[1]) / toScale.y, glm::vec3(to[2]) / toScale.z));
+	return
+		glm::translate(glm::mat4(1.0f), glm::mix(glm::vec3(from[3]), glm::vec3(to[3]), t)) *
+		glm::mat4_cast(glm::slerp(fromRotation, toRotation, t)) *
+		glm::scale(glm::mat4(1.0f), glm::mix(fromScale, toScale, t));
+}
+
+// Pins an entity to a spot every update, like our floor tiles and the bed
+struct Anchor {
+	glm::vec3 Position = glm::vec3(0.0f);
+
+	template <typename Archive>
+	void serialize(Archive& archive) {
+		archive(CEREAL_NVP(Position));
+	}
 };
 
-struct UpdateBehaviour {
-	std::function<void(entt::entity e, float dt)> Function;
+// Moves an entity every update, in units (and degrees) per second
+struct Velocity {
+	glm::vec3 Linear = glm::vec3(0.0f);
+	glm::vec3 Angular = glm::vec3(0.0f);
+
+	template <typename Archive>
+	void serialize(Archive& archive) {
+		archive(CEREAL_NVP(Linear), CEREAL_NVP(Angular));
+	}
+};
+
+// Makes the spider crawl around in a circle, by turning it's velocity a bit every update
+struct SpiderCrawl {
+	float Speed = 0.3f;      // Units per second
+	float TurnRate = -90.0f; // Degrees per second
+	float Heading = 90.0f;   // The direction we are crawling, in degrees from +x
+
+	template <typename Archive>
+	void serialize(Archive& archive) {
+		archive(CEREAL_NVP(Speed), CEREAL_NVP(TurnRate), CEREAL_NVP(Heading));
+	}
 };
 
 /*
@@ -86,16 +154,50 @@ void Game::Run()
 
 	static float prevFrame = glfwGetTime();
 
+	// Nothing has moved yet, so our first frame shouldn't blend in from the origin
+	myPreviousCameraPos = myCamera->GetPosition();
+	myPreviousModelTransformObj = myModelTransformObj;
+
+	// Our first frame needs something to draw, after this the snapshots come from __Simulate
+	__ExtractSnapshot(mySnapshots[myFrontSnapshot]);
+	mySimThread = std::thread(&Game::__SimulationThread, this);
+
 	// Run as long as the window is open
 	while (!glfwWindowShouldClose(myWindow)) {
 		// Poll for events from windows (clicks, keypressed, closing, all that)
 		glfwPollEvents();
+		// GLFW only lets us read the keyboard from the main thread, so we grab it here for Update
+		for (int key = GLFW_KEY_SPACE; key <= GLFW_KEY_LAST; key++)
+			myKeys[key] = glfwGetKey(myWindow, key) == GLFW_PRESS;
 
 		float thisFrame = glfwGetTime();
 		float deltaTime = thisFrame - prevFrame;
 
-		Update(deltaTime);
-		Draw(deltaTime);
+		if (myPipelined) {
+			// The next frame gets simulated on our simulation thread while we draw the last one that it gave us, so
+			// a frame takes about as long as the slower of the two, instead of both of them added together
+			{
+				std::lock_guard<std::mutex> lock(mySimLock);
+				mySimDeltaTime = deltaTime;
+				mySimPending = true;
+			}
+			mySimSignal.notify_all();
+
+			__TimedDraw(deltaTime);
+
+			// Nothing else is allowed to touch the scene until the simulation is done with it (ImGui included)
+			std::unique_lock<std::mutex> lock(mySimLock);
+			mySimSignal.wait(lock, [this]() { return !mySimPending; });
+			myFrontSnapshot = 1 - myFrontSnapshot;
+		}
+		else {
+			__Simulate(deltaTime);
+			myFrontSnapshot = 1 - myFrontSnapshot;
+			__TimedDraw(deltaTime);
+		}
+
+		// Nothing is simulating right now, so this is where finished scene loads get swapped in
+		SceneManager::Update();
 
 		ImGuiNewFrame();
 		DrawGui(deltaTime);
@@ -110,12 +212,64 @@ void Game::Run()
 
 	LOG_INFO("Shutting down...");
 
+	{
+		std::lock_guard<std::mutex> lock(mySimLock);
+		mySimExit = true;
+	}
+	mySimSignal.notify_all();
+	mySimThread.join();
+
 	UnloadContent();
 
 	ShutdownImGui();
 	Shutdown();
 }
 
+void Game::__SimulationThread() {
+	std::unique_lock<std::mutex> lock(mySimLock);
+	while (true) {
+		mySimSignal.wait(lock, [this]() { return mySimPending || mySimExit; });
+		if (mySimExit)
+			return;
+		lock.unlock();
+		__Simulate(mySimDeltaTime);
+		lock.lock();
+		mySimPending = false;
+		mySimSignal.notify_all();
+	}
+}
+
+void Game::__Simulate(float deltaTime) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// The simulation steps at a fixed rate no matter how fast we're drawing, anything left over carries into
+	// the next frame. If we fall too far behind, we drop the time instead of trying to catch up
+	float step = 1.0f / myTickRate;
+	myAccumulator += deltaTime;
+	myLastSteps = 0;
+	while (myAccumulator >= step && myLastSteps < myMaxSteps) {
+		__StoreTransforms();
+		Update(step);
+		myAccumulator -= step;
+		myLastSteps++;
+	}
+	if (myAccumulator >= step)
+		myAccumulator = std::fmod(myAccumulator, step);
+	// How far we are between our last two steps, the snapshot uses this to blend between them
+	myInterpolation = myAccumulator / step;
+
+	// The front snapshot is the one being drawn, so we always write into the other one
+	__ExtractSnapshot(mySnapshots[1 - myFrontSnapshot]);
+
+	mySimMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Game::__TimedDraw(float deltaTime) {
+	auto start = std::chrono::high_resolution_clock::now();
+	Draw(deltaTime);
+	myDrawMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 void Game::Resize(int newWidth, int newHeight) {
 	myCamera->Projection = glm::perspective(glm::radians(60.0f), newWidth / (float)newHeight, 0.01f, 1000.0f);
 }
@@ -161,6 +315,7 @@ void Game::Initialize() {
 }
 
 void Game::Shutdown() {
+	Parallel::Shutdown();
 	glfwTerminate();
 }
 
@@ -206,14 +361,11 @@ void Game::LoadContent() {
 	glm::vec3 position = myCamera->GetPosition();
 
 	Material::Sptr testMat = std::make_shared<Material>(phong);
-	testMat->Set("a_LightPos", { -2, 1.5, 2 });
-	//testMat->Set("a_LightPos", { position });
-	testMat->Set("a_LightColor", { 1.0f, 1.0f, 1.0f }); //color of the light 
+	// Lights are now entities with a PointLight component, see below
 	testMat->Set("a_AmbientColor", { 1.0f, 1.0f, 0.9f }); //color of the scene
 	testMat->Set("a_AmbientPower", 0.2f); //basically sets the color of scene
 	testMat->Set("a_LightSpecPower", 0.5f);
 	testMat->Set("a_LightShininess", 256);
-	testMat->Set("a_LightAttenuation", 1.0f);
 	//Texture2D::Sptr albedo = Texture2D::LoadFromFile("color-grid.png");
 	Texture2D::Sptr albedo = Texture2D::LoadFromFile("Tile.png");
 	testMat->Set("s_Albedo", albedo);
@@ -222,13 +374,10 @@ void Game::LoadContent() {
 	Shader::Sptr phong2 = std::make_shared<Shader>();
 	phong2->Load("lighting.vs.glsl", "blinn-phong.fs.glsl");
 	Material::Sptr testMat2 = std::make_shared<Material>(phong2);
-	testMat2->SetTest("a_LightPos", { -28.5, 14, 1 }, "a_LightPos2", { -26, 2, 1 });
-	testMat2->Set("a_LightColor", { 1.0f, 1.0f, 1.0f }); //color of the light 
 	testMat2->Set("a_AmbientColor", { 1.0f, 1.0f, 0.9f });
 	testMat2->Set("a_AmbientPower", 0.2f);
 	testMat2->Set("a_LightSpecPower", 0.5f);
 	testMat2->Set("a_LightShininess", 256);
-	testMat2->Set("a_LightAttenuation", 1.0f);
 	Texture2D::Sptr albedo2 = Texture2D::LoadFromFile("Tile.png");
 	testMat2->Set("s_Albedo", albedo2);
 
@@ -258,11 +407,86 @@ void Game::LoadContent() {
 	//load Level
 	OpenObj("Level1_Floorless.obj", ObjMeshData, uvs, normals);
 	mylevel = std::make_shared<Mesh>(ObjMeshData.data(), ObjMeshData.size(), nullptr, 0);
+	// The walls of the level are what hide most of our props, so they get used as our occluder
+	std::shared_ptr<std::vector<glm::vec3>> levelOccluder = OcclusionCuller::BuildOccluder(ObjMeshData.data(), ObjMeshData.size());
+	myOcclusionCuller = std::make_shared<OcclusionCuller>(256, 256);
+
+	myClusteredLighting = std::make_shared<ClusteredLighting>();
+	myShadowAtlas = std::make_shared<ShadowAtlas>();
 
 	//square
 	myModelTransform = glm::mat4(1.0f);
 	//End Engine
 
+	// Our game logic, see SystemScheduler. The anchors and the spider don't share any components, so they run at
+	// the same time, and movement runs once they are both done
+	mySystems = std::make_shared<SystemScheduler>();
+	mySystems->Add("Anchors", SystemScheduler::Reads<Anchor>(), SystemScheduler::Writes<TempTransform>(),
+		[](float dt, TempTransform& transform, const Anchor& anchor) {
+			transform.SetPosition = anchor.Position;
+		});
+	mySystems->Add("Spider", SystemScheduler::Reads<>(), SystemScheduler::Writes<SpiderCrawl, Velocity>(),
+		[](float dt, SpiderCrawl& crawl, Velocity& velocity) {
+			crawl.Heading += crawl.TurnRate * dt;
+			float heading = glm::radians(crawl.Heading);
+			velocity.Linear = glm::vec3(glm::cos(heading), glm::sin(heading), 0.0f) * crawl.Speed;
+			velocity.Angular = glm::vec3(0.0f, 0.0f, crawl.TurnRate);
+		});
+	mySystems->Add("Movement", SystemScheduler::Reads<Velocity>(), SystemScheduler::Writes<TempTransform>(),
+		[](float dt, TempTransform& transform, const Velocity& velocity) {
+			transform.SetPosition += velocity.Linear * dt;
+			transform.SetRotation += velocity.Angular * dt;
+		});
+
+	// Everything that our scenes can be saved with. Assets need to keep the same IDs, or old scene files won't
+	// be able to find them
+	mySerializer = std::make_shared<SceneSerializer>();
+	mySerializer->AddAsset<Mesh>("Floor1", myMesh);
+	mySerializer->AddAsset<Mesh>("Floor2", myMesh2);
+	mySerializer->AddAsset<Mesh>("Floor3", myMesh3);
+	mySerializer->AddAsset<Mesh>("Floor4", myMesh4);
+	mySerializer->AddAsset<Mesh>("Spider", myMeshObj);
+	mySerializer->AddAsset<Mesh>("Bed", myMeshObjBed);
+	mySerializer->AddAsset<Mesh>("Level1", mylevel);
+	mySerializer->AddAsset<Material>("Tile", testMat);
+	mySerializer->AddAsset<Material>("Tile2", testMat2);
+	mySerializer->AddAsset<std::vector<glm::vec3>>("Level1", levelOccluder);
+	mySerializer->AddComponent<TempTransform>("TempTransform");
+	mySerializer->AddComponent<MeshRenderer>("MeshRenderer");
+	mySerializer->AddComponent<Anchor>("Anchor");
+	mySerializer->AddComponent<Velocity>("Velocity");
+	mySerializer->AddComponent<SpiderCrawl>("SpiderCrawl");
+	mySerializer->AddComponent<PointLight>("PointLight");
+	mySerializer->AddComponent<ShadowCaster>("ShadowCaster");
+	mySerializer->AddComponent<Occluder>("Occluder");
+
+	// Prefabs, these are the components that get copied to each instance (the transform comes from the caller)
+	SceneManager::AddPrefabComponent<MeshRenderer>();
+	SceneManager::AddPrefabComponent<ShadowCaster>();
+	SceneManager::AddPrefabComponent<Anchor>();
+	SceneManager::AddPrefabComponent<Velocity>();
+	SceneManager::AddPrefabComponent<SpiderCrawl>();
+	SceneManager::AddPrefabComponent<PointLight>();
+	SceneManager::AddPrefabComponent<Occluder>();
+	{
+		auto& prefabs = SceneManager::Prefabs;
+
+		entt::entity spider = SceneManager::CreatePrefab("Spider");
+		MeshRenderer& spiderRenderer = prefabs.assign<MeshRenderer>(spider);
+		spiderRenderer.Material = testMat;
+		spiderRenderer.Mesh = myMeshObj;
+		prefabs.assign<ShadowCaster>(spider).Static = false;
+		// It crawls around in a circle forever
+		prefabs.assign<SpiderCrawl>(spider);
+		prefabs.assign<Velocity>(spider);
+
+		entt::entity bed = SceneManager::CreatePrefab("Bed");
+		MeshRenderer& bedRenderer = prefabs.assign<MeshRenderer>(bed);
+		bedRenderer.Material = testMat;
+		bedRenderer.Mesh = myMeshObjBed;
+		prefabs.assign<ShadowCaster>(bed).Static = true;
+	}
+
 
 	SceneManager::RegisterScene("Test");
 	SceneManager::RegisterScene("Test2");
@@ -275,6 +499,7 @@ void Game::LoadContent() {
 		entt::entity e1 = ecs.create();
 		MeshRenderer& m1 = ecs.assign<MeshRenderer>(e1);
 		ecs.assign<TempTransform>(e1).SetScale = glm::vec3(1.0f);
+		ecs.get<TempTransform>(e1).SetPosition = glm::vec3(-7.5, 7.5, 0);
 		m1.Material = testMat;
 		m1.Mesh = myMesh;
 
@@ -307,11 +532,9 @@ void Game::LoadContent() {
 		//mc.Mesh = MainCharacter; //Not currently drawing Johnny
 
 		//Spider
-		entt::entity e2 = ecs.create();
-		MeshRenderer& m2 = ecs.assign<MeshRenderer>(e2);
-		ecs.assign<TempTransform>(e2).SetScale = glm::vec3(1.2f);
-		m2.Material = testMat;
-		m2.Mesh = myMeshObj;
+		TempTransform spiderTransform;
+		spiderTransform.SetScale = glm::vec3(1.2f);
+		SceneManager::Instantiate(ecs, SceneManager::FindPrefab("Spider"), 1, &spiderTransform);
 
 		//Level1
 		entt::entity L1 = ecs.create();
@@ -319,42 +542,29 @@ void Game::LoadContent() {
 		ecs.assign<TempTransform>(L1).SetScale = glm::vec3(1.0f);
 		Lv1.Material = testMat;
 		Lv1.Mesh = mylevel;
+		ecs.assign<Occluder>(L1).Triangles = levelOccluder;
+		ecs.assign<ShadowCaster>(L1).Static = true;
 
 		//Bed
-		entt::entity e3 = ecs.create();
-		MeshRenderer& m3 = ecs.assign<MeshRenderer>(e3);
-		ecs.assign<TempTransform>(e3).SetScale = glm::vec3(1.0f);
-		m3.Material = testMat;
-		m3.Mesh = myMeshObjBed;
+		TempTransform bedTransform;
+		entt::entity e3 = SceneManager::Instantiate(ecs, SceneManager::FindPrefab("Bed"), 1, &bedTransform)[0];
+
+		//Lights, these used to be baked into the materials
+		glm::vec3 lightPositions[3] = { { -2, 1.5, 2 }, { -28.5, 14, 1 }, { -26, 2, 1 } };
+		for (const glm::vec3& lightPos : lightPositions) {
+			entt::entity light = ecs.create();
+			ecs.assign<TempTransform>(light).SetPosition = lightPos;
+			ecs.assign<PointLight>(light).CastShadows = true;
+		}
 
 		//Required for our current movement system (for main character)
 		myModelTransformObj = glm::mat3(1.0f);
 		myModelTransform1 = glm::mat4(1.0f);
 
 		//Setting up the floor textures
-		auto FloorPos1 = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-7.5, 7.5, 0);
-		};
-		auto& Flooring1 = ecs.get_or_assign<UpdateBehaviour>(e1);//floor
-		Flooring1.Function = FloorPos1;
-		//Setting up the floor textures
-		auto FloorPos2 = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-22.5, 7.5, 0);
-		};
-		auto& Flooring2 = ecs.get_or_assign<UpdateBehaviour>(e4);//floor
-		Flooring2.Function = FloorPos2;
-		//Floor 3
-		auto FloorPos3 = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-7.5, 22.5, 0);
-		};
-		auto& Flooring3 = ecs.get_or_assign<UpdateBehaviour>(e5);//floor
-		Flooring3.Function = FloorPos3;
-		//Floor 4
-		auto FloorPos4 = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-22.5, 22.5, 0);
-		};
-		auto& Flooring4 = ecs.get_or_assign<UpdateBehaviour>(e6);//floor
-		Flooring4.Function = FloorPos4;
+		ecs.assign<Anchor>(e4).Position = glm::vec3(-22.5, 7.5, 0);
+		ecs.assign<Anchor>(e5).Position = glm::vec3(-7.5, 22.5, 0);
+		ecs.assign<Anchor>(e6).Position = glm::vec3(-22.5, 22.5, 0);
 
 		//RNG Bed Spawning 
 		int rng;
@@ -365,92 +575,68 @@ void Game::LoadContent() {
 		std::chrono::duration<double> diff = end - start;
 
 		rng = diff.count() * 100000;
+		auto& BedSpawn = ecs.assign<Anchor>(e3);//e3 is the bed
 		if (rng % 3 == 0) {
-			auto BedPos1 = [](entt::entity e, float dt) {
-				CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-2.0, 24.5, 0);
-			};
-			auto& BedSpawn = ecs.get_or_assign<UpdateBehaviour>(e3);//e3 is the bed
-			BedSpawn.Function = BedPos1;
+			BedSpawn.Position = glm::vec3(-2.0, 24.5, 0);
 		}
 		else if (rng % 3 == 1) {
-			auto BedPos2 = [](entt::entity e, float dt) {
-				CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-28.0, 17.5, 0);
-			};
-			auto& BedSpawn = ecs.get_or_assign<UpdateBehaviour>(e3);//e3 is the bed
-			BedSpawn.Function = BedPos2;
+			BedSpawn.Position = glm::vec3(-28.0, 17.5, 0);
 		}
 		else if (rng % 3 == 2) {
-			auto BedPos3 = [](entt::entity e, float dt) {
-				CurrentRegistry().get<TempTransform>(e).SetPosition = glm::vec3(-28.0, 28.5, 0);
-			};
-			auto& BedSpawn = ecs.get_or_assign<UpdateBehaviour>(e3);//e3 is the bed
-			BedSpawn.Function = BedPos3;
+			BedSpawn.Position = glm::vec3(-28.0, 28.5, 0);
 		}
+	}
 
-		//Movement (New system)
-		//Forward
-		auto moveF = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition += glm::vec3(0, 0.005, 0);
-		};
-		//Back
-		auto moveB = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition += glm::vec3(0, -0.005, 0);
-		};
-		//Right
-		auto moveR = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition += glm::vec3(0.005, 0, 0);
-		};
-		//Left
-		auto moveL = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition += glm::vec3(-0.005, 0, 0);
-		};
-		//Rotate Right
-		auto rotR = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetRotation += glm::vec3(0, 0, 90 * dt);
-		};
-		//Rotate Left
-		auto rotL = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetRotation += glm::vec3(0, 0, -90 * dt);
-		};
-
-		//This moves the spider you see at start 
-		//Spider Movement
-		auto CircleMoving = [](entt::entity e, float dt) {
-			CurrentRegistry().get<TempTransform>(e).SetPosition += glm::vec3(0, 0.005, 0);
-			CurrentRegistry().get<TempTransform>(e).SetRotation += glm::vec3(0, 0, -90 * dt); //not moving as I though
-		}; 
-		//Movement that actually causes it move forever
-		auto& moveSpider = ecs.get_or_assign <UpdateBehaviour>(e2);//e2 is the spider 
-		moveSpider.Function = CircleMoving;
-
-		//This will aplly the movement functions above
-		auto& up = ecs.get_or_assign<UpdateBehaviour>(e1);
-
-		//Basically updates position forever
-		if (moveForward == true) { //Forward Moving 
-			up.Function = moveF;
-		}
-		if (moveBack == true) { //Back Moving 
-			up.Function = moveB;
-		}
-		if (moveLeft == true) { //Left Moving 
-			up.Function = moveL;
-		}
-		if (moveRight == true) { //Right Moving 
-			up.Function = moveR;
-		}
-		if (rotateLeft == true) { //Rotation Left
-			up.Function = rotL;
-		}
-		if (rotateRight == true) { //Rotation Right
-			up.Function = rotR;
-		}
-		//*/
-	}
+	// Test2 gets built on a background thread the first time we need it, see SceneManager::Preload. The bed gets
+	// read in while loading, but it's mesh has to be made back on the main thread
+	{
+		auto bedData = std::make_shared<std::vector<Vertex>>();
+		auto bedEntity = std::make_shared<entt::entity>(entt::null);
+		SceneManager::Get("Test2")->SetLoader(
+			[this, bedData, bedEntity, testMat, testMat2](Scene& scene) {
+				auto& ecs = scene.Registry();
+				std::vector<glm::vec2> bedUvs;
+				std::vector<glm::vec3> bedNormals;
+				OpenObj("Bed.obj", *bedData, bedUvs, bedNormals);
+
+				// A single floor tile with a crowd of spiders crawling around on it
+				entt::entity floor = ecs.create();
+				MeshRenderer& floorRenderer = ecs.assign<MeshRenderer>(floor);
+				floorRenderer.Material = testMat2;
+				floorRenderer.Mesh = myMesh;
+				ecs.assign<TempTransform>(floor);
+				ecs.assign<Anchor>(floor).Position = glm::vec3(-7.5, 7.5, 0);
+
+				// rand isn't safe to use off of the main thread
+				std::mt19937 rng(1234);
+				std::uniform_real_distribution<float> spread(1.0f, 14.0f);
+				std::vector<TempTransform> spiders(200);
+				for (TempTransform& transform : spiders) {
+					transform.SetPosition = glm::vec3(-spread(rng), spread(rng), 0.0f);
+					transform.SetRotation = glm::vec3(0.0f, 0.0f, spread(rng) * 25.0f);
+					transform.SetScale = glm::vec3(1.2f);
+				}
+				SceneManager::Instantiate(ecs, SceneManager::FindPrefab("Spider"), spiders.size(), spiders.data());
+
+				entt::entity light = ecs.create();
+				ecs.assign<TempTransform>(light).SetPosition = glm::vec3(-7.5, 7.5, 3);
+				ecs.assign<PointLight>(light).CastShadows = true;
+
+				*bedEntity = ecs.create();
+				ecs.assign<TempTransform>(*bedEntity).SetPosition = glm::vec3(-2.0, 12.5, 0);
+				ecs.assign<MeshRenderer>(*bedEntity).Material = testMat;
+				ecs.assign<ShadowCaster>(*bedEntity).Static = true;
+			},
+			[bedData, bedEntity](Scene& scene) {
+				scene.Registry().get<MeshRenderer>(*bedEntity).Mesh = std::make_shared<Mesh>(bedData->data(), bedData->size(), nullptr, 0);
+				bedData->clear();
+			});
+	}
 }
 
 void Game::UnloadContent() {
-
+	// Waits on any scenes that are still loading, and frees our meshes while we still have a GL context
+	SceneManager::DestroyScenes();
 }
 
 void Game::InitImGui() {
@@ -533,46 +719,46 @@ void Game::Update(float deltaTime) {
 	glm::vec3 positionC = position - position;
 
 	//Forward
-	if (glfwGetKey(myWindow, GLFW_KEY_W) == GLFW_PRESS) {
+	if (myKeys[GLFW_KEY_W]) {
 		//myModelTransformObj = glm::translate(myModelTransformObj, glm::vec3(0.0f, 0.013, 0.0));
 		myModelTransformObj += glm::translate(myModelTransformObj, glm::vec3(CameraPosX, CameraPosY, 0.0));
 		movement.y += speed * deltaTime;
 		moveForward = true;
 	}
 	//Left
-	if (glfwGetKey(myWindow, GLFW_KEY_A) == GLFW_PRESS) {
+	if (myKeys[GLFW_KEY_A]) {
 		myModelTransformObj = glm::translate(myModelTransformObj, glm::vec3(-0.013, 0.0f, 0.0));
 		movement.x -= speed * deltaTime;
 		moveLeft = true;
 	}
 	//Back
-	if (glfwGetKey(myWindow, GLFW_KEY_S) == GLFW_PRESS) {
+	if (myKeys[GLFW_KEY_S]) {
 		myModelTransformObj = glm::translate(myModelTransformObj, glm::vec3(0.0f, -0.013, 0.0));
 		movement.y -= speed * deltaTime;
 		moveBack = true;
 	}
 	//Right
-	if (glfwGetKey(myWindow, GLFW_KEY_D) == GLFW_PRESS) {
+	if (myKeys[GLFW_KEY_D]) {
 		myModelTransformObj = glm::translate(myModelTransformObj, glm::vec3(0.013, 0.0f, 0.0));
 		movement.x += speed * deltaTime;
 		moveRight = true;
 	}
 	//Used these rotates before, they work fine are a little buggy with camera "follow" (IJKL, old movement, when I&K = forward/Back, J&L rotate, U&O Left/Right)
 	//:Left rotate
-	if (glfwGetKey(myWindow, GLFW_KEY_J) == GLFW_PRESS) {
+	if (myKeys[GLFW_KEY_J]) {
 		myModelTransformObj = glm::rotate(myModelTransformObj, 0.0055f, glm::vec3(0, 0, 1));
 		rotateLeft = true;
 	}
 	//Right rotate
-	if (glfwGetKey(myWindow, GLFW_KEY_L) == GLFW_PRESS) {
+	if (myKeys[GLFW_KEY_L]) {
 		myModelTransformObj = glm::rotate(myModelTransformObj, -0.0055f, glm::vec3(0, 0, 1));
 		rotateRight = true;
 	}
 	myModelTransformObj = myModelTransformObj;
 
-	if (glfwGetKey(myWindow, GLFW_KEY_J) == GLFW_PRESS)
+	if (myKeys[GLFW_KEY_J])
 		rotation.z -= rotSpeed * deltaTime;
-	if (glfwGetKey(myWindow, GLFW_KEY_L) == GLFW_PRESS)
+	if (myKeys[GLFW_KEY_L])
 		rotation.z += rotSpeed * deltaTime;
 
 	// Rotate and move our camera based on input
@@ -585,12 +771,80 @@ void Game::Update(float deltaTime) {
 
 	static float angle = 90;
 
-	auto view = CurrentRegistry().view<UpdateBehaviour>();
-	for (const auto& e : view) {
-		auto& func = CurrentRegistry().get<UpdateBehaviour>(e);
-		if (func.Function) {
-			func.Function(e, deltaTime);
-		}
+	mySystems->Run(CurrentRegistry(), deltaTime);
+}
+
+void Game::__StoreTransforms() {
+	myPreviousCameraPos = myCamera->GetPosition();
+	myPreviousModelTransformObj = myModelTransformObj;
+
+	auto& ecs = CurrentRegistry();
+	// Anything new starts with a history of where it is now, so that it doesn't slide in from somewhere else
+	std::vector<entt::entity> added;
+	auto transforms = ecs.view<TempTransform>();
+	for (const auto& entity : transforms)
+		if (!ecs.has<PreviousTransform>(entity))
+			added.push_back(entity);
+	for (const auto& entity : added)
+		ecs.assign<PreviousTransform>(entity).Value = ecs.get<TempTransform>(entity);
+
+	ecs.view<const TempTransform, PreviousTransform>().each([](const TempTransform& current, PreviousTransform& previous) {
+		previous.Value = current;
+	});
+}
+
+glm::mat4 Game::__GetRenderTransform(entt::entity entity) {
+	auto& ecs = CurrentRegistry();
+	const TempTransform& transform = ecs.get_or_assign<TempTransform>(entity);
+	const PreviousTransform* previous = ecs.try_get<PreviousTransform>(entity);
+	return previous != nullptr ? InterpolateTransform(previous->Value, transform, myInterpolation) : transform.GetWorldTransform();
+}
+
+void Game::__ExtractSnapshot(RenderSnapshot& snapshot) {
+	snapshot.Clear();
+
+	// The camera gets drawn part way between our last two steps as well, we put it back once we've copied it
+	glm::vec3 cameraPos = myCamera->GetPosition();
+	myCamera->SetPosition(glm::mix(myPreviousCameraPos, cameraPos, myInterpolation));
+	snapshot.View = myCamera->GetView();
+	snapshot.Projection = myCamera->Projection;
+	snapshot.CameraPosition = myCamera->GetPosition();
+	myCamera->SetPosition(cameraPos);
+	snapshot.CharacterTransform = InterpolateTransform(myPreviousModelTransformObj, myModelTransformObj, myInterpolation);
+
+	// We'll grab a reference to the ecs to make things easier
+	auto& ecs = CurrentRegistry();
+
+	auto renderers = ecs.view<MeshRenderer>();
+	for (const auto& entity : renderers) {
+		const MeshRenderer& renderer = renderers.get(entity);
+		// Nothing to draw if the mesh is invalid
+		if (renderer.Mesh == nullptr || renderer.Material == nullptr)
+			continue;
+		snapshot.Items.push_back({ renderer.Mesh, renderer.Material, __GetRenderTransform(entity), ecs.has<Occluder>(entity) });
+	}
+	// We sort our draws based on material properties
+	// This will group all of our meshes based on shader first, then material second
+	std::sort(snapshot.Items.begin(), snapshot.Items.end(), [](const RenderSnapshot::DrawItem& lhs, const RenderSnapshot::DrawItem& rhs) {
+		if (lhs.MaterialPtr->GetShader() != rhs.MaterialPtr->GetShader())
+			return lhs.MaterialPtr->GetShader() < rhs.MaterialPtr->GetShader();
+		else
+			return lhs.MaterialPtr < rhs.MaterialPtr;
+		});
+
+	auto lights = ecs.view<PointLight>();
+	for (const auto& entity : lights)
+		snapshot.Lights.push_back({ glm::vec3(__GetRenderTransform(entity)[3]), lights.get(entity) });
+
+	auto casters = ecs.view<ShadowCaster, MeshRenderer>();
+	for (const auto& entity : casters)
+		snapshot.Casters.push_back({ casters.get<MeshRenderer>(entity).Mesh, __GetRenderTransform(entity), casters.get<ShadowCaster>(entity).Static });
+
+	auto occluders = ecs.view<Occluder>();
+	for (const auto& entity : occluders) {
+		const Occluder& occluder = occluders.get(entity);
+		if (occluder.Triangles != nullptr)
+			snapshot.Occluders.push_back({ occluder.Triangles, __GetRenderTransform(entity) });
 	}
 }
 
@@ -599,87 +853,75 @@ void Game::Draw(float deltaTime) {
 	glClearColor(myClearColor.x, myClearColor.y, myClearColor.z, myClearColor.w);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// Everything we draw comes from the snapshot, the scene itself may be busy simulating the next frame
+	const RenderSnapshot& frame = mySnapshots[myFrontSnapshot];
+	glm::mat4 viewProjection = frame.GetViewProjection();
+
 	myShader->Bind();
 	//obj creation
 	//glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-	myShader->SetUniform("a_ModelViewProjection", myCamera->GetViewProjection() * myModelTransformObj);
+	myShader->SetUniform("a_ModelViewProjection", viewProjection * frame.CharacterTransform);
 	MainCharacter->Draw();
 
-	// We'll grab a reference to the ecs to make things easier
-	auto& ecs = CurrentRegistry();
-
-	// We sort our mesh renderers based on material properties
-	// This will group all of our meshes based on shader first, then material second
-	ecs.sort<MeshRenderer>([](const MeshRenderer& lhs, const MeshRenderer& rhs) {
-		if (rhs.Material == nullptr || rhs.Mesh == nullptr)
-			return false;
-		else if (lhs.Material == nullptr || lhs.Mesh == nullptr)
-			return true;
-		else if (lhs.Material->GetShader() != rhs.Material->GetShader())
-			return lhs.Material->GetShader() < rhs.Material->GetShader();
-		else
-			return lhs.Material < rhs.Material;
-		});
-
 	// These will keep track of the current shader and material that we have bound
 	Material::Sptr mat = nullptr;
 	Shader::Sptr boundShader = nullptr;
 
-	// A view will let us iterate over all of our entities that have the given component types
-	auto view = ecs.view<MeshRenderer>();
-
-	for (const auto& entity : view) {
-		// Get our shader
-		const MeshRenderer& renderer = ecs.get<MeshRenderer>(entity);
+	// Draw all of our occluders into the CPU depth buffer before we start submitting anything
+	myOcclusionCuller->BeginFrame(viewProjection);
+	if (myOcclusionCullingEnabled) {
+		for (const RenderSnapshot::OccluderItem& occluder : frame.Occluders)
+			myOcclusionCuller->AddOccluder(*occluder.Triangles, occluder.World);
+		myOcclusionCuller->Rasterize();
+	}
 
-		// Early bail if mesh is invalid
-		if (renderer.Mesh == nullptr || renderer.Material == nullptr)
+	// Bin all of our lights into the clusters that they can reach
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(myWindow, &width, &height);
+	myClusteredLighting->BeginFrame(frame.View, frame.Projection, width, height);
+	myShadowAtlas->BeginFrame();
+	for (const RenderSnapshot::Light& light : frame.Lights) {
+		// Lights that don't fit in the atlas just won't have shadows
+		int shadowIndex = light.Settings.CastShadows ? myShadowAtlas->AddLight(light.Position, light.Settings.Radius) : -1;
+		myClusteredLighting->AddLight(light.Position, light.Settings, shadowIndex);
+	}
+	myClusteredLighting->Build();
+
+	// Update our shadows, the atlas works out which of the static casters actually need to be re-drawn
+	for (const RenderSnapshot::Caster& caster : frame.Casters)
+		myShadowAtlas->AddCaster(caster.MeshPtr, caster.World, caster.Static);
+	// Johnny is still drawn outside of the ECS, but should still cast a shadow
+	myShadowAtlas->AddCaster(MainCharacter, frame.CharacterTransform, false);
+	myShadowAtlas->Render();
+
+	for (const RenderSnapshot::DrawItem& item : frame.Items) {
+		// Skip anything that is hidden behind our occluders (the occluders themselves always get drawn)
+		if (myOcclusionCullingEnabled && !item.IsOccluder &&
+			!myOcclusionCuller->IsVisible(item.MeshPtr->GetBoundsMin(), item.MeshPtr->GetBoundsMax(), item.World))
 			continue;
 		// If our shader has changed, we need to bind it and update our frame-level uniforms
-		if (renderer.Material->GetShader() != boundShader) {
-			boundShader = renderer.Material->GetShader();
+		if (item.MaterialPtr->GetShader() != boundShader) {
+			boundShader = item.MaterialPtr->GetShader();
 			boundShader->Bind();
-			boundShader->SetUniform("a_CameraPos", myCamera->GetPosition());
+			boundShader->SetUniform("a_CameraPos", frame.CameraPosition);
+			myClusteredLighting->Apply(boundShader);
+			myShadowAtlas->Apply(boundShader);
 		}
 		// If our material has changed, we need to apply it to the shader
-		if (renderer.Material != mat) {
-			mat = renderer.Material;
+		if (item.MaterialPtr != mat) {
+			mat = item.MaterialPtr;
 			mat->Apply();
 		}
-		//Older Transforms
-		// We'll need some info about the entities position in the world
-		const TempTransform& transform = ecs.get_or_assign<TempTransform>(entity);
-		// Get the object's transformation
-		glm::mat4 worldTransform = transform.GetWorldTransform();
 		// Our normal matrix is the inverse-transpose of our object's world rotation
-		glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(transform.GetWorldTransform())));
+		glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(item.World)));
 		
 		// Update the MVP using the item's transform
-		mat->GetShader()->SetUniform(
-			"a_ModelViewProjection",
-			myCamera->GetViewProjection() *
-			transform.GetWorldTransform());
-		
-		// Update the model matrix to the item's world transform
-		mat->GetShader()->SetUniform("a_Model", transform.GetWorldTransform());
-		//end of old
-
-		//New Transformations
-		//const Transform& transform = ecs.get_or_assign<Transform>(entity);
-		//glm::mat4 worldTransform = transform.GetWorldTransform();
-		//glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(worldTransform)));
-		//
-		//mat->GetShader()->SetUniform(
-		//	"a_ModelViewProjection",
-		//	myCamera->GetViewProjection() *
-		//	worldTransform);
-		//mat->GetShader()->SetUniform("a_Model", worldTransform);
-		//end of new
-
+		mat->GetShader()->SetUniform("a_ModelViewProjection", viewProjection * item.World);
 		// Update the model matrix to the item's world transform
+		mat->GetShader()->SetUniform("a_Model", item.World);
 		mat->GetShader()->SetUniform("a_NormalMatrix", normalMatrix);
 		// Draw the item
-		renderer.Mesh->Draw();
+		item.MeshPtr->Draw();
 	}
 }
 
@@ -695,11 +937,25 @@ void Game::DrawGui(float deltaTime) {
 	}
 	// Our object's test color
 	ImGui::ColorEdit4("Object Color", &testColor[0]);
+	// Scenes that aren't loaded yet get loaded in the background, and we switch over once they're ready
+	static const char* stateNames[] = { "Unloaded", "Loading", "Ready", "Active" };
 	auto it = SceneManager::Each();
 	for (auto& kvp : it) {
+		ImGui::PushID(kvp.first.c_str());
 		if (ImGui::Button(kvp.first.c_str())) {
 			SceneManager::SetCurrentScene(kvp.first);
 		}
+		ImGui::SameLine();
+		if (ImGui::Button("Preload")) {
+			SceneManager::Preload(kvp.first);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Unload")) {
+			SceneManager::Unload(kvp.first);
+		}
+		ImGui::SameLine();
+		ImGui::Text("%s%s", stateNames[(int)kvp.second->GetState()], SceneManager::GetPendingScene() == kvp.first ? " (switching)" : "");
+		ImGui::PopID();
 	}
 	ImGui::End();
 
@@ -707,6 +963,74 @@ void Game::DrawGui(float deltaTime) {
 	ImGui::Begin("Debug");
 	// Draw a formatted text line
 	ImGui::Text("Time: %f", glfwGetTime());
+	// How many of our texture loads were handed an already loaded texture
+	AssetRegistryStats textureStats = Texture2D::GetCacheStats();
+	ImGui::Text("Textures: %d live, %d hits, %d misses", (int)textureStats.Live, (int)textureStats.Hits, (int)textureStats.Misses);
+
+	if (ImGui::CollapsingHeader("Simulation")) {
+		ImGui::SliderFloat("Tick Rate", &myTickRate, 10.0f, 240.0f);
+		ImGui::SliderInt("Max Steps", &myMaxSteps, 1, 16);
+		ImGui::Text("Steps last frame: %d, interpolation: %.2f", myLastSteps, myInterpolation);
+		// When pipelined, what we see is always one frame behind the simulation
+		ImGui::Checkbox("Pipelined", &myPipelined);
+		ImGui::Text("Simulate: %.3f ms, draw: %.3f ms", mySimMs, myDrawMs);
+	}
+
+	if (ImGui::CollapsingHeader("Systems")) {
+		ImGui::Text("%d stages", mySystems->GetStageCount());
+		for (const SystemScheduler::SystemStats& stats : mySystems->GetStats())
+			ImGui::Text("%s: stage %d, %.3f ms", stats.Name.c_str(), stats.Stage, stats.LastMs);
+	}
+
+	if (ImGui::CollapsingHeader("Scene File")) {
+		static const char* formatNames[] = { "Binary", "JSON" };
+		static const char* paths[] = { "scene.bin", "scene.json" };
+		static int format = 0;
+		ImGui::Combo("Format", &format, formatNames, 2);
+		if (ImGui::Button("Save")) {
+			mySerializer->Save(CurrentRegistry(), paths[format], (SceneSerializer::Format)format);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load")) {
+			// We load into an empty registry, so if the file is bad we still have our old scene
+			entt::registry loaded;
+			if (mySerializer->Load(loaded, paths[format], (SceneSerializer::Format)format)) {
+				CurrentRegistry() = std::move(loaded);
+				// The old entity IDs mean nothing now, and the static shadows were drawn from the old scene
+				myDebugLights.clear();
+				mySpawnedSpiders.clear();
+				myShadowAtlas->Invalidate();
+			}
+		}
+		const SceneSerializer::Stats& sceneStats = mySerializer->GetStats();
+		ImGui::Text("%d entities, %d components in %.3f ms", (int)sceneStats.Entities, (int)sceneStats.Components, sceneStats.LastMs);
+	}
+
+	if (ImGui::CollapsingHeader("Prefabs")) {
+		if (ImGui::Button("Spawn 10000 Spiders")) {
+			// Scattered over the rooms of the level, facing every which way
+			std::vector<TempTransform> transforms(10000);
+			for (TempTransform& transform : transforms) {
+				transform.SetPosition = glm::vec3(-30.0f + (rand() % 3000) / 100.0f, (rand() % 3000) / 100.0f, 0.0f);
+				transform.SetRotation = glm::vec3(0.0f, 0.0f, (float)(rand() % 360));
+				transform.SetScale = glm::vec3(1.2f);
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			std::vector<entt::entity> spiders = SceneManager::Instantiate(SceneManager::FindPrefab("Spider"), transforms.size(), transforms.data());
+			mySpawnMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			mySpawnedSpiders.insert(mySpawnedSpiders.end(), spiders.begin(), spiders.end());
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear Spawned Spiders")) {
+			auto& ecs = CurrentRegistry();
+			for (entt::entity spider : mySpawnedSpiders) {
+				if (ecs.valid(spider))
+					ecs.destroy(spider);
+			}
+			mySpawnedSpiders.clear();
+		}
+		ImGui::Text("%d spawned spiders, last spawn took %.3f ms", (int)mySpawnedSpiders.size(), mySpawnMs);
+	}
 
 	// Start a new ImGui header for our camera settings
 	if (ImGui::CollapsingHeader("Camera Settings")) {
@@ -749,6 +1073,63 @@ void Game::DrawGui(float deltaTime) {
 		}
 	}
 	ImGui::End();
+
+	// Stats and a view of the CPU depth buffer for our occlusion culling
+	ImGui::Begin("Occlusion Culling");
+	ImGui::Checkbox("Enabled", &myOcclusionCullingEnabled);
+	const OcclusionCuller::Stats& stats = myOcclusionCuller->GetStats();
+	ImGui::Text("Occluder Triangles: %d (%d rasterized)", (int)stats.OccluderTriangles, (int)stats.RasterizedTriangles);
+	ImGui::Text("Raster Time: %.3f ms", stats.RasterMs);
+	ImGui::Text("Tested: %d", (int)stats.Tested);
+	ImGui::Text("Frustum Culled: %d", (int)stats.FrustumCulled);
+	ImGui::Text("Occlusion Culled: %d", (int)stats.OcclusionCulled);
+	if (ImGui::CollapsingHeader("Depth Buffer")) {
+		// Our buffer is stored bottom to top, so we flip the V coordinates to draw it the right way up
+		const Texture2D::Sptr& depth = myOcclusionCuller->GetDebugTexture();
+		ImGui::Image((ImTextureID)(intptr_t)depth->GetHandle(),
+			ImVec2((float)myOcclusionCuller->GetWidth(), (float)myOcclusionCuller->GetHeight()), ImVec2(0, 1), ImVec2(1, 0));
+	}
+	ImGui::End();
+
+	// Stats for our clustered lighting, and some buttons to throw a bunch of extra lights into the level
+	ImGui::Begin("Lighting");
+	const ClusteredLighting::Stats& lightStats = myClusteredLighting->GetStats();
+	ImGui::Text("Lights: %d (%d visible)", (int)lightStats.Lights, (int)lightStats.VisibleLights);
+	ImGui::Text("Light Indices: %d", (int)lightStats.Indices);
+	ImGui::Text("Most Lights In A Cluster: %d", (int)lightStats.MaxPerCluster);
+	ImGui::Text("Build Time: %.3f ms", lightStats.BuildMs);
+	const ShadowAtlas::Stats& shadowStats = myShadowAtlas->GetStats();
+	ImGui::Text("Shadowed Lights: %d (%d static re-draws)", (int)shadowStats.Lights, (int)shadowStats.StaticRedraws);
+	ImGui::Text("Shadow Draws: %d static, %d dynamic (%d culled)", (int)shadowStats.StaticDraws, (int)shadowStats.DynamicDraws, (int)shadowStats.CulledCasters);
+	if (ImGui::Button("Re-draw Static Shadows")) {
+		myShadowAtlas->Invalidate();
+	}
+	if (ImGui::Button("Spawn 100 Lights")) {
+		auto& ecs = CurrentRegistry();
+		for (int ix = 0; ix < 100; ix++) {
+			entt::entity light = ecs.create();
+			// Scatter them over the rooms of the level
+			ecs.assign<TempTransform>(light).SetPosition = glm::vec3(
+				-30.0f + (rand() % 3000) / 100.0f,
+				(rand() % 3000) / 100.0f,
+				0.5f + (rand() % 250) / 100.0f);
+			PointLight& settings = ecs.assign<PointLight>(light);
+			settings.Color = glm::vec3((rand() % 100) / 100.0f, (rand() % 100) / 100.0f, (rand() % 100) / 100.0f);
+			settings.Attenuation = 4.0f;
+			settings.Radius = 4.0f;
+			myDebugLights.push_back(light);
+		}
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Clear Spawned Lights")) {
+		auto& ecs = CurrentRegistry();
+		for (entt::entity light : myDebugLights) {
+			if (ecs.valid(light))
+				ecs.destroy(light);
+		}
+		myDebugLights.clear();
+	}
+	ImGui::End();
 }
 
 
@@ -1,6 +1,16 @@
 #pragma once
 #include "Includes.h"
+#include "OcclusionCuller.h"
+#include "ClusteredLighting.h"
+#include "ShadowAtlas.h"
+#include "SystemScheduler.h"
+#include "RenderSnapshot.h"
+#include "SceneSerializer.h"
+#include "entt.hpp"
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <functional>
@@ -35,6 +45,18 @@ protected:
 	void Draw(float deltaTime);
 	void DrawGui(float deltaTime);
 
+	// Keeps where everything was before the next simulation step, so Draw can blend between steps
+	void __StoreTransforms();
+	// Gets an entity's world transform, part way between it's last two simulation steps
+	glm::mat4 __GetRenderTransform(entt::entity entity);
+	// Copies everything Draw needs out of the current scene
+	void __ExtractSnapshot(RenderSnapshot& snapshot);
+	// Runs as many fixed steps as deltaTime covers, then fills in the back snapshot
+	void __Simulate(float deltaTime);
+	// Waits for Run to hand us a frame, and simulates it
+	void __SimulationThread();
+	void __TimedDraw(float deltaTime);
+
 	//From online 
 	//http://www.opengl-tutorial.org/beginners-tutorials/tutorial-7-model-loading/ 
 	bool OpenObj(const char* path, std::vector<Vertex>& out_vertices, std::vector <glm::vec2>& out_uvs, std::vector < glm::vec3 >& out_normals);//for Obj loading with UVs & normals
@@ -99,6 +121,51 @@ protected:
 	Shader::Sptr myShaderLevel;
 	glm::mat4 myModelTransformLevel;
 
+	// Draws the level's walls into a small CPU depth buffer so we can skip anything hidden behind them
+	OcclusionCuller::Sptr myOcclusionCuller;
+	bool myOcclusionCullingEnabled = true;
+
+	// Works out which lights touch which parts of the screen, so our shaders can handle lots of lights
+	ClusteredLighting::Sptr myClusteredLighting;
+	// Cached shadows for our room lights
+	ShadowAtlas::Sptr myShadowAtlas;
+	// Lights that were spawned from the debug menu to stress test the lighting
+	std::vector<entt::entity> myDebugLights;
+	// Spiders that were spawned from the debug menu to stress test our prefabs
+	std::vector<entt::entity> mySpawnedSpiders;
+	float mySpawnMs = 0.0f;
+	// Runs our game logic every update, see LoadContent for the systems
+	SystemScheduler::Sptr mySystems;
+	// Saves and loads our scenes, see LoadContent for the assets and components it knows about
+	SceneSerializer::Sptr mySerializer;
+
+	// Update runs this many times per second, no matter our frame rate
+	float myTickRate = 60.0f;
+	// The most updates we'll run in a single frame, so one slow frame doesn't snowball into more of them
+	int   myMaxSteps = 5;
+	float myAccumulator = 0.0f;
+	// How far we are between our last two updates, from 0 to 1
+	float myInterpolation = 1.0f;
+	int   myLastSteps = 0;
+	glm::vec3 myPreviousCameraPos = glm::vec3(0.0f);
+	glm::mat4 myPreviousModelTransformObj = glm::mat4(1.0f);
+
+	// Draw reads from the front snapshot while __Simulate fills in the other one
+	RenderSnapshot mySnapshots[2];
+	int  myFrontSnapshot = 0;
+	// Whether we simulate the next frame on mySimThread while drawing this one
+	bool myPipelined = true;
+	std::thread mySimThread;
+	std::mutex  mySimLock;
+	std::condition_variable mySimSignal;
+	bool  mySimPending = false;
+	bool  mySimExit = false;
+	float mySimDeltaTime = 0.0f;
+	float mySimMs = 0.0f;
+	float myDrawMs = 0.0f;
+	// The keyboard as of the start of this frame, see Run
+	bool myKeys[GLFW_KEY_LAST + 1] = { false };
+
 	//Main Character
 	Mesh::Sptr MainCharacter;
 	std::vector<Vertex> MainCharData;
@@ -25,8 +25,6 @@ public:
 	void Set(const std::string& name, const glm::vec4& value) { myVec4s[name] = value; }
 	void Set(const std::string& name, const glm::vec3& value) { myVec3s[name] = value; }
 
-	void SetTest(const std::string& name, const glm::vec3& value, const std::string& name2, const glm::vec3& value2) { myVec3s[name] = value; myVec3s[name2] = value2; }
-
 	void Set(const std::string& name, const float& value) { myFloats[name] = value; }
 
 	void Set(const std::string& name, const Texture2D::Sptr& value) { myTextures[name] = value; }
@@ -1,10 +1,20 @@
 #include "Mesh.h"
 #include "Game.h"
+#include <cfloat>
+#include <vector>
 
 Mesh::Mesh(Vertex* vertices, size_t numVerts, uint32_t* indices, size_t numIndices) {
 	myIndexCount = numIndices;
 	myVertexCount = numVerts;
 
+	// Calculate our bounds while we still have the vertices on the CPU
+	myBoundsMin = glm::vec3(numVerts > 0 ? FLT_MAX : 0.0f);
+	myBoundsMax = glm::vec3(numVerts > 0 ? -FLT_MAX : 0.0f);
+	for (size_t ix = 0; ix < numVerts; ix++) {
+		myBoundsMin = glm::min(myBoundsMin, vertices[ix].Position);
+		myBoundsMax = glm::max(myBoundsMax, vertices[ix].Position);
+	}
+
 	// Create and bind our vertex array
 	glCreateVertexArrays(1, &myVao);
 	glBindVertexArray(myVao);
@@ -48,6 +58,21 @@ Mesh::Mesh(Vertex* vertices, size_t numVerts, uint32_t* indices, size_t numIndic
 	// Unbind our VAO
 	glBindVertexArray(0);
 
+	// Depth only passes don't need anything but the position, so we keep a separate stream with just that,
+	// which means we only have to pull in 12 bytes per vertex instead of the whole vertex
+	std::vector<glm::vec3> positions(numVerts);
+	for (size_t ix = 0; ix < numVerts; ix++)
+		positions[ix] = vertices[ix].Position;
+	glCreateBuffers(1, &myPositionBuffer);
+	glNamedBufferData(myPositionBuffer, numVerts * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+
+	glCreateVertexArrays(1, &myPositionVao);
+	glVertexArrayVertexBuffer(myPositionVao, 0, myPositionBuffer, 0, sizeof(glm::vec3));
+	glEnableVertexArrayAttrib(myPositionVao, 0);
+	glVertexArrayAttribFormat(myPositionVao, 0, 3, GL_FLOAT, false, 0);
+	glVertexArrayAttribBinding(myPositionVao, 0, 0);
+	glVertexArrayElementBuffer(myPositionVao, myBuffers[1]);
+
 	//MeshPosition(glm::vec3(0));
 }
 
@@ -56,6 +81,8 @@ Mesh::~Mesh() {
 	glDeleteBuffers(2, myBuffers);
 	// Clean up our VAO
 	glDeleteVertexArrays(1, &myVao);
+	glDeleteBuffers(1, &myPositionBuffer);
+	glDeleteVertexArrays(1, &myPositionVao);
 }
 
 void Mesh::Draw() {
@@ -68,4 +95,13 @@ void Mesh::Draw() {
 		// Draw all of our vertices as triangles, our indexes are unsigned ints (uint32_t)
 		glDrawArrays(GL_TRIANGLES, 0, myVertexCount);
 	}
+}
+
+void Mesh::DrawPositions() {
+	glBindVertexArray(myPositionVao);
+	if (myIndexCount > 0) {
+		glDrawElements(GL_TRIANGLES, myIndexCount, GL_UNSIGNED_INT, nullptr);
+	} else {
+		glDrawArrays(GL_TRIANGLES, 0, myVertexCount);
+	}
 }
\ No newline at end of file
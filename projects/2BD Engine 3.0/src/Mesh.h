@@ -23,6 +23,12 @@ public:
 
 	// Draws this mesh
 	void Draw();
+	// Draws this mesh using only it's positions, for depth only passes like shadows
+	void DrawPositions();
+
+	// Gets the corners of the axis aligned box that encloses this mesh, in the mesh's local space
+	const glm::vec3& GetBoundsMin() const { return myBoundsMin; }
+	const glm::vec3& GetBoundsMax() const { return myBoundsMax; }
 
 private:
 	// Our GL handle for the Vertex Array Object
@@ -31,6 +37,11 @@ private:
 	GLuint myBuffers[2];
 	// The number of vertices and indices in this mesh
 	size_t myVertexCount, myIndexCount;
+	// A tightly packed copy of just our positions, and the VAO that uses it (shares our index buffer)
+	GLuint myPositionVao;
+	GLuint myPositionBuffer;
+	// The local space bounds of our vertices, used for culling
+	glm::vec3 myBoundsMin, myBoundsMax;
 
 	//Test for position
 	glm::vec3 MeshPosition;
@@ -0,0 +1,317 @@
+#include "OcclusionCuller.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+// Anything closer to the camera than this is in front of our near plane, we throw out triangles that cross
+// it rather than clipping them, which only ever makes the occluders smaller (so it is always safe)
+static const float MinW = 0.01f;
+// How much closer we pretend a tested box is, so that rounding in the rasterizer never hides something
+// sitting right up against a wall
+static const float DepthBias = 1.001f;
+
+OcclusionCuller::OcclusionCuller(int width, int height) {
+	myTilesX = (width + TileWidth - 1) / TileWidth;
+	myTilesY = (height + TileHeight - 1) / TileHeight;
+	myWidth = myTilesX * TileWidth;
+	myHeight = myTilesY * TileHeight;
+
+	myDepth.resize((size_t)myWidth * myHeight, 0.0f);
+	myTileMin.resize((size_t)myTilesX * myTilesY, 0.0f);
+	myBins.resize((size_t)myTilesX * myTilesY);
+	myViewProjection = glm::mat4(1.0f);
+}
+
+std::shared_ptr<std::vector<glm::vec3>> OcclusionCuller::BuildOccluder(const Vertex* vertices, size_t count, float minArea) {
+	std::shared_ptr<std::vector<glm::vec3>> result = std::make_shared<std::vector<glm::vec3>>();
+	result->reserve(count);
+	for (size_t ix = 0; ix + 2 < count; ix += 3) {
+		const glm::vec3& a = vertices[ix].Position;
+		const glm::vec3& b = vertices[ix + 1].Position;
+		const glm::vec3& c = vertices[ix + 2].Position;
+		// Half the length of the cross product is the area of the triangle
+		if (glm::length(glm::cross(b - a, c - a)) * 0.5f >= minArea) {
+			result->push_back(a);
+			result->push_back(b);
+			result->push_back(c);
+		}
+	}
+	result->shrink_to_fit();
+	return result;
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection) {
+	myViewProjection = viewProjection;
+	myOccluders.clear();
+	myStats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& triangles, const glm::mat4& world) {
+	OccluderInstance instance;
+	instance.Triangles = &triangles;
+	instance.ModelViewProjection = myViewProjection * world;
+	instance.FirstTriangle = myStats.OccluderTriangles;
+	myOccluders.push_back(instance);
+	myStats.OccluderTriangles += triangles.size() / 3;
+}
+
+void OcclusionCuller::__SetupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, ScreenTriangle& result) const {
+	result.Valid = false;
+	if (a.w < MinW || b.w < MinW || c.w < MinW)
+		return;
+
+	// Project to screen space, and store 1/w in the z component
+	glm::vec3 p[3];
+	const glm::vec4* clip[3] = { &a, &b, &c };
+	for (int ix = 0; ix < 3; ix++) {
+		float invW = 1.0f / clip[ix]->w;
+		p[ix] = glm::vec3(
+			(clip[ix]->x * invW * 0.5f + 0.5f) * myWidth,
+			(clip[ix]->y * invW * 0.5f + 0.5f) * myHeight,
+			invW);
+	}
+
+	// Our occluders are double sided, so we just flip any clockwise triangles around
+	float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+	if (std::abs(area) < 1e-6f)
+		return;
+	if (area < 0.0f) {
+		std::swap(p[1], p[2]);
+		area = -area;
+	}
+
+	// Bounding box of the pixels that the triangle could cover
+	glm::vec2 lo = glm::vec2(glm::min(p[0], glm::min(p[1], p[2])));
+	glm::vec2 hi = glm::vec2(glm::max(p[0], glm::max(p[1], p[2])));
+	result.Bounds = glm::ivec4(
+		std::max(0, (int)std::floor(lo.x)),
+		std::max(0, (int)std::floor(lo.y)),
+		std::min(myWidth - 1, (int)std::floor(hi.x)),
+		std::min(myHeight - 1, (int)std::floor(hi.y)));
+	if (result.Bounds.x > result.Bounds.z || result.Bounds.y > result.Bounds.w)
+		return;
+
+	// Edge functions, these are the 2D cross product of the edge and the vector from the edge's start to the point
+	auto edge = [](const glm::vec3& p0, const glm::vec3& p1) {
+		return glm::vec3(p0.y - p1.y, p1.x - p0.x, p0.x * p1.y - p1.x * p0.y);
+	};
+	result.EdgeA = edge(p[0], p[1]);
+	result.EdgeB = edge(p[1], p[2]);
+	result.EdgeC = edge(p[2], p[0]);
+
+	// Solve for the plane that 1/w sits on
+	float dz1 = p[1].z - p[0].z;
+	float dz2 = p[2].z - p[0].z;
+	result.Depth.x = (dz1 * (p[2].y - p[0].y) - dz2 * (p[1].y - p[0].y)) / area;
+	result.Depth.y = (dz2 * (p[1].x - p[0].x) - dz1 * (p[2].x - p[0].x)) / area;
+	result.Depth.z = p[0].z - result.Depth.x * p[0].x - result.Depth.y * p[0].y;
+	result.Valid = true;
+}
+
+void OcclusionCuller::Rasterize() {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Transform and set up all of our triangles in parallel
+	myTriangles.resize(myStats.OccluderTriangles);
+	for (const OccluderInstance& occluder : myOccluders) {
+		const std::vector<glm::vec3>& verts = *occluder.Triangles;
+		Parallel::For(verts.size() / 3, [&](size_t begin, size_t end) {
+			for (size_t ix = begin; ix < end; ix++) {
+				__SetupTriangle(
+					occluder.ModelViewProjection * glm::vec4(verts[ix * 3 + 0], 1.0f),
+					occluder.ModelViewProjection * glm::vec4(verts[ix * 3 + 1], 1.0f),
+					occluder.ModelViewProjection * glm::vec4(verts[ix * 3 + 2], 1.0f),
+					myTriangles[occluder.FirstTriangle + ix]);
+			}
+		}, 256);
+	}
+
+	// Bin the triangles into every tile that they touch. This is cheap compared to the rasterization,
+	// and doing it in order keeps the bins deterministic
+	for (auto& bin : myBins)
+		bin.clear();
+	for (size_t ix = 0; ix < myTriangles.size(); ix++) {
+		const ScreenTriangle& tri = myTriangles[ix];
+		if (!tri.Valid)
+			continue;
+		myStats.RasterizedTriangles++;
+		for (int ty = tri.Bounds.y / TileHeight; ty <= tri.Bounds.w / TileHeight; ty++)
+			for (int tx = tri.Bounds.x / TileWidth; tx <= tri.Bounds.z / TileWidth; tx++)
+				myBins[(size_t)ty * myTilesX + tx].push_back((uint32_t)ix);
+	}
+
+	// Every tile owns its own pixels, so we can rasterize them all at once without any locking
+	Parallel::For(myBins.size(), [&](size_t begin, size_t end) {
+		for (size_t tile = begin; tile < end; tile++)
+			__RasterizeTile((int)tile);
+	});
+
+	auto end = std::chrono::high_resolution_clock::now();
+	myStats.RasterMs = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void OcclusionCuller::__RasterizeTile(int tile) {
+	int x0 = (tile % myTilesX) * TileWidth;
+	int y0 = (tile / myTilesX) * TileHeight;
+	int x1 = x0 + TileWidth - 1;
+	int y1 = y0 + TileHeight - 1;
+
+	// Clear the tile
+	for (int y = y0; y <= y1; y++)
+		std::fill_n(&myDepth[(size_t)y * myWidth + x0], TileWidth, 0.0f);
+
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (uint32_t index : myBins[tile]) {
+		const ScreenTriangle& tri = myTriangles[index];
+
+		// Only walk the part of the triangle that is inside this tile, starting on a multiple of 4 pixels
+		int minX = std::max(x0, tri.Bounds.x) & ~3;
+		int maxX = std::min(x1, tri.Bounds.z);
+		int minY = std::max(y0, tri.Bounds.y);
+		int maxY = std::min(y1, tri.Bounds.w);
+
+		const __m128 stepA = _mm_set1_ps(tri.EdgeA.x * 4.0f);
+		const __m128 stepB = _mm_set1_ps(tri.EdgeB.x * 4.0f);
+		const __m128 stepC = _mm_set1_ps(tri.EdgeC.x * 4.0f);
+		const __m128 stepZ = _mm_set1_ps(tri.Depth.x * 4.0f);
+
+		for (int y = minY; y <= maxY; y++) {
+			float py = y + 0.5f;
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)minX), offsets);
+
+			// Evaluate our edge functions and depth plane for the first 4 pixels of the row, then step along
+			__m128 eA = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.EdgeA.x), px), _mm_set1_ps(tri.EdgeA.y * py + tri.EdgeA.z));
+			__m128 eB = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.EdgeB.x), px), _mm_set1_ps(tri.EdgeB.y * py + tri.EdgeB.z));
+			__m128 eC = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.EdgeC.x), px), _mm_set1_ps(tri.EdgeC.y * py + tri.EdgeC.z));
+			__m128 z  = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.Depth.x), px), _mm_set1_ps(tri.Depth.y * py + tri.Depth.z));
+
+			float* row = &myDepth[(size_t)y * myWidth];
+			for (int x = minX; x <= maxX; x += 4) {
+				__m128 mask = _mm_and_ps(_mm_cmpge_ps(eA, zero), _mm_and_ps(_mm_cmpge_ps(eB, zero), _mm_cmpge_ps(eC, zero)));
+				if (_mm_movemask_ps(mask) != 0) {
+					__m128 old = _mm_loadu_ps(row + x);
+					__m128 closest = _mm_max_ps(old, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(mask, closest), _mm_andnot_ps(mask, old)));
+				}
+				eA = _mm_add_ps(eA, stepA);
+				eB = _mm_add_ps(eB, stepB);
+				eC = _mm_add_ps(eC, stepC);
+				z  = _mm_add_ps(z, stepZ);
+			}
+		}
+	}
+
+	// Find the farthest depth in the tile, any box that is closer than this can skip the per pixel test
+	__m128 tileMin = _mm_set1_ps(FLT_MAX);
+	for (int y = y0; y <= y1; y++) {
+		const float* row = &myDepth[(size_t)y * myWidth];
+		for (int x = x0; x <= x1; x += 4)
+			tileMin = _mm_min_ps(tileMin, _mm_loadu_ps(row + x));
+	}
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, tileMin);
+	myTileMin[tile] = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+}
+
+bool OcclusionCuller::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) {
+	myStats.Tested++;
+	glm::mat4 mvp = myViewProjection * world;
+
+	glm::vec2 lo = glm::vec2(FLT_MAX);
+	glm::vec2 hi = glm::vec2(-FLT_MAX);
+	float nearest = 0.0f;
+	// Track which side of each frustum plane all of the corners are on
+	int outside[5] = { 0, 0, 0, 0, 0 };
+	for (int ix = 0; ix < 8; ix++) {
+		glm::vec3 corner(
+			(ix & 1) ? boundsMax.x : boundsMin.x,
+			(ix & 2) ? boundsMax.y : boundsMin.y,
+			(ix & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+		// If the box crosses the near plane, the camera is basically inside of it
+		if (clip.w < MinW)
+			return true;
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z > clip.w;
+
+		float invW = 1.0f / clip.w;
+		glm::vec2 screen = (glm::vec2(clip) * invW * 0.5f + 0.5f) * glm::vec2(myWidth, myHeight);
+		lo = glm::min(lo, screen);
+		hi = glm::max(hi, screen);
+		nearest = std::max(nearest, invW);
+	}
+	for (int plane = 0; plane < 5; plane++) {
+		if (outside[plane] == 8) {
+			myStats.FrustumCulled++;
+			return false;
+		}
+	}
+
+	int minX = std::max(0, (int)std::floor(lo.x));
+	int minY = std::max(0, (int)std::floor(lo.y));
+	int maxX = std::min(myWidth - 1, (int)std::floor(hi.x));
+	int maxY = std::min(myHeight - 1, (int)std::floor(hi.y));
+	if (minX > maxX || minY > maxY) {
+		myStats.FrustumCulled++;
+		return false;
+	}
+
+	nearest *= DepthBias;
+	const __m128 boxDepth = _mm_set1_ps(nearest);
+	for (int ty = minY / TileHeight; ty <= maxY / TileHeight; ty++) {
+		for (int tx = minX / TileWidth; tx <= maxX / TileWidth; tx++) {
+			// Every pixel in this tile is in front of the box
+			if (myTileMin[(size_t)ty * myTilesX + tx] > nearest)
+				continue;
+
+			// Otherwise look for any pixel that is farther away than the closest point of the box. Growing
+			// the range out to a multiple of 4 can only ever make us more conservative
+			int x0 = std::max(minX, tx * TileWidth) & ~3;
+			int x1 = std::min(maxX, tx * TileWidth + TileWidth - 1);
+			int y0 = std::max(minY, ty * TileHeight);
+			int y1 = std::min(maxY, ty * TileHeight + TileHeight - 1);
+			for (int y = y0; y <= y1; y++) {
+				const float* row = &myDepth[(size_t)y * myWidth];
+				for (int x = x0; x <= x1; x += 4) {
+					if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+						return true;
+				}
+			}
+		}
+	}
+
+	myStats.OcclusionCulled++;
+	return false;
+}
+
+const Texture2D::Sptr& OcclusionCuller::GetDebugTexture() {
+	if (myDebugTexture == nullptr) {
+		Texture2DDescription desc;
+		desc.Width = myWidth;
+		desc.Height = myHeight;
+		desc.Format = InternalFormat::R8;
+		myDebugTexture = std::make_shared<Texture2D>(desc);
+		glTextureParameteri(myDebugTexture->GetHandle(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(myDebugTexture->GetHandle(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		myDebugPixels.resize(myDepth.size());
+	}
+
+	// Normalize against the closest pixel, so that the buffer is readable no matter how far away things are
+	float closest = *std::max_element(myDepth.begin(), myDepth.end());
+	float scale = closest > 0.0f ? 255.0f / closest : 0.0f;
+	for (size_t ix = 0; ix < myDepth.size(); ix++)
+		myDebugPixels[ix] = (uint8_t)(myDepth[ix] * scale);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	myDebugTexture->LoadData(myDebugPixels.data(), myWidth, myHeight, PixelFormat::Red, PixelType::UByte);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return myDebugTexture;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <GLM/glm.hpp>
+#include <memory>
+#include <vector>
+#include "Mesh.h"
+#include "Texture2D.h"
+
+/*
+	Marks an entity as something that hides other objects, like the walls of a level. The triangles
+	are stored in the entity's local space, with every 3 positions making up a triangle. These should be
+	simplified versions of the real geometry (large, solid faces only) since we rasterize them every frame
+*/
+struct Occluder {
+	std::shared_ptr<std::vector<glm::vec3>> Triangles;
+};
+
+/*
+	A small software rasterizer that draws occluders into a low resolution depth buffer on the CPU, so
+	that we can skip submitting objects that are hidden behind them. The buffer is split into tiles, which
+	are rasterized in parallel using SSE to evaluate 4 pixels at a time.
+
+	Rather than the usual GL depth we store 1/w in the buffer, since it interpolates linearly across the
+	screen and does not care about what near and far planes the projection uses. Larger values are closer
+	to the camera, and 0 means there is nothing in that pixel
+*/
+class OcclusionCuller {
+public:
+	typedef std::shared_ptr<OcclusionCuller> Sptr;
+
+	// The size of the tiles that we bin and rasterize triangles in, in pixels
+	static const int TileWidth = 32;
+	static const int TileHeight = 16;
+
+	struct Stats {
+		size_t OccluderTriangles = 0; // How many triangles were submitted this frame
+		size_t RasterizedTriangles = 0; // How many of those survived clipping and made it to the tiles
+		size_t Tested = 0; // How many bounding boxes have been tested this frame
+		size_t FrustumCulled = 0; // How many of the tested boxes were completely off screen
+		size_t OcclusionCulled = 0; // How many of the tested boxes were hidden behind occluders
+		float  RasterMs = 0.0f; // How long it took to transform, bin, and rasterize the occluders
+	};
+
+	/*
+		Creates a new occlusion culler
+		@param width  The width of the depth buffer, will be rounded up to a multiple of TileWidth
+		@param height The height of the depth buffer, will be rounded up to a multiple of TileHeight
+	*/
+	OcclusionCuller(int width = 256, int height = 256);
+	~OcclusionCuller() = default;
+
+	/*
+		Builds a simplified occluder out of some mesh data, dropping any triangles that are too small
+		to be worth rasterizing
+		@param vertices The vertices to build from, every 3 vertices make up a triangle
+		@param count    The number of vertices
+		@param minArea  The smallest area (in local units) that a triangle can have and still be kept
+	*/
+	static std::shared_ptr<std::vector<glm::vec3>> BuildOccluder(const Vertex* vertices, size_t count, float minArea = 0.05f);
+
+	/*
+		Clears the depth buffer and our stats for a new frame
+		@param viewProjection The camera's view projection matrix for this frame
+	*/
+	void BeginFrame(const glm::mat4& viewProjection);
+	/*
+		Submits an occluder to be drawn, must be called between BeginFrame and Rasterize
+		@param triangles The local space triangles of the occluder
+		@param world     The occluder's world transform
+	*/
+	void AddOccluder(const std::vector<glm::vec3>& triangles, const glm::mat4& world);
+	/*
+		Transforms, bins, and rasterizes all of the occluders that were added this frame
+	*/
+	void Rasterize();
+
+	/*
+		Tests whether any part of a bounding box may be visible, after the frame has been rasterized
+		@param boundsMin The minimum corner of the box, in local space
+		@param boundsMax The maximum corner of the box, in local space
+		@param world     The world transform of the object the box belongs to
+		@returns False if the box is off screen or completely hidden behind the occluders
+	*/
+	bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world);
+
+	const Stats& GetStats() const { return myStats; }
+	int GetWidth() const { return myWidth; }
+	int GetHeight() const { return myHeight; }
+
+	/*
+		Copies the depth buffer into a texture so that we can look at it in ImGui. Note that the texture
+		is stored bottom to top, like all OpenGL textures
+	*/
+	const Texture2D::Sptr& GetDebugTexture();
+
+private:
+	// A triangle after being projected to the screen, stored as the plane equations that we need to rasterize it
+	struct ScreenTriangle {
+		glm::vec3 EdgeA, EdgeB, EdgeC; // Edge functions (a*x + b*y + c), positive on the inside
+		glm::vec3 Depth; // Plane equation for 1/w
+		glm::ivec4 Bounds; // Min x, min y, max x, max y (inclusive), clamped to the screen
+		bool Valid;
+	};
+
+	// An occluder that has been submitted for this frame
+	struct OccluderInstance {
+		const std::vector<glm::vec3>* Triangles;
+		glm::mat4 ModelViewProjection;
+		size_t FirstTriangle; // Where this occluder's triangles start in myTriangles
+	};
+
+	void __SetupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, ScreenTriangle& result) const;
+	void __RasterizeTile(int tile);
+
+	int myWidth, myHeight;
+	int myTilesX, myTilesY;
+
+	glm::mat4 myViewProjection;
+
+	std::vector<OccluderInstance> myOccluders;
+	std::vector<ScreenTriangle> myTriangles;
+	// The indices of the triangles that overlap each tile
+	std::vector<std::vector<uint32_t>> myBins;
+
+	// Our depth buffer, stored row by row from the bottom of the screen
+	std::vector<float> myDepth;
+	// The farthest (smallest) 1/w in each tile, lets us skip most per pixel tests
+	std::vector<float> myTileMin;
+
+	Texture2D::Sptr myDebugTexture;
+	std::vector<uint8_t> myDebugPixels;
+
+	Stats myStats;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <GLM/glm.hpp>
+#include <memory>
+#include <vector>
+#include "Mesh.h"
+#include "Material.h"
+#include "ClusteredLighting.h"
+
+/*
+	Everything that Draw needs to know about a frame, copied out of the scene once the simulation is done with it.
+	Draw only ever reads from one of these, never from the registry, so the simulation is free to work on the next
+	frame while we are still drawing this one.
+
+	We keep two of these around (see Game::Run), the simulation fills in one while Draw reads from the other, and
+	they get swapped once both are done. The meshes and materials are shared pointers, so anything that gets removed
+	from the scene stays alive until we're done drawing it
+*/
+struct RenderSnapshot {
+	struct DrawItem {
+		Mesh::Sptr     MeshPtr;
+		Material::Sptr MaterialPtr;
+		glm::mat4      World;
+		// Occluders never get culled, since they are what is doing the culling
+		bool           IsOccluder;
+	};
+	struct Light {
+		glm::vec3  Position;
+		PointLight Settings;
+	};
+	struct Caster {
+		Mesh::Sptr MeshPtr;
+		glm::mat4  World;
+		bool       Static;
+	};
+	struct OccluderItem {
+		std::shared_ptr<std::vector<glm::vec3>> Triangles;
+		glm::mat4 World;
+	};
+
+	glm::mat4 View = glm::mat4(1.0f);
+	glm::mat4 Projection = glm::mat4(1.0f);
+	glm::vec3 CameraPosition = glm::vec3(0.0f);
+	// Johnny is still drawn outside of the ECS
+	glm::mat4 CharacterTransform = glm::mat4(1.0f);
+
+	// Sorted by shader and then material, so that we switch as little state as we can while drawing
+	std::vector<DrawItem>     Items;
+	std::vector<Light>        Lights;
+	std::vector<Caster>       Casters;
+	std::vector<OccluderItem> Occluders;
+
+	glm::mat4 GetViewProjection() const { return Projection * View; }
+
+	// Empties the snapshot, but keeps the memory around for next time
+	void Clear() {
+		Items.clear();
+		Lights.clear();
+		Casters.clear();
+		Occluders.clear();
+	}
+};
@@ -1,21 +1,69 @@
 #pragma once
 #include "entt.hpp"
+#include <functional>
+#include <string>
+
+/*
+	Where a scene is in it's life, see SceneManager
+*/
+enum class SceneState {
+	Unloaded, // Nothing is in the registry
+	Loading,  // OnLoad is running on a background thread, nothing else should touch the registry
+	Ready,    // Loaded and ready to be switched to
+	Active    // The current scene
+};
 
 class Scene {
 public:
+	typedef std::function<void(Scene&)> LoadFunc;
+
 	Scene() = default;
 	virtual ~Scene() = default;
 
 	virtual void OnOpen() {};
 	virtual void OnClose() {};
 
+	/*
+		Fills in the scene's registry. This runs on a background thread, so it can't touch OpenGL or any other scene
+	*/
+	virtual void OnLoad() { if (myLoad) myLoad(*this); }
+	/*
+		Runs on the main thread once OnLoad is done, for anything that needs OpenGL (like turning loaded vertex data
+		into meshes). This should be quick, since it holds up the frame
+	*/
+	virtual void OnLoadComplete() { if (myLoadComplete) myLoadComplete(*this); }
+	/*
+		Throws away everything in the scene
+	*/
+	virtual void OnUnload() { myRegistry = entt::registry(); }
+
+	/*
+		Sets up the functions that OnLoad and OnLoadComplete call. Scenes with a loader start out unloaded, and get
+		built the first time they are preloaded or switched to. Scenes without one are built by hand, and can't be
+		unloaded
+	*/
+	void SetLoader(const LoadFunc& load, const LoadFunc& loadComplete = nullptr) {
+		myLoad = load;
+		myLoadComplete = loadComplete;
+		if (myState == SceneState::Ready && load)
+			myState = SceneState::Unloaded;
+	}
+	bool HasLoader() const { return (bool)myLoad; }
+
+	SceneState GetState() const { return myState; }
+
 	entt::registry& Registry() { return myRegistry; }
 
 	const std::string& GetName() const { return myName; }
 	void SetName(const std::string& name) { myName = name; }
 
 private:
+	friend class SceneManager;
+
 	entt::registry myRegistry;
 	std::string myName;
+	// Only ever changed by the SceneManager, from the main thread
+	SceneState myState = SceneState::Ready;
+	LoadFunc myLoad, myLoadComplete;
 
 };
\ No newline at end of file
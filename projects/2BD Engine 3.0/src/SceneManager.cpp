@@ -4,6 +4,10 @@
 Scene* SceneManager::_CurrentScene = nullptr;
 std::unordered_map<std::string, Scene*> SceneManager::_KnownScenes;
 entt::registry SceneManager::Prefabs;
+std::unordered_map<std::string, std::future<void>> SceneManager::_Loading;
+std::string SceneManager::_PendingScene;
+std::vector<SceneManager::PrefabPool> SceneManager::_PrefabPools;
+std::unordered_map<std::string, entt::entity> SceneManager::_PrefabNames;
 
 Scene* SceneManager::Current() {
 	return _CurrentScene;
@@ -24,20 +28,101 @@ Scene* SceneManager::Get(const std::string& name) {
 		return _KnownScenes[name];
 }
 
+void SceneManager::__Activate(Scene* scene) {
+	if (_CurrentScene != scene) {
+		if (_CurrentScene != nullptr) {
+			_CurrentScene->OnClose();
+			_CurrentScene->myState = SceneState::Ready;
+		}
+		_CurrentScene = scene;
+		_CurrentScene->myState = SceneState::Active;
+		_CurrentScene->OnOpen();
+	}
+}
+
 bool SceneManager::SetCurrentScene(const std::string& name) {
 	auto it = _KnownScenes.find(name);
 	if (it != _KnownScenes.end()) {
-		if (_CurrentScene != it->second) {
-			if (_CurrentScene != nullptr)
-				_CurrentScene->OnClose();
-			_CurrentScene = it->second;
-			_CurrentScene->OnOpen();
+		if (it->second->myState == SceneState::Ready || it->second->myState == SceneState::Active) {
+			__Activate(it->second);
+			_PendingScene.clear();
+		}
+		else {
+			// We keep showing the current scene until this one is ready, see Update
+			Preload(name);
+			_PendingScene = name;
 		}
 		return true;
 	}
 	return false;
 }
 
+bool SceneManager::Preload(const std::string& name) {
+	auto it = _KnownScenes.find(name);
+	if (it == _KnownScenes.end())
+		return false;
+	Scene* scene = it->second;
+	if (scene->myState == SceneState::Unloaded) {
+		scene->myState = SceneState::Loading;
+		// Loads get their own thread rather than going through Parallel, so that a long load never ends up running
+		// on a thread that is waiting on a Parallel::For during a frame
+		_Loading[name] = std::async(std::launch::async, [scene]() { scene->OnLoad(); });
+	}
+	return true;
+}
+
+bool SceneManager::Unload(const std::string& name) {
+	auto it = _KnownScenes.find(name);
+	if (it == _KnownScenes.end())
+		return false;
+	Scene* scene = it->second;
+	if (scene->myState != SceneState::Ready || !scene->HasLoader())
+		return false;
+	scene->OnUnload();
+	scene->myState = SceneState::Unloaded;
+	return true;
+}
+
+void SceneManager::Update() {
+	for (auto it = _Loading.begin(); it != _Loading.end();) {
+		if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			it++;
+			continue;
+		}
+		Scene* scene = _KnownScenes[it->first];
+		bool failed = false;
+		std::string reason;
+		try {
+			// Re-throws anything that went wrong while loading
+			it->second.get();
+			scene->OnLoadComplete();
+			scene->myState = SceneState::Ready;
+		}
+		catch (const std::exception& e) {
+			failed = true;
+			reason = e.what();
+		}
+		// Loaders are user code, so they could throw just about anything
+		catch (...) {
+			failed = true;
+			reason = "Unknown error";
+		}
+		if (failed) {
+			LOG_WARN("Failed to load scene \"{}\": {}", it->first, reason);
+			scene->OnUnload();
+			scene->myState = SceneState::Unloaded;
+			if (_PendingScene == it->first)
+				_PendingScene.clear();
+		}
+		it = _Loading.erase(it);
+	}
+
+	if (!_PendingScene.empty() && _KnownScenes[_PendingScene]->myState == SceneState::Ready) {
+		__Activate(_KnownScenes[_PendingScene]);
+		_PendingScene.clear();
+	}
+}
+
 void SceneManager::RegisterScene(const std::string& name, Scene* scene) {
 	LOG_ASSERT(!HasScene(name), "A scene with that name already exists!");
 	
@@ -47,11 +132,32 @@ void SceneManager::RegisterScene(const std::string& name, Scene* scene) {
 	_KnownScenes[name] = scene;
 }
 
+entt::entity SceneManager::CreatePrefab(const std::string& name) {
+	LOG_ASSERT(_PrefabNames.find(name) == _PrefabNames.end(), "A prefab with that name already exists!");
+
+	entt::entity prefab = Prefabs.create();
+	_PrefabNames[name] = prefab;
+	return prefab;
+}
+
+entt::entity SceneManager::FindPrefab(const std::string& name) {
+	auto it = _PrefabNames.find(name);
+	if (it != _PrefabNames.end())
+		return it->second;
+	return entt::null;
+}
+
 SceneManager::SceneIterator SceneManager::Each() {
 	return SceneIterator();
 }
 
 void SceneManager::DestroyScenes() {
+	// Scenes that are still loading are using their registries, so we have to let them finish first
+	for (auto& kvp : _Loading)
+		kvp.second.wait();
+	_Loading.clear();
+	_PendingScene.clear();
+
 	for (auto& kvp : _KnownScenes) {
 		delete kvp.second;
 	}
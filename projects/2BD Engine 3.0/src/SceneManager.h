@@ -1,7 +1,12 @@
 #pragma once
 
 #include "Scene.h"
+#include <Logging.h>
+#include <future>
+#include <typeindex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 class SceneManager {
 public:
@@ -18,9 +23,33 @@ public:
 
 	static Scene* Current();
 
+	/*
+		Switches to a scene. If the scene isn't ready yet, it gets preloaded and we switch to it in Update once it
+		is, until then the current scene stays active
+		@returns True if the scene exists
+	*/
 	static bool SetCurrentScene(const std::string& name);
 	static bool HasScene(const std::string& name);
 
+	/*
+		Starts loading a scene on a background thread, does nothing if the scene is already loading or loaded
+		@returns True if the scene exists
+	*/
+	static bool Preload(const std::string& name);
+	/*
+		Throws away everything in a scene to free up it's memory, it will be loaded again the next time it's needed.
+		The current scene, scenes that are still loading, and scenes without a loader can't be unloaded
+		@returns True if the scene was unloaded
+	*/
+	static bool Unload(const std::string& name);
+	/*
+		Finishes off any scenes that are done loading, and does any scene switch that was waiting on them. Must be
+		called from the main thread, while nothing else is using the current scene
+	*/
+	static void Update();
+	// Gets the scene that we're waiting to switch to, or an empty string if there isn't one
+	static const std::string& GetPendingScene() { return _PendingScene; }
+
 	static Scene* Get(const std::string& name);
 
 	static void RegisterScene(const std::string& name, Scene* scene = nullptr);
@@ -29,11 +58,90 @@ public:
 
 	static void DestroyScenes();
 
+	// Holds our prefabs, each prefab is a single entity with the components that every instance starts with
 	static entt::registry Prefabs;
 
+	/*
+		Creates a new, empty prefab, add components to it through the Prefabs registry
+		@param name The name of the prefab, must be unique
+	*/
+	static entt::entity CreatePrefab(const std::string& name);
+	/*
+		Gets the prefab with the given name, or entt::null if there isn't one
+	*/
+	static entt::entity FindPrefab(const std::string& name);
+
+	/*
+		Adds a type of component that gets copied from prefabs to their instances, prefabs can hold components of
+		any other type but they will be left behind
+	*/
+	template <typename T>
+	static void AddPrefabComponent() {
+		PrefabPool pool;
+		pool.Type = std::type_index(typeid(T));
+		pool.Clone = [](entt::registry& registry, const std::vector<entt::entity>& entities, entt::entity prefab) {
+			// Scenes can be loaded on other threads, so we stick to the const version, which never adds a pool
+			const T* value = std::as_const(Prefabs).try_get<T>(prefab);
+			if (value == nullptr)
+				return;
+			// One allocation for the whole pool, then every instance gets a copy (which for meshes and materials
+			// just means sharing the handle)
+			registry.reserve<T>(registry.size<T>() + entities.size());
+			for (const entt::entity entity : entities)
+				registry.assign<T>(entity, *value);
+		};
+		_PrefabPools.push_back(pool);
+	}
+
+	/*
+		Makes a bunch of copies of a prefab in a registry, in one go
+		@param registry   The registry to add the instances to
+		@param prefab     The prefab to copy, from the Prefabs registry
+		@param count      The number of instances to make
+		@param transforms The transform for each instance, there must be count of them
+		@returns The new entities, in the same order as transforms
+	*/
+	template <typename Transform>
+	static std::vector<entt::entity> Instantiate(entt::registry& registry, entt::entity prefab, size_t count, const Transform* transforms) {
+		LOG_ASSERT(Prefabs.valid(prefab), "That isn't a valid prefab!");
+		std::vector<entt::entity> entities(count);
+		if (count == 0)
+			return entities;
+
+		// Every instance gets made in one go. Note that we can't have entt batch the transforms in with them, the
+		// version of entt we're using hands out the component slots in the wrong order when it does that
+		registry.create(entities.begin(), entities.end());
+		registry.reserve<Transform>(registry.size<Transform>() + count);
+		for (size_t ix = 0; ix < count; ix++)
+			registry.assign<Transform>(entities[ix], transforms[ix]);
+
+		for (const PrefabPool& pool : _PrefabPools) {
+			if (pool.Type != std::type_index(typeid(Transform)))
+				pool.Clone(registry, entities, prefab);
+		}
+		return entities;
+	}
+	template <typename Transform>
+	static std::vector<entt::entity> Instantiate(entt::entity prefab, size_t count, const Transform* transforms) {
+		return Instantiate(Current()->Registry(), prefab, count, transforms);
+	}
+
 private:
 	static Scene* _CurrentScene;
 	static std::unordered_map<std::string, Scene*> _KnownScenes;
+	// The scenes that are loading in the background
+	static std::unordered_map<std::string, std::future<void>> _Loading;
+	static std::string _PendingScene;
+
+	static void __Activate(Scene* scene);
+
+	struct PrefabPool {
+		std::type_index Type = std::type_index(typeid(void));
+		// Copies the prefab's component (if it has one) to all of the entities
+		void (*Clone)(entt::registry& registry, const std::vector<entt::entity>& entities, entt::entity prefab);
+	};
+	static std::vector<PrefabPool> _PrefabPools;
+	static std::unordered_map<std::string, entt::entity> _PrefabNames;
 
 };
 
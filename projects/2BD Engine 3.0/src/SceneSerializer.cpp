@@ -0,0 +1,180 @@
+#include "SceneSerializer.h"
+#include "Logging.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+// Bump this whenever the layout of our scene files changes
+static const uint32_t SceneVersion = 1;
+
+thread_local const SceneSerializer* SceneSerializer::__Current = nullptr;
+
+// Makes a serializer current for as long as it's in scope
+struct CurrentSerializer {
+	const SceneSerializer* Previous;
+	CurrentSerializer(const SceneSerializer* serializer, const SceneSerializer*& current) : Previous(current), Current(current) { current = serializer; }
+	~CurrentSerializer() { Current = Previous; }
+	const SceneSerializer*& Current;
+};
+
+template <typename Archive>
+static constexpr bool IsJson() {
+	return std::is_same_v<cereal::JSONOutputArchive, Archive> || std::is_same_v<cereal::JSONInputArchive, Archive>;
+}
+
+const SceneSerializer& SceneSerializer::Current() {
+	LOG_ASSERT(__Current != nullptr, "No scene is being saved or loaded on this thread!");
+	return *__Current;
+}
+
+// JSON files get an object per pool so they're easy to read, binary files are just every pool back to back
+template <typename Archive>
+static void BeginPool(Archive& archive, const std::string& name) {
+	if constexpr (IsJson<Archive>()) {
+		archive.setNextName(name.c_str());
+		archive.startNode();
+	}
+}
+template <typename Archive>
+static void EndPool(Archive& archive) {
+	if constexpr (IsJson<Archive>())
+		archive.finishNode();
+}
+
+std::string SceneSerializer::__GetAssetId(std::type_index type, const void* asset) const {
+	if (asset == nullptr)
+		return std::string();
+	auto table = myAssets.find(type);
+	if (table != myAssets.end()) {
+		auto it = table->second.ByPointer.find(asset);
+		if (it != table->second.ByPointer.end())
+			return it->second;
+	}
+	LOG_WARN("Saving an asset that was never registered, it will be loaded as nullptr");
+	return std::string();
+}
+
+std::shared_ptr<void> SceneSerializer::__FindAsset(std::type_index type, const std::string& id) const {
+	if (id.empty())
+		return nullptr;
+	auto table = myAssets.find(type);
+	if (table != myAssets.end()) {
+		auto it = table->second.ById.find(id);
+		if (it != table->second.ById.end())
+			return it->second;
+	}
+	LOG_WARN("Scene refers to an asset that was never registered: \"{}\"", id);
+	return nullptr;
+}
+
+template <typename Archive>
+size_t SceneSerializer::__Save(Archive& archive, entt::registry& registry) {
+	// Entities are stored as their position in the file rather than their ID, so they can be loaded into any registry
+	EntityIndices indices(registry.size(), 0);
+	uint32_t count = 0;
+	registry.each([&](const entt::entity entity) {
+		indices[entt::to_integer(registry.entity(entity))] = count++;
+	});
+
+	std::vector<std::string> names;
+	for (const Pool& pool : myPools)
+		names.push_back(pool.Name);
+	archive(cereal::make_nvp("Version", SceneVersion), cereal::make_nvp("Entities", count), cereal::make_nvp("Pools", names));
+
+	size_t components = 0;
+	for (const Pool& pool : myPools) {
+		BeginPool(archive, pool.Name);
+		if constexpr (IsJson<Archive>())
+			components += pool.SaveJson(archive, registry, indices);
+		else
+			components += pool.SaveBinary(archive, registry, indices);
+		EndPool(archive);
+	}
+	myStats.Entities = count;
+	return components;
+}
+
+template <typename Archive>
+size_t SceneSerializer::__Load(Archive& archive, entt::registry& registry, std::vector<entt::entity>& entities) {
+	uint32_t version = 0, count = 0;
+	std::vector<std::string> names;
+	archive(cereal::make_nvp("Version", version), cereal::make_nvp("Entities", count), cereal::make_nvp("Pools", names));
+	if (version != SceneVersion)
+		throw std::runtime_error("Unsupported scene version " + std::to_string(version));
+
+	// All of our entities get made in one go, the pools then fill in their components
+	entities.resize(count);
+	registry.create(entities.begin(), entities.end());
+
+	size_t components = 0;
+	for (const std::string& name : names) {
+		auto pool = std::find_if(myPools.begin(), myPools.end(), [&](const Pool& pool) { return pool.Name == name; });
+		// There's no way to skip over a pool we don't know in a binary file, so we have to give up here
+		if (pool == myPools.end())
+			throw std::runtime_error("Unknown component pool \"" + name + "\"");
+		BeginPool(archive, name);
+		if constexpr (IsJson<Archive>())
+			components += pool->LoadJson(archive, registry, entities);
+		else
+			components += pool->LoadBinary(archive, registry, entities);
+		EndPool(archive);
+	}
+	myStats.Entities = count;
+	return components;
+}
+
+bool SceneSerializer::Save(entt::registry& registry, const std::string& path, Format format) {
+	auto start = std::chrono::high_resolution_clock::now();
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		LOG_WARN("Failed to open \"{}\" for writing", path);
+		return false;
+	}
+	CurrentSerializer current(this, __Current);
+	try {
+		// The JSON archive only finishes writing once it is destroyed, hence the scopes
+		if (format == Format::Binary) {
+			BinaryOutput archive(file);
+			myStats.Components = __Save(archive, registry);
+		}
+		else {
+			JsonOutput archive(file);
+			myStats.Components = __Save(archive, registry);
+		}
+	}
+	catch (const std::exception& e) {
+		LOG_WARN("Failed to save \"{}\": {}", path, e.what());
+		return false;
+	}
+	myStats.LastMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+bool SceneSerializer::Load(entt::registry& registry, const std::string& path, Format format) {
+	auto start = std::chrono::high_resolution_clock::now();
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		LOG_WARN("Failed to open \"{}\" for reading", path);
+		return false;
+	}
+	std::vector<entt::entity> entities;
+	CurrentSerializer current(this, __Current);
+	try {
+		if (format == Format::Binary) {
+			BinaryInput archive(file);
+			myStats.Components = __Load(archive, registry, entities);
+		}
+		else {
+			JsonInput archive(file);
+			myStats.Components = __Load(archive, registry, entities);
+		}
+	}
+	catch (const std::exception& e) {
+		// Don't leave half a scene behind
+		registry.destroy(entities.begin(), entities.end());
+		LOG_WARN("Failed to load \"{}\": {}", path, e.what());
+		return false;
+	}
+	myStats.LastMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
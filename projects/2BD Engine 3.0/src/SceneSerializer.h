@@ -0,0 +1,229 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "entt.hpp"
+#include <cereal/cereal.hpp>
+#include <cereal/archives/binary.hpp>
+#include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <CerealGLM.h>
+#include "MeshRenderer.h"
+#include "OcclusionCuller.h"
+
+/*
+	Saves and loads the entities in a registry, one component pool at a time. Every component that we want to save
+	has to be registered with AddComponent, and needs a serialize function that cereal can find.
+
+	Meshes, materials and the like can't be written out, so instead they are registered up front under a stable
+	ID, and the file only stores those IDs. Loading looks the IDs back up, so the same shared handles end up in the
+	loaded scene. Serialize functions can get at the IDs through SceneSerializer::Current().
+
+	Binary files are the fast path: pools of components that are trivially copyable get written and read as a
+	single block. JSON files store every component field by field, so they are slow, but they can be read and diffed
+
+	Usage:
+		serializer.AddAsset<Mesh>("Spider", spiderMesh);
+		serializer.AddComponent<MeshRenderer>("MeshRenderer");
+		serializer.Save(registry, "test.scene", SceneSerializer::Format::Binary);
+*/
+class SceneSerializer {
+public:
+	typedef std::shared_ptr<SceneSerializer> Sptr;
+
+	enum class Format {
+		Binary,
+		Json
+	};
+
+	struct Stats {
+		size_t Entities = 0;   // The number of entities in the last scene we saved or loaded
+		size_t Components = 0; // The number of components in the last scene we saved or loaded
+		float  LastMs = 0.0f;  // How long the last save or load took
+	};
+
+	/*
+		Registers an asset, so that components can refer to it from a file
+		@param id    The ID to store in files, must be unique for assets of the same type
+		@param asset The asset to hand back when loading the ID
+	*/
+	template <typename T>
+	void AddAsset(const std::string& id, const std::shared_ptr<T>& asset) {
+		AssetTable& table = myAssets[std::type_index(typeid(T))];
+		table.ById[id] = asset;
+		table.ByPointer[asset.get()] = id;
+	}
+	/*
+		Gets the ID of a registered asset, or an empty string for nullptr or assets that were never registered
+	*/
+	template <typename T>
+	std::string GetAssetId(const std::shared_ptr<T>& asset) const {
+		return __GetAssetId(std::type_index(typeid(T)), asset.get());
+	}
+	/*
+		Gets the asset registered under an ID, or nullptr if there isn't one
+	*/
+	template <typename T>
+	std::shared_ptr<T> FindAsset(const std::string& id) const {
+		return std::static_pointer_cast<T>(__FindAsset(std::type_index(typeid(T)), id));
+	}
+
+	/*
+		Adds a type of component that will be saved and loaded, components that aren't registered are skipped
+		@param name The name to store the pool under, must be unique and stay the same between saving and loading
+	*/
+	template <typename T>
+	void AddComponent(const std::string& name) {
+		static_assert(!std::is_empty_v<T>, "Empty components don't have a pool to save!");
+		Pool pool;
+		pool.Name = name;
+		pool.SaveBinary = &__SavePool<T, BinaryOutput>;
+		pool.SaveJson = &__SavePool<T, JsonOutput>;
+		pool.LoadBinary = &__LoadPool<T, BinaryInput>;
+		pool.LoadJson = &__LoadPool<T, JsonInput>;
+		myPools.push_back(pool);
+	}
+
+	/*
+		Writes every entity in a registry, along with all of their registered components, to a file
+		@returns True if the file was written
+	*/
+	bool Save(entt::registry& registry, const std::string& path, Format format);
+	/*
+		Loads the entities in a file into a registry, anything already in the registry is kept
+		@returns True if the whole file was loaded
+	*/
+	bool Load(entt::registry& registry, const std::string& path, Format format);
+
+	const Stats& GetStats() const { return myStats; }
+
+	/*
+		Gets the serializer that is saving or loading on this thread, only valid inside of Save and Load
+	*/
+	static const SceneSerializer& Current();
+
+protected:
+	typedef cereal::BinaryOutputArchive BinaryOutput;
+	typedef cereal::BinaryInputArchive  BinaryInput;
+	typedef cereal::JSONOutputArchive   JsonOutput;
+	typedef cereal::JSONInputArchive    JsonInput;
+
+	struct AssetTable {
+		std::unordered_map<std::string, std::shared_ptr<void>> ById;
+		std::unordered_map<const void*, std::string> ByPointer;
+	};
+
+	// Maps an entity to it's position in the file, using the entity's index in the registry
+	typedef std::vector<uint32_t> EntityIndices;
+
+	struct Pool {
+		std::string Name;
+		size_t (*SaveBinary)(BinaryOutput&, entt::registry&, const EntityIndices&);
+		size_t (*SaveJson)(JsonOutput&, entt::registry&, const EntityIndices&);
+		size_t (*LoadBinary)(BinaryInput&, entt::registry&, const std::vector<entt::entity>&);
+		size_t (*LoadJson)(JsonInput&, entt::registry&, const std::vector<entt::entity>&);
+	};
+
+	std::unordered_map<std::type_index, AssetTable> myAssets;
+	std::vector<Pool> myPools;
+	Stats myStats;
+
+	static thread_local const SceneSerializer* __Current;
+
+	std::string __GetAssetId(std::type_index type, const void* asset) const;
+	std::shared_ptr<void> __FindAsset(std::type_index type, const std::string& id) const;
+
+	template <typename Archive>
+	size_t __Save(Archive& archive, entt::registry& registry);
+	template <typename Archive>
+	size_t __Load(Archive& archive, entt::registry& registry, std::vector<entt::entity>& entities);
+
+	// Binary archives can take a trivially copyable pool as one big block of memory
+	template <typename T, typename Archive>
+	static constexpr bool IsBlockCopyable() {
+		return std::is_trivially_copyable_v<T> &&
+			(std::is_same_v<Archive, BinaryOutput> || std::is_same_v<Archive, BinaryInput>);
+	}
+
+	template <typename T, typename Archive>
+	static size_t __SavePool(Archive& archive, entt::registry& registry, const EntityIndices& indices) {
+		auto view = registry.view<T>();
+		size_t count = view.size();
+		std::vector<uint32_t> owners(count);
+		const entt::entity* entities = view.data();
+		for (size_t ix = 0; ix < count; ix++)
+			owners[ix] = indices[entt::to_integer(registry.entity(entities[ix]))];
+		archive(cereal::make_nvp("Entities", owners));
+
+		if constexpr (IsBlockCopyable<T, Archive>()) {
+			archive(cereal::binary_data(view.raw(), count * sizeof(T)));
+		}
+		else {
+			std::vector<T> components(view.raw(), view.raw() + count);
+			archive(cereal::make_nvp("Components", components));
+		}
+		return count;
+	}
+
+	template <typename T, typename Archive>
+	static size_t __LoadPool(Archive& archive, entt::registry& registry, const std::vector<entt::entity>& entities) {
+		std::vector<uint32_t> owners;
+		archive(cereal::make_nvp("Entities", owners));
+
+		std::vector<T> components;
+		if constexpr (IsBlockCopyable<T, Archive>()) {
+			components.resize(owners.size());
+			archive(cereal::binary_data(components.data(), components.size() * sizeof(T)));
+		}
+		else {
+			archive(cereal::make_nvp("Components", components));
+		}
+		if (components.size() != owners.size())
+			throw std::runtime_error("Component count does not match entity count");
+
+		// The entt we're using can only batch components onto entities as it creates them, so we reserve the pool
+		// up front and fill it straight from our array instead
+		registry.reserve<T>(registry.size<T>() + owners.size());
+		for (size_t ix = 0; ix < owners.size(); ix++) {
+			if (owners[ix] >= entities.size())
+				throw std::runtime_error("Component refers to an entity that isn't in the file");
+			registry.assign<T>(entities[owners[ix]], std::move(components[ix]));
+		}
+		return owners.size();
+	}
+};
+
+/*
+	Components that hold assets store the asset IDs instead, see SceneSerializer::AddAsset
+*/
+template <typename Archive>
+void save(Archive& archive, const MeshRenderer& renderer) {
+	const SceneSerializer& serializer = SceneSerializer::Current();
+	archive(cereal::make_nvp("Mesh", serializer.GetAssetId(renderer.Mesh)),
+		cereal::make_nvp("Material", serializer.GetAssetId(renderer.Material)));
+}
+template <typename Archive>
+void load(Archive& archive, MeshRenderer& renderer) {
+	const SceneSerializer& serializer = SceneSerializer::Current();
+	std::string mesh, material;
+	archive(cereal::make_nvp("Mesh", mesh), cereal::make_nvp("Material", material));
+	renderer.Mesh = serializer.FindAsset<Mesh>(mesh);
+	renderer.Material = serializer.FindAsset<Material>(material);
+}
+
+template <typename Archive>
+void save(Archive& archive, const Occluder& occluder) {
+	const SceneSerializer& serializer = SceneSerializer::Current();
+	archive(cereal::make_nvp("Triangles", serializer.GetAssetId(occluder.Triangles)));
+}
+template <typename Archive>
+void load(Archive& archive, Occluder& occluder) {
+	const SceneSerializer& serializer = SceneSerializer::Current();
+	std::string triangles;
+	archive(cereal::make_nvp("Triangles", triangles));
+	occluder.Triangles = serializer.FindAsset<std::vector<glm::vec3>>(triangles);
+}
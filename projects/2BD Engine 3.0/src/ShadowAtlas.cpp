@@ -0,0 +1,236 @@
+#include "ShadowAtlas.h"
+#include "Logging.h"
+#include <GLM/gtc/matrix_transform.hpp>
+#include <cfloat>
+
+// The near plane for our shadow cameras, anything closer to the light than this will not cast shadows
+static const float ShadowNear = 0.05f;
+
+// The direction and up vector for each cube face, in the same order as a cube map (+X, -X, +Y, -Y, +Z, -Z)
+static const glm::vec3 FaceDirections[6] = {
+	{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+};
+static const glm::vec3 FaceUps[6] = {
+	{ 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 }
+};
+
+// Simple FNV-1a hash, used to tell if anything around a light has changed
+static void HashBytes(uint64_t& hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t ix = 0; ix < size; ix++) {
+		hash ^= bytes[ix];
+		hash *= 1099511628211ull;
+	}
+}
+
+// Tests a world space box against a view projection, returns false if the box is completely outside of one of the planes
+static bool BoxInFrustum(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& viewProjection) {
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int ix = 0; ix < 8; ix++) {
+		glm::vec4 clip = viewProjection * glm::vec4(
+			(ix & 1) ? boxMax.x : boxMin.x,
+			(ix & 2) ? boxMax.y : boxMin.y,
+			(ix & 4) ? boxMax.z : boxMin.z, 1.0f);
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z < -clip.w;
+		outside[5] += clip.z > clip.w;
+	}
+	for (int plane = 0; plane < 6; plane++)
+		if (outside[plane] == 8)
+			return false;
+	return true;
+}
+
+ShadowAtlas::ShadowAtlas() {
+	// Both atlases need the exact same format, so that we can copy between them
+	glCreateTextures(GL_TEXTURE_2D, 2, myAtlases);
+	glCreateFramebuffers(2, myFramebuffers);
+	for (int ix = 0; ix < 2; ix++) {
+		glTextureStorage2D(myAtlases[ix], 1, GL_DEPTH_COMPONENT16, TileSize * 6, TileSize * MaxLights);
+		glTextureParameteri(myAtlases[ix], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(myAtlases[ix], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(myAtlases[ix], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(myAtlases[ix], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// Lets us use a sampler2DShadow, which gives us 2x2 PCF for free with linear filtering
+		glTextureParameteri(myAtlases[ix], GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTextureParameteri(myAtlases[ix], GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		glNamedFramebufferTexture(myFramebuffers[ix], GL_DEPTH_ATTACHMENT, myAtlases[ix], 0);
+		glNamedFramebufferDrawBuffer(myFramebuffers[ix], GL_NONE);
+		glNamedFramebufferReadBuffer(myFramebuffers[ix], GL_NONE);
+		LOG_ASSERT(glCheckNamedFramebufferStatus(myFramebuffers[ix], GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Shadow atlas framebuffer is incomplete!");
+	}
+
+	glCreateBuffers(1, &myMatrixBuffer);
+	glNamedBufferData(myMatrixBuffer, sizeof(glm::mat4) * 6 * MaxLights, nullptr, GL_DYNAMIC_DRAW);
+
+	myShader = std::make_shared<Shader>();
+	myShader->Load("shadow.vs.glsl", "shadow.fs.glsl");
+
+	Invalidate();
+}
+
+ShadowAtlas::~ShadowAtlas() {
+	glDeleteFramebuffers(2, myFramebuffers);
+	glDeleteTextures(2, myAtlases);
+	glDeleteBuffers(1, &myMatrixBuffer);
+}
+
+void ShadowAtlas::Invalidate() {
+	for (int ix = 0; ix < MaxLights; ix++)
+		myStaticSignatures[ix] = 0;
+}
+
+void ShadowAtlas::BeginFrame() {
+	myLights.clear();
+	myCasters.clear();
+	myStats = Stats();
+}
+
+int ShadowAtlas::AddLight(const glm::vec3& position, float radius) {
+	if (myLights.size() >= MaxLights)
+		return -1;
+
+	Light light;
+	light.Position = position;
+	light.Radius = radius;
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, ShadowNear, glm::max(radius, ShadowNear * 2.0f));
+	for (int face = 0; face < 6; face++)
+		light.FaceViewProjection[face] = projection * glm::lookAt(position, position + FaceDirections[face], FaceUps[face]);
+	myLights.push_back(light);
+	myStats.Lights++;
+	return (int)myLights.size() - 1;
+}
+
+void ShadowAtlas::AddCaster(const Mesh::Sptr& mesh, const glm::mat4& world, bool isStatic) {
+	if (mesh == nullptr)
+		return;
+
+	Caster caster;
+	caster.MeshPtr = mesh;
+	caster.World = world;
+	caster.Static = isStatic;
+	// Transform the mesh's bounds into a world space box
+	caster.WorldMin = glm::vec3(FLT_MAX);
+	caster.WorldMax = glm::vec3(-FLT_MAX);
+	const glm::vec3& localMin = mesh->GetBoundsMin();
+	const glm::vec3& localMax = mesh->GetBoundsMax();
+	for (int ix = 0; ix < 8; ix++) {
+		glm::vec3 corner = glm::vec3(world * glm::vec4(
+			(ix & 1) ? localMax.x : localMin.x,
+			(ix & 2) ? localMax.y : localMin.y,
+			(ix & 4) ? localMax.z : localMin.z, 1.0f));
+		caster.WorldMin = glm::min(caster.WorldMin, corner);
+		caster.WorldMax = glm::max(caster.WorldMax, corner);
+	}
+	myCasters.push_back(caster);
+}
+
+bool ShadowAtlas::__InRange(const Light& light, const Caster& caster) const {
+	glm::vec3 closest = glm::clamp(light.Position, caster.WorldMin, caster.WorldMax);
+	glm::vec3 delta = closest - light.Position;
+	return glm::dot(delta, delta) <= light.Radius * light.Radius;
+}
+
+uint64_t ShadowAtlas::__GetStaticSignature(const Light& light) const {
+	uint64_t hash = 14695981039346656037ull;
+	HashBytes(hash, &light.Position, sizeof(glm::vec3));
+	HashBytes(hash, &light.Radius, sizeof(float));
+	for (const Caster& caster : myCasters) {
+		if (caster.Static && __InRange(light, caster)) {
+			const Mesh* mesh = caster.MeshPtr.get();
+			HashBytes(hash, &mesh, sizeof(mesh));
+			HashBytes(hash, &caster.World, sizeof(glm::mat4));
+		}
+	}
+	// Make sure we never land on the value we use to mark rows as invalid
+	return hash == 0 ? 1 : hash;
+}
+
+void ShadowAtlas::__DrawCasters(GLuint framebuffer, int slot, bool isStatic) {
+	const Light& light = myLights[slot];
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	myShader->SetUniform("a_LightPos", light.Position);
+	myShader->SetUniform("a_LightRadius", light.Radius);
+
+	for (int face = 0; face < 6; face++) {
+		glViewport(face * TileSize, slot * TileSize, TileSize, TileSize);
+		// Static rows get completely re-drawn, so we need to clear them first
+		if (isStatic) {
+			glScissor(face * TileSize, slot * TileSize, TileSize, TileSize);
+			glEnable(GL_SCISSOR_TEST);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glDisable(GL_SCISSOR_TEST);
+		}
+
+		for (const Caster& caster : myCasters) {
+			if (caster.Static != isStatic)
+				continue;
+			// Per light and per face culling, most casters only show up in one or two faces
+			if (!__InRange(light, caster) || !BoxInFrustum(caster.WorldMin, caster.WorldMax, light.FaceViewProjection[face])) {
+				myStats.CulledCasters++;
+				continue;
+			}
+			myShader->SetUniform("a_ModelViewProjection", light.FaceViewProjection[face] * caster.World);
+			myShader->SetUniform("a_Model", caster.World);
+			caster.MeshPtr->DrawPositions();
+			if (isStatic)
+				myStats.StaticDraws++;
+			else
+				myStats.DynamicDraws++;
+		}
+	}
+}
+
+void ShadowAtlas::Render() {
+	// We will be messing with the viewport, so we need to put it back when we're done
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	myShader->Bind();
+	// Our casters are not guaranteed to be closed, so we draw both sides of them
+	glDisable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+
+	for (int slot = 0; slot < (int)myLights.size(); slot++) {
+		// Only re-draw the static shadows when something around the light has changed
+		uint64_t signature = __GetStaticSignature(myLights[slot]);
+		if (signature != myStaticSignatures[slot]) {
+			__DrawCasters(myFramebuffers[0], slot, true);
+			myStaticSignatures[slot] = signature;
+			myStats.StaticRedraws++;
+		}
+
+		// Start the live row off as a copy of the cached static row, then draw our dynamics on top
+		glCopyImageSubData(
+			myAtlases[0], GL_TEXTURE_2D, 0, 0, slot * TileSize, 0,
+			myAtlases[1], GL_TEXTURE_2D, 0, 0, slot * TileSize, 0,
+			TileSize * 6, TileSize, 1);
+		__DrawCasters(myFramebuffers[1], slot, false);
+	}
+	// Rows past our current lights are not being used anymore, so they'll need to be re-drawn if they come back
+	for (int slot = (int)myLights.size(); slot < MaxLights; slot++)
+		myStaticSignatures[slot] = 0;
+
+	// Upload our face matrices for the lighting shaders
+	std::vector<glm::mat4> matrices;
+	matrices.reserve(myLights.size() * 6);
+	for (const Light& light : myLights)
+		matrices.insert(matrices.end(), light.FaceViewProjection, light.FaceViewProjection + 6);
+	if (!matrices.empty())
+		glNamedBufferSubData(myMatrixBuffer, 0, matrices.size() * sizeof(glm::mat4), matrices.data());
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glEnable(GL_CULL_FACE);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void ShadowAtlas::Apply(const Shader::Sptr& shader) const {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShadowBinding, myMatrixBuffer);
+	int slot = AtlasSlot;
+	glBindTextureUnit(slot, myAtlases[1]);
+	shader->SetUniform("s_ShadowAtlas", slot);
+}
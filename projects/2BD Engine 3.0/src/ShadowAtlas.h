@@ -0,0 +1,125 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLM/glm.hpp>
+#include <memory>
+#include <vector>
+#include <cereal/cereal.hpp>
+#include "Mesh.h"
+#include "Shader.h"
+
+/*
+	Marks an entity as something that casts shadows. Static casters (the level, beds, shelves) get cached, and
+	are only re-drawn when a light or one of the statics around it changes. Dynamic casters get drawn every frame
+*/
+struct ShadowCaster {
+	bool Static = true;
+
+	template <typename Archive>
+	void serialize(Archive& archive) {
+		archive(CEREAL_NVP(Static));
+	}
+};
+
+/*
+	Handles shadows for our point lights. Every shadowed light gets a row in a depth atlas, with one tile for each
+	face of it's cube. We keep two copies of the atlas around:
+		- The static atlas only has our static casters in it, and a light's row only gets re-rendered when the
+		  light or the statics in range of it change
+		- The live atlas is what the shaders sample, each frame we copy the static rows into it and draw the
+		  dynamic casters on top
+	The atlas stores the distance to the light divided by the light's radius, rather than the projected depth
+
+	The shader side of this lives in blinn-phong.fs.glsl, and the atlas layout needs to match the defines there
+*/
+class ShadowAtlas {
+public:
+	typedef std::shared_ptr<ShadowAtlas> Sptr;
+
+	// The size of each cube face in the atlas, in pixels
+	static const int TileSize = 512;
+	// How many lights can have shadows at the same time (rows in the atlas)
+	static const int MaxLights = 4;
+	// The SSBO binding point for our face matrices
+	static const GLuint ShadowBinding = 3;
+	// The texture slot we bind the atlas to, well above anything our materials use
+	static const int AtlasSlot = 15;
+
+	struct Stats {
+		size_t Lights = 0; // How many lights have shadows this frame
+		size_t StaticRedraws = 0; // How many lights had their static shadows re-drawn this frame
+		size_t StaticDraws = 0; // How many draw calls we made for static casters
+		size_t DynamicDraws = 0; // How many draw calls we made for dynamic casters
+		size_t CulledCasters = 0; // How many caster / face pairs we skipped because they were out of range
+	};
+
+	ShadowAtlas();
+	~ShadowAtlas();
+
+	/*
+		Clears out the lights and casters from last frame
+	*/
+	void BeginFrame();
+	/*
+		Adds a shadowed light for this frame
+		@param position The world position of the light
+		@param radius   The light's radius, nothing outside of this will cast shadows
+		@returns The light's row in the atlas, or -1 if the atlas is full
+	*/
+	int AddLight(const glm::vec3& position, float radius);
+	/*
+		Adds a shadow caster for this frame
+		@param mesh     The mesh to draw
+		@param world    The mesh's world transform
+		@param isStatic True if the caster can be cached in the static atlas
+	*/
+	void AddCaster(const Mesh::Sptr& mesh, const glm::mat4& world, bool isStatic);
+	/*
+		Updates any static rows that have changed, then composites the dynamic casters into the live atlas
+	*/
+	void Render();
+	/*
+		Forces all of the static shadows to be re-drawn next frame
+	*/
+	void Invalidate();
+
+	/*
+		Binds the live atlas and our face matrices, and sets up the atlas sampler on the given shader
+		@param shader The lighting shader that we are about to draw with
+	*/
+	void Apply(const Shader::Sptr& shader) const;
+
+	const Stats& GetStats() const { return myStats; }
+
+private:
+	struct Light {
+		glm::vec3 Position;
+		float     Radius;
+		glm::mat4 FaceViewProjection[6];
+	};
+	struct Caster {
+		Mesh::Sptr MeshPtr;
+		glm::mat4  World;
+		glm::vec3  WorldMin, WorldMax; // The world space box around the caster
+		bool       Static;
+	};
+
+	// Gets a hash of everything that would affect the static shadows of a light
+	uint64_t __GetStaticSignature(const Light& light) const;
+	bool __InRange(const Light& light, const Caster& caster) const;
+	void __DrawCasters(GLuint framebuffer, int slot, bool isStatic);
+
+	// 0 is the static atlas, 1 is the live atlas that the shaders sample
+	GLuint myAtlases[2];
+	GLuint myFramebuffers[2];
+	// The face matrices for each light, in the same order as the atlas rows
+	GLuint myMatrixBuffer;
+
+	Shader::Sptr myShader;
+
+	std::vector<Light> myLights;
+	std::vector<Caster> myCasters;
+	// The signature that each row of the static atlas was last rendered with
+	uint64_t myStaticSignatures[MaxLights];
+
+	Stats myStats;
+};
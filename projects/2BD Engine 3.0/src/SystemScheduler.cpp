@@ -0,0 +1,50 @@
+#include "SystemScheduler.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <chrono>
+
+static bool Overlaps(const std::vector<std::type_index>& a, const std::vector<std::type_index>& b) {
+	for (const std::type_index& type : a)
+		if (std::find(b.begin(), b.end(), type) != b.end())
+			return true;
+	return false;
+}
+
+bool SystemScheduler::__Conflicts(const System& a, const System& b) {
+	// Reading the same component from two threads is fine, anything that involves a write is not
+	return Overlaps(a.Writes, b.Writes) || Overlaps(a.Writes, b.Reads) || Overlaps(a.Reads, b.Writes);
+}
+
+void SystemScheduler::__AddSystem(System&& system) {
+	// We go in the stage after the last system that we conflict with, so conflicting systems keep the order they were added in
+	int stage = 0;
+	for (size_t ix = 0; ix < mySystems.size(); ix++)
+		if (__Conflicts(system, mySystems[ix]))
+			stage = std::max(stage, myStats[ix].Stage + 1);
+
+	SystemStats stats;
+	stats.Name = system.Name;
+	stats.Stage = stage;
+	if (stage >= (int)myStages.size())
+		myStages.resize(stage + 1);
+	myStages[stage].push_back(mySystems.size());
+	mySystems.push_back(std::move(system));
+	myStats.push_back(stats);
+}
+
+void SystemScheduler::Run(entt::registry& registry, float deltaTime) {
+	std::vector<std::function<void()>> jobs(mySystems.size());
+	for (size_t ix = 0; ix < mySystems.size(); ix++)
+		jobs[ix] = mySystems[ix].Prepare(registry, deltaTime);
+
+	for (const std::vector<size_t>& stage : myStages) {
+		Parallel::For(stage.size(), [&](size_t begin, size_t end) {
+			for (size_t ix = begin; ix < end; ix++) {
+				size_t system = stage[ix];
+				auto start = std::chrono::high_resolution_clock::now();
+				jobs[system]();
+				myStats[system].LastMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+		});
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <vector>
+#include "entt.hpp"
+
+/*
+	Runs our per-entity game logic as systems. Each system says which components it reads and which it writes, and
+	gets called once for every entity that has all of them, straight from the component pools.
+
+	From those declarations we build a dependency graph: two systems conflict if either one writes a component that
+	the other one touches, and conflicting systems always run in the order they were added. Systems are grouped
+	into stages, where nothing in a stage conflicts with anything else in it, and each stage is spread across our
+	worker threads.
+
+	Systems must only touch the components they declared, anything else (including creating or destroying
+	entities) can race with the other systems in their stage
+
+	Usage:
+		scheduler.Add("Movement", SystemScheduler::Reads<Velocity>(), SystemScheduler::Writes<TempTransform>(),
+			[](float dt, TempTransform& transform, const Velocity& velocity) { ... });
+*/
+class SystemScheduler {
+public:
+	typedef std::shared_ptr<SystemScheduler> Sptr;
+
+	template <typename... Components> struct Reads {};
+	template <typename... Components> struct Writes {};
+
+	struct SystemStats {
+		std::string Name;
+		int   Stage = 0;     // The stage that the system runs in, systems in the same stage can run at the same time
+		float LastMs = 0.0f; // How long the system took on it's last run
+	};
+
+	/*
+		Adds a new system, to run after any systems that it conflicts with
+		@param name The name of the system, for our stats
+		@param func Called for every entity with all of our components, as func(deltaTime, written..., read...)
+	*/
+	template <typename... ReadTypes, typename... WriteTypes, typename Func>
+	void Add(const std::string& name, Reads<ReadTypes...>, Writes<WriteTypes...>, Func func) {
+		static_assert(sizeof...(ReadTypes) + sizeof...(WriteTypes) > 0, "A system needs at least one component!");
+		System system;
+		system.Name = name;
+		system.Reads = { std::type_index(typeid(ReadTypes))... };
+		system.Writes = { std::type_index(typeid(WriteTypes))... };
+		system.Prepare = [func](entt::registry& registry, float deltaTime) -> std::function<void()> {
+			// Views have to be made here on the main thread, since making one can add a pool to the registry
+			auto view = registry.view<WriteTypes..., const ReadTypes...>();
+			return [view, func, deltaTime]() {
+				view.each([&](WriteTypes&... written, const ReadTypes&... read) {
+					func(deltaTime, written..., read...);
+				});
+			};
+		};
+		__AddSystem(std::move(system));
+	}
+
+	/*
+		Runs all of our systems over a registry, stage by stage
+		@param registry  The registry to run over
+		@param deltaTime The time since the last run, in seconds
+	*/
+	void Run(entt::registry& registry, float deltaTime);
+
+	const std::vector<SystemStats>& GetStats() const { return myStats; }
+	int GetStageCount() const { return (int)myStages.size(); }
+
+protected:
+	struct System {
+		std::string Name;
+		std::vector<std::type_index> Reads, Writes;
+		// Makes the job that runs this system over a registry
+		std::function<std::function<void()>(entt::registry&, float)> Prepare;
+	};
+
+	std::vector<System> mySystems;
+	std::vector<SystemStats> myStats;
+	// The index of every system in each stage
+	std::vector<std::vector<size_t>> myStages;
+
+	void __AddSystem(System&& system);
+	static bool __Conflicts(const System& a, const System& b);
+};
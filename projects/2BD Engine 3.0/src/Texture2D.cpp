@@ -1,6 +1,12 @@
 #include "Texture2D.h"
 #include "Logging.h"
 #include <stb_image.h>
+#include <AssetRegistry.h>
+
+namespace {
+	// Textures are shared by their path and whether they were loaded with alpha
+	AssetRegistry<std::string, Texture2D> textureRegistry;
+}
 
 Texture2D::Texture2D(const Texture2DDescription& desc) {
 	myDescription = desc;
@@ -39,6 +45,17 @@ void Texture2D::LoadData(void* data, size_t width, size_t height, PixelFormat fo
 }
 
 Texture2D::Sptr Texture2D::LoadFromFile(const std::string& fileName, bool loadAlpha) {
+	std::string key = fileName + (loadAlpha ? "|rgba" : "|rgb");
+	return textureRegistry.GetOrCreate(key, [&]() {
+		return __LoadFromFile(fileName, loadAlpha);
+	});
+}
+
+AssetRegistryStats Texture2D::GetCacheStats() {
+	return textureRegistry.GetStats();
+}
+
+Texture2D::Sptr Texture2D::__LoadFromFile(const std::string& fileName, bool loadAlpha) {
 	int width, height, numChannels;
 	void* data = stbi_load(fileName.c_str(), &width, &height, &numChannels, loadAlpha ? 4 : 3);
 	if (data != nullptr && width != 0 && height != 0 && numChannels != 0) {
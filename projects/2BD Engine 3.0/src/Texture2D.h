@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <EnumToString.h>
+#include <AssetRegistry.h>
 
 // https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml
 // These are some of our more common available internal formats
@@ -62,9 +63,16 @@ public:
 	void Bind(int slot) const;
 	static void UnBind(int slot);
 
+	// Gets the underlying OpenGL handle, for passing to things like ImGui::Image
+	GLuint GetHandle() const { return myTextureHandle; }
+
+	// Loads a texture from a file, if the file is already loaded (and still alive) the existing texture is returned
 	static Sptr LoadFromFile(const std::string& fileName, bool loadAlpha = true);
+	// Gets the hit and miss counts for textures shared by LoadFromFile
+	static AssetRegistryStats GetCacheStats();
 protected:
 	GLuint myTextureHandle;
 	Texture2DDescription myDescription;
 	void __SetupTexture();
+	static Sptr __LoadFromFile(const std::string& fileName, bool loadAlpha);
 };
@@ -1,9 +1,8 @@
-#version 410
+#version 430
 //Basically HeightMap.vs.glsl only I just kept the tutorial variable names, just to manage easier
-layout (location = 0) in vec3 inPosition; //vertex position
-layout (location = 1) in vec4 inColor; //vertex color
-layout (location = 2) in vec3 inNormal;
-layout (location = 3) in vec2 inUV; //vertex uv
+// Drawn with CDLOD, see Terrain.h. Every node uses the same grid patch, which we scale and displace here
+layout (location = 0) in vec2 inGridPos; //vertex position in the patch, from 0 to a_PatchResolution
+layout (location = 1) in vec4 inNode; //xy is the node's min corner, z is its size and w is its LOD
 
 layout (location = 0) out vec4 outColor; //color
 layout (location = 1) out vec3 outNormal;
@@ -20,16 +19,42 @@ uniform mat3 a_NormalMatrix;
 uniform sampler2D myTextureSampler;
 uniform float height;
 
+uniform vec3  a_LodCamera; // The camera's local xy, z is how far it is above or below the terrain (see Terrain.h)
+uniform float a_TerrainSize;
+uniform float a_PatchResolution;
+// x is the distance we start morphing into the next LOD, y is 1 / the distance we morph over
+uniform vec4  a_LodMorph[12];
+
+// Our depth pre-pass uses this same vertex shader, so make sure both programs output identical depths
+invariant gl_Position;
+
+float SampleHeight(vec2 pos) {
+	// The terrain is centered on its origin, and the heightmap repeats
+	return textureLod(myTextureSampler, pos / a_TerrainSize, 0).r;
+}
+
 void main() {
+	float spacing = inNode.z / a_PatchResolution;
+	vec2 pos = inNode.xy + inGridPos * spacing;
+
+	// Odd vertices slide onto their even neighbours as we get further away, so that by the end of our LOD's
+	// range we exactly match the grid of the next one
+	vec4 morph = a_LodMorph[int(inNode.w)];
+	float dist = length(vec3(pos - a_LodCamera.xy, a_LodCamera.z));
+	float morphK = clamp((dist - morph.x) * morph.y, 0.0, 1.0);
+	pos -= fract(inGridPos * 0.5) * 2.0 * spacing * morphK;
+
 	//Height Map
-	float outHeight = texture(myTextureSampler, inUV).r;
-	
-	//v.z = (texture(myTextureSampler, inUV).r);
-	vec3 v = vec3(inPosition.x, inPosition.y, outHeight * height);
+	float outHeight = SampleHeight(pos);
+	vec3 v = vec3(pos.x, pos.y, outHeight * height);
+
+	// Our patch has no normals, so we get them from the slope of the heightmap (one texel either side)
+	vec2 texel = a_TerrainSize / vec2(textureSize(myTextureSampler, 0));
+	float dx = (SampleHeight(pos - vec2(texel.x, 0)) - SampleHeight(pos + vec2(texel.x, 0))) * height / (2.0 * texel.x);
+	float dy = (SampleHeight(pos - vec2(0, texel.y)) - SampleHeight(pos + vec2(0, texel.y))) * height / (2.0 * texel.y);
 
-	outColor = inColor;
-	outNormal = a_NormalMatrix * inNormal;
-	outColor = inColor;
+	outColor = vec4(1.0);
+	outNormal = a_NormalMatrix * normalize(vec3(dx, dy, 1.0));
 	outWorldPos = v;
 	gl_Position = a_ModelViewProjection * vec4(v, 1);
 	
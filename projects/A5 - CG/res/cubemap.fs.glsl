@@ -5,5 +5,6 @@ layout(location = 0) out vec4 outFragColor;
 uniform samplerCube s_Skybox;
 
 void main() {
-	outFragColor = texture(s_Skybox, normalize(inTexCoords).xzy);
+	// The lower mips are blurred for rough reflections, the sky itself always wants the sharp base level
+	outFragColor = textureLod(s_Skybox, normalize(inTexCoords).xzy, 0.0);
 }
\ No newline at end of file
@@ -0,0 +1,5 @@
+#version 410
+// Used for our depth pre-pass, we only care about the depth buffer so we never write a color
+
+void main() {
+}
@@ -0,0 +1,60 @@
+#version 430
+// Grass blades scattered by Vegetation (see Vegetation.h). Every blade is an instance of the same strip, which we
+// turn, bend and scale here
+layout (location = 0) in vec2 inBlade;    // x is across the blade in [-0.5, 0.5], y is up it in [0, 1]
+layout (location = 1) in vec4 inInstance; // xyz is the blade's root, w is a random value in [0, 1)
+
+layout (location = 0) out vec4 outColor;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec3 outWorldPos;
+layout (location = 3) out vec2 outUV;
+
+uniform mat4 a_ModelViewProjection;
+uniform mat4 a_Model;
+uniform mat3 a_NormalMatrix;
+uniform float a_Time;
+
+// Layers are dirt, grass and snow, the same as the terrain
+uniform sampler2DArray s_Albedos;
+
+uniform vec3  a_VegetationCamera; // The camera's position, in the vegetation's local space
+uniform float a_BladeWidth;
+uniform float a_BladeHeight;
+uniform float a_FadeStart;  // The distance that blades start thinning out at
+uniform float a_FadeEnd;    // The distance that the last blades are gone by
+uniform float a_ChunkBlades; // The number of blades in the chunk being drawn
+
+void main() {
+	// Blades are shuffled, so dropping the ones at the end of the chunk thins it out evenly. Blades that are about
+	// to be dropped shrink away first, so that they don't pop
+	vec3 root = inInstance.xyz;
+	float rank = float(gl_InstanceID) / a_ChunkBlades;
+	float density = clamp((a_FadeEnd - distance(root, a_VegetationCamera)) / (a_FadeEnd - a_FadeStart), 0.0, 1.0);
+	float grow = clamp((density - rank) * 10.0, 0.0, 1.0);
+
+	// Every blade gets it's own facing, size and lean from it's random value (up to 1.25x, see Vegetation.cpp)
+	float random = inInstance.w;
+	float angle = random * 6.2831853;
+	vec2 facing = vec2(cos(angle), sin(angle));
+	vec2 side = vec2(-facing.y, facing.x);
+	float height = a_BladeHeight * mix(0.75, 1.25, fract(random * 7.31)) * grow;
+	float width = a_BladeWidth * grow;
+
+	// The wind pushes harder the further up the blade we are
+	float t = inBlade.y;
+	float sway = sin(a_Time * 1.7 + root.x * 0.9 + root.y * 1.3) * 0.25 + (fract(random * 13.7) - 0.5) * 0.4;
+	vec2 bend = (vec2(0.8, 0.6) * sway + facing * 0.15) * t * t * height;
+
+	vec3 pos = root + vec3(side * inBlade.x * width + bend, t * height);
+
+	// Blades are lit like the ground around them, with a bit of their own facing mixed in
+	vec3 normal = normalize(vec3(facing * 0.5, 1.0));
+
+	// The grass's color comes from the terrain's own grass texture, darker towards the roots
+	vec3 albedo = textureLod(s_Albedos, vec3(root.xy, 1.0), 4.0).rgb;
+	outColor = vec4(albedo * mix(0.45, 1.1, t), 1.0);
+	outNormal = a_NormalMatrix * normal;
+	outWorldPos = (a_Model * vec4(pos, 1.0)).xyz;
+	outUV = root.xy;
+	gl_Position = a_ModelViewProjection * vec4(pos, 1.0);
+}
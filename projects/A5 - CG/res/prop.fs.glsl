@@ -0,0 +1,64 @@
+#version 430
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inWorldPos;
+layout(location = 3) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+uniform vec3  a_CameraPos;
+
+// Shared by all of our shaders, see Game::FrameUniforms
+layout(std140, binding = 0) uniform FrameData {
+	mat4 a_FrameView;
+	mat4 a_FrameProjection;
+	vec4 a_FrameCameraPos; // w is the time in seconds
+	vec4 a_AmbientSH[9];   // The diffuse light from our skybox, as spherical harmonics
+	mat4 a_FrameInverseViewProjection;
+};
+
+uniform vec3  a_AmbientColor;
+uniform float a_AmbientPower;
+
+// Every prop's texture is packed in here
+uniform sampler2D s_Atlas;
+
+uniform vec3  a_LightPos;
+uniform vec3  a_LightColor;
+uniform float a_LightShininess;
+uniform float a_LightAttenuation;
+
+// Evaluates our ambient spherical harmonics for a (normalized) direction in cubemap space
+vec3 EvaluateAmbient(vec3 d) {
+	vec3 result =
+		a_AmbientSH[0].xyz * 0.282095 +
+		a_AmbientSH[1].xyz * 0.488603 * d.y +
+		a_AmbientSH[2].xyz * 0.488603 * d.z +
+		a_AmbientSH[3].xyz * 0.488603 * d.x +
+		a_AmbientSH[4].xyz * 1.092548 * d.x * d.y +
+		a_AmbientSH[5].xyz * 1.092548 * d.y * d.z +
+		a_AmbientSH[6].xyz * 0.315392 * (3.0 * d.z * d.z - 1.0) +
+		a_AmbientSH[7].xyz * 1.092548 * d.x * d.z +
+		a_AmbientSH[8].xyz * 0.546274 * (d.x * d.x - d.y * d.y);
+	return max(result, vec3(0.0));
+}
+
+void main() {
+	// Lit the same way as the terrain, so that props sit in the scene properly
+	vec3 norm = normalize(inNormal);
+	vec3 toLight = a_LightPos - inWorldPos;
+	float distToLight = length(toLight);
+	toLight = normalize(toLight);
+	vec3 viewDir = normalize(a_CameraPos - inWorldPos);
+	vec3 halfDir = normalize(toLight + viewDir);
+
+	vec3 specOut = pow(max(dot(norm, halfDir), 0.0), a_LightShininess) * a_LightColor;
+	vec3 diffuseOut = max(dot(norm, toLight), 0) * a_LightColor;
+	vec3 ambientOut = a_AmbientColor * a_AmbientPower * EvaluateAmbient(norm.xzy);
+	float attenuation = 1.0 / (1.0 + a_LightAttenuation * pow(distToLight, 2));
+
+	vec4 albedo = texture(s_Atlas, inUV);
+	vec3 result = (ambientOut + attenuation * (diffuseOut + specOut)) * albedo.xyz * inColor.xyz;
+	outColor = vec4(result, inColor.a * albedo.a);
+}
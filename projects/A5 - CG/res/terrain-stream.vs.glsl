@@ -0,0 +1,65 @@
+#version 430
+// Streamed terrain, see TerrainStreamer.h. Same CDLOD patches as Terrain.vs.glsl, but every chunk has its heights
+// (and normals / splat weights) in its own layer of a texture array
+layout (location = 0) in vec2 inGridPos; //vertex position in the patch, from 0 to a_PatchResolution
+layout (location = 1) in vec4 inNode; //xy is the node's min corner, z is its size and w is its LOD
+layout (location = 2) in vec3 inRoot; //xy is the min corner of the node's chunk, z is the chunk's texture layer
+
+layout (location = 0) out vec4 outColor;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec3 outWorldPos;
+layout (location = 3) out vec2 outUV;
+layout (location = 4) out vec3 outTexWeights;
+
+uniform mat4 a_ModelViewProjection;
+uniform mat4 a_Model;
+uniform mat4 a_ModelView;
+uniform mat3 a_NormalMatrix;
+
+// r is the height in [0, 1]
+uniform sampler2DArray s_ChunkHeights;
+// rg is the normal's xy, b is how much dirt and a is how much snow (grass is whatever is left over)
+uniform sampler2DArray s_ChunkSurface;
+uniform float height;
+
+uniform vec3  a_LodCamera;
+uniform float a_ChunkSize;
+uniform float a_ChunkResolution;
+uniform float a_PatchResolution;
+uniform vec4  a_LodMorph[12];
+
+invariant gl_Position;
+
+vec3 ChunkUV(vec2 pos) {
+	// Chunk textures have a 1 texel border around them, so the chunk itself starts 1 texel in. That way texels
+	// on our edges blend with the same values our neighbours do
+	vec2 texel = (pos - inRoot.xy) / a_ChunkSize * a_ChunkResolution + 1.0;
+	return vec3(texel / (a_ChunkResolution + 2.0), inRoot.z);
+}
+
+void main() {
+	float spacing = inNode.z / a_PatchResolution;
+	vec2 pos = inNode.xy + inGridPos * spacing;
+
+	vec4 morph = a_LodMorph[int(inNode.w)];
+	float dist = length(vec3(pos - a_LodCamera.xy, a_LodCamera.z));
+	float morphK = clamp((dist - morph.x) * morph.y, 0.0, 1.0);
+	pos -= fract(inGridPos * 0.5) * 2.0 * spacing * morphK;
+
+	vec3 uv = ChunkUV(pos);
+	float outHeight = textureLod(s_ChunkHeights, uv, 0).r;
+	vec4 surface = textureLod(s_ChunkSurface, uv, 0);
+	vec3 v = vec3(pos.x, pos.y, outHeight * height);
+
+	vec2 normalXY = surface.rg * 2.0 - 1.0;
+	vec3 normal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+
+	outColor = vec4(1.0);
+	outNormal = a_NormalMatrix * normalize(normal);
+	outWorldPos = v;
+	gl_Position = a_ModelViewProjection * vec4(v, 1);
+
+	// Layers are dirt, grass and snow, like Terrain.vs.glsl
+	outTexWeights = vec3(surface.b, max(1.0 - surface.b - surface.a, 0.0), surface.a);
+	outUV = v.xy;
+}
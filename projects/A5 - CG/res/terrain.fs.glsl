@@ -1,4 +1,4 @@
-#version 410
+#version 430
 
 layout(location = 0) in vec4 inColor;
 layout(location = 1) in vec3 inNormal;
@@ -12,17 +12,41 @@ layout(location = 0) out vec4 outColor;
 
 uniform vec3  a_CameraPos;
 
+// Shared by all of our shaders, see Game::FrameUniforms
+layout(std140, binding = 0) uniform FrameData {
+	mat4 a_FrameView;
+	mat4 a_FrameProjection;
+	vec4 a_FrameCameraPos; // w is the time in seconds
+	vec4 a_AmbientSH[9];   // The diffuse light from our skybox, as spherical harmonics
+	mat4 a_FrameInverseViewProjection;
+};
+
 uniform vec3  a_AmbientColor;
 uniform float a_AmbientPower;
 
-// New in tutorial 06
-uniform sampler2D s_Albedos[3];
+// Layers are dirt, grass and snow
+uniform sampler2DArray s_Albedos;
 
 uniform vec3  a_LightPos;
 uniform vec3  a_LightColor;
 uniform float a_LightShininess;
 uniform float a_LightAttenuation;
 
+// Evaluates our ambient spherical harmonics for a (normalized) direction in cubemap space
+vec3 EvaluateAmbient(vec3 d) {
+	vec3 result =
+		a_AmbientSH[0].xyz * 0.282095 +
+		a_AmbientSH[1].xyz * 0.488603 * d.y +
+		a_AmbientSH[2].xyz * 0.488603 * d.z +
+		a_AmbientSH[3].xyz * 0.488603 * d.x +
+		a_AmbientSH[4].xyz * 1.092548 * d.x * d.y +
+		a_AmbientSH[5].xyz * 1.092548 * d.y * d.z +
+		a_AmbientSH[6].xyz * 0.315392 * (3.0 * d.z * d.z - 1.0) +
+		a_AmbientSH[7].xyz * 1.092548 * d.x * d.z +
+		a_AmbientSH[8].xyz * 0.546274 * (d.x * d.x - d.y * d.y);
+	return max(result, vec3(0.0));
+}
+
 void main() {
 	// Re-normalize our input, so that it is always length 1
 	vec3 norm = normalize(inNormal);
@@ -52,8 +76,8 @@ void main() {
 	// Calculate our diffuse output
 	vec3  diffuseOut = diffuseFactor * a_LightColor;
 
-	// Our ambient is simply the color times the ambient power
-	vec3 ambientOut = a_AmbientColor * a_AmbientPower;
+	// Our ambient comes from the skybox, tinted by our ambient color (cubemaps are Y up, so we swizzle like the skybox does)
+	vec3 ambientOut = a_AmbientColor * a_AmbientPower * EvaluateAmbient(norm.xzy);
 
 	// We will use a modified form of distance squared attenuation, which will avoid divide
 	// by zero errors and allow us to control the light's attenuation via a uniform
@@ -66,9 +90,9 @@ void main() {
 	// Below is modified for tutorial 10
 	// Previously was: vec4 albedo = texture(s_Albedo, inUV);
 	vec4 albedo =
-	 texture(s_Albedos[0], inUV) * weights.x +
-	 texture(s_Albedos[1], inUV) * weights.y +
-	 texture(s_Albedos[2], inUV) * weights.z;
+	 texture(s_Albedos, vec3(inUV, 0)) * weights.x +
+	 texture(s_Albedos, vec3(inUV, 1)) * weights.y +
+	 texture(s_Albedos, vec3(inUV, 2)) * weights.z;
 
 	// Our result is our lighting multiplied by our object's color
 	vec3 result = (ambientOut + attenuation * (diffuseOut + specOut)) * albedo.xyz * inColor.xyz;
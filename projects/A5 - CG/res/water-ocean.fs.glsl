@@ -0,0 +1,43 @@
+#version 430
+// Same lighting as water-shader.fs.glsl, but our normal comes from the FFT ocean's slope map (see Ocean.h), so the
+// detail doesn't depend on how many vertices we have
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inWorldPos;
+layout(location = 3) in vec2 inUV;
+layout(location = 0) out vec4 outColor;
+
+uniform vec3 a_CameraPos;
+
+uniform sampler2D s_OceanSlopes; // xy is dh/dx and dh/dy
+
+uniform vec3 a_WaterColor; // The color of the water
+uniform float a_WaterAlpha; // The alpha value for all water rendering (quick hack for transparent water)
+uniform float a_WaterClarity; // Mixing value for water albedo and reflection / refraction effects
+uniform float a_FresnelPower; // How much reflection is applied
+uniform float a_RefractionIndex; // Should be source / material refractive index (1 / 1.33 for water)
+uniform float a_Roughness; // How blurry our reflections are, picks a level from the prefiltered environment
+uniform samplerCube s_Environment;
+
+void main() {
+	vec2 slope = texture(s_OceanSlopes, inUV).xy;
+	vec3 norm = normalize(vec3(-slope, 1.0));
+	// Determine the direction between the camera and the pixel
+	vec3 viewDir = normalize(inWorldPos - a_CameraPos);
+
+	vec3 reflection = normalize(reflect(viewDir, norm));
+	vec3 refraction = normalize(refract(viewDir, norm, a_RefractionIndex));
+	// The environment's mips are prefiltered for increasing roughness, so we pick our level directly
+	float lod = a_Roughness * float(textureQueryLevels(s_Environment) - 1);
+	vec3 reflected = textureLod(s_Environment, reflection.xzy, lod).rgb;
+	vec3 refracted = textureLod(s_Environment, refraction.xzy, lod).rgb;
+
+	// Calculate our fresnel power
+	vec3 fresnel = vec3(dot(-viewDir, norm)) * a_FresnelPower;
+	// Combine our refracted and reflected components
+	vec3 environmentVal = refracted * (1.0 - fresnel) + reflected * fresnel;
+
+	// We mix together our albedo and our water's clarity
+	vec3 result = mix(a_WaterColor, environmentVal, a_WaterClarity);
+	outColor = vec4(result, inColor.a * a_WaterAlpha);
+}
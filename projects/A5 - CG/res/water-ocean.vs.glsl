@@ -0,0 +1,58 @@
+#version 430
+// The FFT ocean, see Ocean.h. Our vertices are a grid in screen space (xy is in NDC), that gets projected down onto
+// the water every frame. That way we always have the same number of vertices, and they are densest near the camera
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec3 outNormal;
+layout(location = 2) out vec3 outWorldPos;
+layout(location = 3) out vec2 outUV;
+
+layout(std140, binding = 0) uniform FrameData {
+	mat4 a_FrameView;
+	mat4 a_FrameProjection;
+	vec4 a_FrameCameraPos; // w is the time in seconds
+	vec4 a_AmbientSH[9];   // The diffuse light from our skybox, as spherical harmonics
+	mat4 a_FrameInverseViewProjection;
+};
+
+// xyz is how far each spot on the water moves, tiles every a_OceanPatchSize units
+uniform sampler2D s_OceanDisplacement;
+uniform float a_OceanPatchSize;
+// The height of the calm water, the grid is always projected onto this plane
+uniform float a_WaterLevel;
+// How far out from the camera the water goes, anything past this (like the sky) gets pulled in to the horizon
+uniform float a_MaxDistance;
+// The distance between our grid's vertices, in NDC
+uniform float a_GridStep;
+
+vec3 ProjectToWater(vec2 ndc) {
+	vec4 nearPoint = a_FrameInverseViewProjection * vec4(ndc, -1.0, 1.0);
+	vec4 farPoint = a_FrameInverseViewProjection * vec4(ndc, 1.0, 1.0);
+	vec3 origin = nearPoint.xyz / nearPoint.w;
+	vec3 dir = farPoint.xyz / farPoint.w - origin;
+
+	float maxT = a_MaxDistance / max(length(dir.xy), 1e-6);
+	float t = dir.z < 0.0 ? (a_WaterLevel - origin.z) / dir.z : maxT;
+	t = clamp(t, 0.0, maxT);
+	return vec3(origin.xy + dir.xy * t, a_WaterLevel);
+}
+
+void main() {
+	vec3 pos = ProjectToWater(inPosition.xy);
+	vec2 uv = pos.xy / a_OceanPatchSize;
+
+	// Pick the mip that matches how far apart our vertices are out here, so distant vertices don't alias
+	float spacing = distance(pos, ProjectToWater(inPosition.xy + vec2(a_GridStep, 0.0)));
+	float texel = a_OceanPatchSize / float(textureSize(s_OceanDisplacement, 0).x);
+	float lod = max(log2(spacing / texel), 0.0);
+	pos += textureLod(s_OceanDisplacement, uv, lod).xyz;
+
+	outColor = inColor;
+	// The real normal comes from the slope map, per pixel
+	outNormal = vec3(0.0, 0.0, 1.0);
+	outWorldPos = pos;
+	outUV = uv;
+	gl_Position = a_FrameProjection * a_FrameView * vec4(pos, 1.0);
+}
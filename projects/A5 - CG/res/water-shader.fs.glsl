@@ -1,4 +1,4 @@
-#version 410
+#version 430
 layout(location = 0) in vec4 inColor;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 inWorldPos;
@@ -11,6 +11,7 @@ uniform float a_WaterAlpha; // The alpha value for all water rendering (quick ha
 uniform float a_WaterClarity; // Mixing value for water albedo and reflection / refraction effects
 uniform float a_FresnelPower; // How much reflection is applied
 uniform float a_RefractionIndex; // Should be source / material refractive index (1 / 1.33 for water)
+uniform float a_Roughness; // How blurry our reflections are, picks a level from the prefiltered environment
 uniform samplerCube s_Environment;
 
 void main() {
@@ -21,8 +22,10 @@ void main() {
 
  vec3 reflection = normalize(reflect(viewDir, norm));
  vec3 refraction = normalize(refract(viewDir, norm, a_RefractionIndex));
- vec3 reflected = texture(s_Environment, reflection.xzy).rgb;
- vec3 refracted = texture(s_Environment, refraction.xzy).rgb;
+ // The environment's mips are prefiltered for increasing roughness, so we pick our level directly
+ float lod = a_Roughness * float(textureQueryLevels(s_Environment) - 1);
+ vec3 reflected = textureLod(s_Environment, reflection.xzy, lod).rgb;
+ vec3 refracted = textureLod(s_Environment, refraction.xzy, lod).rgb;
 
  // Calculate our fresnel power
  vec3 fresnel = vec3(dot(-viewDir, norm)) * a_FresnelPower;
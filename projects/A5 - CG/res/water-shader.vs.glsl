@@ -12,12 +12,17 @@ layout(location = 2) out vec3 outWorldPos;
 #define MAX_WAVES 8
 uniform mat4 a_ModelViewProjection;
 uniform mat4 a_ModelView;
+uniform mat4 a_Model;
 
 uniform float a_Time;
 uniform float a_Gravity; // This needs to match world units (ex: 9.81 if unit is meters)
 uniform int a_EnabledWaves;
 uniform vec4 a_Waves[MAX_WAVES];
 
+// Ripples from things moving through the water (see RippleField.h), r is the height to add
+uniform sampler2D s_Ripples;
+uniform vec3 a_RippleArea; // xy is the min corner of the ripple grid in world space, z is it's size (0 for no ripples)
+
 vec3 GerstnerWave(vec4 waveInfo, vec3 pos, inout vec3 tangent, inout vec3 binorm) {
  // Our steepness is how 'sharp' the wave is
  float steepness = waveInfo.z;
@@ -63,6 +68,17 @@ void main() {
  for (int ix = 0; ix < a_EnabledWaves && ix < MAX_WAVES; ix++) {
  result += GerstnerWave(a_Waves[ix], pos, tangent, binorm) + 0.55; //shift wave up, not good but it works
  }
+ if (a_RippleArea.z > 0.0) {
+ // The ripples stay put in the world, so we sample them where the vertex ended up
+ vec2 rippleUV = ((a_Model * vec4(result, 1)).xy - a_RippleArea.xy) / a_RippleArea.z;
+ float texel = 1.0 / float(textureSize(s_Ripples, 0).x);
+ result.z += texture(s_Ripples, rippleUV).r;
+ // Tilt our normal with the ripples, using the slope across the neighbouring texels
+ float slopeX = (texture(s_Ripples, rippleUV + vec2(texel, 0)).r - texture(s_Ripples, rippleUV - vec2(texel, 0)).r) / (2 * texel * a_RippleArea.z);
+ float slopeY = (texture(s_Ripples, rippleUV + vec2(0, texel)).r - texture(s_Ripples, rippleUV - vec2(0, texel)).r) / (2 * texel * a_RippleArea.z);
+ tangent.z += slopeX;
+ binorm.z += slopeY;
+ }
  outNormal = normalize(cross(tangent, binorm));
  outWorldPos = result;
  gl_Position = a_ModelViewProjection * vec4(result, 1);
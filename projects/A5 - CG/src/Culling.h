@@ -0,0 +1,23 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+// Tests a box against a view projection, returns false if the box is completely outside of one of the planes
+inline bool BoxInFrustum(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& viewProjection) {
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int ix = 0; ix < 8; ix++) {
+		glm::vec4 clip = viewProjection * glm::vec4(
+			(ix & 1) ? boxMax.x : boxMin.x,
+			(ix & 2) ? boxMax.y : boxMin.y,
+			(ix & 4) ? boxMax.z : boxMin.z, 1.0f);
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z < -clip.w;
+		outside[5] += clip.z > clip.w;
+	}
+	for (int plane = 0; plane < 6; plane++)
+		if (outside[plane] == 8)
+			return false;
+	return true;
+}
@@ -13,14 +13,21 @@
 
 #include "SceneManager.h"
 #include "MeshRenderer.h"
+#include "Terrain.h"
+#include "Vegetation.h"
 #include "Material.h"
 
 #include "Texture2D.h"
+#include "Texture2DArray.h"
+#include "TextureAtlas.h"
+#include "Parallel.h"
 #include "ObjLoader.h"
 
 #include "Transform.h"
 
+#include <filesystem>
 #include <functional>
+#include <random>
 
 //Lecture Includes
 #include <glad/glad.h>
@@ -96,6 +103,9 @@ void Game::Run()
 		float thisFrame = glfwGetTime();
 		float deltaTime = thisFrame - prevFrame;
 
+		// Stream in any texture mips that have finished generating
+		Texture2D::UpdateUploads();
+
 		Update(deltaTime);
 		Draw(deltaTime);
 
@@ -164,6 +174,7 @@ void Game::Initialize() {
 }
 
 void Game::Shutdown() {
+	Parallel::Shutdown();
 	glfwTerminate();
 }
 Mesh::Sptr MakeInvertedCube() {
@@ -183,6 +194,41 @@ Mesh::Sptr MakeInvertedCube() {
 	// Create a new mesh from the data
 	return std::make_shared<Mesh>(verts, 8, indices, 36);
 }
+/*
+	Creates the data for a unit cube that sits on the origin (z goes from 0 to 1), with every face getting the whole
+	[0, 1] UV range, so that it can be remapped into an atlas before we make a mesh out of it
+*/
+MeshData MakeCubeData() {
+	// The normal of each face, along with the two axes that it's UVs run along
+	glm::vec3 faces[6][3] = {
+		{ {  1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+		{ { -1, 0, 0 }, { 0,-1, 0 }, { 0, 0, 1 } },
+		{ {  0, 1, 0 }, {-1, 0, 0 }, { 0, 0, 1 } },
+		{ {  0,-1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+		{ {  0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ {  0, 0,-1 }, {-1, 0, 0 }, { 0, 1, 0 } }
+	};
+	glm::vec2 corners[4] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+
+	MeshData result;
+	for (const auto& face : faces) {
+		uint32_t first = (uint32_t)result.Vertices.size();
+		for (const glm::vec2& corner : corners) {
+			Vertex vert;
+			glm::vec3 pos = face[0] * 0.5f + face[1] * (corner.x - 0.5f) + face[2] * (corner.y - 0.5f);
+			vert.Position = pos + glm::vec3(0.0f, 0.0f, 0.5f);
+			vert.Color = glm::vec4(1.0f);
+			vert.Normal = face[0];
+			vert.UV = corner;
+			result.Vertices.push_back(vert);
+		}
+		// Our axes are picked so that this winding faces outwards
+		uint32_t quad[6] = { 0, 1, 2, 2, 1, 3 };
+		for (uint32_t index : quad)
+			result.Indices.push_back(first + index);
+	}
+	return result;
+}
 Mesh::Sptr MakeSubdividedPlane(float size, int numSections, bool worldUvs = true) {
 	LOG_ASSERT(numSections > 0, "Number of sections must be greater than 0!");
 	LOG_ASSERT(size != 0, "Size cannot be zero!");
@@ -248,6 +294,50 @@ Mesh::Sptr MakeSubdividedPlane(float size, int numSections, bool worldUvs = true
 	return result;
 }
 
+/*
+	Creates a grid that covers the screen, with it's positions in NDC, for water-ocean.vs.glsl to project onto the water
+	@param columns The number of quads across the grid
+	@param rows    The number of quads down the grid
+	@param margin  How far past the edges of the screen the grid goes (1 is exactly the screen), so that waves
+	               that get pushed sideways don't leave gaps at the edges
+*/
+Mesh::Sptr MakeProjectedGrid(int columns, int rows, float margin) {
+	LOG_ASSERT(columns > 0 && rows > 0, "Number of sections must be greater than 0!");
+	size_t vertexCount = (size_t)(columns + 1) * (rows + 1);
+	size_t indexCount = (size_t)columns * rows * 6;
+	Vertex* vertices = new Vertex[vertexCount];
+	uint32_t* indices = new uint32_t[indexCount];
+
+	for (int iy = 0; iy <= rows; iy++) {
+		for (int ix = 0; ix <= columns; ix++) {
+			Vertex& vert = vertices[iy * (columns + 1) + ix];
+			vert.Position = glm::vec3(-margin + 2.0f * margin * ix / columns, -margin + 2.0f * margin * iy / rows, 0.0f);
+			vert.Color = glm::vec4(1.0f);
+			vert.Normal = glm::vec3(0, 0, 1);
+			vert.UV = glm::vec2((float)ix / columns, (float)iy / rows);
+		}
+	}
+	uint32_t index = 0;
+	for (int iy = 0; iy < rows; iy++) {
+		for (int ix = 0; ix < columns; ix++) {
+			uint32_t p1 = iy * (columns + 1) + ix;
+			uint32_t p2 = p1 + 1;
+			uint32_t p3 = p1 + (columns + 1);
+			uint32_t p4 = p3 + 1;
+			indices[index++] = p1;
+			indices[index++] = p2;
+			indices[index++] = p3;
+			indices[index++] = p3;
+			indices[index++] = p2;
+			indices[index++] = p4;
+		}
+	}
+	Mesh::Sptr result = std::make_shared<Mesh>(vertices, vertexCount, indices, indexCount);
+	delete[] vertices;
+	delete[] indices;
+	return result;
+}
+
 glm::vec4 testColor = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
 void Game::LoadContent() {
 	//The 4 cameras
@@ -308,25 +398,62 @@ void Game::LoadContent() {
 	description.MinFilter = MinFilter::LinearMipNearest;
 	description.MagFilter = MagFilter::Linear;
 	description.WrapS = description.WrapT = WrapMode::Repeat;
-	TextureSampler::Sptr Linear = std::make_shared<TextureSampler>(description);
+	TextureSampler::Sptr Linear = TextureSampler::Get(description);
+
+	// The terrain textures get minified a lot, so they need proper mips, filtered in linear space. Since they
+	// are always used together, they live in a single texture array so the terrain only needs one bind
+	Texture2DDescription terrainTexture = Texture2DDescription();
+	terrainTexture.EnableMip = true;
+	terrainTexture.MipMode = MipGeneration::CpuSrgb;
+	terrainTexture.Compress = true;
+	Texture2DArray::Sptr terrainAlbedos = Texture2DArray::LoadFromFiles({ "dirt.png", "grass.png", "snow.png" }, terrainTexture);
+
+	// Both of our terrains (the heightmap and the streamed one) are lit the same way
+	auto setTerrainLighting = [&](const Material::Sptr& material) {
+		material->Set("a_LightPos", { 2, 0, 6 }); //was 2, 0, 4 moved light up a bit
+		material->Set("a_LightColor", { 1.0f, 1.0f, 1.0f });
+		material->Set("a_AmbientColor", { 1.0f, 1.0f, 1.0f });
+		material->Set("a_AmbientPower", 0.35f); // Scales the ambient light from the skybox
+		material->Set("a_LightSpecPower", 0.75f);
+		material->Set("a_LightShininess", 256.0f);
+		material->Set("a_LightAttenuation", 1.0f / 100.0f);
+		material->Set("s_Albedos", terrainAlbedos, Linear);
+	};
 
 	Material::Sptr testMat = std::make_shared<Material>(phong);
-	testMat->Set("a_LightPos", { 2, 0, 6 }); //was 2, 0, 4 moved light up a bit
-	testMat->Set("a_LightColor", { 1.0f, 1.0f, 1.0f });
-	testMat->Set("a_AmbientColor", { 1.0f, 1.0f, 1.0f });
-	testMat->Set("a_AmbientPower", 0.1f);
-	testMat->Set("a_LightSpecPower", 0.75f);
-	testMat->Set("a_LightShininess", 256.0f);
-	testMat->Set("a_LightAttenuation", 1.0f / 100.0f);
+	setTerrainLighting(testMat);
 	//testMat->Set("s_Albedo", albedo, NearestMipped);
-	testMat->Set("s_Albedos[0]", Texture2D::LoadFromFile("dirt.png"), Linear);
-	testMat->Set("s_Albedos[1]", Texture2D::LoadFromFile("grass.png"), Linear);
-	testMat->Set("s_Albedos[2]", Texture2D::LoadFromFile("snow.png"), Linear);
 
-	testMat->Set("myTextureSampler", Texture2D::LoadFromFile("heightmap.bmp"));
 	//This will make the height of the thing but it also shifts it up
-	float heightM = 4.75f; //4.75 is a decent height, if too tall the lighting wont work
-	testMat->Set("height", heightM);
+	//4.75 is a decent height, if too tall the lighting wont work
+	myGround = HeightField::LoadFromFile("heightmap.bmp", 10.0f, 4.75f);
+	Terrain::Sptr terrain = std::make_shared<Terrain>(myGround);
+	testMat->Set("myTextureSampler", terrain->GetHeightmap());
+	testMat->Set("height", myGround->GetHeightScale());
+
+	// The terrain blends 3 textures and does full lighting per pixel, so we lay its depth down first
+	Shader::Sptr terrainDepth = std::make_shared<Shader>();
+	terrainDepth->Load("Terrain.vs.glsl", "depth-only.fs.glsl");
+	testMat->DepthPrePassShader = terrainDepth;
+
+	// Our second scene gets an endless terrain, that is generated around the camera as it moves. If we have a
+	// tiled heightmap (see TiledHeightmap::Build) we page that in instead
+	TerrainStreamerDescription streamDesc;
+	if (std::filesystem::exists("heightmap.tiles")) {
+		streamDesc.Tiles = TiledHeightmap::Open("heightmap.tiles");
+		if (streamDesc.Tiles != nullptr)
+			streamDesc.ChunkResolution = streamDesc.Tiles->GetTileSize();
+	}
+	myStreamedGround = std::make_shared<TerrainStreamer>(streamDesc);
+	Shader::Sptr streamShader = std::make_shared<Shader>();
+	streamShader->Load("terrain-stream.vs.glsl", "terrain.fs.glsl");
+	Shader::Sptr streamDepth = std::make_shared<Shader>();
+	streamDepth->Load("terrain-stream.vs.glsl", "depth-only.fs.glsl");
+	Material::Sptr streamMat = std::make_shared<Material>(streamShader);
+	setTerrainLighting(streamMat);
+	streamMat->Set("s_ChunkHeights", myStreamedGround->GetHeights());
+	streamMat->Set("s_ChunkSurface", myStreamedGround->GetSurface());
+	streamMat->DepthPrePassShader = streamDepth;
 	
 		
 	SceneManager::RegisterScene("Test");
@@ -347,18 +474,34 @@ void Game::LoadContent() {
 		std::string("cubemap/graycloud_ft.jpg"),
 		std::string("cubemap/graycloud_bk.jpg")
 	};
-	scene->Skybox = TextureCube::LoadFromFiles(files);
+	scene->Skybox = TextureCube::LoadFromFiles(files, true, true);
+	// Our ambient light comes from the skybox, we only need to project it once
+	scene->AmbientSH = SphericalHarmonics::Project(scene->Skybox);
+
+	// The streamed terrain scene uses the same sky
+	Scene* streamScene = SceneManager::Get("Test2");
+	streamScene->SkyboxShader = scene->SkyboxShader;
+	streamScene->SkyboxMesh = scene->SkyboxMesh;
+	streamScene->Skybox = scene->Skybox;
+	streamScene->AmbientSH = scene->AmbientSH;
+	{
+		auto& ecs = GetRegistry("Test2");
+		entt::entity e1 = ecs.create();
+		TerrainRenderer& m1 = ecs.assign<TerrainRenderer>(e1);
+		m1.Material = streamMat;
+		m1.Terrain = myStreamedGround;
+	}
 
 	{
 		
 		auto& ecs = GetRegistry("Test");
 
 		entt::entity e1 = ecs.create();
-		MeshRenderer& m1 = ecs.assign<MeshRenderer>(e1);
+		TerrainRenderer& m1 = ecs.assign<TerrainRenderer>(e1);
 		//m1.Material = testMat;
 		//m1.Mesh = myMesh;
 		m1.Material = testMat;
-		m1.Mesh = MakeSubdividedPlane(10.0f, 100, false);
+		m1.Terrain = terrain;
 		//*/
 		
 	}
@@ -378,6 +521,7 @@ void Game::LoadContent() {
 		testMat->Set("a_WaterClarity", 0.9f);
 		testMat->Set("a_FresnelPower", 0.5f);
 		testMat->Set("a_RefractionIndex", 1.0f / 1.34f);
+		testMat->Set("a_Roughness", 0.15f);
 		testMat->Set("s_Environment", scene->Skybox);
 
 		auto& ecs = GetRegistry("Test"); //If scene name chaged, change this
@@ -385,12 +529,124 @@ void Game::LoadContent() {
 		MeshRenderer& m1 = ecs.assign<MeshRenderer>(waterEntity);
 		m1.Material = testMat;
 		m1.Mesh = MakeSubdividedPlane(20.0f, 100);
+		myWaves = GerstnerWaves::FromMaterial(testMat);
+		myWaterExtent = 10.0f;
+		myWaterEntity = waterEntity;
+		myWaterModes[0] = m1;
+
+		myRipples = std::make_shared<RippleField>();
+		testMat->Set("s_Ripples", myRipples->GetTexture());
+		testMat->Set("a_RippleArea", myRipples->GetArea());
+
+		// Something circling the island, so that there are always some ripples to look at. It bobs along on the waves
+		entt::entity wake = ecs.create();
+		ecs.assign<RippleEmitter>(wake);
+		ecs.assign<Transform>(wake);
+		ecs.assign<UpdateBehaviour>(wake).Function = [this](entt::entity e, float dt) {
+			float time = static_cast<float>(glfwGetTime());
+			glm::vec2 position = glm::vec2(glm::cos(time * 0.4f), glm::sin(time * 0.4f)) * 6.0f;
+			GetRegistry("Test").get<Transform>(e).SetPosition(glm::vec3(position, myWaves->GetHeight(position, time)));
+		};
+
+		// The FFT ocean goes on forever, and always has the same number of vertices (see Ocean.h)
+		myOcean = std::make_shared<Ocean>();
+		Shader::Sptr oceanShader = std::make_shared<Shader>();
+		oceanShader->Load("water-ocean.vs.glsl", "water-ocean.fs.glsl");
+		Material::Sptr oceanMat = std::make_shared<Material>(oceanShader);
+		oceanMat->HasTransparency = true;
+		for (const char* name : { "a_WaterAlpha", "a_WaterClarity", "a_FresnelPower", "a_RefractionIndex", "a_Roughness" }) {
+			float value = 0.0f;
+			testMat->TryGet(name, value);
+			oceanMat->Set(name, value);
+		}
+		oceanMat->Set("a_WaterColor", { 0.8f, 1.0f, 0.95f });
+		oceanMat->Set("s_Environment", scene->Skybox);
+		oceanMat->Set("s_OceanDisplacement", myOcean->GetDisplacement());
+		oceanMat->Set("s_OceanSlopes", myOcean->GetSlopes());
+		oceanMat->Set("a_OceanPatchSize", myOcean->GetDescription().PatchSize);
+		// Sits at the same height as the Gerstner water's offset
+		oceanMat->Set("a_WaterLevel", GerstnerWaves::WaveOffset * myWaves->GetWaveCount());
+		oceanMat->Set("a_MaxDistance", 200.0f);
+		const int gridSize = 128;
+		const float gridMargin = 1.1f;
+		oceanMat->Set("a_GridStep", 2.0f * gridMargin / gridSize);
+		myWaterModes[1].Material = oceanMat;
+		myWaterModes[1].Mesh = MakeProjectedGrid(gridSize, gridSize, gridMargin);
 
 		auto& transform = ecs.get_or_assign<Transform>(waterEntity);
 		//Tried but I moved water up in vertex shader, just added .55 
 		//transform.SetPosition.z = terrainScale * 0.3; // Trying to move water up
 
 	}
+	{
+		// Grass grows wherever the terrain shows it's grass texture, as long as it's above the water
+		Shader::Sptr grassShader = std::make_shared<Shader>();
+		grassShader->Load("grass.vs.glsl", "grass.fs.glsl");
+		Material::Sptr grassMat = std::make_shared<Material>(grassShader);
+		setTerrainLighting(grassMat);
+
+		VegetationDescription grassDesc;
+		grassDesc.MinHeight = GerstnerWaves::WaveOffset * myWaves->GetWaveCount() + 0.1f;
+
+		auto& ecs = GetRegistry("Test");
+		entt::entity e1 = ecs.create();
+		VegetationRenderer& m1 = ecs.assign<VegetationRenderer>(e1);
+		m1.Material = grassMat;
+		m1.Vegetation = std::make_shared<Vegetation>(myGround, grassDesc);
+	}
+	{
+		// Crates scattered around the island. Their textures are tiny, so rather than a material each, they all
+		// share one atlas and one material, and get drawn back to back without any state changes
+		std::vector<std::string> propTextures = { "dirt.png", "grass.png", "snow.png" };
+		TextureAtlasDescription atlasDesc;
+		atlasDesc.Options.EnableMip = true;
+		atlasDesc.Options.MipMode = MipGeneration::CpuSrgb;
+		TextureAtlas::Sptr propAtlas = TextureAtlas::Build(propTextures, atlasDesc);
+
+		if (propAtlas != nullptr) {
+			Shader::Sptr propShader = std::make_shared<Shader>();
+			propShader->Load("prop.vs.glsl", "prop.fs.glsl");
+			Material::Sptr propMat = std::make_shared<Material>(propShader);
+			setTerrainLighting(propMat);
+			// Regions are clamped, so we never wrap into our neighbours
+			SamplerDesc propSampler = description;
+			propSampler.WrapS = propSampler.WrapT = WrapMode::ClampToEdge;
+			propMat->Set("s_Atlas", propAtlas->GetTexture(), TextureSampler::Get(propSampler));
+
+			// One mesh per texture, with it's UVs moved into that texture's region
+			MeshData cube = MakeCubeData();
+			std::vector<Mesh::Sptr> propMeshes;
+			for (const std::string& texture : propTextures) {
+				MeshData data = cube;
+				TextureAtlas::RemapUVs(data, propAtlas->GetRegion(texture));
+				propMeshes.push_back(std::make_shared<Mesh>(data.Vertices.data(), data.Vertices.size(), data.Indices.data(), data.Indices.size()));
+			}
+
+			// Keep them out of the water, the same as the grass
+			float minHeight = GerstnerWaves::WaveOffset * myWaves->GetWaveCount() + 0.1f;
+			float halfSize = myGround->GetSize() / 2.0f;
+			std::mt19937 random(1234);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			auto& ecs = GetRegistry("Test");
+			for (int placed = 0, tries = 0; placed < 40 && tries < 400; tries++) {
+				glm::vec2 position = glm::vec2(unit(random), unit(random)) * halfSize * 2.0f - halfSize;
+				float height = myGround->GetHeight(position);
+				if (height < minHeight)
+					continue;
+				float size = 0.08f + unit(random) * 0.08f;
+				entt::entity prop = ecs.create();
+				MeshRenderer& renderer = ecs.assign<MeshRenderer>(prop);
+				renderer.Material = propMat;
+				renderer.Mesh = propMeshes[placed % propMeshes.size()];
+				// Sunk in a little, so that they don't float on slopes
+				ecs.assign<Transform>(prop)
+					.SetPosition(glm::vec3(position, height - size * 0.25f))
+					.SetRotation(glm::vec3(0.0f, 0.0f, unit(random) * glm::two_pi<float>()))
+					.SetScale(size);
+				placed++;
+			}
+		}
+	}
 
 	//Mouse Input (here and not input so mouse doesn't go crazy)
 	//Dividing to properly set up mouse input 
@@ -403,11 +659,16 @@ void Game::LoadContent() {
 
 	//Get the fps mouse movement
 	glfwSetInputMode(myWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+
+	// Create the queries we'll use to time our scene rendering
+	glCreateQueries(GL_TIME_ELAPSED, 2, myFrameTimers);
+
+	myFrameUniforms = std::make_shared<UniformBuffer>(sizeof(FrameUniforms));
 }
 
 
 void Game::UnloadContent() {
-
+	glDeleteQueries(2, myFrameTimers);
 }
 
 void Game::InitImGui() {
@@ -600,8 +861,31 @@ void Game::Update(float deltaTime) {
 		myCamera3->Rotate(rotation);
 		myCamera3->Move(movement);
 	}
+
+	// Don't let the main camera go underneath the terrain (the terrain entities sit at the origin)
+	bool streaming = myStreamedGround != nullptr && CurrentScene() == SceneManager::Get("Test2");
+	if (streaming) {
+		// Chunks are streamed in around the main camera, the other viewports just see whatever is loaded
+		myStreamedGround->Update(myCamera->GetPosition());
+		glm::vec3 position = myCamera->GetPosition();
+		float groundHeight;
+		if (myStreamedGround->GetHeight(glm::vec2(position), groundHeight) && position.z < groundHeight + 0.25f)
+			myCamera->SetPosition(glm::vec3(position.x, position.y, groundHeight + 0.25f));
+	} else if (myGround != nullptr) {
+		glm::vec3 position = myCamera->GetPosition();
+		float minHeight = myGround->GetHeight(glm::vec2(position)) + 0.25f;
+		// Or underneath the water, which uses the same time as it's shader (the water also sits at the origin)
+		if (myWaves != nullptr && !myOceanEnabled && glm::abs(position.x) < myWaterExtent && glm::abs(position.y) < myWaterExtent)
+			minHeight = glm::max(minHeight, myWaves->GetHeight(glm::vec2(position), static_cast<float>(glfwGetTime())) + 0.25f);
+		if (position.z < minHeight)
+			myCamera->SetPosition(glm::vec3(position.x, position.y, minHeight));
+	}
 	
 
+	// The ocean regenerates it's maps on the CPU, so only bother when it can be seen
+	if (myOcean != nullptr && myOceanEnabled && CurrentScene() == SceneManager::Get("Test"))
+		myOcean->Update(static_cast<float>(glfwGetTime()));
+
 	// Rotate our transformation matrix a little bit each frame
 	myModelTransform = glm::rotate(myModelTransform, deltaTime, glm::vec3(0, 0, 1));
 
@@ -612,10 +896,42 @@ void Game::Update(float deltaTime) {
 			func.Function(e, deltaTime);
 		}
 	}
+
+	// Vegetation chunks are generated on the worker threads, and get uploaded here as they finish
+	auto vegetation = CurrentRegistry().view<VegetationRenderer>();
+	for (const auto& e : vegetation) {
+		const VegetationRenderer& renderer = vegetation.get(e);
+		if (renderer.Vegetation != nullptr)
+			renderer.Vegetation->Update();
+	}
+
+	// Anything moving through the Gerstner water leaves ripples behind it
+	if (myRipples != nullptr && !myOceanEnabled && CurrentScene() == SceneManager::Get("Test")) {
+		float time = static_cast<float>(glfwGetTime());
+		auto emitters = CurrentRegistry().view<RippleEmitter, Transform>();
+		for (const auto& e : emitters) {
+			RippleEmitter& emitter = emitters.get<RippleEmitter>(e);
+			glm::vec3 position = emitters.get<Transform>(e).GetWorldPosition();
+			float surface = myWaves->GetHeight(glm::vec2(position), time) + myRipples->GetHeight(glm::vec2(position));
+			if (emitter.HasLastPosition && glm::abs(position.z - surface) < emitter.Radius) {
+				float moved = glm::length(glm::vec2(position - emitter.LastPosition));
+				if (moved > 0.0f)
+					myRipples->AddDisturbance(glm::vec2(position), emitter.Radius, emitter.Strength * moved);
+			}
+			emitter.LastPosition = position;
+			emitter.HasLastPosition = true;
+		}
+		myRipples->Update(glm::vec2(myCamera->GetPosition()), deltaTime);
+		myWaterModes[0].Material->Set("a_RippleArea", myRipples->GetArea());
+	}
 }
 
 void Game::Draw(float deltaTime) {
 	static bool WireFrameON = true;
+
+	// Time how long the GPU spends on our viewports, so we can measure what our render settings buy us
+	glBeginQuery(GL_TIME_ELAPSED, myFrameTimers[myFrameTimerIndex]);
+
 	//View port numbers aren't in order here but it helps me manage the viewport with the camera (so numbers are the same)
 	glm::ivec4 viewport3 = { //bottom left (Ortho Side)
 		0, 0,
@@ -643,6 +959,21 @@ void Game::Draw(float deltaTime) {
 		myWindowSize.x/2, myWindowSize.y / 2
 	};
 	__RenderScene(viewport2, myCamera2, WireFrameON, Active2);
+
+	glEndQuery(GL_TIME_ELAPSED);
+
+	// Read back the previous frame's timer instead of this one's, so that we never stall the pipeline
+	myFrameTimerIndex = (myFrameTimerIndex + 1) % 2;
+	if (myFrameTimerPrimed) {
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(myFrameTimers[myFrameTimerIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsedNs = 0;
+			glGetQueryObjectui64v(myFrameTimers[myFrameTimerIndex], GL_QUERY_RESULT, &elapsedNs);
+			mySceneGpuTimeMs = elapsedNs / 1000000.0f;
+		}
+	}
+	myFrameTimerPrimed |= myFrameTimerIndex == 0;
 }
 
 void Game::DrawGui(float deltaTime) {
@@ -712,9 +1043,95 @@ void Game::DrawGui(float deltaTime) {
 			}
 		}
 	}
+	if (ImGui::CollapsingHeader("Render Settings")) {
+		ImGui::Checkbox("Depth Sorting", &myDepthSortEnabled);
+		ImGui::Checkbox("Depth Pre-pass", &myDepthPrePassEnabled);
+		ImGui::Text("Scene GPU time: %.3f ms", mySceneGpuTimeMs);
+		ImGui::Text("Queued draws: %d", (int)myRenderQueue.size());
+		auto terrains = CurrentRegistry().view<TerrainRenderer>();
+		for (const auto& entity : terrains) {
+			const TerrainStats& stats = terrains.get(entity).Terrain->GetStats();
+			ImGui::Text("Terrain: %d nodes, %d culled, %d triangles", (int)stats.Nodes, (int)stats.Culled, (int)stats.Triangles);
+		}
+		auto vegetation = CurrentRegistry().view<VegetationRenderer>();
+		for (const auto& entity : vegetation) {
+			const VegetationStats& stats = vegetation.get(entity).Vegetation->GetStats();
+			ImGui::Text("Grass: %d chunks drawn, %d culled, %d generating", (int)stats.Drawn, (int)stats.Culled, (int)stats.Pending);
+			ImGui::Text("Grass blades: %d", (int)stats.Blades);
+		}
+		if (myStreamedGround != nullptr && CurrentScene() == SceneManager::Get("Test2")) {
+			const TerrainStreamerStats& stats = myStreamedGround->GetStreamerStats();
+			ImGui::Text("Chunks: %d / %d resident, %d in flight", (int)stats.Resident, (int)stats.Capacity, (int)stats.InFlight);
+			ImGui::Text("Chunks: %d generated, %d cached, %d evicted", (int)stats.Generated, (int)stats.CacheHits, (int)stats.Evicted);
+			ImGui::Text("Chunk uploads: %d KB", (int)(stats.Uploaded / 1024));
+		}
+		if (myOcean != nullptr && ImGui::Checkbox("FFT Ocean", &myOceanEnabled))
+			GetRegistry("Test").get<MeshRenderer>(myWaterEntity) = myWaterModes[myOceanEnabled ? 1 : 0];
+		if (myOceanEnabled)
+			ImGui::Text("Ocean update: %.2f ms", myOcean->GetLastUpdateMs());
+		else if (myRipples != nullptr)
+			ImGui::Text("Ripple update: %.3f ms", myRipples->GetLastUpdateMs());
+		ImGui::Text("Textures streaming: %d", (int)Texture2D::GetPendingUploads());
+		AssetRegistryStats textureStats = Texture2D::GetCacheStats();
+		AssetRegistryStats samplerStats = TextureSampler::GetCacheStats();
+		ImGui::Text("Textures: %d live, %d hits, %d misses", (int)textureStats.Live, (int)textureStats.Hits, (int)textureStats.Misses);
+		ImGui::Text("Samplers: %d live, %d hits, %d misses", (int)samplerStats.Live, (int)samplerStats.Hits, (int)samplerStats.Misses);
+	}
 	ImGui::End();
 }
 
+void Game::__DrawTerrains(const Camera::Sptr& camera, const glm::mat4& viewProjection, bool depthOnly) {
+	auto& ecs = CurrentRegistry();
+	auto terrains = ecs.view<TerrainRenderer>();
+	for (const auto& entity : terrains) {
+		const TerrainRenderer& renderer = terrains.get(entity);
+		if (renderer.Terrain == nullptr || renderer.Material == nullptr)
+			continue;
+
+		const Shader::Sptr& shader = depthOnly ? renderer.Material->DepthPrePassShader : renderer.Material->GetShader();
+		if (shader == nullptr)
+			continue;
+		shader->Bind();
+		shader->SetUniform("a_CameraPos", camera->GetPosition());
+		shader->SetUniform("a_Time", static_cast<float>(glfwGetTime()));
+		if (depthOnly) {
+			renderer.Material->ApplyUniforms(shader);
+		} else {
+			renderer.Material->Apply();
+			glDepthFunc(myDepthPrePassEnabled && renderer.Material->DepthPrePassShader != nullptr ? GL_LEQUAL : GL_LESS);
+		}
+
+		glm::mat4 worldTransform = ecs.get_or_assign<Transform>(entity).GetWorldTransform();
+		shader->SetUniform("a_ModelViewProjection", viewProjection * worldTransform);
+		shader->SetUniform("a_Model", worldTransform);
+		shader->SetUniform("a_NormalMatrix", glm::mat3(glm::transpose(glm::inverse(worldTransform))));
+		renderer.Terrain->Draw(shader);
+	}
+}
+
+void Game::__DrawVegetation(const Camera::Sptr& camera, const glm::mat4& viewProjection) {
+	auto& ecs = CurrentRegistry();
+	auto vegetation = ecs.view<VegetationRenderer>();
+	for (const auto& entity : vegetation) {
+		const VegetationRenderer& renderer = vegetation.get(entity);
+		if (renderer.Vegetation == nullptr || renderer.Material == nullptr)
+			continue;
+
+		const Shader::Sptr& shader = renderer.Material->GetShader();
+		shader->Bind();
+		shader->SetUniform("a_CameraPos", camera->GetPosition());
+		shader->SetUniform("a_Time", static_cast<float>(glfwGetTime()));
+		renderer.Material->Apply();
+		glDepthFunc(GL_LESS);
+
+		glm::mat4 worldTransform = ecs.get_or_assign<Transform>(entity).GetWorldTransform();
+		shader->SetUniform("a_ModelViewProjection", viewProjection * worldTransform);
+		shader->SetUniform("a_Model", worldTransform);
+		shader->SetUniform("a_NormalMatrix", glm::mat3(glm::transpose(glm::inverse(worldTransform))));
+		renderer.Vegetation->Draw(shader);
+	}
+}
+
 void Game::__RenderScene(glm::ivec4 viewport, Camera::Sptr camera, bool WireFrame, bool color)
 {
 	glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
@@ -761,38 +1178,129 @@ void Game::__RenderScene(glm::ivec4 viewport, Camera::Sptr camera, bool WireFram
 	// We'll grab a reference to the ecs to make things easier
 	auto& ecs = CurrentRegistry();
 
-	// We sort our mesh renderers based on material properties
-	// This will group all of our meshes based on shader first, then material second
-	ecs.sort<MeshRenderer>([&](const MeshRenderer& lhs, const MeshRenderer& rhs) {
-		if (rhs.Material == nullptr || rhs.Mesh == nullptr)
-			return false;
-		else if (lhs.Material == nullptr || lhs.Mesh == nullptr)
-			return true;
-		else if (lhs.Material->HasTransparency & !rhs.Material->HasTransparency) //
-			return false; // This section is new
-		else if (!lhs.Material->HasTransparency & rhs.Material->HasTransparency) // The order IS important
-			return true; //
-		else if (lhs.Material->GetShader() != rhs.Material->GetShader())
-			return lhs.Material->GetShader() < rhs.Material->GetShader();
-		else
-			return lhs.Material < rhs.Material;
-		});
+	// We'll need our camera's clip planes to quantize the depth of our objects
+	float zNear, zFar;
+	RenderKey::ExtractClipPlanes(camera->Projection, zNear, zFar);
+	const glm::mat4& viewMatrix = camera->GetView();
+	const glm::mat4 viewProjection = camera->GetViewProjection();
+
+	// Everything that is the same for every shader goes into our frame uniform block, instead of being
+	// set on each shader we bind
+	FrameUniforms frame;
+	frame.View = viewMatrix;
+	frame.Projection = camera->Projection;
+	frame.CameraPosition = glm::vec4(camera->GetPosition(), static_cast<float>(glfwGetTime()));
+	frame.InverseViewProjection = glm::inverse(viewProjection);
+	const SphericalHarmonics& ambient = CurrentScene()->AmbientSH;
+	for (int ix = 0; ix < 9; ix++)
+		frame.AmbientSH[ix] = glm::vec4(ambient.Coefficients[ix], 0.0f);
+	myFrameUniforms->Update(&frame, sizeof(FrameUniforms));
+	myFrameUniforms->Bind(FrameUniformSlot);
+
+	// Build our render queue, every item gets a key from its shader, material and view space depth
+	// Opaques will be drawn front to back within a state bucket (for early-Z), and transparent
+	// objects will be drawn back to front so they blend correctly
+	myRenderQueue.clear();
+	auto renderers = ecs.view<MeshRenderer>();
+	for (const auto& entity : renderers) {
+		const MeshRenderer& renderer = renderers.get(entity);
+
+		// Early bail if mesh is invalid
+		if (renderer.Mesh == nullptr || renderer.Material == nullptr)
+			continue;
+
+		// We'll need some info about the entities position in the world
+		const Transform& transform = ecs.get_or_assign<Transform>(entity);
+
+		RenderItem item;
+		item.Entity = entity;
+		item.WorldTransform = transform.GetWorldTransform();
+
+		// Our depth is the distance along the camera's forward axis to the object's origin
+		float viewDepth = -(viewMatrix * item.WorldTransform[3]).z;
+		uint32_t depth = myDepthSortEnabled ? RenderKey::QuantizeDepth(viewDepth, zNear, zFar) : 0;
+
+		uint32_t shaderId = renderer.Material->GetShader()->GetRenderId();
+		uint32_t materialId = renderer.Material->GetRenderId();
+		item.SortKey = renderer.Material->HasTransparency ?
+			RenderKey::Transparent(shaderId, materialId, depth) :
+			RenderKey::Opaque(shaderId, materialId, depth);
+
+		myRenderQueue.push_back(item);
+	}
+	SortRenderQueue(myRenderQueue);
+
+	// Terrains pick their own patches for this camera, instead of going through the queue
+	auto terrains = ecs.view<TerrainRenderer>();
+	for (const auto& entity : terrains) {
+		const TerrainRenderer& renderer = terrains.get(entity);
+		if (renderer.Terrain == nullptr || renderer.Material == nullptr)
+			continue;
+		glm::mat4 worldTransform = ecs.get_or_assign<Transform>(entity).GetWorldTransform();
+		glm::vec3 localCamera = glm::vec3(glm::inverse(worldTransform) * glm::vec4(camera->GetPosition(), 1.0f));
+		renderer.Terrain->Select(viewProjection * worldTransform, localCamera);
+	}
+	auto vegetation = ecs.view<VegetationRenderer>();
+	for (const auto& entity : vegetation) {
+		const VegetationRenderer& renderer = vegetation.get(entity);
+		if (renderer.Vegetation == nullptr || renderer.Material == nullptr)
+			continue;
+		glm::mat4 worldTransform = ecs.get_or_assign<Transform>(entity).GetWorldTransform();
+		glm::vec3 localCamera = glm::vec3(glm::inverse(worldTransform) * glm::vec4(camera->GetPosition(), 1.0f));
+		renderer.Vegetation->Select(viewProjection * worldTransform, localCamera);
+	}
 
 	// These will keep track of the current shader and material that we have bound
 	Material::Sptr mat = nullptr;
 	Shader::Sptr boundShader = nullptr;
 
-	// A view will let us iterate over all of our entities that have the given component types
-	auto view = ecs.view<MeshRenderer>();
+	// Depth pre-pass, we draw our opaque objects that have a depth shader to the depth buffer only, that
+	// way their expensive fragment shaders will only run on the pixels that are actually visible
+	if (myDepthPrePassEnabled) {
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDisable(GL_BLEND);
+
+		for (const RenderItem& item : myRenderQueue) {
+			// Transparent items are always at the end of our queue, and never write depth
+			if (RenderKey::IsTransparent(item.SortKey))
+				break;
+
+			const MeshRenderer& renderer = renderers.get(item.Entity);
+			const Shader::Sptr& depthShader = renderer.Material->DepthPrePassShader;
+			if (depthShader == nullptr)
+				continue;
+
+			if (depthShader != boundShader) {
+				boundShader = depthShader;
+				boundShader->Bind();
+				boundShader->SetUniform("a_CameraPos", camera->GetPosition());
+				boundShader->SetUniform("a_Time", static_cast<float>(glfwGetTime()));
+				mat = nullptr;
+			}
+			if (renderer.Material != mat) {
+				mat = renderer.Material;
+				mat->ApplyUniforms(depthShader);
+			}
 
-	for (const auto& entity : view) {
+			depthShader->SetUniform("a_ModelViewProjection", viewProjection * item.WorldTransform);
+			depthShader->SetUniform("a_Model", item.WorldTransform);
+			renderer.Mesh->Draw();
+		}
+		__DrawTerrains(camera, viewProjection, true);
 
-		// Get our shader
-		const MeshRenderer& renderer = ecs.get<MeshRenderer>(entity);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		mat = nullptr;
+		boundShader = nullptr;
+	}
 
-		// Early bail if mesh is invalid
-		if (renderer.Mesh == nullptr || renderer.Material == nullptr)
-			continue;
+	// Our terrains are opaque and cover a lot of the screen, so they go first
+	__DrawTerrains(camera, viewProjection, false);
+	__DrawVegetation(camera, viewProjection);
+
+	for (const RenderItem& item : myRenderQueue) {
+
+		// Get our shader
+		const MeshRenderer& renderer = renderers.get(item.Entity);
 
 		// If our shader has changed, we need to bind it and update our frame-level uniforms
 		if (renderer.Material->GetShader() != boundShader) {
@@ -806,13 +1314,12 @@ void Game::__RenderScene(glm::ivec4 viewport, Camera::Sptr camera, bool WireFram
 		if (renderer.Material != mat) {
 			mat = renderer.Material;
 			mat->Apply();
+			// Anything that was in the pre-pass already has its exact depth in the buffer
+			glDepthFunc(myDepthPrePassEnabled && mat->DepthPrePassShader != nullptr ? GL_LEQUAL : GL_LESS);
 		}
 
-		// We'll need some info about the entities position in the world
-		const Transform& transform = ecs.get_or_assign<Transform>(entity);
-
 		// Get the object's transformation
-		glm::mat4 worldTransform = transform.GetWorldTransform();
+		const glm::mat4& worldTransform = item.WorldTransform;
 
 		// Our normal matrix is the inverse-transpose of our object's world rotation
 		glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(worldTransform)));
@@ -820,7 +1327,7 @@ void Game::__RenderScene(glm::ivec4 viewport, Camera::Sptr camera, bool WireFram
 		// Update the MVP using the item's transform
 		mat->GetShader()->SetUniform(
 			"a_ModelViewProjection",
-			camera->GetViewProjection() *
+			viewProjection *
 			worldTransform);
 
 		// Update the model matrix to the item's world transform
@@ -832,6 +1339,7 @@ void Game::__RenderScene(glm::ivec4 viewport, Camera::Sptr camera, bool WireFram
 		// Draw the item
 		renderer.Mesh->Draw();
 	}
+	glDepthFunc(GL_LESS);
 
 	auto scene = CurrentScene();
 	// Draw the skybox after everything else, if the scene has one
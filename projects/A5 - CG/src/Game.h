@@ -12,6 +12,15 @@
 #include "Mesh.h"
 #include "Shader.h"
 #include "Camera.h"
+#include "RenderQueue.h"
+#include "UniformBuffer.h"
+#include "HeightField.h"
+#include "GerstnerWaves.h"
+#include "Ocean.h"
+#include "RippleField.h"
+#include "MeshRenderer.h"
+#include "entt.hpp"
+#include "TerrainStreamer.h"
 
 class Game {
 public:
@@ -41,6 +50,9 @@ protected:
 
 	glm::ivec2 myWindowSize;
 	void __RenderScene(glm::ivec4 viewport, Camera::Sptr camera, bool wireFrame, bool color);
+	// Draws the terrains that were selected for this camera, with either their material or their depth pre-pass shader
+	void __DrawTerrains(const Camera::Sptr& camera, const glm::mat4& viewProjection, bool depthOnly);
+	void __DrawVegetation(const Camera::Sptr& camera, const glm::mat4& viewProjection);
 
 	//Probably use to select viewport (only 1 active at a time)
 	bool Active1 = false; //numbers correspond to camera numbers
@@ -76,6 +88,21 @@ private:
 	// Our models transformation matrix
 	glm::mat4   myModelTransform;
 
+	// The CPU side of our terrain's heights, for keeping things on the ground
+	HeightField::Sptr myGround;
+	// The endless terrain in our second scene, which needs to know where the camera is every frame
+	TerrainStreamer::Sptr myStreamedGround;
+	// The CPU side of the water's waves, and how far the water plane goes out from the origin
+	GerstnerWaves::Sptr myWaves;
+	float myWaterExtent = 0.0f;
+	// The FFT ocean, which can be swapped in for the Gerstner water. Index 0 is the Gerstner water, 1 is the ocean
+	Ocean::Sptr  myOcean;
+	entt::entity myWaterEntity = entt::null;
+	MeshRenderer myWaterModes[2];
+	bool         myOceanEnabled = false;
+	// Ripples from things moving through the Gerstner water, these follow the main camera
+	RippleField::Sptr myRipples;
+
 	//Different Camera Set Up
 	struct Viewport
 	{
@@ -87,4 +114,27 @@ private:
 
 	Viewport myViewports[4];
 
+	// Our per-viewport render queue, kept around so we don't re-allocate it every frame
+	std::vector<RenderItem> myRenderQueue;
+	// Whether we sort by view space depth, and whether we run a depth pre-pass for expensive materials
+	bool myDepthSortEnabled = true;
+	bool myDepthPrePassEnabled = true;
+
+	// Double buffered GPU timer queries, so we can read last frame's result without stalling
+	GLuint myFrameTimers[2] = { 0, 0 };
+	int    myFrameTimerIndex = 0;
+	bool   myFrameTimerPrimed = false;
+	float  mySceneGpuTimeMs = 0.0f;
+
+	// Matches the FrameData uniform block (std140) that our shaders share
+	struct FrameUniforms {
+		glm::mat4 View;
+		glm::mat4 Projection;
+		glm::vec4 CameraPosition; // w is the time in seconds
+		glm::vec4 AmbientSH[9];   // xyz only, see SphericalHarmonics
+		glm::mat4 InverseViewProjection;
+	};
+	static const uint32_t FrameUniformSlot = 0;
+	UniformBuffer::Sptr myFrameUniforms;
+
 };
\ No newline at end of file
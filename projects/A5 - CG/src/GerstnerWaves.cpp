@@ -0,0 +1,152 @@
+#include "GerstnerWaves.h"
+#include "SimdMath.h"
+#include <Parallel.h>
+#include <GLM/gtc/constants.hpp>
+#include <string>
+
+const float GerstnerWaves::WaveOffset = 0.55f;
+
+namespace {
+	// How many Newton steps GetHeights takes, it converges quadratically so this is plenty for sane steepness
+	const int BatchIterations = 5;
+	// GetHeight stops early once it's this close (squared) to the position we asked for
+	const float SolveTolerance = 1e-10f;
+	const int MaxIterations = 8;
+	// Keeps us from dividing by zero when the waves are steep enough to fold over
+	const float MinDeterminant = 1e-3f;
+}
+
+GerstnerWaves::GerstnerWaves(const std::vector<glm::vec4>& waves, float gravity) {
+	myAmplitude = 0.0f;
+	for (size_t ix = 0; ix < waves.size() && ix < MaxWaves; ix++) {
+		// Same math (and order) as GerstnerWave in the shader, so that we get the same floats out
+		Wave wave;
+		wave.Steepness = waves[ix].z;
+		wave.K = 2.0f * glm::pi<float>() / waves[ix].w;
+		wave.Speed = glm::sqrt(gravity / wave.K);
+		wave.Direction = glm::normalize(glm::vec2(waves[ix].x, waves[ix].y));
+		wave.Amplitude = wave.Steepness / wave.K;
+		myAmplitude += glm::abs(wave.Amplitude);
+		myWaves.push_back(wave);
+	}
+}
+
+glm::vec3 GerstnerWaves::__Displace(const glm::vec2& restPosition, float time, glm::vec3& tangent, glm::vec3& binormal) const {
+	glm::vec3 result = glm::vec3(0.0f);
+	tangent = glm::vec3(1, 0, 0);
+	binormal = glm::vec3(0, 1, 0);
+	for (const Wave& wave : myWaves) {
+		const glm::vec2& dir = wave.Direction;
+		float f = wave.K * (glm::dot(dir, restPosition) - wave.Speed * time);
+		float sinF = glm::sin(f);
+		float cosF = glm::cos(f);
+		tangent += glm::vec3(-dir.x * dir.x * (wave.Steepness * sinF), -dir.x * dir.y * (wave.Steepness * sinF), dir.x * (wave.Steepness * cosF));
+		binormal += glm::vec3(-dir.x * dir.y * (wave.Steepness * sinF), -dir.y * dir.y * (wave.Steepness * sinF), dir.y * (wave.Steepness * cosF));
+		result += glm::vec3(dir.x * (wave.Amplitude * cosF), dir.y * (wave.Amplitude * cosF), wave.Amplitude * sinF) + WaveOffset;
+	}
+	return result;
+}
+
+glm::vec3 GerstnerWaves::Evaluate(const glm::vec2& restPosition, float time, glm::vec3* normal) const {
+	glm::vec3 tangent, binormal;
+	glm::vec3 result = glm::vec3(restPosition, 0.0f) + __Displace(restPosition, time, tangent, binormal);
+	if (normal != nullptr)
+		*normal = glm::normalize(glm::cross(tangent, binormal));
+	return result;
+}
+
+float GerstnerWaves::GetHeight(const glm::vec2& position, float time, glm::vec3* normal) const {
+	// Look for the rest position that gets moved over the position we want, starting from the one with no waves
+	glm::vec2 rest = position - glm::vec2(WaveOffset * myWaves.size());
+	glm::vec3 tangent, binormal, offset;
+	for (int iteration = 0; ; iteration++) {
+		offset = __Displace(rest, time, tangent, binormal);
+		glm::vec2 error = rest + glm::vec2(offset) - position;
+		if (iteration == MaxIterations || glm::dot(error, error) < SolveTolerance)
+			break;
+		// The xy of our tangent and binormal are how the moved position changes with the rest position
+		float det = glm::max(tangent.x * binormal.y - binormal.x * tangent.y, MinDeterminant);
+		rest -= glm::vec2(binormal.y * error.x - binormal.x * error.y, tangent.x * error.y - tangent.y * error.x) / det;
+	}
+	if (normal != nullptr)
+		*normal = glm::normalize(glm::cross(tangent, binormal));
+	return offset.z;
+}
+
+void GerstnerWaves::__SolveBlocks(const glm::vec2* positions, float* results, size_t count, float time) const {
+	// Same steps as GetHeight, 4 positions at a time. We always take the same number of steps, since branching on
+	// every lane would cost more than the extra steps do
+	const __m128 offset = _mm_set1_ps(WaveOffset * myWaves.size());
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minDet = _mm_set1_ps(MinDeterminant);
+	for (size_t ix = 0; ix < count; ix += 4) {
+		// Split our interleaved positions into xxxx and yyyy
+		__m128 a = _mm_loadu_ps(&positions[ix].x);
+		__m128 b = _mm_loadu_ps(&positions[ix + 2].x);
+		__m128 targetX = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 targetY = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 restX = _mm_sub_ps(targetX, offset);
+		__m128 restY = _mm_sub_ps(targetY, offset);
+
+		for (int iteration = 0; ; iteration++) {
+			__m128 moveX = offset, moveY = offset, moveZ = offset;
+			__m128 tangentX = one, tangentY = _mm_setzero_ps(), binormalY = one;
+			for (const Wave& wave : myWaves) {
+				__m128 dirX = _mm_set1_ps(wave.Direction.x);
+				__m128 dirY = _mm_set1_ps(wave.Direction.y);
+				__m128 along = _mm_add_ps(_mm_mul_ps(dirX, restX), _mm_mul_ps(dirY, restY));
+				__m128 f = _mm_mul_ps(_mm_set1_ps(wave.K), _mm_sub_ps(along, _mm_set1_ps(wave.Speed * time)));
+				__m128 sinF, cosF;
+				SinCosPs(f, sinF, cosF);
+
+				__m128 slope = _mm_mul_ps(_mm_set1_ps(wave.Steepness), sinF);
+				__m128 height = _mm_mul_ps(_mm_set1_ps(wave.Amplitude), cosF);
+				moveX = _mm_add_ps(moveX, _mm_mul_ps(dirX, height));
+				moveY = _mm_add_ps(moveY, _mm_mul_ps(dirY, height));
+				moveZ = _mm_add_ps(moveZ, _mm_mul_ps(_mm_set1_ps(wave.Amplitude), sinF));
+				tangentX = _mm_sub_ps(tangentX, _mm_mul_ps(_mm_mul_ps(dirX, dirX), slope));
+				tangentY = _mm_sub_ps(tangentY, _mm_mul_ps(_mm_mul_ps(dirX, dirY), slope));
+				binormalY = _mm_sub_ps(binormalY, _mm_mul_ps(_mm_mul_ps(dirY, dirY), slope));
+			}
+			if (iteration == BatchIterations) {
+				_mm_storeu_ps(results + ix, moveZ);
+				break;
+			}
+
+			// The tangent space is symmetric, so the binormal's x is the tangent's y
+			__m128 errorX = _mm_sub_ps(_mm_add_ps(restX, moveX), targetX);
+			__m128 errorY = _mm_sub_ps(_mm_add_ps(restY, moveY), targetY);
+			__m128 det = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(tangentX, binormalY), _mm_mul_ps(tangentY, tangentY)), minDet);
+			restX = _mm_sub_ps(restX, _mm_div_ps(_mm_sub_ps(_mm_mul_ps(binormalY, errorX), _mm_mul_ps(tangentY, errorY)), det));
+			restY = _mm_sub_ps(restY, _mm_div_ps(_mm_sub_ps(_mm_mul_ps(tangentX, errorY), _mm_mul_ps(tangentY, errorX)), det));
+		}
+	}
+}
+
+void GerstnerWaves::GetHeights(const glm::vec2* positions, float* results, size_t count, float time) const {
+	size_t blocks = count / 4;
+	// Small batches aren't worth waking up the workers for
+	if (blocks < 256) {
+		__SolveBlocks(positions, results, blocks * 4, time);
+	} else {
+		Parallel::For(blocks, [&](size_t begin, size_t end) {
+			__SolveBlocks(positions + begin * 4, results + begin * 4, (end - begin) * 4, time);
+		}, 64);
+	}
+	for (size_t ix = blocks * 4; ix < count; ix++)
+		results[ix] = GetHeight(positions[ix], time);
+}
+
+GerstnerWaves::Sptr GerstnerWaves::FromMaterial(const Material::Sptr& material) {
+	int enabled = 0;
+	float gravity = 0.0f;
+	material->TryGet("a_EnabledWaves", enabled);
+	material->TryGet("a_Gravity", gravity);
+	std::vector<glm::vec4> waves;
+	for (int ix = 0; ix < enabled && ix < MaxWaves; ix++) {
+		glm::vec4 wave = glm::vec4(0.0f);
+		material->TryGet("a_Waves[" + std::to_string(ix) + "]", wave);
+		waves.push_back(wave);
+	}
+	return std::make_shared<GerstnerWaves>(waves, gravity);
+}
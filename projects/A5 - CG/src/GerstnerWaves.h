@@ -0,0 +1,92 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Material.h"
+#include "Utils.h"
+
+/*
+	A CPU copy of the waves that water-shader.vs.glsl draws, so that floating things can sit on the water.
+
+	Evaluate matches the shader exactly: each wave moves a point on the (flat) water mesh sideways and up, and the
+	shader adds 0.55 to every axis for every wave it sums. Since the waves move points sideways, the water above
+	a given spot didn't start there, so GetHeight solves for the point that ends up over it (Newton's method, using
+	the same tangents that the shader uses for it's normals).
+
+	Positions are in the water mesh's local space, and time is the a_Time that the water is drawn with
+*/
+class GerstnerWaves
+{
+public:
+	typedef std::shared_ptr<GerstnerWaves> Sptr;
+	NoCopy(GerstnerWaves);
+	NoMove(GerstnerWaves);
+
+	// Matches MAX_WAVES in water-shader.vs.glsl
+	static const int MaxWaves = 8;
+	// What the shader adds to every axis for each wave (to lift the water up)
+	static const float WaveOffset;
+
+	/*
+		Creates a new set of waves, in the same format as the water material's a_Waves uniforms
+		@param waves   Each wave is [xDir, yDir, steepness, wavelength], anything past MaxWaves is ignored
+		@param gravity The gravity the waves move with, in world units (a_Gravity)
+	*/
+	GerstnerWaves(const std::vector<glm::vec4>& waves, float gravity);
+	virtual ~GerstnerWaves() = default;
+
+	/*
+		Gets where a point on the water mesh gets moved to, exactly like the shader does
+		@param restPosition The position of the vertex on the flat water mesh
+		@param time         The time the water is drawn at
+		@param normal       If set, receives the normal of the water at the point
+	*/
+	glm::vec3 Evaluate(const glm::vec2& restPosition, float time, glm::vec3* normal = nullptr) const;
+
+	/*
+		Gets the height of the water surface above (or below) a position
+		@param position The local position to find the water height at
+		@param time     The time the water is drawn at
+		@param normal   If set, receives the normal of the water at the position
+	*/
+	float GetHeight(const glm::vec2& position, float time, glm::vec3* normal = nullptr) const;
+
+	/*
+		Gets the height of the water at a whole bunch of positions at once (like buoyancy probes), 4 at a time with
+		SSE. Large batches are also split across our worker threads
+		@param positions The local positions to find the water height at
+		@param results   Receives the height for each position, must have room for count values
+		@param count     The number of positions
+		@param time      The time the water is drawn at
+	*/
+	void GetHeights(const glm::vec2* positions, float* results, size_t count, float time) const;
+
+	// Gets the number of waves that get summed together
+	int GetWaveCount() const { return (int)myWaves.size(); }
+	// Gets the highest the water can go above (or below) it's offset
+	float GetAmplitude() const { return myAmplitude; }
+
+	/*
+		Grabs the wave settings from a water material (a_Waves, a_EnabledWaves and a_Gravity). Anything that was
+		never set is 0, like an unset uniform. This is a copy, so make a new one if the material changes
+		@param material The material that the water is drawn with
+	*/
+	static Sptr FromMaterial(const Material::Sptr& material);
+
+protected:
+	// Everything the shader works out for a wave that doesn't change per vertex
+	struct Wave {
+		glm::vec2 Direction;
+		float     Steepness;
+		float     K;         // 2 PI / wavelength
+		float     Speed;     // How fast the wave moves, sqrt(gravity / K)
+		float     Amplitude; // Steepness / K
+	};
+	std::vector<Wave> myWaves;
+	float myAmplitude;
+
+	// Gets the sideways and up movement from all of our waves at a rest position, and the xy of the tangents
+	glm::vec3 __Displace(const glm::vec2& restPosition, float time, glm::vec3& tangent, glm::vec3& binormal) const;
+	// Solves for a range of positions, the count must be a multiple of 4
+	void __SolveBlocks(const glm::vec2* positions, float* results, size_t count, float time) const;
+};
@@ -0,0 +1,206 @@
+#include "HeightField.h"
+#include "Logging.h"
+#include "Texture2D.h"
+#include <Parallel.h>
+#include <emmintrin.h>
+#include <cfloat>
+#include <cmath>
+
+// Rounds each lane down to a whole number (SSE2 has no floor), only valid for values that fit in an int
+static inline __m128 FloorPs(__m128 value) {
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f)));
+}
+
+HeightField::HeightField(const std::vector<float>& heights, uint32_t width, uint32_t height, float size, float heightScale) {
+	LOG_ASSERT(heights.size() == (size_t)width * height, "Heightmap data does not match it's size!");
+	LOG_ASSERT(size > 0.0f, "Height field must have a size greater than 0!");
+
+	myHeights = heights;
+	myWidth = width;
+	myHeight = height;
+	mySize = size;
+	myHeightScale = heightScale;
+
+	myMinHeight = FLT_MAX;
+	myMaxHeight = -FLT_MAX;
+	for (float value : myHeights) {
+		myMinHeight = glm::min(myMinHeight, value * heightScale);
+		myMaxHeight = glm::max(myMaxHeight, value * heightScale);
+	}
+}
+
+float HeightField::__Sample(float x, float y) const {
+	// Wrap into [0, 1) first, then find the texels on either side of us like a GL_REPEAT, GL_LINEAR sampler does
+	float u = x / mySize;
+	float v = y / mySize;
+	u -= std::floor(u);
+	v -= std::floor(v);
+	float tx = u * myWidth - 0.5f;
+	float ty = v * myHeight - 0.5f;
+	float floorX = std::floor(tx);
+	float floorY = std::floor(ty);
+	float fracX = tx - floorX;
+	float fracY = ty - floorY;
+
+	int x0 = (int)floorX, x1 = x0 + 1;
+	int y0 = (int)floorY, y1 = y0 + 1;
+	if (x0 < 0) x0 += myWidth;
+	if (y0 < 0) y0 += myHeight;
+	if (x1 >= (int)myWidth) x1 -= myWidth;
+	if (y1 >= (int)myHeight) y1 -= myHeight;
+
+	const float* row0 = &myHeights[(size_t)y0 * myWidth];
+	const float* row1 = &myHeights[(size_t)y1 * myWidth];
+	float top = row0[x0] + (row0[x1] - row0[x0]) * fracX;
+	float bottom = row1[x0] + (row1[x1] - row1[x0]) * fracX;
+	return top + (bottom - top) * fracY;
+}
+
+float HeightField::GetHeight(const glm::vec2& position) const {
+	return __Sample(position.x, position.y) * myHeightScale;
+}
+
+glm::vec3 HeightField::GetNormal(const glm::vec2& position) const {
+	glm::vec2 texel = glm::vec2(mySize / myWidth, mySize / myHeight);
+	float dx = (GetHeight(position - glm::vec2(texel.x, 0.0f)) - GetHeight(position + glm::vec2(texel.x, 0.0f))) / (2.0f * texel.x);
+	float dy = (GetHeight(position - glm::vec2(0.0f, texel.y)) - GetHeight(position + glm::vec2(0.0f, texel.y))) / (2.0f * texel.y);
+	return glm::normalize(glm::vec3(dx, dy, 1.0f));
+}
+
+void HeightField::__SampleBlocks(const glm::vec2* positions, float* results, size_t count) const {
+	// Same steps as __Sample, just 4 positions at a time. Only the texel fetches are done one by one
+	const __m128 size = _mm_set1_ps(mySize);
+	const __m128 width = _mm_set1_ps((float)myWidth);
+	const __m128 height = _mm_set1_ps((float)myHeight);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 scale = _mm_set1_ps(myHeightScale);
+	const __m128i widthI = _mm_set1_epi32((int)myWidth);
+	const __m128i heightI = _mm_set1_epi32((int)myHeight);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i zero = _mm_setzero_si128();
+
+	alignas(16) int x0[4], x1[4], y0[4], y1[4];
+	for (size_t ix = 0; ix < count; ix += 4) {
+		// Split our interleaved positions into xxxx and yyyy
+		__m128 a = _mm_loadu_ps(&positions[ix].x);
+		__m128 b = _mm_loadu_ps(&positions[ix + 2].x);
+		__m128 u = _mm_div_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), size);
+		__m128 v = _mm_div_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), size);
+		u = _mm_sub_ps(u, FloorPs(u));
+		v = _mm_sub_ps(v, FloorPs(v));
+		__m128 tx = _mm_sub_ps(_mm_mul_ps(u, width), half);
+		__m128 ty = _mm_sub_ps(_mm_mul_ps(v, height), half);
+		__m128 floorX = FloorPs(tx);
+		__m128 floorY = FloorPs(ty);
+		__m128 fracX = _mm_sub_ps(tx, floorX);
+		__m128 fracY = _mm_sub_ps(ty, floorY);
+
+		// Wrap our texel coordinates around the edges
+		__m128i left = _mm_cvttps_epi32(floorX);
+		__m128i up = _mm_cvttps_epi32(floorY);
+		__m128i right = _mm_add_epi32(left, one);
+		__m128i down = _mm_add_epi32(up, one);
+		left = _mm_add_epi32(left, _mm_and_si128(_mm_cmplt_epi32(left, zero), widthI));
+		up = _mm_add_epi32(up, _mm_and_si128(_mm_cmplt_epi32(up, zero), heightI));
+		right = _mm_sub_epi32(right, _mm_and_si128(_mm_cmpeq_epi32(right, widthI), widthI));
+		down = _mm_sub_epi32(down, _mm_and_si128(_mm_cmpeq_epi32(down, heightI), heightI));
+		_mm_store_si128((__m128i*)x0, left);
+		_mm_store_si128((__m128i*)x1, right);
+		_mm_store_si128((__m128i*)y0, up);
+		_mm_store_si128((__m128i*)y1, down);
+
+		const float* data = myHeights.data();
+		#define TEXEL(lane, xs, ys) data[(size_t)ys[lane] * myWidth + xs[lane]]
+		__m128 h00 = _mm_setr_ps(TEXEL(0, x0, y0), TEXEL(1, x0, y0), TEXEL(2, x0, y0), TEXEL(3, x0, y0));
+		__m128 h10 = _mm_setr_ps(TEXEL(0, x1, y0), TEXEL(1, x1, y0), TEXEL(2, x1, y0), TEXEL(3, x1, y0));
+		__m128 h01 = _mm_setr_ps(TEXEL(0, x0, y1), TEXEL(1, x0, y1), TEXEL(2, x0, y1), TEXEL(3, x0, y1));
+		__m128 h11 = _mm_setr_ps(TEXEL(0, x1, y1), TEXEL(1, x1, y1), TEXEL(2, x1, y1), TEXEL(3, x1, y1));
+		#undef TEXEL
+
+		__m128 top = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fracX));
+		__m128 bottom = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fracX));
+		__m128 result = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fracY));
+		_mm_storeu_ps(results + ix, _mm_mul_ps(result, scale));
+	}
+}
+
+void HeightField::GetHeights(const glm::vec2* positions, float* results, size_t count) const {
+	size_t blocks = count / 4;
+	// Small batches aren't worth waking up the workers for
+	if (blocks < 1024) {
+		__SampleBlocks(positions, results, blocks * 4);
+	} else {
+		Parallel::For(blocks, [&](size_t begin, size_t end) {
+			__SampleBlocks(positions + begin * 4, results + begin * 4, (end - begin) * 4);
+		}, 256);
+	}
+	for (size_t ix = blocks * 4; ix < count; ix++)
+		results[ix] = GetHeight(positions[ix]);
+}
+
+bool HeightField::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const {
+	// Clip the ray to the slab between our lowest and highest points, nothing outside of it can hit
+	float start = 0.0f, end = maxDistance;
+	if (glm::abs(direction.z) > 1e-8f) {
+		float enter = (myMinHeight - origin.z) / direction.z;
+		float exit = (myMaxHeight - origin.z) / direction.z;
+		start = glm::max(start, glm::min(enter, exit));
+		end = glm::min(end, glm::max(enter, exit));
+	} else if (origin.z > myMaxHeight) {
+		return false;
+	}
+	if (start > end)
+		return false;
+
+	auto above = [&](float t) {
+		glm::vec3 point = origin + direction * t;
+		return point.z - GetHeight(glm::vec2(point));
+	};
+	if (above(start) <= 0.0f) {
+		distance = start;
+		return true;
+	}
+
+	// Step about half a texel at a time, so that we can't step over any bumps. Straight down rays can do it in one
+	float texel = mySize / (float)glm::max(myWidth, myHeight);
+	float horizontal = glm::length(glm::vec2(direction));
+	float step = horizontal > 0.0f ? glm::max(texel * 0.5f / horizontal, (end - start) / 65536.0f) : end - start;
+
+	float prev = start;
+	for (float t = glm::min(start + step, end); ; t = glm::min(t + step, end)) {
+		if (above(t) <= 0.0f) {
+			// We crossed the ground somewhere in the last step, narrow it down
+			float low = prev, high = t;
+			for (int iteration = 0; iteration < 16; iteration++) {
+				float mid = (low + high) * 0.5f;
+				if (above(mid) > 0.0f)
+					low = mid;
+				else
+					high = mid;
+			}
+			distance = high;
+			return true;
+		}
+		if (t >= end)
+			break;
+		prev = t;
+	}
+	return false;
+}
+
+HeightField::Sptr HeightField::LoadFromFile(const std::string& fileName, float size, float heightScale) {
+	// Our shaders have always used the red channel as the height, 16 bit images keep their full precision
+	std::vector<uint16_t> texels;
+	uint32_t width = 0, height = 0;
+	if (!Texture2D::DecodeR16(fileName, texels, width, height)) {
+		LOG_WARN("Failed to load heightmap from \"{}\"", fileName);
+		return nullptr;
+	}
+
+	std::vector<float> heights(texels.size());
+	for (size_t ix = 0; ix < heights.size(); ix++)
+		heights[ix] = texels[ix] / 65535.0f;
+
+	return std::make_shared<HeightField>(heights, width, height, size, heightScale);
+}
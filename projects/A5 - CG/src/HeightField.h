@@ -0,0 +1,87 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Utils.h"
+
+/*
+	A CPU copy of a terrain's heightmap, so that gameplay code can ask how high the ground is without going
+	through the GPU.
+
+	Sampling matches Terrain.vs.glsl exactly: positions are in the terrain's local space, the heightmap is
+	stretched across Size once (uv = position.xy / Size) with repeat wrapping and bilinear filtering, and the
+	result is scaled by HeightScale. Normals use the same central differences as the shader, one texel apart
+*/
+class HeightField
+{
+public:
+	typedef std::shared_ptr<HeightField> Sptr;
+	NoCopy(HeightField);
+	NoMove(HeightField);
+
+	/*
+		Creates a new height field from some heightmap data
+		@param heights     The height of each texel, in [0, 1], row by row
+		@param width       The width of the heightmap, in texels
+		@param height      The height of the heightmap, in texels
+		@param size        The width and length of the terrain in world units
+		@param heightScale The height of a fully white texel
+	*/
+	HeightField(const std::vector<float>& heights, uint32_t width, uint32_t height, float size, float heightScale);
+	virtual ~HeightField() = default;
+
+	// Gets the bilinearly filtered height of the ground at a local position
+	float GetHeight(const glm::vec2& position) const;
+	// Gets the normal of the ground at a local position
+	glm::vec3 GetNormal(const glm::vec2& position) const;
+
+	/*
+		Gets the height of the ground under a whole bunch of points at once, 4 at a time with SSE. Large batches
+		are also split across our worker threads
+		@param positions The local positions to sample
+		@param results   Receives the height for each position, must have room for count values
+		@param count     The number of positions to sample
+	*/
+	void GetHeights(const glm::vec2* positions, float* results, size_t count) const;
+
+	/*
+		Marches a ray against the ground, refining the hit with a binary search once we step under it
+		@param origin      The start of the ray, in local space
+		@param direction   The direction of the ray, does not need to be normalized
+		@param maxDistance The furthest along the ray to search, in multiples of direction
+		@param distance    Receives how far along the ray the ground was hit, in multiples of direction
+		@returns True if the ray hit the ground
+	*/
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+
+	// Gets the raw heightmap data, in [0, 1]
+	const std::vector<float>& GetData() const { return myHeights; }
+	// Gets the size of our heightmap, in texels
+	glm::ivec2 GetResolution() const { return glm::ivec2(myWidth, myHeight); }
+	float GetSize() const { return mySize; }
+	float GetHeightScale() const { return myHeightScale; }
+	// Gets the lowest and highest the ground goes, after scaling
+	float GetMinHeight() const { return myMinHeight; }
+	float GetMaxHeight() const { return myMaxHeight; }
+
+	/*
+		Loads a height field from an image, using it's first channel as the height like our shaders do
+		@param fileName    The path to the heightmap to load, 16 bit PNGs and raw R16 files are also supported (see Texture2D::DecodeR16)
+		@param size        The width and length of the terrain in world units
+		@param heightScale The height of a fully white texel
+		@returns The new height field, or nullptr if the image could not be loaded
+	*/
+	static Sptr LoadFromFile(const std::string& fileName, float size, float heightScale);
+
+protected:
+	std::vector<float> myHeights;
+	uint32_t           myWidth, myHeight;
+	float              mySize, myHeightScale;
+	float              myMinHeight, myMaxHeight;
+
+	// Samples our heightmap at a local position, without applying our height scale
+	float __Sample(float x, float y) const;
+	// Samples a range of positions, the count must be a multiple of 4
+	void __SampleBlocks(const glm::vec2* positions, float* results, size_t count) const;
+};
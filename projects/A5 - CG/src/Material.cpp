@@ -1,16 +1,28 @@
 #include "Material.h"
 
 void Material::Apply() {
+	ApplyUniforms(myShader);
+
+	if (HasTransparency) {
+		glEnable(GL_BLEND);
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE);
+	}
+	else {
+		glDisable(GL_BLEND);
+	}
+}
+
+void Material::ApplyUniforms(const Shader::Sptr& shader) {
 	for (auto& kvp : myMat4s)
-		myShader->SetUniform(kvp.first.c_str(), kvp.second);
+		shader->SetUniform(kvp.first.c_str(), kvp.second);
 	for (auto& kvp : myVec4s)
-		myShader->SetUniform(kvp.first.c_str(), kvp.second);
+		shader->SetUniform(kvp.first.c_str(), kvp.second);
 	for (auto& kvp : myVec3s)
-		myShader->SetUniform(kvp.first.c_str(), kvp.second);
+		shader->SetUniform(kvp.first.c_str(), kvp.second);
 	for (auto& kvp : myFloats)
-		myShader->SetUniform(kvp.first.c_str(), kvp.second);
+		shader->SetUniform(kvp.first.c_str(), kvp.second);
 	for (auto& kvp : myInts)
-		myShader->SetUniform(kvp.first.c_str(), kvp.second);
+		shader->SetUniform(kvp.first.c_str(), kvp.second);
 
 	// New in tutorial 06
 	// updated in tutorial 09
@@ -21,7 +33,7 @@ void Material::Apply() {
 		else
 			TextureSampler::Unbind(slot);
 		kvp.second.Texture->Bind(slot);
-		myShader->SetUniform(kvp.first.c_str(), slot);
+		shader->SetUniform(kvp.first.c_str(), slot);
 		slot++;
 	}
 	for (auto& kvp : myCubeMaps) {
@@ -30,16 +42,16 @@ void Material::Apply() {
 		else
 			TextureSampler::Unbind(slot);
 		kvp.second.Texture->Bind(slot);
-		myShader->SetUniform(kvp.first.c_str(), slot);
+		shader->SetUniform(kvp.first.c_str(), slot);
 		slot++;
 	}
-
-	if (HasTransparency) {
-		glEnable(GL_BLEND);
-		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE);
-	}
-	else {
-		glDisable(GL_BLEND);
+	for (auto& kvp : myTextureArrays) {
+		if (kvp.second.Sampler != nullptr)
+			kvp.second.Sampler->Bind(slot);
+		else
+			TextureSampler::Unbind(slot);
+		kvp.second.Texture->Bind(slot);
+		shader->SetUniform(kvp.first.c_str(), slot);
+		slot++;
 	}
-
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <memory>
 #include "Shader.h"
 #include "Texture2D.h"
+#include "Texture2DArray.h"
 #include "TextureCube.h"
 
 /*
@@ -15,13 +16,25 @@ public:
 
 	bool HasTransparency;
 
+	// Optional depth-only variant of our shader, when set our opaque geometry is laid down in a
+	// depth pre-pass first, so our (expensive) fragment shader only runs once per pixel
+	Shader::Sptr DepthPrePassShader;
 	
 	// Modify the existing constructor! Dont add a new one!
-	Material(const Shader::Sptr& shader) : HasTransparency(false) { myShader = shader; }
+	Material(const Shader::Sptr& shader) : HasTransparency(false), DepthPrePassShader(nullptr) {
+		myShader = shader;
+		static uint32_t nextRenderId = 0;
+		myRenderId = nextRenderId++;
+	}
 	virtual ~Material() = default;
 	
 	const Shader::Sptr& GetShader() const { return myShader; }
 	virtual void Apply();
+	// Uploads our uniforms and textures to the given shader, without touching any blending state
+	void ApplyUniforms(const Shader::Sptr& shader);
+
+	// Gets a small, unique ID for this material, used to group draw calls by material when sorting
+	uint32_t GetRenderId() const { return myRenderId; }
 	
 	void Set(const std::string& name, const glm::mat4& value) { myMat4s[name] = value; }
 	void Set(const std::string& name, const glm::vec4& value) { myVec4s[name] = value; }
@@ -35,8 +48,16 @@ public:
 	void Set(const std::string& name, const TextureCube::Sptr& value, const TextureSampler::Sptr& sampler = nullptr) {
 		myCubeMaps[name] = { value, sampler };
 	}
+	void Set(const std::string& name, const Texture2DArray::Sptr& value, const TextureSampler::Sptr& sampler = nullptr) {
+		myTextureArrays[name] = { value, sampler };
+	}
 
 	void Set(const std::string& name, const int& value) { myInts[name] = value; }
+
+	// Gets a value that was set on this material, returns false (leaving value alone) if it was never set
+	bool TryGet(const std::string& name, glm::vec4& value) const { return __TryGet(myVec4s, name, value); }
+	bool TryGet(const std::string& name, float& value) const { return __TryGet(myFloats, name, value); }
+	bool TryGet(const std::string& name, int& value) const { return __TryGet(myInts, name, value); }
 	
 protected:
 	struct Sampler2DInfo {
@@ -45,6 +66,7 @@ protected:
 	};
 	
 	Shader::Sptr myShader;
+	uint32_t     myRenderId;
 	std::unordered_map<std::string, glm::mat4> myMat4s;
 	std::unordered_map<std::string, glm::vec4> myVec4s;
 	std::unordered_map<std::string, glm::vec3> myVec3s;
@@ -60,4 +82,19 @@ protected:
 		TextureSampler::Sptr Sampler;
 	};
 	std::unordered_map<std::string, SamplerCubeInfo> myCubeMaps;
+
+	struct Sampler2DArrayInfo {
+		Texture2DArray::Sptr Texture;
+		TextureSampler::Sptr Sampler;
+	};
+	std::unordered_map<std::string, Sampler2DArrayInfo> myTextureArrays;
+
+	template <typename T>
+	static bool __TryGet(const std::unordered_map<std::string, T>& values, const std::string& name, T& value) {
+		auto it = values.find(name);
+		if (it == values.end())
+			return false;
+		value = it->second;
+		return true;
+	}
 };
\ No newline at end of file
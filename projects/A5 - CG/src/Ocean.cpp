@@ -0,0 +1,256 @@
+#include "Ocean.h"
+#include "Logging.h"
+#include "SimdMath.h"
+#include <Parallel.h>
+#include <GLM/gtc/constants.hpp>
+#include <xmmintrin.h>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+Ocean::Ocean(const OceanDescription& desc) {
+	LOG_ASSERT(desc.Resolution >= 4 && (desc.Resolution & (desc.Resolution - 1)) == 0, "Ocean resolution must be a power of 2!");
+	LOG_ASSERT(desc.PatchSize > 0.0f, "Ocean patch must have a size greater than 0!");
+	myDesc = desc;
+	myDesc.UpdateInterval = glm::max(myDesc.UpdateInterval, 1u);
+	myFrame = 0;
+	myLastUpdateMs = 0.0f;
+
+	uint32_t n = myDesc.Resolution;
+	size_t texels = (size_t)n * n;
+	for (int ix = 0; ix < FieldCount * 2; ix++) {
+		myFields[ix].resize(texels);
+		myTransposed[ix].resize(texels);
+	}
+
+	int bits = 0;
+	while ((1u << bits) < n) bits++;
+	myReversed.resize(n);
+	for (uint32_t ix = 0; ix < n; ix++) {
+		uint32_t reversed = 0;
+		for (int bit = 0; bit < bits; bit++)
+			reversed |= ((ix >> bit) & 1) << (bits - 1 - bit);
+		myReversed[ix] = reversed;
+	}
+	myTwiddleRe.resize(n / 2);
+	myTwiddleIm.resize(n / 2);
+	for (uint32_t ix = 0; ix < n / 2; ix++) {
+		double angle = 2.0 * glm::pi<double>() * ix / n;
+		myTwiddleRe[ix] = (float)std::cos(angle);
+		myTwiddleIm[ix] = (float)std::sin(angle);
+	}
+
+	__BuildSpectrum();
+
+	// Our maps get sampled from far away, so they need mips to keep from shimmering
+	Texture2DDescription texture = Texture2DDescription();
+	texture.Width = texture.Height = n;
+	texture.EnableMip = true;
+	texture.Sampler.MinFilter = MinFilter::LinearMipLinear;
+	texture.Sampler.MagFilter = MagFilter::Linear;
+	texture.Sampler.WrapS = texture.Sampler.WrapT = WrapMode::Repeat;
+	texture.Format = InternalFormat::RGBA16F;
+	myDisplacement = std::make_shared<Texture2D>(texture);
+	texture.Format = InternalFormat::RG16F;
+	mySlopes = std::make_shared<Texture2D>(texture);
+}
+
+void Ocean::__BuildSpectrum() {
+	uint32_t n = myDesc.Resolution;
+	size_t texels = (size_t)n * n;
+	mySpectrumRe.assign(texels, 0.0f);
+	mySpectrumIm.assign(texels, 0.0f);
+	myMirrorRe.resize(texels);
+	myMirrorIm.resize(texels);
+	myOmega.resize(texels);
+	myKx.resize(texels);
+	myKy.resize(texels);
+	myDirX.resize(texels);
+	myDirY.resize(texels);
+
+	std::mt19937 random(myDesc.Seed);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+	glm::vec2 wind = glm::normalize(myDesc.WindDirection);
+	// The largest waves that the wind can make, and how far we damp out the smallest ones
+	float largest = myDesc.WindSpeed * myDesc.WindSpeed / myDesc.Gravity;
+	float smallest = myDesc.MinWavelength / (2.0f * glm::pi<float>());
+	float step = 2.0f * glm::pi<float>() / myDesc.PatchSize;
+	// Quantizing our frequencies to multiples of this makes every wave loop after RepeatTime
+	float baseOmega = 2.0f * glm::pi<float>() / myDesc.RepeatTime;
+
+	// Note that our rows go along x and our columns go along y. The FFTs end up transposing everything, so this
+	// way our output comes out row by row
+	for (uint32_t row = 0; row < n; row++) {
+		for (uint32_t column = 0; column < n; column++) {
+			size_t ix = (size_t)row * n + column;
+			// Our waves are in FFT order, so the second half of each axis is the negative frequencies
+			glm::vec2 k = glm::vec2(row < n / 2 ? (int)row : (int)row - (int)n, column < n / 2 ? (int)column : (int)column - (int)n) * step;
+			float length = glm::length(k);
+			myKx[ix] = k.x;
+			myKy[ix] = k.y;
+			myOmega[ix] = std::floor(std::sqrt(myDesc.Gravity * length) / baseOmega) * baseOmega;
+			myDirX[ix] = length > 0.0f ? myDesc.Choppiness * k.x / length : 0.0f;
+			myDirY[ix] = length > 0.0f ? myDesc.Choppiness * k.y / length : 0.0f;
+
+			// We always draw our random numbers, so changing the wind doesn't change the ocean's features. The
+			// Nyquist frequencies have no matching negative frequency, so they are left out
+			float real = gaussian(random);
+			float imaginary = gaussian(random);
+			if (length == 0.0f || row == n / 2 || column == n / 2)
+				continue;
+
+			float kDotWind = glm::dot(k / length, wind);
+			float phillips = myDesc.Amplitude * std::exp(-1.0f / (length * largest * length * largest)) / (length * length * length * length);
+			phillips *= kDotWind * kDotWind * std::exp(-length * length * smallest * smallest);
+			float scale = std::sqrt(phillips * 0.5f) * step;
+			mySpectrumRe[ix] = real * scale;
+			mySpectrumIm[ix] = imaginary * scale;
+		}
+	}
+
+	// Every wave also needs the conjugate of the one going the other way, so that our heights come out real
+	for (uint32_t row = 0; row < n; row++) {
+		for (uint32_t column = 0; column < n; column++) {
+			size_t mirror = (size_t)((n - row) % n) * n + (n - column) % n;
+			myMirrorRe[(size_t)row * n + column] = mySpectrumRe[mirror];
+			myMirrorIm[(size_t)row * n + column] = -mySpectrumIm[mirror];
+		}
+	}
+}
+
+void Ocean::__EvaluateSpectrum(float time, size_t begin, size_t end) {
+	// h(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t), then
+	//   height + i dx    = (1 + dirX) h
+	//   dy + i slope x   = -(kx + i dirY) h
+	//   slope y          = i ky h
+	uint32_t n = myDesc.Resolution;
+	__m128 t = _mm_set1_ps(time);
+	float* fields[FieldCount * 2];
+	for (int ix = 0; ix < FieldCount * 2; ix++)
+		fields[ix] = myFields[ix].data();
+
+	for (size_t ix = begin * n; ix < end * n; ix += 4) {
+		__m128 sinW, cosW;
+		SinCosPs(_mm_mul_ps(_mm_loadu_ps(&myOmega[ix]), t), sinW, cosW);
+		__m128 a = _mm_loadu_ps(&mySpectrumRe[ix]);
+		__m128 b = _mm_loadu_ps(&mySpectrumIm[ix]);
+		__m128 mRe = _mm_loadu_ps(&myMirrorRe[ix]);
+		__m128 mIm = _mm_loadu_ps(&myMirrorIm[ix]);
+		__m128 hRe = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(a, cosW), _mm_mul_ps(b, sinW)), _mm_add_ps(_mm_mul_ps(mRe, cosW), _mm_mul_ps(mIm, sinW)));
+		__m128 hIm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, sinW), _mm_mul_ps(b, cosW)), _mm_sub_ps(_mm_mul_ps(mIm, cosW), _mm_mul_ps(mRe, sinW)));
+
+		__m128 kx = _mm_loadu_ps(&myKx[ix]);
+		__m128 ky = _mm_loadu_ps(&myKy[ix]);
+		__m128 chop = _mm_add_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(&myDirX[ix]));
+		__m128 dirY = _mm_loadu_ps(&myDirY[ix]);
+		_mm_storeu_ps(fields[0] + ix, _mm_mul_ps(chop, hRe));
+		_mm_storeu_ps(fields[1] + ix, _mm_mul_ps(chop, hIm));
+		_mm_storeu_ps(fields[2] + ix, _mm_sub_ps(_mm_mul_ps(dirY, hIm), _mm_mul_ps(kx, hRe)));
+		_mm_storeu_ps(fields[3] + ix, _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_mul_ps(kx, hIm), _mm_mul_ps(dirY, hRe))));
+		_mm_storeu_ps(fields[4] + ix, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(ky, hIm)));
+		_mm_storeu_ps(fields[5] + ix, _mm_mul_ps(ky, hRe));
+	}
+}
+
+void Ocean::__InverseColumns(std::vector<float>* fields, size_t begin, size_t end) {
+	// A plain radix 2 FFT, but every butterfly works on 4 neighbouring columns at once
+	uint32_t n = myDesc.Resolution;
+	for (int field = 0; field < FieldCount; field++) {
+		float* re = fields[field * 2].data();
+		float* im = fields[field * 2 + 1].data();
+		for (size_t group = begin; group < end; group++) {
+			size_t column = group * 4;
+
+			for (uint32_t row = 0; row < n; row++) {
+				uint32_t other = myReversed[row];
+				if (other <= row)
+					continue;
+				size_t a = (size_t)row * n + column, b = (size_t)other * n + column;
+				__m128 tempRe = _mm_loadu_ps(re + a), tempIm = _mm_loadu_ps(im + a);
+				_mm_storeu_ps(re + a, _mm_loadu_ps(re + b));
+				_mm_storeu_ps(im + a, _mm_loadu_ps(im + b));
+				_mm_storeu_ps(re + b, tempRe);
+				_mm_storeu_ps(im + b, tempIm);
+			}
+
+			for (uint32_t size = 2; size <= n; size *= 2) {
+				uint32_t half = size / 2;
+				uint32_t twiddleStep = n / size;
+				for (uint32_t start = 0; start < n; start += size) {
+					for (uint32_t ix = 0; ix < half; ix++) {
+						__m128 wRe = _mm_set1_ps(myTwiddleRe[ix * twiddleStep]);
+						__m128 wIm = _mm_set1_ps(myTwiddleIm[ix * twiddleStep]);
+						size_t a = (size_t)(start + ix) * n + column;
+						size_t b = a + (size_t)half * n;
+						__m128 aRe = _mm_loadu_ps(re + a), aIm = _mm_loadu_ps(im + a);
+						__m128 bRe = _mm_loadu_ps(re + b), bIm = _mm_loadu_ps(im + b);
+						__m128 tRe = _mm_sub_ps(_mm_mul_ps(bRe, wRe), _mm_mul_ps(bIm, wIm));
+						__m128 tIm = _mm_add_ps(_mm_mul_ps(bRe, wIm), _mm_mul_ps(bIm, wRe));
+						_mm_storeu_ps(re + a, _mm_add_ps(aRe, tRe));
+						_mm_storeu_ps(im + a, _mm_add_ps(aIm, tIm));
+						_mm_storeu_ps(re + b, _mm_sub_ps(aRe, tRe));
+						_mm_storeu_ps(im + b, _mm_sub_ps(aIm, tIm));
+					}
+				}
+			}
+		}
+	}
+}
+
+void Ocean::__Transpose(size_t begin, size_t end) {
+	uint32_t n = myDesc.Resolution;
+	for (int field = 0; field < FieldCount * 2; field++) {
+		const float* source = myFields[field].data();
+		float* dest = myTransposed[field].data();
+		for (size_t blockRow = begin; blockRow < end; blockRow++) {
+			for (size_t blockColumn = 0; blockColumn < n / 4; blockColumn++) {
+				const float* from = source + blockRow * 4 * n + blockColumn * 4;
+				__m128 row0 = _mm_loadu_ps(from);
+				__m128 row1 = _mm_loadu_ps(from + n);
+				__m128 row2 = _mm_loadu_ps(from + n * 2);
+				__m128 row3 = _mm_loadu_ps(from + n * 3);
+				_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+				float* to = dest + blockColumn * 4 * n + blockRow * 4;
+				_mm_storeu_ps(to, row0);
+				_mm_storeu_ps(to + n, row1);
+				_mm_storeu_ps(to + n * 2, row2);
+				_mm_storeu_ps(to + n * 3, row3);
+			}
+		}
+	}
+}
+
+void Ocean::Evaluate(float time, std::vector<glm::vec4>& displacement, std::vector<glm::vec2>& slopes) {
+	uint32_t n = myDesc.Resolution;
+	size_t groups = n / 4;
+	time = std::fmod(time, myDesc.RepeatTime);
+
+	Parallel::For(n, [&](size_t begin, size_t end) { __EvaluateSpectrum(time, begin, end); }, 8);
+	Parallel::For(groups, [&](size_t begin, size_t end) { __InverseColumns(myFields, begin, end); });
+	Parallel::For(groups, [&](size_t begin, size_t end) { __Transpose(begin, end); });
+	Parallel::For(groups, [&](size_t begin, size_t end) { __InverseColumns(myTransposed, begin, end); });
+
+	// Our outputs were packed in as the real and imaginary parts of each field
+	displacement.resize((size_t)n * n);
+	slopes.resize((size_t)n * n);
+	Parallel::For(n, [&](size_t begin, size_t end) {
+		for (size_t ix = begin * n; ix < end * n; ix++) {
+			displacement[ix] = glm::vec4(myTransposed[1][ix], myTransposed[2][ix], myTransposed[0][ix], 0.0f);
+			slopes[ix] = glm::vec2(myTransposed[3][ix], myTransposed[4][ix]);
+		}
+	}, 8);
+}
+
+void Ocean::Update(float time) {
+	if (myFrame++ % myDesc.UpdateInterval != 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	Evaluate(time, myDisplacementData, mySlopeData);
+	myLastUpdateMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	uint32_t n = myDesc.Resolution;
+	myDisplacement->LoadData(myDisplacementData.data(), n, n, PixelFormat::Rgba, PixelType::Float);
+	mySlopes->LoadData(mySlopeData.data(), n, n, PixelFormat::Rg, PixelType::Float);
+}
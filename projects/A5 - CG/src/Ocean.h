@@ -0,0 +1,106 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Texture2D.h"
+#include "Utils.h"
+
+struct OceanDescription {
+	// The number of texels across our displacement maps, must be a power of 2 (and at least 4)
+	uint32_t  Resolution = 256;
+	// The width of the ocean patch in world units, the maps tile every PatchSize units
+	float     PatchSize = 16.0f;
+	// The wind speed (in world units per second) and direction, faster wind means bigger, longer waves
+	float     WindSpeed = 6.0f;
+	glm::vec2 WindDirection = glm::vec2(1.0f, 0.3f);
+	// Scales the height of every wave (the A in the Phillips spectrum)
+	float     Amplitude = 0.0003f;
+	// How far waves pinch sideways towards their crests, 0 gives rounded waves
+	float     Choppiness = 1.0f;
+	// Waves shorter than this (in world units) are faded out
+	float     MinWavelength = 0.05f;
+	float     Gravity = 9.81f;
+	uint32_t  Seed = 0;
+	// The ocean loops every this many seconds, which also keeps our sin / cos precise after the game has been
+	// running for a while
+	float     RepeatTime = 200.0f;
+	// How many calls to Update it takes before we regenerate our maps, 1 is every frame
+	uint32_t  UpdateInterval = 1;
+};
+
+/*
+	A deep water ocean surface made from thousands of waves at once, following Tessendorf's "Simulating Ocean Water".
+
+	We start from a random Phillips spectrum, and every update we move each wave forward in time and run inverse
+	FFTs on the CPU to get the height, sideways (choppy) displacement and slope at every texel. The FFTs are done
+	with SSE 4 columns at a time, and each pass is split across our worker threads.
+
+	The results go into 2 tiling textures that water-ocean.vs.glsl / water-ocean.fs.glsl sample, xyz displacement
+	and xy slope. The vertices come from a projected grid (see Game.cpp), so the number of vertices stays the same
+	no matter how much ocean is on screen, and the fine detail comes from the slope map per pixel
+*/
+class Ocean
+{
+public:
+	typedef std::shared_ptr<Ocean> Sptr;
+	NoCopy(Ocean);
+	NoMove(Ocean);
+
+	Ocean(const OceanDescription& desc = OceanDescription());
+	virtual ~Ocean() = default;
+
+	/*
+		Moves the ocean to a new time, regenerating and uploading our maps if this is one of our update frames
+		@param time The time in seconds
+	*/
+	void Update(float time);
+
+	// Gets the xyz displacement of each texel, in world units. Tiles every PatchSize units
+	const Texture2D::Sptr& GetDisplacement() const { return myDisplacement; }
+	// Gets the slope (dh/dx, dh/dy) of each texel
+	const Texture2D::Sptr& GetSlopes() const { return mySlopes; }
+	const OceanDescription& GetDescription() const { return myDesc; }
+	// Gets how long our last update took on the CPU, not counting the upload
+	float GetLastUpdateMs() const { return myLastUpdateMs; }
+
+	/*
+		Runs a single update into CPU buffers, without touching the GPU
+		@param time         The time in seconds
+		@param displacement Receives the xyzw displacement of each texel (w is unused), row by row
+		@param slopes       Receives the xy slope of each texel, row by row
+	*/
+	void Evaluate(float time, std::vector<glm::vec4>& displacement, std::vector<glm::vec2>& slopes);
+
+protected:
+	OceanDescription myDesc;
+	Texture2D::Sptr  myDisplacement;
+	Texture2D::Sptr  mySlopes;
+	uint32_t         myFrame;
+	float            myLastUpdateMs;
+
+	// Our starting spectrum, h0(k) and conj(h0(-k)) for every wave, split into real and imaginary parts
+	std::vector<float> mySpectrumRe, mySpectrumIm;
+	std::vector<float> myMirrorRe, myMirrorIm;
+	// The per-wave constants, our angular frequency, wave vector and (choppiness scaled) normalized wave vector
+	std::vector<float> myOmega, myKx, myKy, myDirX, myDirY;
+
+	// We pack our 5 real outputs into 3 complex FFTs (height + i dx, dy + i slope x, slope y), each split into
+	// real and imaginary parts, plus a second set to transpose into between passes
+	static const int FieldCount = 3;
+	std::vector<float> myFields[FieldCount * 2];
+	std::vector<float> myTransposed[FieldCount * 2];
+	// Bit reversed indices, and e^(2 PI i j / N) for the first half of our resolution
+	std::vector<uint32_t> myReversed;
+	std::vector<float> myTwiddleRe, myTwiddleIm;
+
+	std::vector<glm::vec4> myDisplacementData;
+	std::vector<glm::vec2> mySlopeData;
+
+	void __BuildSpectrum();
+	// Fills our fields with the spectrum at a time, for the rows [begin, end)
+	void __EvaluateSpectrum(float time, size_t begin, size_t end);
+	// Runs an inverse FFT down the columns of all of our fields, 4 columns at a time, for column groups [begin, end)
+	void __InverseColumns(std::vector<float>* fields, size_t begin, size_t end);
+	// Transposes rows [begin, end) of our fields into myTransposed, in 4x4 blocks (so begin and end are in blocks)
+	void __Transpose(size_t begin, size_t end);
+};
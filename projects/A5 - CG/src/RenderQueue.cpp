@@ -0,0 +1,55 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cmath>
+
+namespace RenderKey {
+	// Masks for the state IDs we pack into our keys
+	constexpr uint64_t IdMask = 0xFFF;
+
+	void ExtractClipPlanes(const glm::mat4& projection, float& zNear, float& zFar) {
+		// Orthographic projections have no perspective divide, so the w row is just (0, 0, 0, 1)
+		if (projection[2][3] == 0.0f) {
+			zNear = (projection[3][2] + 1.0f) / projection[2][2];
+			zFar  = (projection[3][2] - 1.0f) / projection[2][2];
+		}
+		// Perspective projection, see glm::perspective for where these come from
+		else {
+			zNear = projection[3][2] / (projection[2][2] - 1.0f);
+			zFar  = projection[3][2] / (projection[2][2] + 1.0f);
+		}
+		// Make sure we never end up with a degenerate range
+		zNear = glm::max(zNear, 0.0001f);
+		zFar  = glm::max(zFar, zNear + 0.0001f);
+	}
+
+	uint32_t QuantizeDepth(float viewDepth, float zNear, float zFar) {
+		if (viewDepth <= zNear)
+			return 0;
+		if (viewDepth >= zFar)
+			return DepthMax;
+		float t = std::log(viewDepth / zNear) / std::log(zFar / zNear);
+		return static_cast<uint32_t>(t * DepthMax);
+	}
+
+	uint64_t Opaque(uint32_t shaderId, uint32_t materialId, uint32_t depth) {
+		return
+			((uint64_t)(shaderId   & IdMask) << 51) |
+			((uint64_t)(materialId & IdMask) << 39) |
+			((uint64_t)(depth & DepthMax)    << 15);
+	}
+
+	uint64_t Transparent(uint32_t shaderId, uint32_t materialId, uint32_t depth) {
+		// Inverting the depth makes further objects sort first
+		return
+			(1ull << 63) |
+			((uint64_t)(DepthMax - (depth & DepthMax)) << 39) |
+			((uint64_t)(shaderId   & IdMask) << 27) |
+			((uint64_t)(materialId & IdMask) << 15);
+	}
+}
+
+void SortRenderQueue(std::vector<RenderItem>& items) {
+	std::sort(items.begin(), items.end(), [](const RenderItem& lhs, const RenderItem& rhs) {
+		return lhs.SortKey < rhs.SortKey;
+	});
+}
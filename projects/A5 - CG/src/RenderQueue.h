@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "entt.hpp"
+
+/*
+ * Packs all the state we want to sort our draw calls by into a single 64 bit key, so that ordering
+ * an entire frame is just an integer sort
+ *
+ * Opaque layout (front to back inside of a shader / material bucket):
+ *    [ transparent : 1 ][ shader : 12 ][ material : 12 ][ depth : 24 ][ unused : 15 ]
+ * Transparent layout (strictly back to front, state is only a tie breaker):
+ *    [ transparent : 1 ][ ~depth : 24 ][ shader : 12 ][ material : 12 ][ unused : 15 ]
+ */
+namespace RenderKey {
+	// The number of bits we quantize our view space depth into
+	constexpr uint32_t DepthBits = 24;
+	constexpr uint32_t DepthMax  = (1u << DepthBits) - 1;
+
+	/*
+	 * Extracts the near and far clip planes from an OpenGL style perspective or orthographic projection
+	 * @param projection The projection matrix to extract the planes from
+	 * @param zNear      Will store the distance to the near plane
+	 * @param zFar       Will store the distance to the far plane
+	 */
+	void ExtractClipPlanes(const glm::mat4& projection, float& zNear, float& zFar);
+
+	/*
+	 * Quantizes a view space depth into DepthBits bits. We use a logarithmic distribution so that
+	 * objects close to the camera (where ordering matters the most for early-Z) get the most precision
+	 * @param viewDepth The distance along the camera's forward axis
+	 * @param zNear     The distance to the near plane
+	 * @param zFar      The distance to the far plane
+	 */
+	uint32_t QuantizeDepth(float viewDepth, float zNear, float zFar);
+
+	uint64_t Opaque(uint32_t shaderId, uint32_t materialId, uint32_t depth);
+	uint64_t Transparent(uint32_t shaderId, uint32_t materialId, uint32_t depth);
+
+	inline bool IsTransparent(uint64_t key) { return (key >> 63) != 0; }
+}
+
+/*
+ * A single entry in our per-viewport render queue
+ */
+struct RenderItem {
+	uint64_t     SortKey;
+	entt::entity Entity;
+	glm::mat4    WorldTransform;
+};
+
+/*
+ * Sorts the given render items by their keys. Keys are unique enough that we do not need a stable sort
+ */
+void SortRenderQueue(std::vector<RenderItem>& items);
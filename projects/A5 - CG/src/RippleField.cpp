@@ -0,0 +1,161 @@
+#include "RippleField.h"
+#include "Logging.h"
+#include <Parallel.h>
+#include <emmintrin.h>
+#include <chrono>
+#include <cmath>
+
+RippleField::RippleField(const RippleFieldDescription& desc) {
+	LOG_ASSERT(desc.Resolution >= 4 && desc.Resolution % 4 == 0, "Ripple resolution must be a multiple of 4!");
+	LOG_ASSERT(desc.Size > 0.0f && desc.StepTime > 0.0f, "Ripple size and step time must be greater than 0!");
+	myDesc = desc;
+	myCellSize = desc.Size / desc.Resolution;
+	myOrigin = glm::ivec2(-(int)desc.Resolution / 2);
+	myAccumulator = 0.0f;
+	myLastUpdateMs = 0.0f;
+
+	uint32_t stride = __GetStride();
+	myCurrent.assign((size_t)stride * stride, 0.0f);
+	myPrevious.assign((size_t)stride * stride, 0.0f);
+
+	// Cells within this many cells of an edge lose extra energy every step, more the closer they are
+	float band = glm::max(desc.Resolution / 16.0f, 1.0f);
+	myFadeX.resize(desc.Resolution);
+	for (uint32_t ix = 0; ix < desc.Resolution; ix++) {
+		float edge = (float)glm::min(ix, desc.Resolution - 1 - ix);
+		myFadeX[ix] = glm::mix(0.9f, 1.0f, glm::min(edge / band, 1.0f));
+	}
+	myFadeY = myFadeX;
+
+	Texture2DDescription texture = Texture2DDescription();
+	texture.Width = texture.Height = desc.Resolution;
+	texture.Format = InternalFormat::R16F;
+	texture.Sampler.MinFilter = MinFilter::Linear;
+	texture.Sampler.MagFilter = MagFilter::Linear;
+	texture.Sampler.WrapS = texture.Sampler.WrapT = WrapMode::ClampToBorder;
+	texture.Sampler.BorderColor = glm::vec4(0.0f);
+	myTexture = std::make_shared<Texture2D>(texture);
+}
+
+void RippleField::AddDisturbance(const glm::vec2& position, float radius, float depth) {
+	myDisturbances.push_back({ position, radius, depth });
+}
+
+float RippleField::GetHeight(const glm::vec2& position) const {
+	glm::vec2 cell = position / myCellSize - glm::vec2(myOrigin) - 0.5f;
+	glm::ivec2 base = glm::ivec2(glm::floor(cell));
+	glm::vec2 frac = cell - glm::vec2(base);
+	int size = (int)myDesc.Resolution;
+	uint32_t stride = __GetStride();
+	// Cells outside of the grid are 0, just like the texture's border
+	auto sample = [&](int x, int y) {
+		return x < 0 || y < 0 || x >= size || y >= size ? 0.0f : myCurrent[(size_t)(y + 1) * stride + x + 1];
+	};
+	float top = glm::mix(sample(base.x, base.y), sample(base.x + 1, base.y), frac.x);
+	float bottom = glm::mix(sample(base.x, base.y + 1), sample(base.x + 1, base.y + 1), frac.x);
+	return glm::mix(top, bottom, frac.y);
+}
+
+void RippleField::__Shift(const glm::ivec2& origin) {
+	glm::ivec2 offset = origin - myOrigin;
+	myOrigin = origin;
+	int size = (int)myDesc.Resolution;
+	uint32_t stride = __GetStride();
+	for (std::vector<float>* heights : { &myCurrent, &myPrevious }) {
+		std::vector<float> shifted(heights->size(), 0.0f);
+		for (int y = 0; y < size; y++) {
+			int sourceY = y + offset.y;
+			if (sourceY < 0 || sourceY >= size)
+				continue;
+			for (int x = 0; x < size; x++) {
+				int sourceX = x + offset.x;
+				if (sourceX >= 0 && sourceX < size)
+					shifted[(size_t)(y + 1) * stride + x + 1] = (*heights)[(size_t)(sourceY + 1) * stride + sourceX + 1];
+			}
+		}
+		heights->swap(shifted);
+	}
+}
+
+void RippleField::__StepRows(size_t begin, size_t end, float k, float damping) {
+	uint32_t stride = __GetStride();
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 four = _mm_set1_ps(4.0f);
+	const __m128 kv = _mm_set1_ps(k);
+	for (size_t y = begin; y < end; y++) {
+		// Our border means that every cell has 4 neighbours, so there are no special cases at the edges
+		const float* row = &myCurrent[(y + 1) * stride + 1];
+		const float* up = row - stride;
+		const float* down = row + stride;
+		float* previous = &myPrevious[(y + 1) * stride + 1];
+		__m128 rowFade = _mm_set1_ps(myFadeY[y] * damping);
+		for (size_t x = 0; x < myDesc.Resolution; x += 4) {
+			__m128 center = _mm_loadu_ps(row + x);
+			__m128 neighbours = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1)),
+				_mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)));
+			__m128 laplacian = _mm_sub_ps(neighbours, _mm_mul_ps(center, four));
+			__m128 next = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(center, two), _mm_loadu_ps(previous + x)), _mm_mul_ps(laplacian, kv));
+			// Each cell only reads it's own previous height, so we can write the next one over it
+			_mm_storeu_ps(previous + x, _mm_mul_ps(next, _mm_mul_ps(rowFade, _mm_loadu_ps(&myFadeX[x]))));
+		}
+	}
+}
+
+void RippleField::Step() {
+	// Push down the water under everything that moved since our last step
+	uint32_t stride = __GetStride();
+	int size = (int)myDesc.Resolution;
+	for (const Disturbance& disturbance : myDisturbances) {
+		glm::vec2 cell = disturbance.Position / myCellSize - glm::vec2(myOrigin) - 0.5f;
+		float radius = disturbance.Radius / myCellSize;
+		glm::ivec2 first = glm::max(glm::ivec2(glm::floor(cell - radius)), glm::ivec2(0));
+		glm::ivec2 last = glm::min(glm::ivec2(glm::ceil(cell + radius)), glm::ivec2(size - 1));
+		for (int y = first.y; y <= last.y; y++) {
+			for (int x = first.x; x <= last.x; x++) {
+				float distance = glm::length(glm::vec2(x, y) - cell) / glm::max(radius, 1e-3f);
+				if (distance < 1.0f) {
+					float falloff = 1.0f - distance * distance;
+					myCurrent[(size_t)(y + 1) * stride + x + 1] -= disturbance.Depth * falloff * falloff;
+				}
+			}
+		}
+	}
+	myDisturbances.clear();
+
+	// k is (speed * dt / dx)^2, anything over 0.5 blows up so we clamp it there
+	float courant = myDesc.WaveSpeed * myDesc.StepTime / myCellSize;
+	float k = glm::min(courant * courant, 0.5f);
+	float damping = std::pow(myDesc.Damping, myDesc.StepTime);
+	Parallel::For(myDesc.Resolution, [&](size_t begin, size_t end) {
+		__StepRows(begin, end, k, damping);
+	}, 32);
+	myCurrent.swap(myPrevious);
+}
+
+void RippleField::Update(const glm::vec2& center, float deltaTime) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Only move once the center gets far enough away, so that we aren't shuffling our heights around every frame
+	glm::ivec2 centerCell = glm::ivec2(glm::floor(center / myCellSize));
+	glm::ivec2 wanted = centerCell - glm::ivec2(myDesc.Resolution / 2);
+	glm::ivec2 drift = glm::abs(wanted - myOrigin);
+	if (glm::max(drift.x, drift.y) > (int)myDesc.Resolution / 8)
+		__Shift(wanted);
+
+	myAccumulator = glm::min(myAccumulator + deltaTime, myDesc.StepTime * myDesc.MaxSteps);
+	int steps = 0;
+	while (myAccumulator >= myDesc.StepTime) {
+		Step();
+		myAccumulator -= myDesc.StepTime;
+		steps++;
+	}
+	myLastUpdateMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (steps > 0) {
+		// Skip over our border, by telling GL how long our rows really are
+		uint32_t stride = __GetStride();
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+		myTexture->LoadData(&myCurrent[stride + 1], myDesc.Resolution, myDesc.Resolution, PixelFormat::Red, PixelType::Float);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	}
+}
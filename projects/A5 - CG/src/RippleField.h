@@ -0,0 +1,108 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Texture2D.h"
+#include "Utils.h"
+
+struct RippleFieldDescription {
+	// The number of cells across the grid, must be a multiple of 4
+	uint32_t Resolution = 256;
+	// The width of the area the grid covers, in world units
+	float    Size = 16.0f;
+	// How fast ripples spread out, in world units per second
+	float    WaveSpeed = 1.5f;
+	// How much of each ripple is left after a second, lower values calm down faster
+	float    Damping = 0.35f;
+	// The length of each simulation step, in seconds. We take as many steps as we need each frame
+	float    StepTime = 1.0f / 60.0f;
+	// The most steps we'll take in one frame, so a long frame doesn't snowball into an even longer one
+	int      MaxSteps = 4;
+};
+
+// Disturbs a RippleField as the entity moves through the water
+struct RippleEmitter {
+	// The radius of the disturbance, in world units
+	float     Radius = 0.3f;
+	// How far down the water gets pushed for every world unit that we move
+	float     Strength = 0.08f;
+	glm::vec3 LastPosition = glm::vec3(0.0f);
+	bool      HasLastPosition = false;
+};
+
+/*
+	A small patch of ripples that follows the camera around, for water reacting to things moving through it. This
+	sits on top of the Gerstner waves, water-shader.vs.glsl adds our heights to it's displacement.
+
+	Each step solves the damped 2D wave equation on our grid, h' = 2h - h_prev + k * laplacian(h), 4 cells at a time
+	with SSE and with our rows split across the worker threads. Cells near the edges of the grid lose their energy
+	faster, so ripples fade out instead of bouncing back. The grid only moves in whole cells (and only once the
+	camera gets far enough from the center), so ripples stay put in the world as it moves.
+
+	Our heights are uploaded into a single channel texture every frame that we step
+*/
+class RippleField
+{
+public:
+	typedef std::shared_ptr<RippleField> Sptr;
+	NoCopy(RippleField);
+	NoMove(RippleField);
+
+	RippleField(const RippleFieldDescription& desc = RippleFieldDescription());
+	virtual ~RippleField() = default;
+
+	/*
+		Pushes the water down around a point, the ripples spread out from there on our next step
+		@param position The world position of the disturbance, anything outside of our grid is ignored
+		@param radius   The radius of the disturbance, in world units
+		@param depth    How far down to push the center of the disturbance
+	*/
+	void AddDisturbance(const glm::vec2& position, float radius, float depth);
+
+	/*
+		Moves the grid to follow a point, then runs as many steps as have built up and uploads the result
+		@param center    The point the grid should be centered around, usually the camera
+		@param deltaTime The time since our last update, in seconds
+	*/
+	void Update(const glm::vec2& center, float deltaTime);
+
+	// Runs a single simulation step, without uploading anything
+	void Step();
+
+	// Gets the height of the water at a world position, 0 outside of our grid
+	float GetHeight(const glm::vec2& position) const;
+
+	// Gets our heights, row by row, in a texture that is 0 past the edges
+	const Texture2D::Sptr& GetTexture() const { return myTexture; }
+	// Gets the world position of our grid's min corner in xy, and our size in z. The shader needs this to place us
+	glm::vec3 GetArea() const { return glm::vec3(glm::vec2(myOrigin) * myCellSize, myDesc.Size); }
+	const RippleFieldDescription& GetDescription() const { return myDesc; }
+	// Gets how long our last update took on the CPU, not counting the upload
+	float GetLastUpdateMs() const { return myLastUpdateMs; }
+
+protected:
+	RippleFieldDescription myDesc;
+	Texture2D::Sptr myTexture;
+	float myCellSize;
+	// The min corner of our grid, in whole cells from the world origin
+	glm::ivec2 myOrigin;
+	float myAccumulator;
+	float myLastUpdateMs;
+
+	// Our current and previous heights. Both have a border of 1 cell that is always 0, so rows are Resolution + 2 wide
+	std::vector<float> myCurrent, myPrevious;
+	// How much of each cell survives a step, along x and along y, this is where the edges lose their energy
+	std::vector<float> myFadeX, myFadeY;
+
+	struct Disturbance {
+		glm::vec2 Position;
+		float Radius, Depth;
+	};
+	std::vector<Disturbance> myDisturbances;
+
+	uint32_t __GetStride() const { return myDesc.Resolution + 2; }
+	// Moves our heights so the grid's min corner is at a new cell, dropping anything that falls off
+	void __Shift(const glm::ivec2& origin);
+	// Steps the rows [begin, end) of our grid (not counting the border)
+	void __StepRows(size_t begin, size_t end, float k, float damping);
+};
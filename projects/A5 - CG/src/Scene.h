@@ -3,12 +3,15 @@
 #include "TextureCube.h"
 #include "Shader.h"
 #include "Mesh.h"
+#include "SphericalHarmonics.h"
 
 class Scene {
 public:
 	TextureCube::Sptr Skybox;
 	Shader::Sptr      SkyboxShader;
 	Mesh::Sptr        SkyboxMesh;
+	// The diffuse lighting from our skybox, should be projected whenever the skybox changes
+	SphericalHarmonics AmbientSH;
 	
 	Scene() = default;
 	virtual ~Scene() = default;
@@ -41,6 +41,9 @@ char* readFile(const char* filename) {
 
 
 Shader::Shader() {
+	// Hand out sequential IDs, these only need to be unique among live shaders
+	static uint32_t nextRenderId = 0;
+	myRenderId = nextRenderId++;
 	myShaderHandle = glCreateProgram();
 }
 
@@ -30,9 +30,13 @@ public:
 
 	void Bind();
 
+	// Gets a small, unique ID for this shader, used to group draw calls by shader when sorting
+	uint32_t GetRenderId() const { return myRenderId; }
+
 private:
 	GLuint __CompileShaderPart(const char* source, GLenum type);
 
 	GLuint myShaderHandle;
+	uint32_t myRenderId;
 };
 
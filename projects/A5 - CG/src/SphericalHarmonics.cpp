@@ -0,0 +1,104 @@
+#include "SphericalHarmonics.h"
+#include "Logging.h"
+#include <GLM/gtc/constants.hpp>
+#include <Parallel.h>
+#include <mutex>
+#include <xmmintrin.h>
+
+namespace {
+	// Evaluates the first 9 real spherical harmonic basis functions for a direction, see
+	// "An Efficient Representation for Irradiance Environment Maps" (Ramamoorthi and Hanrahan)
+	void EvaluateBasis(const glm::vec3& dir, float result[9]) {
+		result[0] = 0.282095f;
+		result[1] = 0.488603f * dir.y;
+		result[2] = 0.488603f * dir.z;
+		result[3] = 0.488603f * dir.x;
+		result[4] = 1.092548f * dir.x * dir.y;
+		result[5] = 1.092548f * dir.y * dir.z;
+		result[6] = 0.315392f * (3.0f * dir.z * dir.z - 1.0f);
+		result[7] = 1.092548f * dir.x * dir.z;
+		result[8] = 0.546274f * (dir.x * dir.x - dir.y * dir.y);
+	}
+
+	// Convolving with a cosine lobe scales each band by pi, 2pi/3 and pi/4, and we divide by pi to go from
+	// irradiance to outgoing light
+	const float BandScale[9] = {
+		1.0f,
+		2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+		0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+	};
+}
+
+glm::vec3 SphericalHarmonics::Evaluate(const glm::vec3& dir) const {
+	float basis[9];
+	EvaluateBasis(dir, basis);
+	glm::vec3 result = glm::vec3(0.0f);
+	for (int ix = 0; ix < 9; ix++)
+		result += Coefficients[ix] * basis[ix];
+	return glm::max(result, glm::vec3(0.0f));
+}
+
+SphericalHarmonics SphericalHarmonics::ProjectCube(const uint8_t* const faces[6], uint32_t size) {
+	__m128 totals[9];
+	for (int ix = 0; ix < 9; ix++)
+		totals[ix] = _mm_setzero_ps();
+	std::mutex totalLock;
+
+	Parallel::For((size_t)6 * size, [&](size_t begin, size_t end) {
+		__m128 sums[9];
+		for (int ix = 0; ix < 9; ix++)
+			sums[ix] = _mm_setzero_ps();
+
+		float basis[9];
+		for (size_t row = begin; row < end; row++) {
+			int face = (int)(row / size);
+			uint32_t y = (uint32_t)(row % size);
+			float t = (y + 0.5f) / size * 2.0f - 1.0f;
+			const uint8_t* pixels = faces[face] + (size_t)y * size * 4;
+
+			for (uint32_t x = 0; x < size; x++) {
+				float s = (x + 0.5f) / size * 2.0f - 1.0f;
+				glm::vec3 dir = TextureCube::GetFaceDirection((CubeMapFace)face, s, t);
+				// The solid angle of a texel shrinks towards the edges of a face
+				float lengthSq = glm::dot(dir, dir);
+				float solidAngle = 4.0f / (size * size * lengthSq * std::sqrt(lengthSq));
+				EvaluateBasis(dir / std::sqrt(lengthSq), basis);
+
+				const uint8_t* texel = pixels + x * 4;
+				__m128 color = _mm_setr_ps(
+					Texture2D::SrgbToLinear(texel[0]), Texture2D::SrgbToLinear(texel[1]), Texture2D::SrgbToLinear(texel[2]), 0.0f);
+				// Stash the solid angle in w, so we can check that our weights add up to the whole sphere
+				color = _mm_mul_ps(_mm_add_ps(color, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f)), _mm_set1_ps(solidAngle));
+				for (int ix = 0; ix < 9; ix++)
+					sums[ix] = _mm_add_ps(sums[ix], _mm_mul_ps(color, _mm_set1_ps(basis[ix])));
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(totalLock);
+		for (int ix = 0; ix < 9; ix++)
+			totals[ix] = _mm_add_ps(totals[ix], sums[ix]);
+	}, 4);
+
+	// The total solid angle will be a little off of 4pi, so we normalize our result to account for it
+	alignas(16) float values[4];
+	_mm_store_ps(values, totals[0]);
+	float normalize = (4.0f * glm::pi<float>()) / (values[3] / 0.282095f);
+
+	SphericalHarmonics result;
+	for (int ix = 0; ix < 9; ix++) {
+		_mm_store_ps(values, totals[ix]);
+		result.Coefficients[ix] = glm::vec3(values[0], values[1], values[2]) * normalize * BandScale[ix];
+	}
+	return result;
+}
+
+SphericalHarmonics SphericalHarmonics::Project(const TextureCube::Sptr& cube, int level) {
+	LOG_ASSERT(cube != nullptr, "Cannot project a null cubemap!");
+	std::vector<uint8_t> faceData[6];
+	const uint8_t* faces[6];
+	for (int face = 0; face < 6; face++) {
+		faceData[face] = cube->GetLevelData((CubeMapFace)face, level);
+		faces[face] = faceData[face].data();
+	}
+	return ProjectCube(faces, glm::max(cube->GetSize() >> level, 1u));
+}
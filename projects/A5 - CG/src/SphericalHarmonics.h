@@ -0,0 +1,32 @@
+#pragma once
+#include <GLM/glm.hpp>
+#include "TextureCube.h"
+
+/*
+	Stores the lighting from an environment as 9 (L2) spherical harmonic coefficients. The coefficients have the
+	cosine lobe and 1/pi already folded in, so evaluating them for a normal gives the diffuse light leaving a
+	white surface facing that way, which is just a handful of multiply-adds in a shader.
+
+	Directions are in the cubemap's space, which is Y up. Our shaders swizzle our Z up world directions with
+	.xzy before sampling cubemaps, and the same goes for evaluating these
+*/
+struct SphericalHarmonics {
+	glm::vec3 Coefficients[9] = {};
+
+	// Evaluates the diffuse lighting for a surface facing the given (normalized) direction
+	glm::vec3 Evaluate(const glm::vec3& dir) const;
+
+	/*
+		Projects the faces of a cubemap onto our basis. Rows are split across our worker threads, and each
+		texel is accumulated into the coefficients as a single SSE vector in linear space
+		@param faces The RGBA8 (gamma encoded) pixel data for each face
+		@param size  The width and height of each face
+	*/
+	static SphericalHarmonics ProjectCube(const uint8_t* const faces[6], uint32_t size);
+	/*
+		Projects a cubemap that is already on the GPU by reading one of it's levels back
+		@param cube  The cubemap to project
+		@param level The mip level to read, only use something other than 0 if the mips are not prefiltered
+	*/
+	static SphericalHarmonics Project(const TextureCube::Sptr& cube, int level = 0);
+};
@@ -0,0 +1,321 @@
+#include "Terrain.h"
+#include "Logging.h"
+#include "Culling.h"
+#include <GLM/gtc/integer.hpp>
+#include <GLM/gtc/constants.hpp>
+#include <cfloat>
+#include <cstddef>
+#include <cstdio>
+
+// Must match the size of a_LodMorph in Terrain.vs.glsl
+static const int MaxLods = 12;
+
+// Checks if any part of a node is within range of our LOD camera (see Terrain::myLodCamera)
+static bool NodeInRange(const glm::vec3& lodCamera, float range, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+	glm::vec2 delta = glm::vec2(lodCamera) - glm::clamp(glm::vec2(lodCamera), glm::vec2(boxMin), glm::vec2(boxMax));
+	return glm::dot(delta, delta) + lodCamera.z * lodCamera.z <= range * range;
+}
+
+Terrain::Terrain(const HeightField::Sptr& heightField, const TerrainDescription& desc) {
+	LOG_ASSERT(heightField != nullptr, "Terrain needs a height field!");
+
+	myDescription = desc;
+	myHeightField = heightField;
+	int width = heightField->GetResolution().x;
+	int height = heightField->GetResolution().y;
+
+	// Our heightmap is sampled with bilinear filtering and repeat wrapping, just like in the shader
+	Texture2DDescription textureDesc;
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.Format = InternalFormat::R16;
+	textureDesc.Sampler.MinFilter = MinFilter::Linear;
+	textureDesc.Sampler.MagFilter = MagFilter::Linear;
+	myHeightmap = std::make_shared<Texture2D>(textureDesc);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	myHeightmap->LoadMipData(0, width, height, PixelFormat::Red, PixelType::Float, heightField->GetData().data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	__Init(heightField->GetSize(), (uint32_t)glm::max(width, height), heightField->GetMinHeight(), heightField->GetMaxHeight());
+
+	// We only have the one root, centered on our origin, so the texture starts half way through it
+	TerrainRoot root;
+	root.Offset = glm::vec2(heightField->GetSize() * -0.5f);
+	const std::vector<float>& heights = heightField->GetData();
+	float heightScale = heightField->GetHeightScale();
+	root.Bounds = __BuildBounds(myLodCount, glm::ivec2(width, height), [&](int x, int y) {
+		int tx = (((x - width / 2) % width) + width) % width;
+		int ty = (((y - height / 2) % height) + height) % height;
+		return heights[(size_t)ty * width + tx] * heightScale;
+	});
+	myRoots.push_back(root);
+}
+
+Terrain::Terrain(const TerrainDescription& desc, float rootSize, uint32_t rootTexels, float minHeight, float maxHeight) {
+	myDescription = desc;
+	__Init(rootSize, rootTexels, minHeight, maxHeight);
+}
+
+Terrain::~Terrain() {
+	glDeleteBuffers(3, myBuffers);
+	glDeleteVertexArrays(1, &myVao);
+}
+
+void Terrain::__Init(float rootSize, uint32_t rootTexels, float minHeight, float maxHeight) {
+	LOG_ASSERT(myDescription.PatchResolution >= 2 && myDescription.PatchResolution % 2 == 0, "Patch resolution must be a multiple of 2!");
+
+	myRootSize = rootSize;
+	myMinHeight = minHeight;
+	myMaxHeight = maxHeight;
+	myLodCount = __GetLodCount(rootTexels, myDescription.PatchResolution);
+	myInstanceCapacity = 0;
+	__BuildRanges();
+	__CreatePatch();
+}
+
+int Terrain::__GetLodCount(uint32_t rootTexels, uint32_t patchResolution) {
+	// Our most detailed LOD should have about one vertex per heightmap texel, any more is wasted
+	uint32_t leafCount = glm::max(rootTexels / patchResolution, 1u);
+	return glm::min((int)glm::log2(leafCount) + 1, MaxLods);
+}
+
+std::vector<std::vector<glm::vec2>> Terrain::__BuildBounds(int lodCount, const glm::ivec2& rootTexels, const std::function<float(int x, int y)>& texel) {
+	std::vector<std::vector<glm::vec2>> result(lodCount);
+
+	// Our leaves take the min and max of every texel that can be blended into them, including the ones just
+	// past their edges (since bilinear filtering pulls those in)
+	int leaves = 1 << (lodCount - 1);
+	std::vector<glm::vec2>& leafBounds = result[0];
+	leafBounds.resize((size_t)leaves * leaves);
+	for (int y = 0; y < leaves; y++) {
+		int minY = (int)glm::floor((float)y / leaves * rootTexels.y - 0.5f);
+		int maxY = (int)glm::floor((float)(y + 1) / leaves * rootTexels.y - 0.5f) + 1;
+		for (int x = 0; x < leaves; x++) {
+			int minX = (int)glm::floor((float)x / leaves * rootTexels.x - 0.5f);
+			int maxX = (int)glm::floor((float)(x + 1) / leaves * rootTexels.x - 0.5f) + 1;
+
+			glm::vec2 bounds = glm::vec2(FLT_MAX, -FLT_MAX);
+			for (int ty = minY; ty <= maxY; ty++) {
+				for (int tx = minX; tx <= maxX; tx++) {
+					float value = texel(tx, ty);
+					bounds.x = glm::min(bounds.x, value);
+					bounds.y = glm::max(bounds.y, value);
+				}
+			}
+			leafBounds[(size_t)y * leaves + x] = bounds;
+		}
+	}
+
+	// Every other level is just the min and max of it's 4 children
+	for (int lod = 1; lod < lodCount; lod++) {
+		int nodes = 1 << (lodCount - 1 - lod);
+		const std::vector<glm::vec2>& children = result[lod - 1];
+		result[lod].resize((size_t)nodes * nodes);
+		for (int y = 0; y < nodes; y++) {
+			for (int x = 0; x < nodes; x++) {
+				const glm::vec2& a = children[(size_t)(y * 2 + 0) * nodes * 2 + x * 2 + 0];
+				const glm::vec2& b = children[(size_t)(y * 2 + 0) * nodes * 2 + x * 2 + 1];
+				const glm::vec2& c = children[(size_t)(y * 2 + 1) * nodes * 2 + x * 2 + 0];
+				const glm::vec2& d = children[(size_t)(y * 2 + 1) * nodes * 2 + x * 2 + 1];
+				result[lod][(size_t)y * nodes + x] = glm::vec2(
+					glm::min(glm::min(a.x, b.x), glm::min(c.x, d.x)),
+					glm::max(glm::max(a.y, b.y), glm::max(c.y, d.y)));
+			}
+		}
+	}
+	return result;
+}
+
+void Terrain::__BuildRanges() {
+	// Each LOD covers (at least) twice the distance of the one before it. A node can reach past the end of it's
+	// range by up to it's diagonal, and it's neighbours in the next LOD can't have started morphing there or their
+	// edges won't line up, so small detail distances need the ranges pushed out further
+	float leafSize = myRootSize / (float)(1 << (myLodCount - 1));
+	float morphLength = 1.0f - glm::clamp(myDescription.MorphStart, 0.0f, 0.9f);
+	myLodRanges.resize(myLodCount);
+	myLodRanges[0] = leafSize * glm::max(myDescription.DetailDistance, glm::root_two<float>());
+	for (int lod = 1; lod < myLodCount; lod++) {
+		float diagonal = leafSize * (float)(1 << (lod - 1)) * glm::root_two<float>();
+		float gap = glm::max(diagonal * 2.0f, diagonal / morphLength);
+		myLodRanges[lod] = glm::max(myLodRanges[lod - 1] * 2.0f, myLodRanges[lod - 1] + gap);
+	}
+	// The coarsest LOD covers everything
+	myLodRanges[myLodCount - 1] = FLT_MAX;
+}
+
+void Terrain::__CreatePatch() {
+	// Our grid vertices are just their integer coordinates in the patch, the shader scales them to the node
+	int resolution = (int)myDescription.PatchResolution;
+	int edgeVerts = resolution + 1;
+	std::vector<glm::vec2> vertices((size_t)edgeVerts * edgeVerts);
+	for (int y = 0; y <= resolution; y++)
+		for (int x = 0; x <= resolution; x++)
+			vertices[(size_t)y * edgeVerts + x] = glm::vec2(x, y);
+
+	// Indices are grouped by quadrant, so that a node can be drawn using only part of the patch
+	int half = resolution / 2;
+	std::vector<uint32_t> indices;
+	indices.reserve((size_t)resolution * resolution * 6);
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		int startX = (quadrant & 1) * half;
+		int startY = (quadrant >> 1) * half;
+		for (int y = startY; y < startY + half; y++) {
+			for (int x = startX; x < startX + half; x++) {
+				uint32_t p1 = (y + 0) * edgeVerts + (x + 0);
+				uint32_t p2 = (y + 0) * edgeVerts + (x + 1);
+				uint32_t p3 = (y + 1) * edgeVerts + (x + 0);
+				uint32_t p4 = (y + 1) * edgeVerts + (x + 1);
+				// The diagonal goes the same way as the one on the next LOD, so fully morphed quads line up with it
+				indices.insert(indices.end(), { p1, p2, p3, p3, p2, p4 });
+			}
+		}
+	}
+
+	glCreateVertexArrays(1, &myVao);
+	glCreateBuffers(3, myBuffers);
+	glNamedBufferStorage(myBuffers[0], vertices.size() * sizeof(glm::vec2), vertices.data(), 0);
+	glNamedBufferStorage(myBuffers[1], indices.size() * sizeof(uint32_t), indices.data(), 0);
+
+	// Attribute 0 is the grid position, from our vertex buffer
+	glVertexArrayVertexBuffer(myVao, 0, myBuffers[0], 0, sizeof(glm::vec2));
+	glEnableVertexArrayAttrib(myVao, 0);
+	glVertexArrayAttribFormat(myVao, 0, 2, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(myVao, 0, 0);
+
+	// Attribute 1 is the node, once per instance
+	glVertexArrayVertexBuffer(myVao, 1, myBuffers[2], 0, sizeof(PatchInstance));
+	glVertexArrayBindingDivisor(myVao, 1, 1);
+	glEnableVertexArrayAttrib(myVao, 1);
+	glVertexArrayAttribFormat(myVao, 1, 4, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(myVao, 1, 1);
+
+	// Attribute 2 is the node's root offset and texture layer, only used by streamed terrain
+	glEnableVertexArrayAttrib(myVao, 2);
+	glVertexArrayAttribFormat(myVao, 2, 3, GL_FLOAT, GL_FALSE, offsetof(PatchInstance, Root));
+	glVertexArrayAttribBinding(myVao, 2, 1);
+
+	glVertexArrayElementBuffer(myVao, myBuffers[1]);
+}
+
+void Terrain::__GetNodeBounds(const TerrainRoot& root, int lod, int x, int y, glm::vec3& boundsMin, glm::vec3& boundsMax) const {
+	int nodes = 1 << (myLodCount - 1 - lod);
+	float size = myRootSize / (float)nodes;
+	const glm::vec2& heights = root.Bounds[lod][(size_t)y * nodes + x];
+	boundsMin = glm::vec3(root.Offset.x + x * size, root.Offset.y + y * size, heights.x);
+	boundsMax = glm::vec3(boundsMin.x + size, boundsMin.y + size, heights.y);
+}
+
+bool Terrain::__SelectNode(const TerrainRoot& root, int lod, int x, int y, const glm::mat4& viewProjection) {
+	glm::vec3 boundsMin, boundsMax;
+	__GetNodeBounds(root, lod, x, y, boundsMin, boundsMax);
+
+	// If we're out of range, our parent will need to cover us with a coarser patch
+	if (!NodeInRange(myLodCamera, myLodRanges[lod], boundsMin, boundsMax))
+		return false;
+	if (!BoxInFrustum(boundsMin, boundsMax, viewProjection)) {
+		myStats.Culled++;
+		return true;
+	}
+
+	PatchInstance node;
+	node.Offset = glm::vec2(boundsMin);
+	node.Size = boundsMax.x - boundsMin.x;
+	node.Lod = (float)lod;
+	node.Root = glm::vec3(root.Offset, root.Layer);
+
+	// If none of our children are close enough to need more detail, we can draw ourselves in one go
+	if (lod == 0 || !NodeInRange(myLodCamera, myLodRanges[lod - 1], boundsMin, boundsMax)) {
+		mySelection[Full].push_back(node);
+		return true;
+	}
+
+	// Otherwise, any children that don't need more detail get drawn by us, with the matching quarter of our patch
+	for (int child = 0; child < 4; child++) {
+		int childX = x * 2 + (child & 1);
+		int childY = y * 2 + (child >> 1);
+		if (!__SelectNode(root, lod - 1, childX, childY, viewProjection)) {
+			glm::vec3 childMin, childMax;
+			__GetNodeBounds(root, lod - 1, childX, childY, childMin, childMax);
+			if (BoxInFrustum(childMin, childMax, viewProjection))
+				mySelection[Quadrant0 + child].push_back(node);
+			else
+				myStats.Culled++;
+		}
+	}
+	return true;
+}
+
+void Terrain::Select(const glm::mat4& viewProjection, const glm::vec3& cameraPos) {
+	// Our LOD distances ignore the height of the terrain under each vertex, and only use how far the camera is
+	// above (or below) the terrain as a whole. That way a node's range only depends on it's 2D bounds, so we
+	// know exactly how far past it's range it can reach
+	float height = glm::clamp(cameraPos.z, myMinHeight, myMaxHeight);
+	myLodCamera = glm::vec3(cameraPos.x, cameraPos.y, cameraPos.z - height);
+	myStats = TerrainStats();
+	for (int part = 0; part < PartCount; part++)
+		mySelection[part].clear();
+
+	// The top LOD's range covers everything, so every root is always in range
+	for (const TerrainRoot& root : myRoots)
+		__SelectNode(root, myLodCount - 1, 0, 0, viewProjection);
+
+	size_t patchTriangles = (size_t)myDescription.PatchResolution * myDescription.PatchResolution * 2;
+	size_t total = 0;
+	for (int part = 0; part < PartCount; part++) {
+		total += mySelection[part].size();
+		myStats.Triangles += mySelection[part].size() * (part == Full ? patchTriangles : patchTriangles / 4);
+	}
+	myStats.Nodes = total;
+
+	// Upload all of our instances in one go, Draw picks out the range for each part. We do this here instead of
+	// in Draw so that the depth pre-pass and main pass can share it
+	if (total > myInstanceCapacity)
+		myInstanceCapacity = glm::max(total, myInstanceCapacity * 2);
+	glNamedBufferData(myBuffers[2], myInstanceCapacity * sizeof(PatchInstance), nullptr, GL_STREAM_DRAW);
+	size_t offset = 0;
+	for (int part = 0; part < PartCount; part++) {
+		if (mySelection[part].empty())
+			continue;
+		glNamedBufferSubData(myBuffers[2], offset * sizeof(PatchInstance), mySelection[part].size() * sizeof(PatchInstance), mySelection[part].data());
+		offset += mySelection[part].size();
+	}
+}
+
+void Terrain::Draw(const Shader::Sptr& shader) {
+	if (myStats.Nodes == 0)
+		return;
+
+	shader->SetUniform("a_LodCamera", myLodCamera);
+	shader->SetUniform("a_PatchResolution", (float)myDescription.PatchResolution);
+	for (int lod = 0; lod < myLodCount; lod++) {
+		// We start morphing part way through our range, and are fully morphed into the next LOD at the end of it
+		float end = myLodRanges[lod];
+		float start = (lod == 0 ? 0.0f : myLodRanges[lod - 1]);
+		start += (end - start) * glm::clamp(myDescription.MorphStart, 0.0f, 0.9f);
+		char name[32];
+		snprintf(name, sizeof(name), "a_LodMorph[%d]", lod);
+		// The coarsest LOD has nothing to morph into
+		shader->SetUniform(name, lod == myLodCount - 1 ? glm::vec4(0.0f) : glm::vec4(start, 1.0f / (end - start), 0.0f, 0.0f));
+	}
+
+	__ApplyUniforms(shader);
+
+	glBindVertexArray(myVao);
+	size_t quarterIndices = (size_t)myDescription.PatchResolution * myDescription.PatchResolution * 6 / 4;
+	GLuint baseInstance = 0;
+	for (int part = 0; part < PartCount; part++) {
+		GLsizei count = (GLsizei)mySelection[part].size();
+		if (count == 0)
+			continue;
+		size_t firstIndex = part == Full ? 0 : (part - Quadrant0) * quarterIndices;
+		size_t indexCount = part == Full ? quarterIndices * 4 : quarterIndices;
+		glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_INT,
+			(void*)(firstIndex * sizeof(uint32_t)), count, baseInstance);
+		baseInstance += count;
+	}
+	glBindVertexArray(0);
+}
+
+void Terrain::__ApplyUniforms(const Shader::Sptr& shader) {
+	shader->SetUniform("a_TerrainSize", myRootSize);
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <glad/glad.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Utils.h"
+#include "Shader.h"
+#include "Material.h"
+#include "Texture2D.h"
+#include "HeightField.h"
+
+struct TerrainDescription {
+	// The number of quads along each side of our grid patch, must be a multiple of 2
+	uint32_t PatchResolution = 16;
+	// The distance that the most detailed LOD is used out to, in multiples of the smallest node's size. Each
+	// coarser LOD covers twice the distance of the one before it
+	float DetailDistance = 5.0f;
+	// How far into each LOD's range we start morphing into the next one (0 morphs across the whole range, up to 0.9)
+	float MorphStart = 0.66f;
+};
+
+// The per-frame numbers for a terrain, from the last call to Select
+struct TerrainStats {
+	size_t Nodes = 0;     // The number of patches (or patch quadrants) that will be drawn
+	size_t Culled = 0;    // The number of nodes that were skipped for being outside of the frustum
+	size_t Triangles = 0; // The number of triangles that will be drawn
+};
+
+/*
+	Renders a heightmap using CDLOD (continuous distance-dependent level of detail). The terrain is split up
+	into a quadtree, where each node stores the min and max height underneath it. Each frame we walk the tree,
+	picking smaller nodes closer to the camera and skipping any that are outside of the frustum.
+
+	Every node is drawn with the same grid patch (instanced), so the number of vertices only depends on how
+	many nodes are in range, not on the size of the terrain. In the vertex shader, vertices slide towards the
+	next coarser grid as they get close to the edge of their LOD's range, so there are no seams or popping.
+
+	Heights are sampled the same way as the old plane did, uv = position.xy / Size with repeat wrapping, so the
+	terrain spans [-Size / 2, Size / 2] around it's origin. See Terrain.vs.glsl, and HeightField for the same
+	heights on the CPU.
+
+	A terrain can also be made up of many equally sized quadtrees (roots) side by side, each with their heights
+	in their own layer of a texture array, see TerrainStreamer
+*/
+class Terrain
+{
+public:
+	GraphicsClass(Terrain);
+
+	/*
+		Creates a new terrain to render a height field
+		@param heightField The heights to render, which also gives us our size and height scale
+		@param desc        The LOD settings for the terrain
+	*/
+	Terrain(const HeightField::Sptr& heightField, const TerrainDescription& desc = TerrainDescription());
+	virtual ~Terrain();
+
+	/*
+		Picks the nodes to draw for a camera, should be called once per view before Draw
+		@param viewProjection The view projection matrix multiplied with the terrain's world transform
+		@param cameraPos      The position of the camera, in the terrain's local space
+	*/
+	void Select(const glm::mat4& viewProjection, const glm::vec3& cameraPos);
+	/*
+		Draws the nodes from the last call to Select. The shader should already be bound, with the
+		terrain's material applied and it's transform uniforms set
+		@param shader The shader to draw with, should use Terrain.vs.glsl (or terrain-stream.vs.glsl for streamed terrain)
+	*/
+	void Draw(const Shader::Sptr& shader);
+
+	// Gets the texture that holds our heights, for sampling in the vertex shader
+	const Texture2D::Sptr& GetHeightmap() const { return myHeightmap; }
+	const HeightField::Sptr& GetHeightField() const { return myHeightField; }
+	const TerrainDescription& GetDescription() const { return myDescription; }
+	const TerrainStats& GetStats() const { return myStats; }
+	// Gets the number of levels in our quadtree, level 0 is the most detailed
+	int GetLodCount() const { return myLodCount; }
+
+protected:
+	// A single quadtree, our single heightmap terrain only has one of these
+	struct TerrainRoot {
+		glm::vec2 Offset = glm::vec2(0.0f); // The local position of the root's min corner
+		float     Layer = 0.0f;             // The texture array layer that holds the root's heights
+		// The min and max height under each node, one entry per LOD (stored like mip levels) with the most detailed first
+		std::vector<std::vector<glm::vec2>> Bounds;
+	};
+	// A single node (or one quadrant of a node) that we will draw, matches the instance attributes in our shaders
+	struct PatchInstance {
+		glm::vec2 Offset; // The local position of the node's min corner
+		float     Size;   // The width of the node
+		float     Lod;    // The LOD level that the node is being drawn at
+		glm::vec3 Root;   // The offset of the node's root, and it's texture layer
+	};
+	// Which part of the patch a node is drawn with, every quadrant has it's own range in our index buffer
+	enum PatchPart {
+		Full = 0,
+		Quadrant0, Quadrant1, Quadrant2, Quadrant3,
+		PartCount
+	};
+
+	TerrainDescription myDescription;
+	TerrainStats       myStats;
+
+	HeightField::Sptr myHeightField;
+	Texture2D::Sptr   myHeightmap;
+
+	// The size of each root, and the lowest and highest any root can go (used for our LOD distances)
+	float myRootSize;
+	float myMinHeight, myMaxHeight;
+	std::vector<TerrainRoot> myRoots;
+
+	int myLodCount;
+	// The distance that each LOD is used out to
+	std::vector<float> myLodRanges;
+
+	// The nodes picked by Select, bucketed by which part of the patch they need
+	std::vector<PatchInstance> mySelection[PartCount];
+	// The camera's local x and y, with z being how far it is above or below the terrain's height range
+	glm::vec3 myLodCamera;
+
+	GLuint myVao;
+	// 0 is grid vertices, 1 is indices, 2 is instances
+	GLuint myBuffers[3];
+	size_t myInstanceCapacity;
+
+	/*
+		Sets up the LOD ranges and patch, for terrains that manage their own roots
+		@param desc       The LOD settings for the terrain
+		@param rootSize   The width of each root, in local units
+		@param rootTexels The number of height texels across each root, which decides how many LODs we need
+		@param minHeight  The lowest that any root can go
+		@param maxHeight  The highest that any root can go
+	*/
+	Terrain(const TerrainDescription& desc, float rootSize, uint32_t rootTexels, float minHeight, float maxHeight);
+	// Sets any uniforms that our shader needs beyond the LOD ones, like how to map positions to texture coordinates
+	virtual void __ApplyUniforms(const Shader::Sptr& shader);
+
+	/*
+		Builds the min and max heights for every node in a root
+		@param lodCount   The number of LODs in the root
+		@param rootTexels The number of height texels across the root on each axis
+		@param texel      Gets the height of a texel, relative to the root's first texel. Will also be asked for the
+		                  texels just outside of the root, since filtering blends them in
+	*/
+	static std::vector<std::vector<glm::vec2>> __BuildBounds(int lodCount, const glm::ivec2& rootTexels, const std::function<float(int x, int y)>& texel);
+	// Gets the number of LODs we need for a root with the given number of texels across it
+	static int __GetLodCount(uint32_t rootTexels, uint32_t patchResolution);
+
+	void __Init(float rootSize, uint32_t rootTexels, float minHeight, float maxHeight);
+	void __BuildRanges();
+	void __CreatePatch();
+	void __GetNodeBounds(const TerrainRoot& root, int lod, int x, int y, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+	bool __SelectNode(const TerrainRoot& root, int lod, int x, int y, const glm::mat4& viewProjection);
+};
+
+// Attach to an entity (along with a Transform) to render it as a terrain
+struct TerrainRenderer {
+	Material::Sptr Material;
+	Terrain::Sptr  Terrain;
+};
@@ -0,0 +1,428 @@
+#include "TerrainStreamer.h"
+#include "Logging.h"
+#include <stb_perlin.h>
+#include <AssetRegistry.h>
+#include <Parallel.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+	// Bump this whenever generation changes, so that old cache entries get re-generated
+	const uint32_t ChunkVersion = 1;
+	const uint32_t ChunkMagic = 0x4B484354; // "TCHK"
+
+	struct ChunkHeader {
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t Resolution;
+		uint32_t Reserved;
+	};
+
+	// The layers that we will never go over, no matter how big our memory budget is
+	const int MaxChunkLayers = 256;
+}
+
+uint64_t TerrainNoise::GetHash() const {
+	size_t result = 0;
+	HashCombine(result, Frequency);
+	HashCombine(result, Octaves);
+	HashCombine(result, Lacunarity);
+	HashCombine(result, Gain);
+	HashCombine(result, Seed);
+	return result;
+}
+
+TerrainStreamer::TerrainStreamer(const TerrainStreamerDescription& desc) :
+	Terrain(desc.Lod, desc.ChunkSize, desc.ChunkResolution, 0.0f, desc.HeightScale)
+{
+	LOG_ASSERT(desc.ChunkSize > 0.0f, "Chunks must have a size greater than 0!");
+	LOG_ASSERT(desc.ChunkResolution % desc.Lod.PatchResolution == 0, "Chunk resolution must be a multiple of the patch resolution!");
+	LOG_ASSERT(desc.Tiles == nullptr || desc.Tiles->GetTileSize() == desc.ChunkResolution, "Chunk resolution must match the heightmap's tile size!");
+
+	myStreamerDesc = desc;
+	myInbox = std::make_shared<ChunkInbox>();
+	myRootsDirty = false;
+
+	myCacheKey = desc.Noise.GetHash();
+	HashCombine(myCacheKey, desc.ChunkSize);
+	HashCombine(myCacheKey, desc.HeightScale);
+
+	// Our memory budget decides how many chunks we can keep on the GPU at once
+	uint32_t texels = desc.ChunkResolution + 2;
+	size_t bytesPerChunk = (size_t)texels * texels * (2 + 4);
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	int layers = (int)glm::min(desc.MemoryBudget / bytesPerChunk, (size_t)glm::min(maxLayers, MaxChunkLayers));
+	LOG_ASSERT(layers > 0, "Terrain memory budget is too small to fit a single chunk!");
+	myStreamerStats.Capacity = layers;
+	for (int layer = layers - 1; layer >= 0; layer--)
+		myFreeLayers.push_back(layer);
+
+	// The border texels mean we never need to wrap, and the vertex shader only ever reads level 0
+	Texture2DArrayDescription textureDesc;
+	textureDesc.Width = texels;
+	textureDesc.Height = texels;
+	textureDesc.Layers = layers;
+	textureDesc.Format = InternalFormat::R16;
+	textureDesc.Sampler.MinFilter = MinFilter::Linear;
+	textureDesc.Sampler.MagFilter = MagFilter::Linear;
+	textureDesc.Sampler.WrapS = textureDesc.Sampler.WrapT = WrapMode::ClampToEdge;
+	myHeights = std::make_shared<Texture2DArray>(textureDesc);
+	textureDesc.Format = InternalFormat::RGBA8;
+	mySurface = std::make_shared<Texture2DArray>(textureDesc);
+
+	LOG_INFO("Terrain streamer can hold {} chunks ({} KB each)", layers, bytesPerChunk / 1024);
+}
+
+TerrainStreamer::~TerrainStreamer() = default;
+
+std::vector<float> TerrainStreamer::GenerateHeights(const TerrainStreamerDescription& desc, const glm::ivec2& coord, int margin) {
+	int resolution = (int)desc.ChunkResolution;
+	int texels = resolution + 2 + margin * 2;
+	double texelSize = (double)desc.ChunkSize / resolution;
+	const TerrainNoise& noise = desc.Noise;
+
+	// Octaves get their own slice of the noise (stb_perlin only takes 8 bits of seed, so we offset along z instead)
+	float totalAmplitude = 0.0f;
+	for (int octave = 0; octave < noise.Octaves; octave++)
+		totalAmplitude += std::pow(noise.Gain, (float)octave);
+	float baseZ = (float)(noise.Seed % 256) + 0.5f;
+
+	std::vector<float> result((size_t)texels * texels);
+	for (int y = 0; y < texels; y++) {
+		// We work out positions from the global texel index, so that neighbouring chunks generate the exact same
+		// values for the texels they share
+		int64_t globalY = (int64_t)coord.y * resolution + y - 1 - margin;
+		float worldY = (float)((globalY + 0.5) * texelSize);
+		for (int x = 0; x < texels; x++) {
+			int64_t globalX = (int64_t)coord.x * resolution + x - 1 - margin;
+			float worldX = (float)((globalX + 0.5) * texelSize);
+
+			float frequency = noise.Frequency, amplitude = 1.0f, sum = 0.0f;
+			for (int octave = 0; octave < noise.Octaves; octave++) {
+				sum += stb_perlin_noise3(worldX * frequency, worldY * frequency, baseZ + octave * 17.31f, 0, 0, 0) * amplitude;
+				frequency *= noise.Lacunarity;
+				amplitude *= noise.Gain;
+			}
+			// Perlin noise rarely gets close to +-1, so we stretch it a bit to use more of our height range
+			result[(size_t)y * texels + x] = glm::clamp(0.5f + 0.75f * sum / totalAmplitude, 0.0f, 1.0f);
+		}
+	}
+	return result;
+}
+
+void TerrainStreamer::__BuildSurface(const TerrainStreamerDescription& desc, const std::vector<float>& paddedHeights, ChunkData& chunk) {
+	int resolution = (int)desc.ChunkResolution;
+	int texels = resolution + 2;
+	int padded = texels + 2;
+	float texelSize = desc.ChunkSize / resolution;
+
+	chunk.Heights.resize((size_t)texels * texels);
+	chunk.Surface.resize((size_t)texels * texels * 4);
+	for (int y = 0; y < texels; y++) {
+		const float* row = &paddedHeights[(size_t)(y + 1) * padded + 1];
+		for (int x = 0; x < texels; x++) {
+			float value = row[x];
+			chunk.Heights[(size_t)y * texels + x] = value;
+
+			// Same central differences as Terrain.vs.glsl, one texel either side
+			float dx = (row[x - 1] - row[x + 1]) * desc.HeightScale / (2.0f * texelSize);
+			float dy = (row[x - padded] - row[x + padded]) * desc.HeightScale / (2.0f * texelSize);
+			glm::vec3 normal = glm::normalize(glm::vec3(dx, dy, 1.0f));
+
+			// Dirt down low and snow up high like the heightmap terrain, with dirt taking over from grass on steep slopes
+			float dirt = glm::clamp((0.5f - value) * 4.0f, 0.0f, 1.0f);
+			float snow = glm::clamp((value - 0.5f) * 4.0f, 0.0f, 1.0f);
+			float grass = 1.0f - dirt - snow;
+			dirt += grass * glm::clamp((1.0f - normal.z - 0.15f) * 4.0f, 0.0f, 1.0f);
+
+			uint8_t* surface = &chunk.Surface[((size_t)y * texels + x) * 4];
+			surface[0] = (uint8_t)std::lround((normal.x * 0.5f + 0.5f) * 255.0f);
+			surface[1] = (uint8_t)std::lround((normal.y * 0.5f + 0.5f) * 255.0f);
+			surface[2] = (uint8_t)std::lround(dirt * 255.0f);
+			surface[3] = (uint8_t)std::lround(snow * 255.0f);
+		}
+	}
+
+}
+
+std::unique_ptr<TerrainStreamer::ChunkData> TerrainStreamer::__BuildChunk(const TerrainStreamerDescription& desc, const glm::ivec2& coord, const std::string& cachePath) {
+	std::unique_ptr<ChunkData> result = std::make_unique<ChunkData>();
+	result->Coord = coord;
+
+	if (desc.Tiles != nullptr) {
+		// Our tiles already have a 2 texel apron, which is exactly the border plus the extra texel for normals
+		static_assert(TiledHeightmap::Apron == 2, "Tile aprons need to cover our border and normals!");
+		int padded = (int)desc.ChunkResolution + 4;
+		const uint16_t* tile = desc.Tiles->GetTile(coord.x, coord.y);
+		std::vector<float> heights((size_t)padded * padded);
+		for (size_t ix = 0; ix < heights.size(); ix++)
+			heights[ix] = tile[ix] / 65535.0f;
+		// We keep our own copy from here on, so there's no need for the OS to hang on to it
+		desc.Tiles->ReleaseTile(coord.x, coord.y);
+		__BuildSurface(desc, heights, *result);
+		result->FromCache = true;
+	} else {
+		result->FromCache = !cachePath.empty() && __ReadChunk(cachePath, desc.ChunkResolution, *result);
+	}
+	if (!result->FromCache) {
+		// We need one more texel around our border to get normals for it
+		__BuildSurface(desc, GenerateHeights(desc, coord, 1), *result);
+		if (!cachePath.empty() && !__WriteChunk(cachePath, desc.CacheDirectory, desc.ChunkResolution, *result))
+			LOG_WARN("Failed to write terrain chunk to \"{}\"", cachePath);
+	}
+
+	// Bounds are cheap enough that we don't bother caching them. Our root texels start after the border
+	int texels = (int)desc.ChunkResolution + 2;
+	float heightScale = desc.HeightScale;
+	const std::vector<float>& heights = result->Heights;
+	result->Bounds = __BuildBounds(__GetLodCount(desc.ChunkResolution, desc.Lod.PatchResolution), glm::ivec2(desc.ChunkResolution), [&](int x, int y) {
+		return heights[(size_t)(y + 1) * texels + (x + 1)] * heightScale;
+	});
+	return result;
+}
+
+bool TerrainStreamer::__ReadChunk(const std::string& path, uint32_t resolution, ChunkData& result) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	ChunkHeader header;
+	file.read((char*)&header, sizeof(ChunkHeader));
+	if (!file || header.Magic != ChunkMagic || header.Version != ChunkVersion || header.Resolution != resolution)
+		return false;
+
+	size_t texels = (size_t)(resolution + 2) * (resolution + 2);
+	result.Heights.resize(texels);
+	result.Surface.resize(texels * 4);
+	file.read((char*)result.Heights.data(), result.Heights.size() * sizeof(float));
+	file.read((char*)result.Surface.data(), result.Surface.size());
+	return (bool)file;
+}
+
+bool TerrainStreamer::__WriteChunk(const std::string& path, const std::string& directory, uint32_t resolution, const ChunkData& chunk) {
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	ChunkHeader header;
+	header.Magic = ChunkMagic;
+	header.Version = ChunkVersion;
+	header.Resolution = resolution;
+	header.Reserved = 0;
+
+	// Write to a temporary file first, so that a crash part way through never leaves a broken cache entry
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		file.write((const char*)&header, sizeof(ChunkHeader));
+		file.write((const char*)chunk.Heights.data(), chunk.Heights.size() * sizeof(float));
+		file.write((const char*)chunk.Surface.data(), chunk.Surface.size());
+		if (!file)
+			return false;
+	}
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
+
+std::string TerrainStreamer::__GetCachePath(const glm::ivec2& coord) const {
+	// Tiled heightmaps are already on disk, there's nothing to gain from caching them again
+	if (myStreamerDesc.CacheDirectory.empty() || myStreamerDesc.Tiles != nullptr)
+		return "";
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "%016llx_%d_%d.chunk", (unsigned long long)myCacheKey, coord.x, coord.y);
+	return myStreamerDesc.CacheDirectory + "/" + fileName;
+}
+
+void TerrainStreamer::__Request(const glm::ivec2& coord) {
+	myRequested[coord] = true;
+	std::shared_ptr<ChunkInbox> inbox = myInbox;
+	TerrainStreamerDescription desc = myStreamerDesc;
+	std::string cachePath = __GetCachePath(coord);
+	Parallel::Enqueue([inbox, desc, coord, cachePath]() {
+		std::unique_ptr<ChunkData> chunk = __BuildChunk(desc, coord, cachePath);
+		std::lock_guard<std::mutex> lock(inbox->Mutex);
+		inbox->Chunks.push_back(std::move(chunk));
+	});
+}
+
+void TerrainStreamer::__Upload(const ChunkData& chunk, int layer) {
+	uint32_t texels = myStreamerDesc.ChunkResolution + 2;
+	// Chunk rows are not always a multiple of 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	myHeights->LoadLayer(layer, 0, texels, texels, PixelFormat::Red, PixelType::Float, chunk.Heights.data());
+	mySurface->LoadLayer(layer, 0, texels, texels, PixelFormat::Rgba, PixelType::UByte, chunk.Surface.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	ResidentChunk& resident = myResident[chunk.Coord];
+	resident.Layer = layer;
+	resident.Heights = chunk.Heights;
+	resident.Bounds = chunk.Bounds;
+	myStreamerStats.Uploaded += chunk.Heights.size() * sizeof(decltype(chunk.Heights)::value_type) + chunk.Surface.size();
+	myRootsDirty = true;
+}
+
+void TerrainStreamer::__UpdateDesired(const glm::vec2& position) {
+	// Every chunk that has any part of it within our load radius, nearest first
+	float chunkSize = myStreamerDesc.ChunkSize;
+	float radius = myStreamerDesc.LoadRadius;
+	glm::ivec2 minCoord = glm::ivec2(glm::floor((position - radius) / chunkSize));
+	glm::ivec2 maxCoord = glm::ivec2(glm::floor((position + radius) / chunkSize));
+
+	// Tiled heightmaps only have so many chunks
+	if (myStreamerDesc.Tiles != nullptr) {
+		minCoord = glm::max(minCoord, glm::ivec2(0));
+		maxCoord = glm::min(maxCoord, myStreamerDesc.Tiles->GetTileCount() - 1);
+	}
+
+	std::vector<std::pair<float, glm::ivec2>> candidates;
+	for (int y = minCoord.y; y <= maxCoord.y; y++) {
+		for (int x = minCoord.x; x <= maxCoord.x; x++) {
+			glm::vec2 boundsMin = glm::vec2(x, y) * chunkSize;
+			glm::vec2 delta = position - glm::clamp(position, boundsMin, boundsMin + chunkSize);
+			float distance = glm::length(delta);
+			if (distance <= radius)
+				candidates.push_back({ distance, glm::ivec2(x, y) });
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	// We can't keep more chunks around than we have layers for
+	candidates.resize(glm::min(candidates.size(), myStreamerStats.Capacity));
+
+	std::vector<glm::ivec2> desired(candidates.size());
+	for (size_t ix = 0; ix < candidates.size(); ix++)
+		desired[ix] = candidates[ix].second;
+	if (desired != myDesired) {
+		myDesired = std::move(desired);
+		myDesiredRank.clear();
+		for (size_t ix = 0; ix < myDesired.size(); ix++)
+			myDesiredRank[myDesired[ix]] = (int)ix;
+		myRootsDirty = true;
+	}
+}
+
+void TerrainStreamer::__RebuildRoots() {
+	// We only draw the chunks we want, anything else that is still resident is just being kept around in case we
+	// come back to it
+	myRoots.clear();
+	for (const glm::ivec2& coord : myDesired) {
+		auto it = myResident.find(coord);
+		if (it == myResident.end())
+			continue;
+		TerrainRoot root;
+		root.Offset = glm::vec2(coord) * myStreamerDesc.ChunkSize;
+		root.Layer = (float)it->second.Layer;
+		root.Bounds = it->second.Bounds;
+		myRoots.push_back(std::move(root));
+	}
+	myRootsDirty = false;
+}
+
+void TerrainStreamer::Update(const glm::vec3& cameraPos) {
+	glm::vec2 position = glm::vec2(cameraPos);
+	myStreamerStats.Uploaded = 0;
+	__UpdateDesired(position);
+
+	// Grab anything that our workers have finished
+	{
+		std::lock_guard<std::mutex> lock(myInbox->Mutex);
+		for (std::unique_ptr<ChunkData>& chunk : myInbox->Chunks) {
+			myRequested.erase(chunk->Coord);
+			if (chunk->FromCache)
+				myStreamerStats.CacheHits++;
+			else
+				myStreamerStats.Generated++;
+			myPending.push_back(std::move(chunk));
+		}
+		myInbox->Chunks.clear();
+	}
+
+	// Throw out anything the camera has moved away from while it was generating, and upload the nearest first
+	myPending.erase(std::remove_if(myPending.begin(), myPending.end(), [&](const std::unique_ptr<ChunkData>& chunk) {
+		return myDesiredRank.find(chunk->Coord) == myDesiredRank.end() || myResident.find(chunk->Coord) != myResident.end();
+	}), myPending.end());
+	std::sort(myPending.begin(), myPending.end(), [&](const std::unique_ptr<ChunkData>& a, const std::unique_ptr<ChunkData>& b) {
+		return myDesiredRank[a->Coord] < myDesiredRank[b->Coord];
+	});
+
+	size_t uploaded = 0;
+	for (; uploaded < myPending.size() && myStreamerStats.Uploaded < myStreamerDesc.UploadBudget; uploaded++) {
+		if (myFreeLayers.empty()) {
+			// Make room by dropping the furthest chunk that we don't want anymore. Since we never want more chunks
+			// than we have layers, there is always one to drop
+			auto furthest = myResident.end();
+			float furthestDistance = -1.0f;
+			for (auto it = myResident.begin(); it != myResident.end(); it++) {
+				if (myDesiredRank.find(it->first) != myDesiredRank.end())
+					continue;
+				glm::vec2 center = (glm::vec2(it->first) + 0.5f) * myStreamerDesc.ChunkSize;
+				float distance = glm::length(center - position);
+				if (distance > furthestDistance) {
+					furthest = it;
+					furthestDistance = distance;
+				}
+			}
+			if (furthest == myResident.end())
+				break;
+			myFreeLayers.push_back(furthest->second.Layer);
+			myResident.erase(furthest);
+			myStreamerStats.Evicted++;
+		}
+		int layer = myFreeLayers.back();
+		myFreeLayers.pop_back();
+		__Upload(*myPending[uploaded], layer);
+	}
+	myPending.erase(myPending.begin(), myPending.begin() + uploaded);
+
+	// Ask for the nearest chunks that we don't have yet
+	for (const glm::ivec2& coord : myDesired) {
+		if (myRequested.size() >= myStreamerDesc.MaxInFlight)
+			break;
+		if (myResident.find(coord) != myResident.end() || myRequested.find(coord) != myRequested.end())
+			continue;
+		bool pending = false;
+		for (const std::unique_ptr<ChunkData>& chunk : myPending)
+			pending |= chunk->Coord == coord;
+		if (!pending)
+			__Request(coord);
+	}
+
+	if (myRootsDirty)
+		__RebuildRoots();
+	myStreamerStats.Resident = myResident.size();
+	myStreamerStats.InFlight = myRequested.size();
+}
+
+bool TerrainStreamer::GetHeight(const glm::vec2& position, float& result) const {
+	float chunkSize = myStreamerDesc.ChunkSize;
+	glm::ivec2 coord = glm::ivec2(glm::floor(position / chunkSize));
+	auto it = myResident.find(coord);
+	if (it == myResident.end())
+		return false;
+
+	// Same as a GL_LINEAR sampler with our border texels, see terrain-stream.vs.glsl
+	int resolution = (int)myStreamerDesc.ChunkResolution;
+	int texels = resolution + 2;
+	glm::vec2 texel = (position - glm::vec2(coord) * chunkSize) / chunkSize * (float)resolution + 0.5f;
+	glm::vec2 floorTexel = glm::floor(texel);
+	glm::vec2 frac = texel - floorTexel;
+	int x0 = glm::clamp((int)floorTexel.x, 0, texels - 2);
+	int y0 = glm::clamp((int)floorTexel.y, 0, texels - 2);
+
+	const float* row0 = &it->second.Heights[(size_t)y0 * texels];
+	const float* row1 = row0 + texels;
+	float top = row0[x0] + (row0[x0 + 1] - row0[x0]) * frac.x;
+	float bottom = row1[x0] + (row1[x0 + 1] - row1[x0]) * frac.x;
+	result = (top + (bottom - top) * frac.y) * myStreamerDesc.HeightScale;
+	return true;
+}
+
+void TerrainStreamer::__ApplyUniforms(const Shader::Sptr& shader) {
+	shader->SetUniform("a_ChunkSize", myStreamerDesc.ChunkSize);
+	shader->SetUniform("a_ChunkResolution", (float)myStreamerDesc.ChunkResolution);
+	shader->SetUniform("height", myStreamerDesc.HeightScale);
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Terrain.h"
+#include "Texture2DArray.h"
+#include "TiledHeightmap.h"
+
+// The fractal noise that our procedural terrain is made out of
+struct TerrainNoise {
+	// How many features per world unit the first octave has
+	float    Frequency = 0.08f;
+	// The number of layers of noise to add together
+	int      Octaves = 6;
+	// How much the frequency grows with each octave
+	float    Lacunarity = 2.0f;
+	// How much the amplitude shrinks with each octave
+	float    Gain = 0.5f;
+	// Different seeds give completely different terrain
+	uint32_t Seed = 0;
+
+	// Gets a hash of all of our settings, so that cached chunks are thrown out if they change
+	uint64_t GetHash() const;
+};
+
+struct TerrainStreamerDescription {
+	// The width of each chunk, in world units
+	float    ChunkSize = 10.0f;
+	// The number of height texels across each chunk, must be a multiple of the patch resolution
+	uint32_t ChunkResolution = 128;
+	// The height of the highest possible point, heights go from 0 to this
+	float    HeightScale = 4.75f;
+	TerrainNoise Noise = TerrainNoise();
+	// When set, chunks are paged in from this heightmap (one tile per chunk) instead of being generated. The map
+	// starts at the origin, chunks outside of it are never loaded, and ChunkResolution must match it's tile size
+	TiledHeightmap::Sptr Tiles = nullptr;
+
+	// How far from the camera we want chunks to be loaded
+	float  LoadRadius = 40.0f;
+	// How much GPU memory our chunk textures can use, this decides how many chunks can be resident at once
+	size_t MemoryBudget = 32 * 1024 * 1024;
+	// How many bytes of chunk data we will upload to the GPU in a single frame, to avoid hitches
+	size_t UploadBudget = 2 * 1024 * 1024;
+	// The most chunks that can be generating (or loading from disk) at once
+	uint32_t MaxInFlight = 8;
+	// Where we keep generated chunks, relative to the working directory. Leave empty to turn off caching
+	std::string CacheDirectory = "cache/terrain";
+
+	// The LOD settings for each chunk's quadtree
+	TerrainDescription Lod = TerrainDescription();
+};
+
+// The per-frame numbers for a streamer, from the last call to Update
+struct TerrainStreamerStats {
+	size_t Resident = 0;   // The number of chunks on the GPU
+	size_t Capacity = 0;   // The most chunks that fit in our memory budget
+	size_t InFlight = 0;   // The number of chunks being generated or loaded
+	size_t Generated = 0;  // The total number of chunks that we had to generate
+	size_t CacheHits = 0;  // The total number of chunks that were loaded from the disk cache (or a tiled heightmap)
+	size_t Evicted = 0;    // The total number of chunks that were dropped to make room
+	size_t Uploaded = 0;   // The number of bytes uploaded to the GPU this frame
+};
+
+/*
+	An endless procedural terrain, made up of square chunks that are generated around the camera as it moves.
+
+	Chunks are generated on our worker threads (fractal noise from stb_perlin), along with their normals, splat
+	weights and LOD bounds, and cached on disk so that we only ever generate each one once. Finished chunks are
+	uploaded into a layer of our texture arrays on the main thread, with a limit on how much gets uploaded per
+	frame. When every layer is in use, the chunk furthest from the camera is evicted.
+
+	Each chunk is one root of our CDLOD quadtree, so it draws just like a regular Terrain, but with
+	terrain-stream.vs.glsl. Chunk textures have a 1 texel border copied from their neighbours, so that filtering
+	lines up exactly across chunk edges.
+
+	Instead of noise, chunks can also come from a TiledHeightmap, for maps that are too big to load all at once
+*/
+class TerrainStreamer : public Terrain
+{
+public:
+	GraphicsClass(TerrainStreamer);
+
+	TerrainStreamer(const TerrainStreamerDescription& desc = TerrainStreamerDescription());
+	virtual ~TerrainStreamer();
+
+	/*
+		Requests, uploads and evicts chunks around a position, should be called once per frame before Select
+		@param cameraPos The position of the camera, in the terrain's local space
+	*/
+	void Update(const glm::vec3& cameraPos);
+
+	/*
+		Gets the height of the ground at a local position, from the chunks that are currently resident. This
+		matches what gets drawn, since we keep a CPU copy of every resident chunk's heights
+		@param position The local position to sample
+		@param result   Will store the height at the position
+		@returns True if the chunk under the position is resident
+	*/
+	bool GetHeight(const glm::vec2& position, float& result) const;
+
+	// Gets the height of each chunk texel, one layer per chunk
+	const Texture2DArray::Sptr& GetHeights() const { return myHeights; }
+	// Gets the normal and splat weights of each chunk texel, one layer per chunk
+	const Texture2DArray::Sptr& GetSurface() const { return mySurface; }
+	const TerrainStreamerDescription& GetStreamerDescription() const { return myStreamerDesc; }
+	const TerrainStreamerStats& GetStreamerStats() const { return myStreamerStats; }
+
+	/*
+		Generates the heights for a chunk, including it's border texels, on the calling thread
+		@param desc   The settings to generate with
+		@param coord  The chunk to generate
+		@param margin The number of texels to add around the chunk, on top of it's border
+		@returns (ChunkResolution + 2 + margin * 2)^2 heights, in [0, 1] (not scaled by HeightScale), row by row
+	*/
+	static std::vector<float> GenerateHeights(const TerrainStreamerDescription& desc, const glm::ivec2& coord, int margin = 0);
+
+protected:
+	// The data for a single chunk, built on a worker thread
+	struct ChunkData {
+		glm::ivec2 Coord;
+		// Includes the border, so (ChunkResolution + 2)^2 of each. Heights are in [0, 1] like a HeightField
+		std::vector<float>   Heights;
+		std::vector<uint8_t> Surface;
+		std::vector<std::vector<glm::vec2>> Bounds;
+		bool FromCache = false;
+	};
+	// Finished chunks get handed back to us through here. The workers hold on to it with a shared pointer, so
+	// that it outlives us if we get destroyed while chunks are still generating
+	struct ChunkInbox {
+		std::mutex Mutex;
+		std::vector<std::unique_ptr<ChunkData>> Chunks;
+	};
+	struct ResidentChunk {
+		int Layer;
+		std::vector<float> Heights;
+		std::vector<std::vector<glm::vec2>> Bounds;
+	};
+	struct CoordHash {
+		size_t operator()(const glm::ivec2& coord) const { return (size_t)coord.x * 73856093u ^ (size_t)coord.y * 19349663u; }
+	};
+
+	TerrainStreamerDescription myStreamerDesc;
+	TerrainStreamerStats       myStreamerStats;
+
+	Texture2DArray::Sptr myHeights;
+	Texture2DArray::Sptr mySurface;
+
+	std::shared_ptr<ChunkInbox> myInbox;
+	std::unordered_map<glm::ivec2, ResidentChunk, CoordHash> myResident;
+	// The chunks that are being generated right now
+	std::unordered_map<glm::ivec2, bool, CoordHash> myRequested;
+	// Chunks that have finished generating, but are waiting on our upload budget
+	std::vector<std::unique_ptr<ChunkData>> myPending;
+	std::vector<int> myFreeLayers;
+	// The chunks we want resident, nearest first, and where each one is in that list
+	std::vector<glm::ivec2> myDesired;
+	std::unordered_map<glm::ivec2, int, CoordHash> myDesiredRank;
+	// Set when the chunks that we should be drawing change
+	bool myRootsDirty;
+	// Identifies our noise and chunk settings in cache file names
+	uint64_t myCacheKey;
+
+	virtual void __ApplyUniforms(const Shader::Sptr& shader) override;
+
+	void __Request(const glm::ivec2& coord);
+	void __Upload(const ChunkData& chunk, int layer);
+	void __UpdateDesired(const glm::vec2& position);
+	void __RebuildRoots();
+	std::string __GetCachePath(const glm::ivec2& coord) const;
+
+	// Generates (or loads) a single chunk, runs on a worker thread. Tiles are paged in straight from their heightmap
+	static std::unique_ptr<ChunkData> __BuildChunk(const TerrainStreamerDescription& desc, const glm::ivec2& coord, const std::string& cachePath);
+	static bool __ReadChunk(const std::string& path, uint32_t resolution, ChunkData& result);
+	static bool __WriteChunk(const std::string& path, const std::string& directory, uint32_t resolution, const ChunkData& chunk);
+	// Fills in a chunk's heights, normals and splat weights from heights with an extra texel of padding
+	static void __BuildSurface(const TerrainStreamerDescription& desc, const std::vector<float>& paddedHeights, ChunkData& chunk);
+};
@@ -1,8 +1,112 @@
 #include "Texture2D.h"
 #include "Logging.h"
+#include "TextureCooker.h"
 #include <stb_image.h>
 #include <GLM/gtc/integer.hpp>
 #include <GLM/gtc/type_ptr.hpp>
+#include <Parallel.h>
+#include <AssetRegistry.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <xmmintrin.h>
+
+namespace {
+	// Uploads that have their levels ready, and are waiting for the main thread to pick them up
+	std::mutex uploadLock;
+	std::vector<std::shared_ptr<PendingUpload>> readyUploads;
+	// Uploads that are part way through being uploaded, only touched by the main thread
+	std::vector<std::shared_ptr<PendingUpload>> activeUploads;
+	std::atomic<size_t> pendingUploadCount{ 0 };
+
+	// Uploads the next level of a pending upload and lets the shader see it, returning the number of bytes uploaded
+	size_t UploadNextLevel(PendingUpload& upload) {
+		int level = upload.NextLevel--;
+		size_t bytes = 0;
+		std::vector<MipLevel>& layers = upload.Levels[level];
+		for (size_t layer = 0; layer < layers.size(); layer++) {
+			const MipLevel& mip = layers[layer];
+			if (upload.IsArray && upload.Compressed)
+				glCompressedTextureSubImage3D(upload.Handle, level, 0, 0, (GLint)layer, mip.Width, mip.Height, 1, (GLenum)upload.CompressedFormat, (GLsizei)mip.Data.size(), mip.Data.data());
+			else if (upload.IsArray)
+				glTextureSubImage3D(upload.Handle, level, 0, 0, (GLint)layer, mip.Width, mip.Height, 1, (GLenum)upload.Format, GL_UNSIGNED_BYTE, mip.Data.data());
+			else if (upload.Compressed)
+				glCompressedTextureSubImage2D(upload.Handle, level, 0, 0, mip.Width, mip.Height, (GLenum)upload.CompressedFormat, (GLsizei)mip.Data.size(), mip.Data.data());
+			else
+				glTextureSubImage2D(upload.Handle, level, 0, 0, mip.Width, mip.Height, (GLenum)upload.Format, GL_UNSIGNED_BYTE, mip.Data.data());
+			bytes += mip.Data.size();
+		}
+		glTextureParameteri(upload.Handle, GL_TEXTURE_BASE_LEVEL, level);
+		// The GPU has it's own copy now
+		std::vector<MipLevel>().swap(layers);
+		return bytes;
+	}
+
+	// Lookup tables for going between gamma encoded bytes and linear floats
+	struct SrgbTables {
+		float   ToLinear[256];
+		uint8_t FromLinear[4096];
+
+		SrgbTables() {
+			for (int ix = 0; ix < 256; ix++) {
+				float c = ix / 255.0f;
+				ToLinear[ix] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int ix = 0; ix < 4096; ix++) {
+				float c = ix / 4095.0f;
+				c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				FromLinear[ix] = (uint8_t)glm::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f);
+			}
+		}
+	};
+	const SrgbTables& GetSrgbTables() {
+		static SrgbTables tables;
+		return tables;
+	}
+
+	// Textures loaded from files are shared as long as they were loaded with the same settings
+	struct TextureKey {
+		std::string          Path;
+		Texture2DDescription Options;
+		bool                 LoadAlpha;
+
+		bool operator ==(const TextureKey& other) const {
+			return LoadAlpha == other.LoadAlpha && Path == other.Path && Options == other.Options;
+		}
+	};
+	struct TextureKeyHash {
+		size_t operator()(const TextureKey& key) const {
+			size_t result = key.Options.GetHash();
+			HashCombine(result, key.Path);
+			HashCombine(result, key.LoadAlpha);
+			return result;
+		}
+	};
+	AssetRegistry<TextureKey, Texture2D, TextureKeyHash> textureRegistry;
+}
+
+size_t Texture2DDescription::GetHash() const {
+	size_t result = Sampler.GetHash();
+	HashCombine(result, Width);
+	HashCombine(result, Height);
+	HashCombine(result, (GLint)Format);
+	HashCombine(result, EnableMip);
+	HashCombine(result, MipLevels);
+	HashCombine(result, (GLint)MipMode);
+	HashCombine(result, Compress);
+	return result;
+}
+
+bool Texture2DDescription::operator ==(const Texture2DDescription& other) const {
+	return
+		Width == other.Width && Height == other.Height && Format == other.Format &&
+		EnableMip == other.EnableMip && MipLevels == other.MipLevels && MipMode == other.MipMode &&
+		Compress == other.Compress && Sampler == other.Sampler;
+}
 
 Texture2D::Texture2D(const Texture2DDescription& desc) {
 	myDescription = desc;
@@ -16,9 +120,9 @@ Texture2D::~Texture2D() {
 }
 
 void Texture2D::__SetupTexture() {
+	// A full mip chain goes all the way down to 1x1
 	if (myDescription.MipLevels == -1)
-		myDescription.MipLevels = glm::max(
-			glm::log2(glm::min(myDescription.Width, myDescription.Height)), 1u);
+		myDescription.MipLevels = glm::log2(glm::max(glm::max(myDescription.Width, myDescription.Height), 1u)) + 1;
 	
 	glCreateTextures(GL_TEXTURE_2D, 1, &myTextureHandle);
 	glTextureStorage2D(myTextureHandle,
@@ -55,23 +159,173 @@ void Texture2D::LoadData(void* data, size_t width, size_t height, PixelFormat fo
 	
 	glTextureSubImage2D(myTextureHandle, 0, 0, 0, myDescription.Width, myDescription.Height, (GLenum)format, (GLenum)type, data);
 
-	if (myDescription.EnableMip)
+	if (myDescription.EnableMip && myDescription.MipMode == MipGeneration::Gpu)
 		glGenerateTextureMipmap(myTextureHandle);
 }
 
+void Texture2D::LoadMipData(int level, uint32_t width, uint32_t height, PixelFormat format, PixelType type, const void* data) {
+	glTextureSubImage2D(myTextureHandle, level, 0, 0, width, height, (GLenum)format, (GLenum)type, data);
+}
+
 Texture2D::Sptr Texture2D::LoadFromFile(const std::string& fileName, bool loadAlpha) {
+	return LoadFromFile(fileName, Texture2DDescription(), loadAlpha);
+}
+
+void Texture2D::LoadCompressedData(int level, uint32_t width, uint32_t height, const void* data, size_t size) {
+	LOG_ASSERT(myDescription.Format == InternalFormat::Bc1 || myDescription.Format == InternalFormat::Bc3, "Texture does not have a compressed format!");
+	glCompressedTextureSubImage2D(myTextureHandle, level, 0, 0, width, height, (GLenum)myDescription.Format, (GLsizei)size, data);
+}
+
+Texture2D::Sptr Texture2D::LoadFromFile(const std::string& fileName, const Texture2DDescription& options, bool loadAlpha) {
+	TextureKey key = { fileName, options, loadAlpha };
+	return textureRegistry.GetOrCreate(key, [&]() {
+		return __LoadFromFile(fileName, options, loadAlpha);
+	});
+}
+
+bool Texture2D::DecodeR16(const std::string& fileName, std::vector<uint16_t>& result, uint32_t& width, uint32_t& height) {
+	std::string extension = std::filesystem::path(fileName).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)::tolower(c); });
+
+	// Raw heightmaps have no header, so we can only assume that they are square
+	if (extension == ".r16" || extension == ".raw") {
+		std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+			return false;
+		size_t texels = (size_t)file.tellg() / sizeof(uint16_t);
+		size_t size = (size_t)std::sqrt((double)texels);
+		if (size == 0 || size * size != texels) {
+			LOG_WARN("Raw heightmap \"{}\" is not square", fileName);
+			return false;
+		}
+		result.resize(texels);
+		file.seekg(0);
+		file.read((char*)result.data(), texels * sizeof(uint16_t));
+		width = height = (uint32_t)size;
+		return (bool)file;
+	}
+
+	// We take the first channel as is, instead of letting stb_image convert colour images to luminance
+	int imageWidth, imageHeight, numChannels;
+	if (stbi_is_16_bit(fileName.c_str())) {
+		stbi_us* data = stbi_load_16(fileName.c_str(), &imageWidth, &imageHeight, &numChannels, 0);
+		if (data == nullptr)
+			return false;
+		result.resize((size_t)imageWidth * imageHeight);
+		for (size_t ix = 0; ix < result.size(); ix++)
+			result[ix] = data[ix * numChannels];
+		stbi_image_free(data);
+	} else {
+		stbi_uc* data = stbi_load(fileName.c_str(), &imageWidth, &imageHeight, &numChannels, 0);
+		if (data == nullptr)
+			return false;
+		result.resize((size_t)imageWidth * imageHeight);
+		// Multiplying by 257 maps 255 to 65535, so 8 bit images still cover our whole range
+		for (size_t ix = 0; ix < result.size(); ix++)
+			result[ix] = (uint16_t)(data[ix * numChannels] * 257);
+		stbi_image_free(data);
+	}
+	width = imageWidth;
+	height = imageHeight;
+	return width != 0 && height != 0;
+}
+
+Texture2D::Sptr Texture2D::LoadR16FromFile(const std::string& fileName, const Texture2DDescription& options) {
+	std::vector<uint16_t> texels;
+	uint32_t width, height;
+	if (!DecodeR16(fileName, texels, width, height)) {
+		LOG_WARN("Failed to load image from \"{}\"", fileName);
+		return nullptr;
+	}
+
+	Texture2DDescription desc = options;
+	desc.Width = width;
+	desc.Height = height;
+	desc.Format = InternalFormat::R16;
+	desc.Compress = false;
+	// Our CPU mip generation only handles 8 bit data
+	desc.MipMode = MipGeneration::Gpu;
+	Sptr result = std::make_shared<Texture2D>(desc);
+	// Rows of 16 bit texels are only 4 byte aligned for even widths
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	result->LoadData(texels.data(), width, height, PixelFormat::Red, PixelType::UShort);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return result;
+}
+
+AssetRegistryStats Texture2D::GetCacheStats() {
+	return textureRegistry.GetStats();
+}
+
+Texture2D::Sptr Texture2D::__LoadFromFile(const std::string& fileName, const Texture2DDescription& options, bool loadAlpha) {
+	if (options.Compress) {
+		CookOptions cook;
+		cook.AllowAlpha = loadAlpha;
+		cook.GenerateMips = options.EnableMip;
+		cook.Srgb = options.MipMode == MipGeneration::CpuSrgb;
+		CookedImage image;
+		if (TextureCooker::Cook(fileName, cook, image)) {
+			Texture2DDescription desc = options;
+			desc.Width = image.Width;
+			desc.Height = image.Height;
+			desc.Format = image.Format;
+			desc.MipLevels = (int)image.Levels.size();
+			desc.EnableMip = image.Levels.size() > 1;
+
+			Sptr result = std::make_shared<Texture2D>(desc);
+			if (desc.EnableMip && desc.MipMode != MipGeneration::Gpu) {
+				std::shared_ptr<PendingUpload> upload = std::make_shared<PendingUpload>();
+				upload->Texture = result;
+				upload->Handle = result->myTextureHandle;
+				upload->Compressed = image.Format != InternalFormat::RGBA8;
+				upload->CompressedFormat = image.Format;
+				for (MipLevel& level : image.Levels)
+					upload->Levels.push_back({ std::move(level) });
+				QueueUpload(upload, (int)upload->Levels.size());
+				return result;
+			}
+			for (size_t ix = 0; ix < image.Levels.size(); ix++) {
+				const MipLevel& level = image.Levels[ix];
+				result->LoadCompressedData((int)ix, level.Width, level.Height, level.Data.data(), level.Data.size());
+			}
+			return result;
+		}
+		LOG_WARN("Failed to cook \"{}\", falling back to an uncompressed texture", fileName);
+	}
 
 	int width, height, numChannels;
 	void* data = stbi_load(fileName.c_str(), &width, &height, &numChannels, loadAlpha ? 4 : 3);
 
 	if (data != nullptr && width != 0 && height != 0 && numChannels != 0) {
-		Texture2DDescription desc = Texture2DDescription();
+		Texture2DDescription desc = options;
 		desc.Width = width;
 		desc.Height = height;
 		desc.Format = loadAlpha ? InternalFormat::RGBA8 : InternalFormat::RGB8;
+		PixelFormat format = loadAlpha ? PixelFormat::Rgba : PixelFormat::Rgb;
 		
 		Sptr result = std::make_shared<Texture2D>(desc);
-		result->LoadData(data, width, height, loadAlpha? PixelFormat::Rgba : PixelFormat::Rgb, PixelType::UByte);
+
+		// Hand the image off to our workers to build the mips, it will get uploaded over the next few frames
+		if (desc.EnableMip && desc.MipMode != MipGeneration::Gpu && result->myDescription.MipLevels > 1) {
+			std::shared_ptr<PendingUpload> upload = std::make_shared<PendingUpload>();
+			upload->Texture = result;
+			upload->Handle = result->myTextureHandle;
+			upload->Format = format;
+			uint8_t* source = (uint8_t*)data;
+			int channels = loadAlpha ? 4 : 3;
+			int levels = result->myDescription.MipLevels;
+			bool srgb = desc.MipMode == MipGeneration::CpuSrgb;
+			QueueUpload(upload, levels, [source, width, height, channels, levels, srgb](PendingUpload& upload) {
+				std::vector<MipLevel> mips = GenerateMipChain(source, width, height, channels, levels, srgb);
+				upload.Levels.push_back({ { (uint32_t)width, (uint32_t)height, std::vector<uint8_t>(source, source + (size_t)width * height * channels) } });
+				stbi_image_free(source);
+				for (MipLevel& mip : mips)
+					upload.Levels.push_back({ std::move(mip) });
+			});
+			return result;
+		}
+
+		result->LoadData(data, width, height, format, PixelType::UByte);
 		stbi_image_free(data);
 		return result;
 	} else {
@@ -80,3 +334,149 @@ Texture2D::Sptr Texture2D::LoadFromFile(const std::string& fileName, bool loadAl
 	}
 }
 
+
+float Texture2D::SrgbToLinear(uint8_t value) {
+	return GetSrgbTables().ToLinear[value];
+}
+
+uint8_t Texture2D::LinearToSrgb(float value) {
+	return GetSrgbTables().FromLinear[(int)(glm::clamp(value, 0.0f, 1.0f) * 4095.0f + 0.5f)];
+}
+
+std::vector<MipLevel> Texture2D::GenerateMipChain(const uint8_t* data, uint32_t width, uint32_t height, int channels, int levels, bool srgb) {
+	LOG_ASSERT(channels >= 1 && channels <= 4, "Mip generation only supports 1 to 4 channels!");
+	const SrgbTables& tables = GetSrgbTables();
+
+	// Alpha is always linear, so only the colour channels go through our gamma tables
+	bool gamma[4] = { false, false, false, false };
+	int colorChannels = (channels == 2 || channels == 4) ? channels - 1 : channels;
+	for (int c = 0; c < colorChannels; c++)
+		gamma[c] = srgb;
+
+	// We do all of our filtering on 4 floats per pixel, that way every pixel is a single SSE register no matter
+	// how many channels we actually have. Each level is filtered from the float version of the last one, so we
+	// never lose precision by going through bytes
+	std::vector<float> source((size_t)width * height * 4, 1.0f);
+	Parallel::For(height, [&](size_t begin, size_t end) {
+		for (size_t y = begin; y < end; y++) {
+			for (size_t x = 0; x < width; x++) {
+				const uint8_t* pixel = data + (y * width + x) * channels;
+				float* out = &source[(y * width + x) * 4];
+				for (int c = 0; c < channels; c++)
+					out[c] = gamma[c] ? tables.ToLinear[pixel[c]] : pixel[c] / 255.0f;
+			}
+		}
+	}, 16);
+
+	std::vector<MipLevel> result;
+	result.reserve(levels > 1 ? levels - 1 : 0);
+	std::vector<float> dest;
+	uint32_t srcWidth = width, srcHeight = height;
+	for (int level = 1; level < levels; level++) {
+		MipLevel mip;
+		mip.Width = glm::max(srcWidth / 2, 1u);
+		mip.Height = glm::max(srcHeight / 2, 1u);
+		mip.Data.resize((size_t)mip.Width * mip.Height * channels);
+		dest.resize((size_t)mip.Width * mip.Height * 4);
+
+		Parallel::For(mip.Height, [&](size_t begin, size_t end) {
+			const __m128 quarter = _mm_set1_ps(0.25f);
+			for (size_t y = begin; y < end; y++) {
+				// Odd sizes just clamp to the last row / column
+				size_t y0 = glm::min<size_t>(y * 2, srcHeight - 1);
+				size_t y1 = glm::min<size_t>(y * 2 + 1, srcHeight - 1);
+				for (size_t x = 0; x < mip.Width; x++) {
+					size_t x0 = glm::min<size_t>(x * 2, srcWidth - 1);
+					size_t x1 = glm::min<size_t>(x * 2 + 1, srcWidth - 1);
+					__m128 sum = _mm_add_ps(
+						_mm_add_ps(_mm_loadu_ps(&source[(y0 * srcWidth + x0) * 4]), _mm_loadu_ps(&source[(y0 * srcWidth + x1) * 4])),
+						_mm_add_ps(_mm_loadu_ps(&source[(y1 * srcWidth + x0) * 4]), _mm_loadu_ps(&source[(y1 * srcWidth + x1) * 4])));
+					__m128 average = _mm_mul_ps(sum, quarter);
+					_mm_storeu_ps(&dest[(y * mip.Width + x) * 4], average);
+
+					// Convert back down to bytes, re-applying the gamma curve where needed
+					alignas(16) float values[4];
+					_mm_store_ps(values, average);
+					uint8_t* out = &mip.Data[(y * mip.Width + x) * channels];
+					for (int c = 0; c < channels; c++) {
+						float v = glm::clamp(values[c], 0.0f, 1.0f);
+						out[c] = gamma[c] ? tables.FromLinear[(int)(v * 4095.0f + 0.5f)] : (uint8_t)(v * 255.0f + 0.5f);
+					}
+				}
+			}
+		}, 4);
+
+		source.swap(dest);
+		srcWidth = mip.Width;
+		srcHeight = mip.Height;
+		result.push_back(std::move(mip));
+	}
+	return result;
+}
+
+void Texture2D::QueueUpload(const std::shared_ptr<PendingUpload>& upload, int levels, const std::function<void(PendingUpload&)>& generate) {
+	LOG_ASSERT(levels > 0, "Cannot upload an empty mip chain!");
+	upload->NextLevel = levels - 1;
+	pendingUploadCount++;
+
+	// Our smaller mips have rows that are not 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (generate) {
+		// Only let the shader see our smallest level, and give it something to show until the real data is ready
+		LOG_ASSERT(!upload->Compressed, "Compressed mip chains can not be generated in the background!");
+		glTextureParameteri(upload->Handle, GL_TEXTURE_BASE_LEVEL, upload->NextLevel);
+		glClearTexImage(upload->Handle, upload->NextLevel, (GLenum)upload->Format, GL_UNSIGNED_BYTE, nullptr);
+		Parallel::Enqueue([upload, generate]() {
+			generate(*upload);
+			std::lock_guard<std::mutex> lock(uploadLock);
+			readyUploads.push_back(upload);
+		});
+	}
+	else {
+		// We already have every level, so the smallest one can go up right away
+		LOG_ASSERT(upload->Levels.size() == (size_t)levels, "Mip chain is missing levels!");
+		UploadNextLevel(*upload);
+		std::lock_guard<std::mutex> lock(uploadLock);
+		readyUploads.push_back(upload);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void Texture2D::UpdateUploads(size_t byteBudget) {
+	// Grab anything that our workers have finished with
+	{
+		std::lock_guard<std::mutex> lock(uploadLock);
+		activeUploads.insert(activeUploads.end(), readyUploads.begin(), readyUploads.end());
+		readyUploads.clear();
+	}
+	if (activeUploads.empty())
+		return;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t uploaded = 0;
+	for (auto it = activeUploads.begin(); it != activeUploads.end(); ) {
+		std::shared_ptr<PendingUpload> upload = *it;
+		// Holding on to the texture keeps it's handle valid while we upload
+		std::shared_ptr<void> texture = upload->Texture.lock();
+
+		// Upload from the smallest level to the largest, moving our base level down as each one lands so that
+		// the texture gets sharper as it loads in
+		while (texture != nullptr && upload->NextLevel >= 0 && (uploaded == 0 || uploaded < byteBudget))
+			uploaded += UploadNextLevel(*upload);
+
+		// Either we're done, or nobody is holding on to the texture anymore
+		if (texture == nullptr || upload->NextLevel < 0) {
+			pendingUploadCount--;
+			it = activeUploads.erase(it);
+		}
+		else if (uploaded >= byteBudget)
+			break;
+		else
+			++it;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+size_t Texture2D::GetPendingUploads() {
+	return pendingUploadCount;
+}
@@ -1,11 +1,21 @@
 #pragma once
 #include <glad\glad.h>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 #include <EnumToString.h>
 #include "Utils.h"
 #include "TextureSampler.h"
 
+// Our glad loader was not generated with EXT_texture_compression_s3tc, but every desktop driver we care about supports it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 // https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml
 // These are some of our more common available internal formats
 ENUM(InternalFormat, GLint,
@@ -16,7 +26,14 @@ ENUM(InternalFormat, GLint,
 	RGB8         = GL_RGB8,
 	RGB16        = GL_RGB16,
 	RGBA8        = GL_RGBA8,
-	RGBA16       = GL_RGBA16
+	RGBA16       = GL_RGBA16,
+	// Half float formats, for data that can go negative (or past 1)
+	R16F         = GL_R16F,
+	RG16F        = GL_RG16F,
+	RGBA16F      = GL_RGBA16F,
+	// Block compressed formats, see TextureCooker
+	Bc1          = GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+	Bc3          = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
 
 	// Note: There are sized internal formats but there is a LOT of them
 );
@@ -44,6 +61,19 @@ ENUM(PixelType, GLint,
 	Float  = GL_FLOAT
 );
 
+// How the mip chain for a texture gets filled in when EnableMip is set
+ENUM(MipGeneration, GLint,
+	Gpu       = 0, // Let the driver build them with glGenerateTextureMipmap once the data is loaded (default)
+	CpuLinear = 1, // Box filtered on worker threads, for data textures like heightmaps
+	CpuSrgb   = 2  // Box filtered in linear space on worker threads, for colour textures that are stored gamma encoded
+);
+
+// A single level of a mip chain that was generated on the CPU
+struct MipLevel {
+	uint32_t Width, Height;
+	std::vector<uint8_t> Data;
+};
+
 // Represents all the data required to set up our texture (but not actually load it's data)
 // This is more or less all the GPU state that we care about
 struct Texture2DDescription {
@@ -55,6 +85,36 @@ struct Texture2DDescription {
 	bool EnableMip      = false;
 	int MipLevels       = -1;
 	SamplerDesc Sampler = SamplerDesc();
+
+	// When a CPU option is selected, the mips are uploaded progressively from smallest to largest over
+	// the next few frames (see Texture2D::UpdateUploads), so the texture is usable right away
+	MipGeneration MipMode = MipGeneration::Gpu;
+
+	// Cooks the texture into BC1 (or BC3 if it has alpha) with a full mip chain when loading from a file. The
+	// result is cached on disk, so after the first run we skip decoding entirely. MipMode only affects how the
+	// cooked mips are filtered
+	bool Compress = false;
+
+	// Gets a hash of all of our settings, for looking up textures that were loaded the same way
+	size_t GetHash() const;
+	// Textures with equal descriptions were loaded the same way
+	bool operator ==(const Texture2DDescription& other) const;
+	bool operator !=(const Texture2DDescription& other) const { return !(*this == other); }
+};
+
+// A mip chain that is being uploaded a few levels at a time, from the smallest to the largest (see Texture2D::QueueUpload)
+struct PendingUpload {
+	std::weak_ptr<void> Texture;          // Only used to tell if the texture is still alive
+	GLuint              Handle = 0;
+	bool                IsArray = false;  // True for a Texture2DArray, where every level has a MipLevel for each layer
+	PixelFormat         Format = PixelFormat::Rgba;
+	// Compressed levels are uploaded as is, in the texture's own format
+	bool                Compressed = false;
+	InternalFormat      CompressedFormat = InternalFormat::Bc1;
+	// Indexed by level and then by layer (a Texture2D only has the one layer)
+	std::vector<std::vector<MipLevel>> Levels;
+	// The next level that we need to upload, we work our way down to 0
+	int                 NextLevel = -1;
 };
 
 // Represents a 2D texture in OpenGL
@@ -67,15 +127,89 @@ public:
 	virtual ~Texture2D();
 	
 	void LoadData(void* data, size_t width, size_t height, PixelFormat format, PixelType type);
+	/*
+		Uploads block compressed data into one of our mip levels, our format must be a compressed one
+		@param level  The mip level to upload to
+		@param width  The width of the level, in pixels
+		@param height The height of the level, in pixels
+		@param data   The compressed blocks
+		@param size   The size of data, in bytes
+	*/
+	void LoadCompressedData(int level, uint32_t width, uint32_t height, const void* data, size_t size);
+	// Uploads data into one of our mip levels directly, for mip chains that were built on the CPU
+	void LoadMipData(int level, uint32_t width, uint32_t height, PixelFormat format, PixelType type, const void* data);
 	
 	void Bind(int slot) const;
 	static void UnBind(int slot);
 	
 	static Sptr LoadFromFile(const std::string& fileName, bool loadAlpha = true);
+	/*
+		Loads a texture from a file, using the given description for everything but the size and format. If the
+		same file was already loaded with the same settings and is still alive, the existing texture is returned
+		@param fileName  The path to the image to load
+		@param options   The mip and sampler settings to use, Width, Height and Format are ignored
+		@param loadAlpha True if we should load an alpha channel
+	*/
+	static Sptr LoadFromFile(const std::string& fileName, const Texture2DDescription& options, bool loadAlpha = true);
+	/*
+		Loads a single channel 16 bit texture (InternalFormat::R16), for data like heightmaps where 8 bits leaves
+		visible steps. These are never compressed, and any mips are generated on the GPU
+		@param fileName The path to the image to load, see DecodeR16
+		@param options  The mip and sampler settings to use, Width, Height, Format and Compress are ignored
+	*/
+	static Sptr LoadR16FromFile(const std::string& fileName, const Texture2DDescription& options = Texture2DDescription());
+	/*
+		Decodes the first channel of an image as 16 bit values. 16 bit PNGs are loaded at full precision, files
+		ending in .r16 or .raw are read as square, little endian R16 data, and anything else is widened from 8 bits
+		@param fileName The path to the image to load
+		@param result   Will store the texels, row by row
+		@param width    Will store the width of the image
+		@param height   Will store the height of the image
+		@returns True if the image could be loaded
+	*/
+	static bool DecodeR16(const std::string& fileName, std::vector<uint16_t>& result, uint32_t& width, uint32_t& height);
+
+	/*
+		Builds a full mip chain from some 8 bit image data, using a 2x2 box filter. Rows are split across our
+		worker threads, and each pixel is filtered as a single SSE vector
+		@param data     The pixel data for level 0
+		@param width    The width of level 0
+		@param height   The height of level 0
+		@param channels The number of 8 bit channels per pixel (1 to 4)
+		@param levels   The number of levels to generate, including level 0
+		@param srgb     True if the colour channels are gamma encoded, and should be filtered in linear space
+		@returns The mip chain, starting with level 1 (level 0 is the input data)
+	*/
+	static std::vector<MipLevel> GenerateMipChain(const uint8_t* data, uint32_t width, uint32_t height, int channels, int levels, bool srgb);
+
+	// Converts a gamma encoded 8 bit colour channel into linear space (table based)
+	static float SrgbToLinear(uint8_t value);
+	// Converts a linear colour channel in [0, 1] back into a gamma encoded 8 bit value (table based)
+	static uint8_t LinearToSrgb(float value);
+
+	/*
+		Queues up a mip chain to be uploaded by UpdateUploads. The texture's base level is moved down to the smallest
+		level, which always has data in it, so the texture can be used right away and gets sharper as it loads in
+		@param upload   The chain to upload
+		@param levels   The number of levels in the chain
+		@param generate If set, invoked on a worker thread to fill in the levels of upload before we start uploading
+		                them. Until then the smallest level is cleared to black (uncompressed chains only)
+	*/
+	static void QueueUpload(const std::shared_ptr<PendingUpload>& upload, int levels, const std::function<void(PendingUpload&)>& generate = nullptr);
+	/*
+		Uploads the next few mip levels of any textures that are loading progressively, should be called once a frame
+		@param byteBudget The most data we will upload in a single call, we always upload at least one level though
+	*/
+	static void UpdateUploads(size_t byteBudget = 4 * 1024 * 1024);
+	// Gets the number of textures that are still generating or uploading mips
+	static size_t GetPendingUploads();
+	// Gets the hit and miss counts for textures shared by LoadFromFile
+	static AssetRegistryStats GetCacheStats();
 
 protected:
 	GLuint               myTextureHandle;
 	Texture2DDescription myDescription;
 
 	void __SetupTexture();
+	static Sptr __LoadFromFile(const std::string& fileName, const Texture2DDescription& options, bool loadAlpha);
 };
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "Texture2DArray.h"
+#include "Logging.h"
+#include "TextureCooker.h"
+#include <stb_image.h>
+#include <GLM/gtc/integer.hpp>
+#include <GLM/gtc/type_ptr.hpp>
+#include <Parallel.h>
+
+Texture2DArray::Texture2DArray(const Texture2DArrayDescription& desc) {
+	myDescription = desc;
+
+	myTextureHandle = 0;
+	__SetupTexture();
+}
+
+Texture2DArray::~Texture2DArray() {
+	glDeleteTextures(1, &myTextureHandle);
+}
+
+void Texture2DArray::__SetupTexture() {
+	// A full mip chain goes all the way down to 1x1
+	if (myDescription.MipLevels == -1)
+		myDescription.MipLevels = glm::log2(glm::max(glm::max(myDescription.Width, myDescription.Height), 1u)) + 1;
+
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &myTextureHandle);
+	glTextureStorage3D(myTextureHandle,
+		myDescription.EnableMip ? myDescription.MipLevels : 1,
+		(GLenum)myDescription.Format, myDescription.Width, myDescription.Height, myDescription.Layers);
+
+	glTextureParameteri(myTextureHandle, GL_TEXTURE_WRAP_S, (GLenum)myDescription.Sampler.WrapS);
+	glTextureParameteri(myTextureHandle, GL_TEXTURE_WRAP_T, (GLenum)myDescription.Sampler.WrapT);
+	glTextureParameteri(myTextureHandle, GL_TEXTURE_MIN_FILTER, (GLenum)myDescription.Sampler.MinFilter);
+	glTextureParameteri(myTextureHandle, GL_TEXTURE_MAG_FILTER, (GLenum)myDescription.Sampler.MagFilter);
+	glTextureParameterfv(myTextureHandle, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(myDescription.Sampler.BorderColor));
+
+	if (myDescription.Sampler.AnisotropicEnabled)
+		glTextureParameterf(myTextureHandle, GL_TEXTURE_MAX_ANISOTROPY, myDescription.Sampler.MaxAnisotropy);
+}
+
+void Texture2DArray::LoadLayer(int layer, int level, uint32_t width, uint32_t height, PixelFormat format, PixelType type, const void* data) {
+	LOG_ASSERT(layer >= 0 && (uint32_t)layer < myDescription.Layers, "Layer is out of range for this texture array!");
+	glTextureSubImage3D(myTextureHandle, level, 0, 0, layer, width, height, 1, (GLenum)format, (GLenum)type, data);
+}
+
+void Texture2DArray::LoadCompressedLayer(int layer, int level, uint32_t width, uint32_t height, const void* data, size_t size) {
+	LOG_ASSERT(layer >= 0 && (uint32_t)layer < myDescription.Layers, "Layer is out of range for this texture array!");
+	LOG_ASSERT(myDescription.Format == InternalFormat::Bc1 || myDescription.Format == InternalFormat::Bc3, "Texture array does not have a compressed format!");
+	glCompressedTextureSubImage3D(myTextureHandle, level, 0, 0, layer, width, height, 1, (GLenum)myDescription.Format, (GLsizei)size, data);
+}
+
+void Texture2DArray::Bind(int slot) const {
+	glBindTextureUnit(slot, myTextureHandle);
+}
+
+void Texture2DArray::UnBind(int slot) {
+	glBindTextureUnit(slot, 0);
+}
+
+Texture2DArray::Sptr Texture2DArray::LoadFromFiles(const std::vector<std::string>& fileNames, const Texture2DDescription& options, bool loadAlpha) {
+	LOG_ASSERT(!fileNames.empty(), "Cannot create a texture array with no layers!");
+
+	Texture2DArrayDescription desc;
+	desc.Layers = (uint32_t)fileNames.size();
+	desc.EnableMip = options.EnableMip;
+	desc.MipLevels = options.MipLevels;
+	desc.Sampler = options.Sampler;
+
+	if (options.Compress) {
+		CookOptions cook;
+		cook.AllowAlpha = loadAlpha;
+		cook.GenerateMips = options.EnableMip;
+		cook.Srgb = options.MipMode == MipGeneration::CpuSrgb;
+
+		// Every layer needs to end up with the same size and block format for us to use them
+		std::vector<CookedImage> layers(fileNames.size());
+		bool success = true;
+		for (size_t ix = 0; ix < fileNames.size() && success; ix++) {
+			success = TextureCooker::Cook(fileNames[ix], cook, layers[ix]) &&
+				layers[ix].Width == layers[0].Width && layers[ix].Height == layers[0].Height &&
+				layers[ix].Format == layers[0].Format;
+		}
+		if (success) {
+			desc.Width = layers[0].Width;
+			desc.Height = layers[0].Height;
+			desc.Format = layers[0].Format;
+			desc.MipLevels = (int)layers[0].Levels.size();
+			desc.EnableMip = layers[0].Levels.size() > 1;
+
+			Sptr result = std::make_shared<Texture2DArray>(desc);
+			// CPU mips go up over the next few frames, smallest first (see Texture2D::UpdateUploads)
+			if (desc.EnableMip && options.MipMode != MipGeneration::Gpu) {
+				std::shared_ptr<PendingUpload> upload = std::make_shared<PendingUpload>();
+				upload->Texture = result;
+				upload->Handle = result->myTextureHandle;
+				upload->IsArray = true;
+				upload->Compressed = desc.Format != InternalFormat::RGBA8;
+				upload->CompressedFormat = desc.Format;
+				upload->Levels.resize(layers[0].Levels.size());
+				for (CookedImage& layer : layers)
+					for (size_t level = 0; level < upload->Levels.size(); level++)
+						upload->Levels[level].push_back(std::move(layer.Levels[level]));
+				Texture2D::QueueUpload(upload, (int)upload->Levels.size());
+				return result;
+			}
+			for (size_t layer = 0; layer < layers.size(); layer++) {
+				for (size_t level = 0; level < layers[layer].Levels.size(); level++) {
+					const MipLevel& mip = layers[layer].Levels[level];
+					result->LoadCompressedLayer((int)layer, (int)level, mip.Width, mip.Height, mip.Data.data(), mip.Data.size());
+				}
+			}
+			return result;
+		}
+		LOG_WARN("Failed to cook texture array layers, falling back to an uncompressed texture array");
+	}
+
+	// Decode all of our layers at once
+	struct DecodedLayer {
+		uint8_t* Data = nullptr;
+		int Width = 0, Height = 0;
+	};
+	std::vector<DecodedLayer> layers(fileNames.size());
+	int channels = loadAlpha ? 4 : 3;
+	Parallel::For(fileNames.size(), [&](size_t begin, size_t end) {
+		for (size_t ix = begin; ix < end; ix++) {
+			int numChannels;
+			layers[ix].Data = stbi_load(fileNames[ix].c_str(), &layers[ix].Width, &layers[ix].Height, &numChannels, channels);
+		}
+	});
+
+	bool success = true;
+	for (size_t ix = 0; ix < layers.size(); ix++) {
+		if (layers[ix].Data == nullptr || layers[ix].Width == 0 || layers[ix].Height == 0) {
+			LOG_WARN("Failed to load image from \"{}\"", fileNames[ix]);
+			success = false;
+		} else if (layers[ix].Width != layers[0].Width || layers[ix].Height != layers[0].Height) {
+			LOG_WARN("Image \"{}\" does not match the size of the other layers in it's texture array", fileNames[ix]);
+			success = false;
+		}
+	}
+
+	Sptr result = nullptr;
+	if (success) {
+		desc.Width = layers[0].Width;
+		desc.Height = layers[0].Height;
+		desc.Format = loadAlpha ? InternalFormat::RGBA8 : InternalFormat::RGB8;
+		PixelFormat format = loadAlpha ? PixelFormat::Rgba : PixelFormat::Rgb;
+
+		result = std::make_shared<Texture2DArray>(desc);
+		int levels = desc.EnableMip ? result->myDescription.MipLevels : 1;
+		bool cpuMips = levels > 1 && options.MipMode != MipGeneration::Gpu;
+		bool srgb = options.MipMode == MipGeneration::CpuSrgb;
+
+		if (cpuMips) {
+			// Our workers build the mips, and then they get uploaded over the next few frames, smallest first
+			std::shared_ptr<PendingUpload> upload = std::make_shared<PendingUpload>();
+			upload->Texture = result;
+			upload->Handle = result->myTextureHandle;
+			upload->IsArray = true;
+			upload->Format = format;
+			// The job frees our decoded layers once it's done with them
+			std::vector<uint8_t*> sources;
+			for (DecodedLayer& layer : layers) {
+				sources.push_back(layer.Data);
+				layer.Data = nullptr;
+			}
+			uint32_t width = desc.Width, height = desc.Height;
+			Texture2D::QueueUpload(upload, levels, [sources, width, height, channels, levels, srgb](PendingUpload& upload) {
+				upload.Levels.resize(levels);
+				for (uint8_t* source : sources) {
+					std::vector<MipLevel> mips = Texture2D::GenerateMipChain(source, width, height, channels, levels, srgb);
+					upload.Levels[0].push_back({ width, height, std::vector<uint8_t>(source, source + (size_t)width * height * channels) });
+					stbi_image_free(source);
+					for (size_t level = 0; level < mips.size(); level++)
+						upload.Levels[level + 1].push_back(std::move(mips[level]));
+				}
+			});
+		}
+		else {
+			// RGB rows won't always be 4 byte aligned
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (size_t layer = 0; layer < layers.size(); layer++)
+				result->LoadLayer((int)layer, 0, desc.Width, desc.Height, format, PixelType::UByte, layers[layer].Data);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			if (levels > 1)
+				glGenerateTextureMipmap(result->myTextureHandle);
+		}
+	}
+
+	for (DecodedLayer& layer : layers)
+		stbi_image_free(layer.Data);
+	return result;
+}
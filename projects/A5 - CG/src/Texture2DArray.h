@@ -0,0 +1,66 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "Utils.h"
+#include "Texture2D.h"
+
+// Represents all the data required to set up a texture array (but not actually load it's data)
+struct Texture2DArrayDescription {
+	uint32_t       Width = 0;
+	uint32_t       Height = 0;
+	uint32_t       Layers = 0;
+	InternalFormat Format = InternalFormat::RGBA8;
+
+	bool EnableMip      = false;
+	int MipLevels       = -1;
+	SamplerDesc Sampler = SamplerDesc();
+};
+
+/*
+	Represents a GL_TEXTURE_2D_ARRAY, a stack of equally sized textures that can all be bound to a single
+	slot, and are selected by layer in the shader. Sets of textures that are always used together (like
+	our terrain splat textures) can be put in an array to save on texture binds and sampler slots
+*/
+class Texture2DArray
+{
+public:
+	GraphicsClass(Texture2DArray);
+
+	Texture2DArray(const Texture2DArrayDescription& description);
+	virtual ~Texture2DArray();
+
+	/*
+		Uploads data into a single layer of the array
+		@param layer  The layer to upload to
+		@param level  The mip level to upload to
+		@param width  The width of the data, must match the size of the mip level
+		@param height The height of the data, must match the size of the mip level
+		@param format The layout of the pixel data
+		@param type   The type of each component in the pixel data
+		@param data   The pixel data
+	*/
+	void LoadLayer(int layer, int level, uint32_t width, uint32_t height, PixelFormat format, PixelType type, const void* data);
+	// Uploads block compressed data into a single layer of the array, our format must be a compressed one
+	void LoadCompressedLayer(int layer, int level, uint32_t width, uint32_t height, const void* data, size_t size);
+
+	void Bind(int slot) const;
+	static void UnBind(int slot);
+
+	const Texture2DArrayDescription& GetDescription() const { return myDescription; }
+
+	/*
+		Loads a set of images into a texture array, one layer per image (in order). All of the images must be the
+		same size. Images are decoded across our worker threads
+		@param fileNames The paths to the images to load
+		@param options   The mip, sampler and compression settings to use, Width, Height and Format are ignored
+		@param loadAlpha True if we should load an alpha channel
+	*/
+	static Sptr LoadFromFiles(const std::vector<std::string>& fileNames, const Texture2DDescription& options, bool loadAlpha = true);
+
+protected:
+	GLuint                    myTextureHandle;
+	Texture2DArrayDescription myDescription;
+
+	void __SetupTexture();
+};
@@ -0,0 +1,141 @@
+#include "TextureAtlas.h"
+#include "Logging.h"
+#include "TextureCooker.h"
+#include <stb_image.h>
+#include <stb_rect_pack.h>
+#include <GLM/gtc/integer.hpp>
+#include <Parallel.h>
+#include <cstring>
+
+const AtlasRegion& TextureAtlas::GetRegion(const std::string& fileName) const {
+	auto it = myRegions.find(fileName);
+	LOG_ASSERT(it != myRegions.end(), "Image \"{}\" was not packed into this atlas!", fileName);
+	return it->second;
+}
+
+void TextureAtlas::RemapUVs(MeshData& mesh, const AtlasRegion& region) {
+	for (Vertex& vertex : mesh.Vertices)
+		vertex.UV = region.Remap(vertex.UV);
+}
+
+TextureAtlas::Sptr TextureAtlas::Build(const std::vector<std::string>& fileNames, const TextureAtlasDescription& desc) {
+	LOG_ASSERT(!fileNames.empty(), "Cannot build an atlas with no images!");
+
+	// Decode all of our images at once
+	struct SourceImage {
+		uint8_t* Data = nullptr;
+		int Width = 0, Height = 0;
+	};
+	std::vector<SourceImage> images(fileNames.size());
+	Parallel::For(fileNames.size(), [&](size_t begin, size_t end) {
+		for (size_t ix = begin; ix < end; ix++) {
+			int numChannels;
+			images[ix].Data = stbi_load(fileNames[ix].c_str(), &images[ix].Width, &images[ix].Height, &numChannels, 4);
+		}
+	});
+	auto freeImages = [&]() {
+		for (SourceImage& image : images)
+			stbi_image_free(image.Data);
+	};
+	for (size_t ix = 0; ix < images.size(); ix++) {
+		if (images[ix].Data == nullptr || images[ix].Width == 0 || images[ix].Height == 0) {
+			LOG_WARN("Failed to load image from \"{}\"", fileNames[ix]);
+			freeImages();
+			return nullptr;
+		}
+	}
+
+	// Each mip level halves our padding, so we stop at the last level that still has a texel of it left
+	int padding = (int)desc.Padding;
+	int levels = desc.Options.EnableMip ? glm::log2(glm::max(padding, 1)) + 1 : 1;
+	if (desc.Options.EnableMip && desc.Options.MipLevels > 0)
+		levels = glm::min(levels, desc.Options.MipLevels);
+	// We pack in blocks the size of a single texel on our smallest mip, so that no texel on any level ever covers
+	// 2 different images. Compressed levels share their colours across 4x4 texels, so then our blocks have to
+	// cover a whole compressed block on the smallest mip, or neighbouring images would bleed in through it
+	int blockSize = (desc.Options.Compress ? 4 : 1) << (levels - 1);
+
+	std::vector<stbrp_rect> rects(images.size());
+	for (size_t ix = 0; ix < images.size(); ix++) {
+		rects[ix].id = (int)ix;
+		rects[ix].w = (images[ix].Width + padding * 2 + blockSize - 1) / blockSize;
+		rects[ix].h = (images[ix].Height + padding * 2 + blockSize - 1) / blockSize;
+	}
+
+	// Find the smallest power of 2 atlas that everything fits in
+	int size = 0;
+	for (int trySize = glm::max(blockSize, 64); trySize <= (int)desc.MaxSize; trySize *= 2) {
+		int blocks = trySize / blockSize;
+		std::vector<stbrp_node> nodes(blocks);
+		stbrp_context context;
+		stbrp_init_target(&context, blocks, blocks, nodes.data(), blocks);
+		if (stbrp_pack_rects(&context, rects.data(), (int)rects.size())) {
+			size = trySize;
+			break;
+		}
+	}
+	if (size == 0) {
+		LOG_WARN("Images do not fit in a {}x{} atlas", desc.MaxSize, desc.MaxSize);
+		freeImages();
+		return nullptr;
+	}
+
+	Sptr result = std::make_shared<TextureAtlas>();
+	result->mySize = glm::ivec2(size);
+
+	// Copy our images in, filling out the rest of each rect by clamping to the edges of the image
+	std::vector<uint8_t> pixels((size_t)size * size * 4, 0);
+	Parallel::For(rects.size(), [&](size_t begin, size_t end) {
+		for (size_t ix = begin; ix < end; ix++) {
+			const stbrp_rect& rect = rects[ix];
+			const SourceImage& image = images[rect.id];
+			for (int y = 0; y < rect.h * blockSize; y++) {
+				int srcY = glm::clamp(y - padding, 0, image.Height - 1);
+				uint8_t* row = &pixels[(((size_t)rect.y * blockSize + y) * size + (size_t)rect.x * blockSize) * 4];
+				for (int x = 0; x < rect.w * blockSize; x++) {
+					int srcX = glm::clamp(x - padding, 0, image.Width - 1);
+					memcpy(row + x * 4, image.Data + ((size_t)srcY * image.Width + srcX) * 4, 4);
+				}
+			}
+		}
+	});
+
+	bool hasAlpha = false;
+	for (size_t ix = 0; ix < rects.size(); ix++) {
+		const stbrp_rect& rect = rects[ix];
+		const SourceImage& image = images[rect.id];
+		AtlasRegion region;
+		region.Offset = glm::vec2(rect.x * blockSize + padding, rect.y * blockSize + padding) / (float)size;
+		region.Scale = glm::vec2(image.Width, image.Height) / (float)size;
+		region.Size = glm::ivec2(image.Width, image.Height);
+		result->myRegions[fileNames[rect.id]] = region;
+
+		for (size_t px = 3; px < (size_t)image.Width * image.Height * 4 && !hasAlpha; px += 4)
+			hasAlpha = image.Data[px] != 255;
+	}
+	freeImages();
+
+	Texture2DDescription textureDesc = desc.Options;
+	textureDesc.Width = size;
+	textureDesc.Height = size;
+	textureDesc.EnableMip = levels > 1;
+	textureDesc.MipLevels = levels;
+	textureDesc.Format = desc.Options.Compress ? (hasAlpha ? InternalFormat::Bc3 : InternalFormat::Bc1) : InternalFormat::RGBA8;
+	result->myTexture = std::make_shared<Texture2D>(textureDesc);
+
+	// We always build the mips ourselves, so that the padding logic above holds
+	std::vector<MipLevel> mips = Texture2D::GenerateMipChain(pixels.data(), size, size, 4, levels, desc.Options.MipMode == MipGeneration::CpuSrgb);
+	for (int level = 0; level < levels; level++) {
+		uint32_t levelSize = level == 0 ? size : mips[level - 1].Width;
+		const uint8_t* data = level == 0 ? pixels.data() : mips[level - 1].Data.data();
+		if (desc.Options.Compress) {
+			std::vector<uint8_t> blocks = TextureCooker::Compress(data, levelSize, levelSize, textureDesc.Format);
+			result->myTexture->LoadCompressedData(level, levelSize, levelSize, blocks.data(), blocks.size());
+		} else {
+			result->myTexture->LoadMipData(level, levelSize, levelSize, PixelFormat::Rgba, PixelType::UByte, data);
+		}
+	}
+
+	LOG_INFO("Packed {} images into a {}x{} atlas", fileNames.size(), size, size);
+	return result;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Utils.h"
+#include "Texture2D.h"
+#include "ObjLoader.h"
+
+// Where a single source image ended up inside of an atlas, in UV space
+struct AtlasRegion {
+	glm::vec2 Offset = glm::vec2(0.0f); // The UV of the region's top left corner (first row of the image)
+	glm::vec2 Scale  = glm::vec2(1.0f); // The size of the region in UV space
+	glm::ivec2 Size  = glm::ivec2(0);   // The size of the source image, in pixels
+
+	// Maps a UV from the source image into the atlas
+	glm::vec2 Remap(const glm::vec2& uv) const { return Offset + glm::clamp(uv, glm::vec2(0.0f), glm::vec2(1.0f)) * Scale; }
+};
+
+struct TextureAtlasDescription {
+	// The number of pixels to pad around each image with copies of it's edges, so that filtering never pulls
+	// in colours from it's neighbours. This also limits how many mips we can have without bleeding, as each
+	// level halves the padding (4 pixels of padding gives us 3 levels, 8 gives us 4)
+	uint32_t Padding = 4;
+	// The largest atlas we will create, if the images don't fit in this they will not be packed
+	uint32_t MaxSize = 4096;
+	// The mip, sampler and compression settings for the atlas texture. Width, Height and Format are ignored, and
+	// MipLevels is limited by Padding
+	Texture2DDescription Options = Texture2DDescription();
+};
+
+/*
+	Packs a bunch of small textures into a single larger one (using stb_rect_pack), so that objects that
+	would each bind their own small texture can share a single material and get batched together.
+
+	Meshes need to have their UVs moved into the region for their texture, see RemapUVs. Since regions
+	are clamped, UVs that tile (go outside of [0, 1]) can not be used with an atlas
+*/
+class TextureAtlas
+{
+public:
+	GraphicsClass(TextureAtlas);
+
+	TextureAtlas() = default;
+	virtual ~TextureAtlas() = default;
+
+	// Gets the texture that all of our images were packed into
+	const Texture2D::Sptr& GetTexture() const { return myTexture; }
+	// Gets the size of the atlas texture, in pixels
+	const glm::ivec2& GetSize() const { return mySize; }
+
+	// Checks if the image with the given file name was packed into this atlas
+	bool HasRegion(const std::string& fileName) const { return myRegions.find(fileName) != myRegions.end(); }
+	// Gets the region for an image that was packed into this atlas, by the file name it was loaded from
+	const AtlasRegion& GetRegion(const std::string& fileName) const;
+
+	/*
+		Moves all of the UVs in a mesh into a region of an atlas
+		@param mesh   The mesh data to update, should be called before the mesh is created
+		@param region The region that the mesh's texture was packed into
+	*/
+	static void RemapUVs(MeshData& mesh, const AtlasRegion& region);
+
+	/*
+		Loads and packs a set of images into a new atlas. Images are decoded across our worker threads
+		@param fileNames The paths to the images to pack
+		@param desc      The settings for the atlas
+		@returns The new atlas, or nullptr if the images could not be loaded or do not fit in MaxSize
+	*/
+	static Sptr Build(const std::vector<std::string>& fileNames, const TextureAtlasDescription& desc = TextureAtlasDescription());
+
+protected:
+	Texture2D::Sptr myTexture;
+	glm::ivec2      mySize;
+	std::unordered_map<std::string, AtlasRegion> myRegions;
+};
@@ -0,0 +1,479 @@
+#include "TextureCooker.h"
+#include "TextureCube.h"
+#include "Logging.h"
+#include <Parallel.h>
+#include <stb_image.h>
+#include <GLM/gtc/integer.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+std::string TextureCooker::CacheDirectory = "cache";
+
+namespace {
+	// Bump this whenever the encoder changes, so that old cache entries get re-cooked
+	const uint32_t CookerVersion = 2;
+
+	// The parts of the DDS format that we actually use, see
+	// https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+	struct DDSPixelFormat {
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t FourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask, GBitMask, BBitMask, ABitMask;
+	};
+	struct DDSHeader {
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t Height;
+		uint32_t Width;
+		uint32_t PitchOrLinearSize;
+		uint32_t Depth;
+		uint32_t MipMapCount;
+		uint32_t Reserved1[11];
+		DDSPixelFormat PixelFormat;
+		uint32_t Caps, Caps2, Caps3, Caps4;
+		uint32_t Reserved2;
+	};
+	static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes!");
+
+	const uint32_t DDSMagic = 0x20534444; // "DDS "
+	const uint32_t FourCCDXT1 = 0x31545844; // "DXT1"
+	const uint32_t FourCCDXT5 = 0x35545844; // "DXT5"
+	const uint32_t CubemapAllFaces = 0x200 | 0xFC00; // DDSCAPS2_CUBEMAP and all 6 of the face flags
+
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t ix = 0; ix < size; ix++) {
+			hash ^= bytes[ix];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint16_t To565(int r, int g, int b) {
+		return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+	}
+	void From565(uint16_t c, int out[3]) {
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	/*
+		Encodes the colour part of a block. We use a bounding box fit (with the diagonal picked from the sign of the
+		colour covariance), inset slightly so that the end points are not wasted on outliers, then pick the closest
+		palette entry for each pixel
+	*/
+	void EncodeColorBlock(const uint8_t block[16][4], uint8_t* out) {
+		int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+		int mean[3] = { 0, 0, 0 };
+		for (int px = 0; px < 16; px++) {
+			for (int c = 0; c < 3; c++) {
+				lo[c] = std::min(lo[c], (int)block[px][c]);
+				hi[c] = std::max(hi[c], (int)block[px][c]);
+				mean[c] += block[px][c];
+			}
+		}
+		// If green and blue trend the opposite way from red, the box diagonal we want runs the other way
+		int covRG = 0, covRB = 0;
+		for (int px = 0; px < 16; px++) {
+			int r = block[px][0] * 16 - mean[0];
+			covRG += r * (block[px][1] * 16 - mean[1]);
+			covRB += r * (block[px][2] * 16 - mean[2]);
+		}
+		if (covRG < 0) std::swap(lo[1], hi[1]);
+		if (covRB < 0) std::swap(lo[2], hi[2]);
+
+		for (int c = 0; c < 3; c++) {
+			int inset = (hi[c] - lo[c]) / 16;
+			lo[c] += inset;
+			hi[c] -= inset;
+		}
+
+		uint16_t c0 = To565(hi[0], hi[1], hi[2]);
+		uint16_t c1 = To565(lo[0], lo[1], lo[2]);
+		// c0 needs to be the larger value to get the 4 colour mode
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		uint32_t indices = 0;
+		if (c0 != c1) {
+			int palette[4][3];
+			From565(c0, palette[0]);
+			From565(c1, palette[1]);
+			for (int c = 0; c < 3; c++) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int px = 0; px < 16; px++) {
+				int best = 0, bestDist = INT_MAX;
+				for (int ix = 0; ix < 4; ix++) {
+					int dr = block[px][0] - palette[ix][0];
+					int dg = block[px][1] - palette[ix][1];
+					int db = block[px][2] - palette[ix][2];
+					int dist = dr * dr + dg * dg + db * db;
+					if (dist < bestDist) {
+						bestDist = dist;
+						best = ix;
+					}
+				}
+				indices |= (uint32_t)best << (px * 2);
+			}
+		}
+
+		memcpy(out, &c0, 2);
+		memcpy(out + 2, &c1, 2);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	// Encodes the alpha part of a BC3 block, using the 8 value mode between the min and max alpha
+	void EncodeAlphaBlock(const uint8_t block[16][4], uint8_t* out) {
+		int lo = 255, hi = 0;
+		for (int px = 0; px < 16; px++) {
+			lo = std::min(lo, (int)block[px][3]);
+			hi = std::max(hi, (int)block[px][3]);
+		}
+		out[0] = (uint8_t)hi;
+		out[1] = (uint8_t)lo;
+
+		uint64_t indices = 0;
+		if (hi != lo) {
+			int palette[8];
+			palette[0] = hi;
+			palette[1] = lo;
+			for (int ix = 1; ix < 7; ix++)
+				palette[ix + 1] = ((7 - ix) * hi + ix * lo) / 7;
+			for (int px = 0; px < 16; px++) {
+				int best = 0, bestDist = INT_MAX;
+				for (int ix = 0; ix < 8; ix++) {
+					int dist = std::abs(block[px][3] - palette[ix]);
+					if (dist < bestDist) {
+						bestDist = dist;
+						best = ix;
+					}
+				}
+				indices |= (uint64_t)best << (px * 3);
+			}
+		}
+		for (int ix = 0; ix < 6; ix++)
+			out[2 + ix] = (uint8_t)(indices >> (ix * 8));
+	}
+}
+
+size_t TextureCooker::GetLevelSize(uint32_t width, uint32_t height, InternalFormat format) {
+	if (format == InternalFormat::RGBA8)
+		return (size_t)width * height * 4;
+	size_t blocks = (size_t)std::max((width + 3) / 4, 1u) * std::max((height + 3) / 4, 1u);
+	return blocks * (format == InternalFormat::Bc3 ? 16 : 8);
+}
+
+std::vector<uint8_t> TextureCooker::Compress(const uint8_t* rgba, uint32_t width, uint32_t height, InternalFormat format) {
+	LOG_ASSERT(format == InternalFormat::Bc1 || format == InternalFormat::Bc3, "Can only compress to BC1 or BC3!");
+	uint32_t blocksX = std::max((width + 3) / 4, 1u);
+	uint32_t blocksY = std::max((height + 3) / 4, 1u);
+	size_t blockSize = format == InternalFormat::Bc3 ? 16 : 8;
+	std::vector<uint8_t> result(GetLevelSize(width, height, format));
+
+	// Each row of blocks is independent, so we can spread them out over our workers
+	Parallel::For(blocksY, [&](size_t begin, size_t end) {
+		uint8_t block[16][4];
+		for (size_t by = begin; by < end; by++) {
+			for (uint32_t bx = 0; bx < blocksX; bx++) {
+				// Gather the block, clamping to the edge of the image for sizes that aren't a multiple of 4
+				for (int py = 0; py < 4; py++) {
+					uint32_t y = std::min((uint32_t)by * 4 + py, height - 1);
+					for (int px = 0; px < 4; px++) {
+						uint32_t x = std::min(bx * 4 + px, width - 1);
+						memcpy(block[py * 4 + px], rgba + ((size_t)y * width + x) * 4, 4);
+					}
+				}
+				uint8_t* out = &result[(by * blocksX + bx) * blockSize];
+				if (format == InternalFormat::Bc3) {
+					EncodeAlphaBlock(block, out);
+					out += 8;
+				}
+				EncodeColorBlock(block, out);
+			}
+		}
+	}, 4);
+	return result;
+}
+
+bool TextureCooker::__ReadSource(const std::string& fileName, std::vector<uint8_t>& result) {
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		LOG_WARN("Failed to open \"{}\" for cooking", fileName);
+		return false;
+	}
+	result.resize((size_t)file.tellg());
+	file.seekg(0, std::ios::beg);
+	file.read((char*)result.data(), result.size());
+	return (bool)file;
+}
+
+uint8_t* TextureCooker::__Decode(const std::vector<uint8_t>& source, const CookOptions& options, int& width, int& height) {
+	// Note that we never touch stb_image's flip setting, since it is shared by every thread. We flip ourselves instead
+	int numChannels;
+	uint8_t* pixels = stbi_load_from_memory(source.data(), (int)source.size(), &width, &height, &numChannels, 4);
+	if (pixels == nullptr || width == 0 || height == 0) {
+		stbi_image_free(pixels);
+		return nullptr;
+	}
+	if (options.FlipY) {
+		std::vector<uint8_t> row((size_t)width * 4);
+		for (int y = 0; y < height / 2; y++) {
+			uint8_t* top = pixels + (size_t)y * width * 4;
+			uint8_t* bottom = pixels + (size_t)(height - 1 - y) * width * 4;
+			memcpy(row.data(), top, row.size());
+			memcpy(top, bottom, row.size());
+			memcpy(bottom, row.data(), row.size());
+		}
+	}
+	return pixels;
+}
+
+MipLevel TextureCooker::__Encode(MipLevel level, InternalFormat format) {
+	if (format != InternalFormat::RGBA8)
+		level.Data = Compress(level.Data.data(), level.Width, level.Height, format);
+	return level;
+}
+
+bool TextureCooker::Cook(const std::string& fileName, const CookOptions& options, CookedImage& result) {
+	// Read the whole source file, we need it to build our cache key anyways
+	std::vector<uint8_t> source;
+	if (!__ReadSource(fileName, source))
+		return false;
+
+	uint64_t key = 14695981039346656037ull;
+	key = HashBytes(key, &CookerVersion, sizeof(CookerVersion));
+	key = HashBytes(key, &options, sizeof(CookOptions));
+	key = HashBytes(key, source.data(), source.size());
+	char keyName[17];
+	snprintf(keyName, sizeof(keyName), "%016llx", (unsigned long long)key);
+	std::string cachePath = CacheDirectory + "/" + keyName + ".dds";
+
+	if (__ReadDDS(cachePath, result))
+		return true;
+
+	// Cache miss, we need to decode and cook the image
+	int width, height;
+	uint8_t* pixels = __Decode(source, options, width, height);
+	if (pixels == nullptr) {
+		LOG_WARN("Failed to decode \"{}\" for cooking", fileName);
+		return false;
+	}
+
+	// Only pay for BC3 if the image actually uses it's alpha channel
+	bool hasAlpha = false;
+	if (options.AllowAlpha) {
+		for (size_t ix = 3; ix < (size_t)width * height * 4 && !hasAlpha; ix += 4)
+			hasAlpha = pixels[ix] != 255;
+	}
+
+	result.Format = !options.Compress ? InternalFormat::RGBA8 : hasAlpha ? InternalFormat::Bc3 : InternalFormat::Bc1;
+	result.Width = width;
+	result.Height = height;
+	result.Faces = 1;
+	result.Levels.clear();
+
+	int levels = options.GenerateMips ? glm::log2(glm::max((uint32_t)width, (uint32_t)height)) + 1 : 1;
+	std::vector<MipLevel> mips = Texture2D::GenerateMipChain(pixels, width, height, 4, levels, options.Srgb);
+
+	MipLevel base;
+	base.Width = width;
+	base.Height = height;
+	base.Data.assign(pixels, pixels + (size_t)width * height * 4);
+	result.Levels.push_back(__Encode(std::move(base), result.Format));
+	for (MipLevel& mip : mips)
+		result.Levels.push_back(__Encode(std::move(mip), result.Format));
+	stbi_image_free(pixels);
+
+	if (!__WriteDDS(cachePath, result))
+		LOG_WARN("Failed to write texture cache entry \"{}\"", cachePath);
+	else
+		LOG_INFO("Cooked \"{}\" to \"{}\"", fileName, cachePath);
+	return true;
+}
+
+bool TextureCooker::CookCube(const std::string faceFiles[6], const CookOptions& options, CookedImage& result) {
+	std::vector<uint8_t> sources[6];
+	for (int face = 0; face < 6; face++) {
+		if (!__ReadSource(faceFiles[face], sources[face]))
+			return false;
+	}
+
+	uint32_t faces = 6;
+	uint64_t key = 14695981039346656037ull;
+	key = HashBytes(key, &CookerVersion, sizeof(CookerVersion));
+	key = HashBytes(key, &faces, sizeof(uint32_t));
+	key = HashBytes(key, &options, sizeof(CookOptions));
+	for (int face = 0; face < 6; face++)
+		key = HashBytes(key, sources[face].data(), sources[face].size());
+	char keyName[17];
+	snprintf(keyName, sizeof(keyName), "%016llx", (unsigned long long)key);
+	std::string cachePath = CacheDirectory + "/" + keyName + ".dds";
+
+	if (__ReadDDS(cachePath, result) && result.Faces == 6)
+		return true;
+
+	// Decode all 6 faces at once
+	uint8_t* pixels[6] = { nullptr };
+	int widths[6] = { 0 }, heights[6] = { 0 };
+	Parallel::For(6, [&](size_t begin, size_t end) {
+		for (size_t face = begin; face < end; face++)
+			pixels[face] = __Decode(sources[face], options, widths[face], heights[face]);
+	});
+
+	bool success = true;
+	for (int face = 0; face < 6; face++) {
+		if (pixels[face] == nullptr) {
+			LOG_WARN("Failed to decode \"{}\" for cooking", faceFiles[face]);
+			success = false;
+		} else if (widths[face] != heights[face] || widths[face] != widths[0]) {
+			LOG_WARN("Cubemap face \"{}\" must be square and the same size as the other faces", faceFiles[face]);
+			success = false;
+		}
+	}
+	if (!success) {
+		for (int face = 0; face < 6; face++)
+			stbi_image_free(pixels[face]);
+		return false;
+	}
+
+	uint32_t size = widths[0];
+	result.Format = options.Compress ? InternalFormat::Bc1 : InternalFormat::RGBA8;
+	result.Width = size;
+	result.Height = size;
+	result.Faces = 6;
+	result.Levels.clear();
+
+	// Work out our mips for every face, in face major order
+	std::vector<MipLevel> mips;
+	int levels = 1;
+	if (options.Prefilter) {
+		// Reflections never need the prefiltered levels below 8x8
+		levels = (int)glm::log2(glm::max(size / 8, 1u)) + 1;
+		mips = TextureCube::PrefilterRadiance(pixels, size, levels);
+	} else if (options.GenerateMips) {
+		levels = (int)glm::log2(size) + 1;
+		for (int face = 0; face < 6; face++) {
+			std::vector<MipLevel> faceMips = Texture2D::GenerateMipChain(pixels[face], size, size, 4, levels, options.Srgb);
+			for (MipLevel& mip : faceMips)
+				mips.push_back(std::move(mip));
+		}
+	}
+
+	for (int face = 0; face < 6; face++) {
+		MipLevel base;
+		base.Width = size;
+		base.Height = size;
+		base.Data.assign(pixels[face], pixels[face] + (size_t)size * size * 4);
+		result.Levels.push_back(__Encode(std::move(base), result.Format));
+		for (int level = 1; level < levels; level++)
+			result.Levels.push_back(__Encode(std::move(mips[face * (levels - 1) + level - 1]), result.Format));
+		stbi_image_free(pixels[face]);
+	}
+
+	if (!__WriteDDS(cachePath, result))
+		LOG_WARN("Failed to write texture cache entry \"{}\"", cachePath);
+	else
+		LOG_INFO("Cooked cubemap \"{}\" to \"{}\"", faceFiles[0], cachePath);
+	return true;
+}
+
+bool TextureCooker::__ReadDDS(const std::string& path, CookedImage& result) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	uint32_t magic = 0;
+	DDSHeader header;
+	file.read((char*)&magic, sizeof(uint32_t));
+	file.read((char*)&header, sizeof(DDSHeader));
+	if (!file || magic != DDSMagic || header.Size != sizeof(DDSHeader))
+		return false;
+
+	if (header.PixelFormat.Flags & 0x4) {
+		if (header.PixelFormat.FourCC == FourCCDXT1)
+			result.Format = InternalFormat::Bc1;
+		else if (header.PixelFormat.FourCC == FourCCDXT5)
+			result.Format = InternalFormat::Bc3;
+		else
+			return false;
+	}
+	else if (header.PixelFormat.RGBBitCount == 32 && header.PixelFormat.RBitMask == 0x000000FF)
+		result.Format = InternalFormat::RGBA8;
+	else
+		return false;
+
+	result.Width = header.Width;
+	result.Height = header.Height;
+	result.Faces = (header.Caps2 & CubemapAllFaces) == CubemapAllFaces ? 6 : 1;
+	uint32_t mipCount = std::max(header.MipMapCount, 1u);
+	result.Levels.resize(mipCount * result.Faces);
+	for (uint32_t face = 0; face < result.Faces; face++) {
+		uint32_t width = header.Width, height = header.Height;
+		for (uint32_t ix = 0; ix < mipCount; ix++) {
+			MipLevel& level = result.Levels[face * mipCount + ix];
+			level.Width = width;
+			level.Height = height;
+			level.Data.resize(GetLevelSize(width, height, result.Format));
+			file.read((char*)level.Data.data(), level.Data.size());
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+		}
+	}
+	return (bool)file;
+}
+
+bool TextureCooker::__WriteDDS(const std::string& path, const CookedImage& image) {
+	std::error_code error;
+	std::filesystem::create_directories(CacheDirectory, error);
+
+	bool compressed = image.Format != InternalFormat::RGBA8;
+	DDSHeader header;
+	memset(&header, 0, sizeof(DDSHeader));
+	header.Size = sizeof(DDSHeader);
+	// CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT, plus LINEARSIZE or PITCH
+	header.Flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | (compressed ? 0x80000 : 0x8);
+	header.Height = image.Height;
+	header.Width = image.Width;
+	header.PitchOrLinearSize = compressed ? (uint32_t)image.Levels[0].Data.size() : image.Width * 4;
+	header.MipMapCount = (uint32_t)image.GetMipCount();
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	if (compressed) {
+		header.PixelFormat.Flags = 0x4; // FOURCC
+		header.PixelFormat.FourCC = image.Format == InternalFormat::Bc3 ? FourCCDXT5 : FourCCDXT1;
+	} else {
+		header.PixelFormat.Flags = 0x40 | 0x1; // RGB | ALPHAPIXELS
+		header.PixelFormat.RGBBitCount = 32;
+		header.PixelFormat.RBitMask = 0x000000FF;
+		header.PixelFormat.GBitMask = 0x0000FF00;
+		header.PixelFormat.BBitMask = 0x00FF0000;
+		header.PixelFormat.ABitMask = 0xFF000000;
+	}
+	// TEXTURE, plus COMPLEX if we have a mip chain or multiple faces, and MIPMAP if we have a mip chain
+	header.Caps = 0x1000 | (image.GetMipCount() > 1 ? 0x8 | 0x400000 : 0) | (image.Faces > 1 ? 0x8 : 0);
+	header.Caps2 = image.Faces == 6 ? CubemapAllFaces : 0;
+
+	// Write to a temporary file first, so that a crash part way through never leaves a broken cache entry
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		file.write((const char*)&DDSMagic, sizeof(uint32_t));
+		file.write((const char*)&header, sizeof(DDSHeader));
+		for (const MipLevel& level : image.Levels)
+			file.write((const char*)level.Data.data(), level.Data.size());
+		if (!file)
+			return false;
+	}
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Texture2D.h"
+
+// The result of cooking an image, ready to hand straight to glCompressedTextureSubImage
+struct CookedImage {
+	InternalFormat Format = InternalFormat::Bc1; // Bc1, Bc3, or RGBA8 if the image was not compressed
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t Faces = 1; // 6 for cubemaps
+	// Level 0 is the full sized image, each level is a tightly packed set of 4x4 blocks (or RGBA8 pixels). For
+	// cubemaps, all of the levels for the first face come first, then the second face, etc...
+	std::vector<MipLevel> Levels;
+
+	// Gets the number of mip levels in each face
+	size_t GetMipCount() const { return Levels.size() / Faces; }
+	const MipLevel& GetLevel(size_t face, size_t level) const { return Levels[face * GetMipCount() + level]; }
+};
+
+// The options that control how an image gets cooked, these are all part of the cache key
+struct CookOptions {
+	bool AllowAlpha = true; // If false, the image is always cooked to BC1 and alpha is thrown out
+	bool GenerateMips = true; // Whether to build a full mip chain, or just level 0
+	bool Srgb = false; // Whether the mips should be filtered in linear space (see MipGeneration::CpuSrgb)
+	bool FlipY = false; // Whether to flip the image vertically when decoding it
+	bool Compress = true; // If false, the levels are stored as RGBA8 (only the decode and mips are cached)
+	bool Prefilter = false; // Cubemaps only, fills the mips with progressively blurrier radiance, see TextureCube::PrefilterRadiance
+};
+
+/*
+	Converts source images into block compressed data (BC1 for opaque images, BC3 for images with alpha), and
+	caches the results on disk as DDS files so that we only ever pay for decoding and encoding once.
+
+	The cache key is a hash of the source file's contents and our options, so editing a texture will re-cook it
+	automatically. Blocks are encoded across all of our worker threads
+*/
+class TextureCooker {
+public:
+	// Where we keep our cooked DDS files, relative to the working directory
+	static std::string CacheDirectory;
+
+	/*
+		Gets the cooked version of an image, cooking it if it is not in the cache yet
+		@param fileName The path to the source image
+		@param options  The settings to cook with
+		@param result   Will store the cooked image
+		@returns True if the image could be cooked or loaded from the cache
+	*/
+	static bool Cook(const std::string& fileName, const CookOptions& options, CookedImage& result);
+	/*
+		Same as Cook, but for the 6 faces of a cubemap, which are decoded in parallel. AllowAlpha is ignored,
+		cubemaps are always opaque
+		@param faceFiles The paths to the images for each face, in the order of CubeMapFace
+		@param options   The settings to cook with
+		@param result    Will store the cooked cubemap
+		@returns True if all 6 faces could be cooked (and are the same size), or were loaded from the cache
+	*/
+	static bool CookCube(const std::string faceFiles[6], const CookOptions& options, CookedImage& result);
+
+	/*
+		Compresses a single image level into BC1 or BC3 blocks
+		@param rgba   The RGBA8 pixels to compress
+		@param width  The width of the image, does not need to be a multiple of 4
+		@param height The height of the image, does not need to be a multiple of 4
+		@param format Either InternalFormat::Bc1 or InternalFormat::Bc3
+		@returns The compressed blocks, in rows from the top of the image
+	*/
+	static std::vector<uint8_t> Compress(const uint8_t* rgba, uint32_t width, uint32_t height, InternalFormat format);
+
+	// Gets the size of a cooked level, in bytes
+	static size_t GetLevelSize(uint32_t width, uint32_t height, InternalFormat format);
+
+private:
+	static bool __ReadSource(const std::string& fileName, std::vector<uint8_t>& result);
+	static uint8_t* __Decode(const std::vector<uint8_t>& source, const CookOptions& options, int& width, int& height);
+	static MipLevel __Encode(MipLevel level, InternalFormat format);
+	static bool __ReadDDS(const std::string& path, CookedImage& result);
+	static bool __WriteDDS(const std::string& path, const CookedImage& image);
+};
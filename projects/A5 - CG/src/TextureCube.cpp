@@ -1,6 +1,85 @@
 #include "TextureCube.h"
 #include "Logging.h"
+#include "TextureCooker.h"
 #include "stb_image.h"
+#include <GLM/gtc/constants.hpp>
+#include <GLM/gtc/integer.hpp>
+#include <Parallel.h>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace {
+	// The inverse of TextureCube::GetFaceDirection, gets the face that a direction hits, and where on it (in [0, 1])
+	int DirectionToFace(const glm::vec3& dir, float& u, float& v) {
+		glm::vec3 a = glm::abs(dir);
+		int face; float sc, tc, ma;
+		if (a.x >= a.y && a.x >= a.z) {
+			face = dir.x > 0.0f ? 0 : 1;
+			sc = dir.x > 0.0f ? -dir.z : dir.z; tc = -dir.y; ma = a.x;
+		} else if (a.y >= a.z) {
+			face = dir.y > 0.0f ? 2 : 3;
+			sc = dir.x; tc = dir.y > 0.0f ? dir.z : -dir.z; ma = a.y;
+		} else {
+			face = dir.z > 0.0f ? 4 : 5;
+			sc = dir.z > 0.0f ? dir.x : -dir.x; tc = -dir.y; ma = a.z;
+		}
+		u = (sc / ma + 1.0f) * 0.5f;
+		v = (tc / ma + 1.0f) * 0.5f;
+		return face;
+	}
+
+	// A cubemap that has been converted to linear floats, so that we can blend it with SSE
+	struct LinearCube {
+		uint32_t Size;
+		std::vector<__m128> Faces[6];
+
+		// Bilinearly samples a face, clamping to it's edges
+		__m128 Sample(int face, float u, float v) const {
+			float x = glm::clamp(u * Size - 0.5f, 0.0f, (float)(Size - 1));
+			float y = glm::clamp(v * Size - 0.5f, 0.0f, (float)(Size - 1));
+			uint32_t x0 = (uint32_t)x, y0 = (uint32_t)y;
+			uint32_t x1 = glm::min(x0 + 1, Size - 1), y1 = glm::min(y0 + 1, Size - 1);
+			__m128 fx = _mm_set1_ps(x - x0), fy = _mm_set1_ps(y - y0);
+			const __m128* data = Faces[face].data();
+			__m128 top    = _mm_add_ps(data[y0 * Size + x0], _mm_mul_ps(_mm_sub_ps(data[y0 * Size + x1], data[y0 * Size + x0]), fx));
+			__m128 bottom = _mm_add_ps(data[y1 * Size + x0], _mm_mul_ps(_mm_sub_ps(data[y1 * Size + x1], data[y1 * Size + x0]), fx));
+			return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+		}
+	};
+
+	// Decodes the faces of a cubemap on our worker threads, flipping them ourselves since stb_image's flip
+	// setting is shared between all threads
+	void DecodeFaces(const std::string faceFiles[6], int channels, bool flip, uint8_t* pixels[6], int widths[6], int heights[6]) {
+		Parallel::For(6, [&](size_t begin, size_t end) {
+			for (size_t face = begin; face < end; face++) {
+				int numChannels;
+				pixels[face] = stbi_load(faceFiles[face].c_str(), &widths[face], &heights[face], &numChannels, channels);
+				if (pixels[face] == nullptr || !flip)
+					continue;
+				size_t stride = (size_t)widths[face] * channels;
+				std::vector<uint8_t> row(stride);
+				for (int y = 0; y < heights[face] / 2; y++) {
+					uint8_t* top = pixels[face] + y * stride;
+					uint8_t* bottom = pixels[face] + (heights[face] - 1 - y) * stride;
+					memcpy(row.data(), top, stride);
+					memcpy(top, bottom, stride);
+					memcpy(bottom, row.data(), stride);
+				}
+			}
+		});
+	}
+}
+
+glm::vec3 TextureCube::GetFaceDirection(CubeMapFace face, float s, float t) {
+	switch (face) {
+		case CubeMapFace::PosX: return glm::vec3( 1.0f,   -t,   -s);
+		case CubeMapFace::NegX: return glm::vec3(-1.0f,   -t,    s);
+		case CubeMapFace::PosY: return glm::vec3(    s, 1.0f,    t);
+		case CubeMapFace::NegY: return glm::vec3(    s,-1.0f,   -t);
+		case CubeMapFace::PosZ: return glm::vec3(    s,   -t, 1.0f);
+		default:                return glm::vec3(   -s,   -t,-1.0f);
+	}
+}
 
 TextureCube::TextureCube(const TextureCubeDesc& desc) {
 	myDesc = desc;
@@ -14,13 +93,14 @@ void TextureCube::Unbind(int slot) { glBindTextureUnit(slot, 0); }
 
 void TextureCube::__InitTexture() {
 	GLenum format = (GLenum)myDesc.Format;
+	myDesc.MipLevels = glm::max(myDesc.MipLevels, 1);
 	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &myHandle);
 	
 	glTextureParameteri(myHandle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(myHandle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(myHandle, GL_TEXTURE_MIN_FILTER, (GLenum)MinFilter::Linear);
+	glTextureParameteri(myHandle, GL_TEXTURE_MIN_FILTER, (GLenum)(myDesc.MipLevels > 1 ? MinFilter::LinearMipLinear : MinFilter::Linear));
 	glTextureParameteri(myHandle, GL_TEXTURE_MAG_FILTER, (GLenum)MagFilter::Linear);
-	glTextureStorage2D(myHandle, 1, format, myDesc.Size, myDesc.Size);
+	glTextureStorage2D(myHandle, myDesc.MipLevels, format, myDesc.Size, myDesc.Size);
 }
 
 void TextureCube::LoadData(uint32_t width, uint32_t height, CubeMapFace face, PixelFormat format, PixelType type, void* data) {
@@ -30,38 +110,179 @@ void TextureCube::LoadData(uint32_t width, uint32_t height, CubeMapFace face, Pi
 		(GLenum)format, (GLenum)type, data);
 }
 
-TextureCube::Sptr TextureCube::LoadFromFiles(const std::string faceFiles[6]) {
+void TextureCube::LoadMipData(CubeMapFace face, int level, PixelFormat format, PixelType type, const void* data) {
+	uint32_t size = glm::max(myDesc.Size >> level, 1u);
+	glTextureSubImage3D(myHandle, level,
+		0, 0, (int)face,
+		size, size, 1,
+		(GLenum)format, (GLenum)type, data);
+}
+
+void TextureCube::LoadCompressedData(CubeMapFace face, int level, const void* data, size_t size) {
+	LOG_ASSERT(myDesc.Format == InternalFormat::Bc1 || myDesc.Format == InternalFormat::Bc3, "Cubemap does not have a compressed format!");
+	uint32_t levelSize = glm::max(myDesc.Size >> level, 1u);
+	// With DSA, cubemaps are treated as 6 layer arrays, so we need the 3D variant to pick a face
+	glCompressedTextureSubImage3D(myHandle, level,
+		0, 0, (int)face,
+		levelSize, levelSize, 1,
+		(GLenum)myDesc.Format, (GLsizei)size, data);
+}
+
+std::vector<uint8_t> TextureCube::GetLevelData(CubeMapFace face, int level) const {
+	uint32_t size = glm::max(myDesc.Size >> level, 1u);
+	std::vector<uint8_t> result((size_t)size * size * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTextureSubImage(myHandle, level, 0, 0, (int)face, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, (GLsizei)result.size(), result.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	return result;
+}
+
+TextureCube::Sptr TextureCube::LoadFromFiles(const std::string faceFiles[6], bool compress, bool prefilter) {
+	if (compress || prefilter) {
+		CookOptions options;
+		options.AllowAlpha = false;
+		options.GenerateMips = false;
+		options.Srgb = true;
+		options.FlipY = true;
+		options.Compress = compress;
+		options.Prefilter = prefilter;
+
+		CookedImage image;
+		if (TextureCooker::CookCube(faceFiles, options, image)) {
+			TextureCubeDesc desc = TextureCubeDesc();
+			desc.Format = image.Format;
+			desc.Size = image.Width;
+			desc.MipLevels = (int)image.GetMipCount();
+			Sptr result = std::make_shared<TextureCube>(desc);
+			// Our smaller mips have rows that are not 4 byte aligned
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (int face = 0; face < 6; face++) {
+				for (int level = 0; level < desc.MipLevels; level++) {
+					const MipLevel& data = image.GetLevel(face, level);
+					if (compress)
+						result->LoadCompressedData((CubeMapFace)face, level, data.Data.data(), data.Data.size());
+					else
+						result->LoadMipData((CubeMapFace)face, level, PixelFormat::Rgba, PixelType::UByte, data.Data.data());
+				}
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			return result;
+		}
+		LOG_WARN("Failed to cook cubemap faces, falling back to an uncompressed cubemap");
+	}
+	
+	uint8_t* pixels[6] = { nullptr };
+	int widths[6] = { 0 }, heights[6] = { 0 };
+	DecodeFaces(faceFiles, 3, true, pixels, widths, heights);
+
 	TextureCubeDesc desc = TextureCubeDesc();
 	desc.Format = InternalFormat::RGB8;
-	stbi_set_flip_vertically_on_load(true);
+	desc.Size = widths[0];
 	Sptr result = nullptr;
 	
 	for (int ix = 0; ix < 6; ix++) {
-		int width, height, numChannels;
-		void* data = stbi_load(faceFiles[ix].c_str(), &width, &height, &numChannels, 3);
-		if (desc.Size != 0 && ((width != desc.Size) | (height != desc.Size))) {
-			stbi_image_free(data);
+		if (pixels[ix] == nullptr || widths[ix] == 0 || heights[ix] == 0) {
+			LOG_WARN("Failed to load image from \"{}\"", faceFiles[ix]);
+			continue;
+		}
+		if ((widths[ix] != desc.Size) | (heights[ix] != desc.Size)) {
+			stbi_image_free(pixels[ix]);
 			LOG_ASSERT(false, "Image file dimensions do not match the size of this cubemap! ({})", faceFiles[ix]);
 		}
-		if (width != height) {
-			stbi_image_free(data);
+		if (widths[ix] != heights[ix]) {
+			stbi_image_free(pixels[ix]);
 			LOG_ASSERT(false, "Image for cubemap must be square! ({})", faceFiles[ix]);
 		}
 		
-		if (ix == 0) {
-			desc.Size = width;
+		if (result == nullptr)
 			result = std::make_shared<TextureCube>(desc);
+		result->LoadData(widths[ix], heights[ix], (CubeMapFace)ix, PixelFormat::Rgb, PixelType::UByte, pixels[ix]);
+		stbi_image_free(pixels[ix]);
+	}
+	return result;
+}
+
+std::vector<MipLevel> TextureCube::PrefilterRadiance(const uint8_t* const faces[6], uint32_t size, int levels) {
+	std::vector<MipLevel> result((size_t)6 * glm::max(levels - 1, 0));
+	if (levels <= 1)
+		return result;
+
+	// Our taps are laid out in a 5x5 grid, spaced one standard deviation apart
+	const int TapRadius = 2;
+
+	// Box filtered copies of the faces for the taps to read from, only built for the sizes we need
+	std::vector<MipLevel> boxMips[6];
+	int boxLevels = (int)glm::log2(size) + 1;
+	Parallel::For(6, [&](size_t begin, size_t end) {
+		for (size_t face = begin; face < end; face++)
+			boxMips[face] = Texture2D::GenerateMipChain(faces[face], size, size, 4, boxLevels, true);
+	});
+
+	for (int level = 1; level < levels; level++) {
+		uint32_t levelSize = glm::max(size >> level, 1u);
+
+		// We treat the roughness of a level like a GGX alpha, which is roughly the angular width of it's lobe
+		float roughness = level / (float)(levels - 1);
+		float sigma = roughness * roughness;
+
+		// Pick the largest source level where a tap spacing of sigma is still at least a texel, so that our
+		// bilinear taps cover every texel in the lobe
+		float sourceTexels = glm::half_pi<float>() / sigma;
+		int sourceLevel = glm::clamp(boxLevels - 1 - (int)glm::log2((uint32_t)glm::max(sourceTexels, 1.0f)), 1, boxLevels - 1);
+		LinearCube source;
+		source.Size = glm::max(size >> sourceLevel, 1u);
+		for (int face = 0; face < 6; face++) {
+			const MipLevel& mip = boxMips[face][sourceLevel - 1];
+			source.Faces[face].resize((size_t)source.Size * source.Size);
+			for (size_t ix = 0; ix < source.Faces[face].size(); ix++) {
+				const uint8_t* texel = &mip.Data[ix * 4];
+				source.Faces[face][ix] = _mm_setr_ps(
+					Texture2D::SrgbToLinear(texel[0]), Texture2D::SrgbToLinear(texel[1]), Texture2D::SrgbToLinear(texel[2]), 1.0f);
+			}
 		}
-		if (data != nullptr && width != 0 && height != 0 && numChannels != 0) {
-			result->LoadData(width, height, (CubeMapFace)ix,
-				numChannels == 4 ? PixelFormat::Rgba : PixelFormat::Rgb,
-				PixelType::UByte, data);
-			stbi_image_free(data);
-		}
-		else {
-			LOG_WARN("Failed to load image from \"{}\"", faceFiles[ix]);
+
+		for (int face = 0; face < 6; face++) {
+			MipLevel& out = result[face * (levels - 1) + level - 1];
+			out.Width = levelSize;
+			out.Height = levelSize;
+			out.Data.resize((size_t)levelSize * levelSize * 4);
 		}
-			
+
+		Parallel::For((size_t)6 * levelSize, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++) {
+				int face = (int)(row / levelSize);
+				uint32_t y = (uint32_t)(row % levelSize);
+				uint8_t* out = &result[face * (levels - 1) + level - 1].Data[(size_t)y * levelSize * 4];
+				float t = (y + 0.5f) / levelSize * 2.0f - 1.0f;
+
+				for (uint32_t x = 0; x < levelSize; x++) {
+					float s = (x + 0.5f) / levelSize * 2.0f - 1.0f;
+					glm::vec3 dir = glm::normalize(GetFaceDirection((CubeMapFace)face, s, t));
+					glm::vec3 up = glm::abs(dir.y) < 0.999f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+					glm::vec3 tangent = glm::normalize(glm::cross(up, dir)) * sigma;
+					glm::vec3 bitangent = glm::cross(dir, tangent);
+
+					__m128 sum = _mm_setzero_ps();
+					for (int j = -TapRadius; j <= TapRadius; j++) {
+						for (int i = -TapRadius; i <= TapRadius; i++) {
+							glm::vec3 tap = dir + tangent * (float)i + bitangent * (float)j;
+							float u, v;
+							int tapFace = DirectionToFace(tap, u, v);
+							float weight = std::exp(-0.5f * (i * i + j * j));
+							sum = _mm_add_ps(sum, _mm_mul_ps(source.Sample(tapFace, u, v), _mm_set1_ps(weight)));
+						}
+					}
+
+					// The alpha channel holds the total weight
+					alignas(16) float color[4];
+					_mm_store_ps(color, sum);
+					out[x * 4 + 0] = Texture2D::LinearToSrgb(color[0] / color[3]);
+					out[x * 4 + 1] = Texture2D::LinearToSrgb(color[1] / color[3]);
+					out[x * 4 + 2] = Texture2D::LinearToSrgb(color[2] / color[3]);
+					out[x * 4 + 3] = 255;
+				}
+			}
+		}, 4);
 	}
 	return result;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <glad/glad.h>
 #include <string>
+#include <vector>
 #include <EnumToString.h>
 #include "Utils.h"
 #include "Texture2D.h"
@@ -17,6 +18,7 @@ ENUM(CubeMapFace, GLint,
 struct TextureCubeDesc {
 	uint32_t Size = 0;
 	InternalFormat Format = InternalFormat::RGBA8;
+	int MipLevels = 1;
 };
 
 class TextureCube {
@@ -27,10 +29,49 @@ public:
 	virtual ~TextureCube();
 	
 	void LoadData(uint32_t width, uint32_t height, CubeMapFace face, PixelFormat format, PixelType type, void* data);
-	static Sptr LoadFromFiles(const std::string faceFiles[6]);
+	// Uploads a single mip level of a face
+	void LoadMipData(CubeMapFace face, int level, PixelFormat format, PixelType type, const void* data);
+	// Uploads a mip level of a face with block compressed data, our format must be a compressed one
+	void LoadCompressedData(CubeMapFace face, int level, const void* data, size_t size);
+	// Reads a mip level of a face back from the GPU as RGBA8, this stalls so it should only be used while loading
+	std::vector<uint8_t> GetLevelData(CubeMapFace face, int level) const;
+	/*
+		Loads a cubemap from 6 image files, in the order of CubeMapFace. Faces are decoded in parallel
+		@param faceFiles The paths to the images for each face
+		@param compress  If true, the faces are cooked to BC1 through the TextureCooker (and cached on disk)
+		@param prefilter If true, we build a mip chain of progressively blurrier radiance for glossy reflections (see
+		                 PrefilterRadiance), this is also cached on disk through the TextureCooker
+	*/
+	static Sptr LoadFromFiles(const std::string faceFiles[6], bool compress = false, bool prefilter = false);
+
+	/*
+		Builds a mip chain for an environment map where each level is a blurrier version of the one before it,
+		so that sampling level N with textureLod approximates a reflection off a surface with a roughness of
+		N / (levels - 1). Each texel gathers a gaussian lobe around it's direction from a box filtered copy of
+		the faces that is small enough for the taps to cover it, wrapping across face edges. Rows are split
+		across our worker threads, and taps are blended as single SSE vectors in linear space
+		@param faces  The RGBA8 (gamma encoded) pixel data for level 0 of each face
+		@param size   The width and height of each face
+		@param levels The number of levels to generate, including level 0
+		@returns The RGBA8 mip chain, starting with level 1 (level 0 is the input data). Levels for the first face
+		         come first, then the second face, etc...
+	*/
+	static std::vector<MipLevel> PrefilterRadiance(const uint8_t* const faces[6], uint32_t size, int levels);
+
+	/*
+		Gets the direction through a point on a cubemap face, using the face layout from the GL spec (section 8.13)
+		@param face The face to get the direction for
+		@param s    The horizontal position on the face, in [-1, 1]
+		@param t    The vertical position on the face, in [-1, 1], with -1 being the first row of the face's data
+		@returns The (unnormalized) direction through that point
+	*/
+	static glm::vec3 GetFaceDirection(CubeMapFace face, float s, float t);
 	
 	void Bind(int slot);
 	static void Unbind(int slot);
+
+	int GetMipLevels() const { return myDesc.MipLevels; }
+	uint32_t GetSize() const { return myDesc.Size; }
 	
 protected:
 	GLuint myHandle;
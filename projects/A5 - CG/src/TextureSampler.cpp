@@ -1,6 +1,38 @@
 #include "TextureSampler.h"
 #include <GLM/gtc/type_ptr.hpp>
 
+namespace {
+	// Samplers are keyed by their description, so two settings that happen to hash the same never share a sampler
+	struct SamplerDescHash {
+		size_t operator()(const SamplerDesc& desc) const { return desc.GetHash(); }
+	};
+	AssetRegistry<SamplerDesc, TextureSampler, SamplerDescHash> samplerRegistry;
+}
+
+size_t SamplerDesc::GetHash() const {
+	size_t result = 0;
+	HashCombine(result, (GLint)WrapS);
+	HashCombine(result, (GLint)WrapT);
+	HashCombine(result, (GLint)WrapR);
+	HashCombine(result, (GLint)MinFilter);
+	HashCombine(result, (GLint)MagFilter);
+	for (int ix = 0; ix < 4; ix++)
+		HashCombine(result, BorderColor[ix]);
+	HashCombine(result, AnisotropicEnabled);
+	HashCombine(result, AnisotropicEnabled ? MaxAnisotropy : 0.0f);
+	return result;
+}
+
+bool SamplerDesc::operator ==(const SamplerDesc& other) const {
+	// The max anisotropy doesn't do anything unless it's enabled, same as in GetHash
+	return
+		WrapS == other.WrapS && WrapT == other.WrapT && WrapR == other.WrapR &&
+		MinFilter == other.MinFilter && MagFilter == other.MagFilter &&
+		BorderColor == other.BorderColor &&
+		AnisotropicEnabled == other.AnisotropicEnabled &&
+		(!AnisotropicEnabled || MaxAnisotropy == other.MaxAnisotropy);
+}
+
 TextureSampler::TextureSampler(const SamplerDesc& desc) {
 	myDesc = desc;
 	glCreateSamplers(1, &myHandle);
@@ -24,4 +56,14 @@ void TextureSampler::Bind(uint32_t slot) {
 }
 void TextureSampler::Unbind(uint32_t slot) {
 	glBindSampler(slot, 0);
-}
\ No newline at end of file
+}
+
+TextureSampler::Sptr TextureSampler::Get(const SamplerDesc& desc) {
+	return samplerRegistry.GetOrCreate(desc, [&]() {
+		return std::make_shared<TextureSampler>(desc);
+	});
+}
+
+AssetRegistryStats TextureSampler::GetCacheStats() {
+	return samplerRegistry.GetStats();
+}
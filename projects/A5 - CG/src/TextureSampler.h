@@ -1,6 +1,7 @@
 #pragma once
 #include <glad/glad.h>
 #include <EnumToString.h>
+#include <AssetRegistry.h>
 #include <GLM/glm.hpp>
 #include "Utils.h"
 
@@ -41,6 +42,12 @@ struct SamplerDesc {
 	
 	bool AnisotropicEnabled = false;
 	float MaxAnisotropy     = 1.0f;
+
+	// Gets a hash of all of our settings, for looking samplers up by their settings
+	size_t GetHash() const;
+	// Samplers with equal settings are interchangeable
+	bool operator ==(const SamplerDesc& other) const;
+	bool operator !=(const SamplerDesc& other) const { return !(*this == other); }
 };
 
 class TextureSampler {
@@ -54,6 +61,15 @@ public:
 	static void Unbind(uint32_t slot);
 	
 	const SamplerDesc& GetDescription() const { return myDesc; }
+
+	/*
+		Gets a shared sampler with the given settings, only creating a new one if there is no sampler
+		with identical settings alive already
+		@param desc The settings for the sampler
+	*/
+	static Sptr Get(const SamplerDesc& desc = SamplerDesc());
+	// Gets the hit and miss counts for our shared samplers
+	static AssetRegistryStats GetCacheStats();
 private:
 	GLuint myHandle;
 	SamplerDesc myDesc;
@@ -0,0 +1,161 @@
+#include "TiledHeightmap.h"
+#include "Logging.h"
+#include "Texture2D.h"
+#include <Parallel.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace {
+	const uint32_t TiledMagic = 0x504D4854; // "THMP"
+	// Bump this whenever the layout changes
+	const uint32_t TiledVersion = 1;
+	// Tiles (and the start of our tile data) are aligned to this, so they can be released independently
+	const size_t PageSize = 4096;
+
+	struct TiledHeader {
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t Width, Height;
+		uint32_t TileSize;
+		uint32_t Apron;
+		uint32_t TilesX, TilesY;
+	};
+
+	size_t AlignToPage(size_t size) {
+		return (size + PageSize - 1) / PageSize * PageSize;
+	}
+}
+
+const uint16_t* TiledHeightmap::GetTile(int x, int y) const {
+	LOG_ASSERT(x >= 0 && y >= 0 && x < myTileCount.x && y < myTileCount.y, "Tile is outside of the heightmap!");
+	return (const uint16_t*)(myFile->GetData() + myDataOffset + ((size_t)y * myTileCount.x + x) * myTileStride);
+}
+
+void TiledHeightmap::ReleaseTile(int x, int y) const {
+	myFile->Release(myDataOffset + ((size_t)y * myTileCount.x + x) * myTileStride, myTileStride);
+}
+
+TiledHeightmap::Sptr TiledHeightmap::Open(const std::string& fileName) {
+	MappedFile::Sptr file = MappedFile::Open(fileName);
+	if (file == nullptr || file->GetSize() < sizeof(TiledHeader)) {
+		LOG_WARN("Failed to open tiled heightmap \"{}\"", fileName);
+		return nullptr;
+	}
+
+	TiledHeader header;
+	memcpy(&header, file->GetData(), sizeof(TiledHeader));
+	if (header.Magic != TiledMagic || header.Version != TiledVersion || header.Apron != Apron || header.TileSize == 0) {
+		LOG_WARN("\"{}\" is not a tiled heightmap, or was built by an older version", fileName);
+		return nullptr;
+	}
+
+	Sptr result = std::make_shared<TiledHeightmap>();
+	result->myFile = file;
+	result->myResolution = glm::ivec2(header.Width, header.Height);
+	result->myTileCount = glm::ivec2(header.TilesX, header.TilesY);
+	result->myTileSize = header.TileSize;
+	uint32_t texels = header.TileSize + Apron * 2;
+	result->myTileStride = AlignToPage((size_t)texels * texels * sizeof(uint16_t));
+	result->myDataOffset = AlignToPage(sizeof(TiledHeader));
+	if (file->GetSize() < result->myDataOffset + (size_t)header.TilesX * header.TilesY * result->myTileStride) {
+		LOG_WARN("Tiled heightmap \"{}\" is truncated", fileName);
+		return nullptr;
+	}
+	return result;
+}
+
+bool TiledHeightmap::Build(const std::string& sourceFile, const std::string& outputFile, uint32_t tileSize) {
+	LOG_ASSERT(tileSize > 0, "Tiles need to be at least 1 texel across!");
+
+	// Raw heightmaps get mapped so that we only ever have a row of tiles in memory, anything else we have to decode
+	std::string extension = std::filesystem::path(sourceFile).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)::tolower(c); });
+	MappedFile::Sptr mapped = nullptr;
+	std::vector<uint16_t> decoded;
+	const uint16_t* source = nullptr;
+	uint32_t width = 0, height = 0;
+	if (extension == ".r16" || extension == ".raw") {
+		mapped = MappedFile::Open(sourceFile);
+		size_t texels = mapped != nullptr ? mapped->GetSize() / sizeof(uint16_t) : 0;
+		width = height = (uint32_t)std::sqrt((double)texels);
+		if (texels == 0 || (size_t)width * height != texels) {
+			LOG_WARN("Failed to map raw heightmap \"{}\", it needs to be square", sourceFile);
+			return false;
+		}
+		source = (const uint16_t*)mapped->GetData();
+	} else {
+		if (!Texture2D::DecodeR16(sourceFile, decoded, width, height)) {
+			LOG_WARN("Failed to load heightmap from \"{}\"", sourceFile);
+			return false;
+		}
+		source = decoded.data();
+	}
+
+	TiledHeader header;
+	header.Magic = TiledMagic;
+	header.Version = TiledVersion;
+	header.Width = width;
+	header.Height = height;
+	header.TileSize = tileSize;
+	header.Apron = Apron;
+	header.TilesX = (width + tileSize - 1) / tileSize;
+	header.TilesY = (height + tileSize - 1) / tileSize;
+
+	uint32_t texels = tileSize + Apron * 2;
+	size_t tileStride = AlignToPage((size_t)texels * texels * sizeof(uint16_t));
+
+	std::error_code error;
+	if (std::filesystem::path(outputFile).has_parent_path())
+		std::filesystem::create_directories(std::filesystem::path(outputFile).parent_path(), error);
+
+	// Write to a temporary file first, so that a crash part way through never leaves a broken heightmap
+	std::string tempPath = outputFile + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		std::vector<uint8_t> headerBlock(AlignToPage(sizeof(TiledHeader)), 0);
+		memcpy(headerBlock.data(), &header, sizeof(TiledHeader));
+		file.write((const char*)headerBlock.data(), headerBlock.size());
+
+		// We fill in a whole row of tiles at once, clamping to the edges of the map for the aprons
+		std::vector<uint8_t> row(tileStride * header.TilesX, 0);
+		size_t releasedBytes = 0;
+		for (uint32_t tileY = 0; tileY < header.TilesY; tileY++) {
+			Parallel::For(header.TilesX, [&](size_t begin, size_t end) {
+				for (size_t tileX = begin; tileX < end; tileX++) {
+					uint16_t* tile = (uint16_t*)&row[tileX * tileStride];
+					for (uint32_t y = 0; y < texels; y++) {
+						int sourceY = glm::clamp((int)(tileY * tileSize + y) - (int)Apron, 0, (int)height - 1);
+						const uint16_t* sourceRow = source + (size_t)sourceY * width;
+						for (uint32_t x = 0; x < texels; x++) {
+							int sourceX = glm::clamp((int)(tileX * tileSize + x) - (int)Apron, 0, (int)width - 1);
+							tile[y * texels + x] = sourceRow[sourceX];
+						}
+					}
+				}
+			});
+			file.write((const char*)row.data(), row.size());
+
+			// We won't need the rows above this row of tiles (apart from the next apron) again
+			if (mapped != nullptr) {
+				size_t doneBytes = (size_t)glm::max((int)((tileY + 1) * tileSize) - (int)Apron, 0) * width * sizeof(uint16_t);
+				mapped->Release(releasedBytes, doneBytes - releasedBytes);
+				releasedBytes = doneBytes;
+			}
+		}
+		if (!file)
+			return false;
+	}
+	std::filesystem::rename(tempPath, outputFile, error);
+	if (error)
+		return false;
+
+	LOG_INFO("Split {}x{} heightmap \"{}\" into {}x{} tiles", width, height, sourceFile, header.TilesX, header.TilesY);
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <GLM/glm.hpp>
+#include <MappedFile.h>
+#include "Utils.h"
+
+/*
+	A 16 bit heightmap split up into square tiles on disk, so that huge maps (16k x 16k and up) never have to be
+	loaded all at once. The file is memory mapped, so a tile only gets read in when it is touched, and can be
+	released again once it has been copied out (see TerrainStreamer, which pages tiles into texture array layers).
+
+	Each tile also stores an apron of texels copied from it's neighbours (clamped at the edges of the map), so a
+	tile can be filtered and have it's normals calculated without touching any other tiles. Tiles are padded out
+	to whole pages, so releasing one never drops part of another.
+
+	Heightmaps are converted into this format with Build
+*/
+class TiledHeightmap
+{
+public:
+	typedef std::shared_ptr<TiledHeightmap> Sptr;
+	NoCopy(TiledHeightmap);
+	NoMove(TiledHeightmap);
+
+	// The number of texels copied in from the neighbours on each side of a tile
+	static const uint32_t Apron = 2;
+
+	TiledHeightmap() = default;
+	virtual ~TiledHeightmap() = default;
+
+	/*
+		Gets the texels for a tile, including it's apron, so (TileSize + Apron * 2)^2 values row by row. Touching
+		these is what actually reads them in from disk
+		@param x The column of the tile
+		@param y The row of the tile
+	*/
+	const uint16_t* GetTile(int x, int y) const;
+	// Lets the OS drop a tile out of memory, call this once you are done copying it somewhere else
+	void ReleaseTile(int x, int y) const;
+
+	// Gets the size of the source heightmap, in texels
+	glm::ivec2 GetResolution() const { return myResolution; }
+	// Gets the number of tiles along each axis
+	glm::ivec2 GetTileCount() const { return myTileCount; }
+	// Gets the number of texels across each tile, not counting the apron
+	uint32_t GetTileSize() const { return myTileSize; }
+
+	/*
+		Opens a tiled heightmap that was written by Build
+		@param fileName The path to the tiled heightmap
+		@returns The heightmap, or nullptr if the file could not be mapped or is not a tiled heightmap
+	*/
+	static Sptr Open(const std::string& fileName);
+
+	/*
+		Converts a heightmap into our tiled format. Raw R16 sources are memory mapped and converted a row of tiles
+		at a time, so they can be much larger than we would want to load at once. Tiles are filled in across our
+		worker threads
+		@param sourceFile The heightmap to convert, anything that Texture2D::DecodeR16 can load
+		@param outputFile The path to write the tiled heightmap to
+		@param tileSize   The number of texels across each tile, not counting the apron
+		@returns True if the tiled heightmap was written
+	*/
+	static bool Build(const std::string& sourceFile, const std::string& outputFile, uint32_t tileSize = 256);
+
+protected:
+	MappedFile::Sptr myFile;
+	glm::ivec2       myResolution;
+	glm::ivec2       myTileCount;
+	uint32_t         myTileSize;
+	// The number of bytes from the start of one tile to the next, tiles are page aligned
+	size_t           myTileStride;
+	size_t           myDataOffset;
+};
@@ -0,0 +1,25 @@
+#include "UniformBuffer.h"
+#include "Logging.h"
+
+UniformBuffer::UniformBuffer(size_t size) {
+	mySize = size;
+	glCreateBuffers(1, &myHandle);
+	glNamedBufferStorage(myHandle, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+UniformBuffer::~UniformBuffer() {
+	glDeleteBuffers(1, &myHandle);
+}
+
+void UniformBuffer::Update(const void* data, size_t size, size_t offset) {
+	LOG_ASSERT(offset + size <= mySize, "Data is too large for this uniform buffer!");
+	glNamedBufferSubData(myHandle, offset, size, data);
+}
+
+void UniformBuffer::Bind(uint32_t slot) const {
+	glBindBufferBase(GL_UNIFORM_BUFFER, slot, myHandle);
+}
+
+void UniformBuffer::Unbind(uint32_t slot) {
+	glBindBufferBase(GL_UNIFORM_BUFFER, slot, 0);
+}
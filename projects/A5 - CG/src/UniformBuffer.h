@@ -0,0 +1,37 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include "Utils.h"
+
+/*
+	Represents a uniform buffer object in OpenGL, a block of uniform data that can be shared by every shader
+	that declares a matching uniform block, instead of setting the same uniforms on each shader
+*/
+class UniformBuffer {
+public:
+	GraphicsClass(UniformBuffer);
+
+	/*
+		Creates a new uniform buffer
+		@param size The size of the buffer, in bytes
+	*/
+	UniformBuffer(size_t size);
+	~UniformBuffer();
+
+	/*
+		Uploads new data into the buffer
+		@param data   The data to upload, should match the std140 layout of the block in the shader
+		@param size   The number of bytes to upload
+		@param offset The offset into the buffer to upload to, in bytes
+	*/
+	void Update(const void* data, size_t size, size_t offset = 0);
+	// Binds this buffer to the given uniform block binding (set with layout(binding = N) in the shader)
+	void Bind(uint32_t slot) const;
+	static void Unbind(uint32_t slot);
+
+	size_t GetSize() const { return mySize; }
+
+private:
+	GLuint myHandle;
+	size_t mySize;
+};
@@ -0,0 +1,199 @@
+#include "Vegetation.h"
+#include "Logging.h"
+#include "Culling.h"
+#include <Parallel.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+// Blades are scaled by up to this much, see grass.vs.glsl
+static const float MaxBladeScale = 1.25f;
+
+Vegetation::Vegetation(const HeightField::Sptr& heightField, const VegetationDescription& desc) {
+	LOG_ASSERT(heightField != nullptr, "Vegetation needs a height field to grow on!");
+	LOG_ASSERT(desc.ChunkSize > 0.0f && desc.MaxDistance > desc.FadeStart, "Vegetation needs a chunk size, and a max distance past the fade start!");
+	myHeightField = heightField;
+	myDescription = desc;
+	myCamera = glm::vec3(0.0f);
+	myInbox = std::make_shared<ChunkInbox>();
+
+	// Our chunks get rounded so that they evenly cover the whole terrain
+	float size = heightField->GetSize();
+	myChunksPerSide = glm::max((int)std::ceil(size / desc.ChunkSize), 1);
+	myDescription.ChunkSize = size / myChunksPerSide;
+
+	__CreateBlade();
+
+	myChunks.resize((size_t)myChunksPerSide * myChunksPerSide);
+	std::shared_ptr<ChunkInbox> inbox = myInbox;
+	for (size_t ix = 0; ix < myChunks.size(); ix++) {
+		glm::vec2 chunkMin = glm::vec2(-size / 2.0f) + glm::vec2(ix % myChunksPerSide, ix / myChunksPerSide) * myDescription.ChunkSize;
+		myChunks[ix].BoundsMin = glm::vec3(chunkMin, 0.0f);
+		myChunks[ix].BoundsMax = glm::vec3(chunkMin + myDescription.ChunkSize, 0.0f);
+
+		HeightField::Sptr field = heightField;
+		VegetationDescription chunkDesc = myDescription;
+		Parallel::Enqueue([inbox, field, chunkDesc, ix, chunkMin]() {
+			std::unique_ptr<ChunkData> chunk = __BuildChunk(field, chunkDesc, ix, chunkMin);
+			std::lock_guard<std::mutex> lock(inbox->Mutex);
+			inbox->Chunks.push_back(std::move(chunk));
+		});
+	}
+	myStats.Pending = myChunks.size();
+}
+
+Vegetation::~Vegetation() {
+	for (Chunk& chunk : myChunks)
+		if (chunk.Buffer != 0)
+			glDeleteBuffers(1, &chunk.Buffer);
+	glDeleteBuffers(2, myBuffers);
+	glDeleteVertexArrays(1, &myVao);
+}
+
+float Vegetation::GetGrassWeight(float height) {
+	return glm::min(glm::clamp((0.75f - height) * 4.0f, 0.0f, 1.0f), glm::clamp((height - 0.25f) * 4.0f, 0.0f, 1.0f));
+}
+
+void Vegetation::__CreateBlade() {
+	// A tapered strip that ends in a point, x goes across the blade and y goes up it. The shader does the rest
+	const float heights[] = { 0.0f, 0.35f, 0.65f, 0.88f };
+	const float widths[] = { 1.0f, 0.85f, 0.6f, 0.35f };
+	std::vector<glm::vec2> vertices;
+	std::vector<uint16_t> indices;
+	for (int ix = 0; ix < 4; ix++) {
+		vertices.push_back(glm::vec2(-0.5f * widths[ix], heights[ix]));
+		vertices.push_back(glm::vec2(0.5f * widths[ix], heights[ix]));
+		if (ix > 0) {
+			uint16_t base = (uint16_t)(ix * 2 - 2);
+			indices.insert(indices.end(), { base, (uint16_t)(base + 1), (uint16_t)(base + 2), (uint16_t)(base + 2), (uint16_t)(base + 1), (uint16_t)(base + 3) });
+		}
+	}
+	vertices.push_back(glm::vec2(0.0f, 1.0f));
+	indices.insert(indices.end(), { 6, 7, 8 });
+	myIndexCount = (GLsizei)indices.size();
+
+	glCreateVertexArrays(1, &myVao);
+	glCreateBuffers(2, myBuffers);
+	glNamedBufferStorage(myBuffers[0], vertices.size() * sizeof(glm::vec2), vertices.data(), 0);
+	glNamedBufferStorage(myBuffers[1], indices.size() * sizeof(uint16_t), indices.data(), 0);
+
+	// Attribute 0 is the position on the blade, from our vertex buffer
+	glVertexArrayVertexBuffer(myVao, 0, myBuffers[0], 0, sizeof(glm::vec2));
+	glEnableVertexArrayAttrib(myVao, 0);
+	glVertexArrayAttribFormat(myVao, 0, 2, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(myVao, 0, 0);
+
+	// Attribute 1 is the blade's root and random value, once per instance. Draw points this at each chunk's buffer
+	glVertexArrayBindingDivisor(myVao, 1, 1);
+	glEnableVertexArrayAttrib(myVao, 1);
+	glVertexArrayAttribFormat(myVao, 1, 4, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(myVao, 1, 1);
+
+	glVertexArrayElementBuffer(myVao, myBuffers[1]);
+}
+
+std::unique_ptr<Vegetation::ChunkData> Vegetation::__BuildChunk(const HeightField::Sptr& heightField, const VegetationDescription& desc, size_t index, const glm::vec2& chunkMin) {
+	std::unique_ptr<ChunkData> result = std::make_unique<ChunkData>();
+	result->Index = index;
+	result->HeightRange = glm::vec2(FLT_MAX, -FLT_MAX);
+
+	// Every chunk gets it's own seed, so that the same terrain always grows the same grass no matter which order
+	// our chunks finish in
+	std::mt19937 random(desc.Seed ^ (uint32_t)(index * 2654435761u));
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// Scatter candidates evenly, then keep each one with a chance of the grass weight under it
+	size_t candidates = (size_t)(desc.Density * desc.ChunkSize * desc.ChunkSize);
+	std::vector<glm::vec2> positions(candidates);
+	for (glm::vec2& position : positions)
+		position = chunkMin + glm::vec2(unit(random), unit(random)) * desc.ChunkSize;
+	std::vector<float> heights(candidates);
+	heightField->GetHeights(positions.data(), heights.data(), candidates);
+
+	float heightScale = heightField->GetHeightScale();
+	result->Instances.reserve(candidates / 2);
+	for (size_t ix = 0; ix < candidates; ix++) {
+		float height = heights[ix];
+		if (height < desc.MinHeight || unit(random) >= GetGrassWeight(height / heightScale))
+			continue;
+		result->Instances.push_back(glm::vec4(positions[ix], height, unit(random)));
+		result->HeightRange.x = glm::min(result->HeightRange.x, height);
+		result->HeightRange.y = glm::max(result->HeightRange.y, height);
+	}
+
+	// Shuffled, so that drawing only the first part of the chunk still covers all of it
+	std::shuffle(result->Instances.begin(), result->Instances.end(), random);
+	return result;
+}
+
+void Vegetation::Update() {
+	std::vector<std::unique_ptr<ChunkData>> finished;
+	{
+		std::lock_guard<std::mutex> lock(myInbox->Mutex);
+		finished.swap(myInbox->Chunks);
+	}
+
+	for (const std::unique_ptr<ChunkData>& data : finished) {
+		Chunk& chunk = myChunks[data->Index];
+		chunk.Ready = true;
+		chunk.Count = (GLsizei)data->Instances.size();
+		myStats.Chunks++;
+		myStats.Pending--;
+		if (chunk.Count == 0)
+			continue;
+
+		chunk.BoundsMin.z = data->HeightRange.x;
+		chunk.BoundsMax.z = data->HeightRange.y + myDescription.BladeHeight * MaxBladeScale;
+		glCreateBuffers(1, &chunk.Buffer);
+		glNamedBufferStorage(chunk.Buffer, data->Instances.size() * sizeof(glm::vec4), data->Instances.data(), 0);
+	}
+}
+
+void Vegetation::Select(const glm::mat4& viewProjection, const glm::vec3& cameraPos) {
+	myCamera = cameraPos;
+	myStats.Drawn = myStats.Culled = myStats.Blades = 0;
+	mySelection.clear();
+
+	float fadeRange = myDescription.MaxDistance - myDescription.FadeStart;
+	for (size_t ix = 0; ix < myChunks.size(); ix++) {
+		const Chunk& chunk = myChunks[ix];
+		if (!chunk.Ready || chunk.Count == 0)
+			continue;
+
+		// Our density is picked from the nearest point in the chunk, so it's never less than any blade inside needs
+		float distance = glm::length(cameraPos - glm::clamp(cameraPos, chunk.BoundsMin, chunk.BoundsMax));
+		if (distance >= myDescription.MaxDistance || !BoxInFrustum(chunk.BoundsMin, chunk.BoundsMax, viewProjection)) {
+			myStats.Culled++;
+			continue;
+		}
+		float density = glm::clamp((myDescription.MaxDistance - distance) / fadeRange, 0.0f, 1.0f);
+		GLsizei count = glm::min((GLsizei)std::ceil(chunk.Count * density), chunk.Count);
+		mySelection.push_back({ ix, count });
+		myStats.Drawn++;
+		myStats.Blades += count;
+	}
+}
+
+void Vegetation::Draw(const Shader::Sptr& shader) {
+	if (mySelection.empty())
+		return;
+
+	shader->SetUniform("a_VegetationCamera", myCamera);
+	shader->SetUniform("a_BladeWidth", myDescription.BladeWidth);
+	shader->SetUniform("a_BladeHeight", myDescription.BladeHeight);
+	shader->SetUniform("a_FadeStart", myDescription.FadeStart);
+	shader->SetUniform("a_FadeEnd", myDescription.MaxDistance);
+
+	// Our blades are a single sheet, so both sides need to be drawn
+	glDisable(GL_CULL_FACE);
+	glBindVertexArray(myVao);
+	for (const DrawItem& item : mySelection) {
+		const Chunk& chunk = myChunks[item.Chunk];
+		glVertexArrayVertexBuffer(myVao, 1, chunk.Buffer, 0, sizeof(glm::vec4));
+		shader->SetUniform("a_ChunkBlades", (float)chunk.Count);
+		glDrawElementsInstanced(GL_TRIANGLES, myIndexCount, GL_UNSIGNED_SHORT, nullptr, item.Count);
+	}
+	glBindVertexArray(0);
+	glEnable(GL_CULL_FACE);
+}
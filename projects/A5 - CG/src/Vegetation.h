@@ -0,0 +1,132 @@
+#pragma once
+#include <glad/glad.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <GLM/glm.hpp>
+#include "Utils.h"
+#include "Shader.h"
+#include "Material.h"
+#include "HeightField.h"
+
+struct VegetationDescription {
+	// The width of each chunk, in local units. Chunks are what we cull and draw, so this trades draw calls for culling
+	float    ChunkSize = 2.5f;
+	// The number of blades per square unit, where the terrain is fully grass
+	float    Density = 6000.0f;
+	// The size of a blade, each one is scaled by a random amount around this
+	float    BladeWidth = 0.015f;
+	float    BladeHeight = 0.1f;
+	// The distance that blades start thinning out at, and the distance that the last of them are gone by
+	float    FadeStart = 4.0f;
+	float    MaxDistance = 12.0f;
+	// Nothing grows below this height (in local units), so that we can keep grass out of the water
+	float    MinHeight = 0.0f;
+	uint32_t Seed = 1337;
+};
+
+// The per-frame numbers for our vegetation, from the last call to Select
+struct VegetationStats {
+	size_t Chunks = 0;  // The number of chunks that have finished generating
+	size_t Pending = 0; // The number of chunks that are still generating
+	size_t Drawn = 0;   // The number of chunks that will be drawn
+	size_t Culled = 0;  // The number of chunks that were skipped for being out of range or outside of the frustum
+	size_t Blades = 0;  // The number of blades that will be drawn
+};
+
+/*
+	Scatters grass blades across a height field, wherever the terrain's splat weights would show grass (the same
+	height thresholds as in Terrain.vs.glsl). The terrain is split up into chunks, each with it's own instance
+	buffer, that are filled on the worker threads and uploaded as they finish.
+
+	Each chunk's blades are shuffled, so the first N of them are always spread evenly over the whole chunk. That
+	lets us thin out chunks by distance by just drawing less of them, grass.vs.glsl then shrinks away the blades
+	that are close to being dropped, so they don't pop. Every chunk is a single instanced draw of the same blade.
+
+	Instances are in the height field's local space, so the vegetation should share a transform with it's terrain
+*/
+class Vegetation
+{
+public:
+	GraphicsClass(Vegetation);
+
+	/*
+		Starts scattering vegetation across a height field, chunks become visible as they finish
+		@param heightField The heights to grow on, which also gives us our size
+		@param desc        The density and size settings for our blades
+	*/
+	Vegetation(const HeightField::Sptr& heightField, const VegetationDescription& desc = VegetationDescription());
+	virtual ~Vegetation();
+
+	// Uploads any chunks that have finished generating since our last update, should be called once per frame
+	void Update();
+	/*
+		Picks the chunks to draw for a camera, and how many blades to draw from each, should be called once per view before Draw
+		@param viewProjection The view projection matrix multiplied with the vegetation's world transform
+		@param cameraPos      The position of the camera, in our local space
+	*/
+	void Select(const glm::mat4& viewProjection, const glm::vec3& cameraPos);
+	/*
+		Draws the chunks from the last call to Select. The shader should already be bound, with our material
+		applied and it's transform uniforms set
+		@param shader The shader to draw with, should use grass.vs.glsl
+	*/
+	void Draw(const Shader::Sptr& shader);
+
+	const VegetationDescription& GetDescription() const { return myDescription; }
+	const VegetationStats& GetStats() const { return myStats; }
+
+	// Gets how much grass grows at a normalized terrain height, matches the grass weight in Terrain.vs.glsl
+	static float GetGrassWeight(float height);
+
+protected:
+	// The blades for a single chunk, built on a worker thread. Each is the blade's root in xyz, and a random value in w
+	struct ChunkData {
+		size_t Index;
+		std::vector<glm::vec4> Instances;
+		glm::vec2 HeightRange;
+	};
+	// Finished chunks get handed back to us through here. The workers hold on to it with a shared pointer, so
+	// that it outlives us if we get destroyed while chunks are still generating
+	struct ChunkInbox {
+		std::mutex Mutex;
+		std::vector<std::unique_ptr<ChunkData>> Chunks;
+	};
+	struct Chunk {
+		glm::vec3 BoundsMin, BoundsMax;
+		GLuint    Buffer = 0;
+		GLsizei   Count = 0;
+		bool      Ready = false;
+	};
+	// A chunk that we will draw, and how many of it's blades
+	struct DrawItem {
+		size_t  Chunk;
+		GLsizei Count;
+	};
+
+	VegetationDescription myDescription;
+	VegetationStats       myStats;
+
+	HeightField::Sptr myHeightField;
+	int myChunksPerSide;
+	std::vector<Chunk> myChunks;
+	std::shared_ptr<ChunkInbox> myInbox;
+
+	std::vector<DrawItem> mySelection;
+	glm::vec3 myCamera;
+
+	GLuint myVao;
+	// 0 is blade vertices, 1 is indices
+	GLuint myBuffers[2];
+	GLsizei myIndexCount;
+
+	void __CreateBlade();
+	// Scatters the blades for a single chunk, runs on a worker thread
+	static std::unique_ptr<ChunkData> __BuildChunk(const HeightField::Sptr& heightField, const VegetationDescription& desc, size_t index, const glm::vec2& chunkMin);
+};
+
+// Attach to an entity (along with a Transform) to render vegetation
+struct VegetationRenderer {
+	Material::Sptr   Material;
+	Vegetation::Sptr Vegetation;
+};